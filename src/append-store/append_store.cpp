@@ -6,6 +6,7 @@
 #include "append_store.h"
 #include "../include/exception.h"
 #include "append_store_scanner.h"
+#include "../common/metrics.h"
 
 LoggerPtr PanguAppendStore::logger_ = Logger::getLogger("BigArchive.AppendStore");
 
@@ -14,7 +15,11 @@ PanguAppendStore::PanguAppendStore(const StoreParameter& para, bool iscreate)
       mAppend(para.mAppend), 
       mMaxChunkId(0), 
       mAppendChunkId(0),
-      mCompressionType(para.mCompressionFlag)
+      mCompressionType(para.mCompressionFlag),
+      mTailing(false),
+      mAppendChunks(para.mNumStripes == 0 ? 1 : para.mNumStripes),
+      mAppendStripe(0),
+      mStripeAppends(0)
 {
     if (mRoot.compare(mRoot.size()-1, 1, "/"))
     {
@@ -61,6 +66,11 @@ std::string PanguAppendStore::Append(const std::string& data)
 
     h.mChunkId = p_chunk->GetID();
 
+    static MetricCounter* appends = Metrics::Counter("bigarchive_appendstore_appends_total", "Records appended to append stores");
+    static MetricCounter* append_bytes = Metrics::Counter("bigarchive_appendstore_append_bytes_total", "Bytes appended to append stores");
+    appends->Inc();
+    append_bytes->Inc(data.size());
+
     //LOG4CXX_INFO(logger_, "Store::Append " << mRoot << "mChunkId : " << p_chunk->GetID() << ", mIndex : " << h.mIndex << ", size : " << data.size());
     return h.ToString();
 }
@@ -96,10 +106,20 @@ void PanguAppendStore::GarbageCollection(bool force)
 
 void PanguAppendStore::Flush()
 {
-    if (mCurrentAppendChunk.get() != 0)
+    for (size_t i = 0; i < mAppendChunks.size(); i++)
+    {
+        if (mAppendChunks[i].get() != 0)
+        {
+            TurnOnWrite(mAppendChunks[i].get());
+            mAppendChunks[i]->Flush();
+        }
+    }
+    UpdateManifest();
+    // removals are buffered in the delete logs
+    ChunkMapType::iterator it;
+    for (it = mDeleteChunkMap.begin(); it != mDeleteChunkMap.end(); ++it)
     {
-        TurnOnWrite(mCurrentAppendChunk.get());
-        mCurrentAppendChunk->Flush();
+        it->second->Flush();
     }
 }
 
@@ -114,8 +134,15 @@ bool PanguAppendStore::Read(const std::string& h, std::string* data)
         return bOK;
     }
 
+    static MetricCounter* reads = Metrics::Counter("bigarchive_appendstore_reads_total", "Records read from append stores");
+    static MetricCounter* cache_hits = Metrics::Counter("bigarchive_appendstore_cache_hits_total", "Append store reads served by the chunk cache");
+    static MetricCounter* read_bytes = Metrics::Counter("bigarchive_appendstore_read_bytes_total", "Bytes read from append stores");
+    reads->Inc();
+
     if (mCache->Find(handle, data))
     {
+        cache_hits->Inc();
+        read_bytes->Inc(data->size());
         LOG4CXX_DEBUG(logger_, "Cache Hit in Store for Handle : " << handle.mChunkId << "," << handle.mIndex);
         return true;
     }
@@ -129,6 +156,8 @@ bool PanguAppendStore::Read(const std::string& h, std::string* data)
     
     TurnOnRead(p_chunk);
     bOK = p_chunk->Read(handle.mIndex, data);
+    if (bOK)
+        read_bytes->Inc(data->size());
 
     LOG4CXX_DEBUG(logger_, "Store::Read : " << mRoot << " & mChunkId : " << handle.mChunkId << " & mIndex : " <<  handle.mIndex);
     return bOK;
@@ -141,6 +170,8 @@ void PanguAppendStore::Remove(const std::string& h)
     {
         return;
     }
+    static MetricCounter* removes = Metrics::Counter("bigarchive_appendstore_removes_total", "Records removed from append stores");
+    removes->Inc();
     Chunk* p_chunk = LoadDeleteChunk(handle.mChunkId);
     if (p_chunk == 0)
     {
@@ -150,14 +181,45 @@ void PanguAppendStore::Remove(const std::string& h)
     LOG4CXX_DEBUG(logger_, "Store::Removed : " << mRoot << " & mChunkId : " << handle.mChunkId << " & mIndex : " <<  handle.mIndex);
 }
 
+void PanguAppendStore::BatchRemove(const std::vector<std::string>& handlevec)
+{
+    // group the indices by chunk, each chunk logs its group with one write
+    std::map<ChunkIDType, std::vector<IndexType> > chunk_indices;
+    for (size_t i = 0; i < handlevec.size(); i++)
+    {
+        Handle handle(handlevec[i]);
+        if (handle.isValid())
+        {
+            chunk_indices[handle.mChunkId].push_back(handle.mIndex);
+        }
+    }
+
+    static MetricCounter* removes = Metrics::Counter("bigarchive_appendstore_removes_total", "Records removed from append stores");
+    std::map<ChunkIDType, std::vector<IndexType> >::const_iterator it;
+    for (it = chunk_indices.begin(); it != chunk_indices.end(); ++it)
+    {
+        Chunk* p_chunk = LoadDeleteChunk(it->first);
+        if (p_chunk == 0)
+        {
+            continue;
+        }
+        p_chunk->BatchRemove(it->second);
+        removes->Inc(it->second.size());
+        LOG4CXX_DEBUG(logger_, "Store::BatchRemoved : " << mRoot << " & mChunkId : " << it->first << " & count : " << it->second.size());
+    }
+}
+
 void PanguAppendStore::Close() {
 	if(mAppend) {
-		Chunk* p_chunk = mCurrentAppendChunk.get();//LoadAppendChunk(); 
-		if(p_chunk != 0) {
-            LOG4CXX_DEBUG(logger_, "Close write chunk: " << p_chunk->GetID());
-            TurnOnWrite(p_chunk);
-			p_chunk->Close();
+		for (size_t i = 0; i < mAppendChunks.size(); i++) {
+			Chunk* p_chunk = mAppendChunks[i].get();
+			if(p_chunk != 0) {
+                LOG4CXX_DEBUG(logger_, "Close write chunk: " << p_chunk->GetID());
+                TurnOnWrite(p_chunk);
+				p_chunk->Close();
+			}
 		}
+		UpdateManifest();
  	}
 	
 	std::map<ChunkIDType, ChunkPtr>::iterator chunk_iter;
@@ -175,10 +237,52 @@ void PanguAppendStore::Close() {
 
 void PanguAppendStore::Reload()
 {
-    mChunkMap.clear();
     mCache->Clear();
-    mMaxChunkId = Chunk::GetMaxChunkID(mRoot);
     mCurrentRandomChunk.reset();
+    if (!mManifest.Load(mRoot) || mManifest.empty())
+    {
+        mChunkMap.clear();
+        mMaxChunkId = Chunk::GetMaxChunkID(mRoot);
+        return;
+    }
+
+    // keep the loaded chunks and read only the tails of their indexes
+    mMaxChunkId = mManifest.GetMaxChunkID();
+    ChunkMapType::iterator it = mChunkMap.begin();
+    while (it != mChunkMap.end())
+    {
+        const ChunkManifestEntry* entry = mManifest.Find(it->first);
+        if (entry == NULL)
+        {
+            mChunkMap.erase(it++);
+            continue;
+        }
+        it->second->ExtendIndex(*entry);
+        ++it;
+    }
+}
+
+uint64_t PanguAppendStore::Tail()
+{
+    mTailing = true;
+    // chunks started since are found in the manifest, or by listing without one
+    if (mManifest.Load(mRoot) && !mManifest.empty())
+    {
+        mMaxChunkId = std::max(mMaxChunkId, mManifest.GetMaxChunkID());
+    }
+    else
+    {
+        mMaxChunkId = std::max(mMaxChunkId, Chunk::GetMaxChunkID(mRoot));
+    }
+
+    uint64_t added = 0;
+    ChunkMapType::iterator it;
+    for (it = mChunkMap.begin(); it != mChunkMap.end(); ++it)
+    {
+        added += it->second->TailIndex();
+    }
+    LOG4CXX_DEBUG(logger_, "Store::Tail " << mRoot << " : " << added << " new records, max chunk id " << mMaxChunkId);
+    return added;
 }
 
 void PanguAppendStore::Init(bool iscreate)
@@ -228,13 +332,25 @@ void PanguAppendStore::Init(bool iscreate)
     {
         THROW_EXCEPTION(AppendStoreNotExistException, "store not exist (3 dirs)" + mRoot);
     }
-    mMaxChunkId = Chunk::GetMaxChunkID(mRoot);
+    if (mManifest.Load(mRoot) && !mManifest.empty())
+    {
+        mMaxChunkId = mManifest.GetMaxChunkID();
+    }
+    else
+    {
+        mMaxChunkId = Chunk::GetMaxChunkID(mRoot);
+    }
 
     if (mAppend)
     {
         LOG4CXX_DEBUG(logger_, "mMaxChunkSize : " << mMeta.maxChunkSize << " & mBlockIndexInterval : " << mMeta.blockIndexInterval);
         // Currently, append at the last chunk // set mMaxChunkId: chunks are in [0, mMaxChunkId] inclusive
         mAppendChunkId = mMaxChunkId;
+        // each stripe goes on with one of the chunks the manifest has room in
+        if (!mManifest.empty())
+        {
+            mManifest.GetOpenChunkIDs(mMeta.maxChunkSize, mAppendChunks.size(), &mResumeChunkIds);
+        }
         mCodec.reset(CompressionCodec::getCodec(compressAlgo.c_str(), 1024, true));
     }
     else 
@@ -322,41 +438,88 @@ void PanguAppendStore::AllocNextChunk()
     mAppendChunkId = mMaxChunkId;
 }
 
-Chunk* PanguAppendStore::LoadAppendChunk()
+void PanguAppendStore::UpdateManifest()
 {
-    if (mCurrentAppendChunk.get() != 0)
+    bool changed = false;
+    for (size_t i = 0; i < mAppendChunks.size(); i++)
     {
-        if (mCurrentAppendChunk->IsChunkFull() == false)
+        if (mAppendChunks[i].get() != 0)
         {
-            //LOG4CXX_DEBUG(logger_, "Loaded Current chunk");
-            return mCurrentAppendChunk.get();
+            // the other stripes may hold index records that are not written yet
+            mAppendChunks[i]->FlushIndexLog();
+            ChunkManifestEntry entry;
+            mAppendChunks[i]->GetManifestEntry(&entry);
+            changed = mManifest.Update(entry) || changed;
         }
-        else
+    }
+    if (changed)
+    {
+        mManifest.Save(mRoot);
+    }
+}
+
+Chunk* PanguAppendStore::LoadAppendChunk()
+{
+    // move to the next stripe once a whole block went to the current one,
+    // the records of a block stay in one chunk and are read back together
+    if (mAppendChunks.size() > 1 && mStripeAppends >= mMeta.blockIndexInterval)
+    {
+        mAppendStripe = (mAppendStripe + 1) % mAppendChunks.size();
+        mStripeAppends = 0;
+    }
+    mStripeAppends++;
+
+    ChunkPtr& current = mAppendChunks[mAppendStripe];
+    if (current.get() != 0 && current->IsChunkFull() == false)
+    {
+        //LOG4CXX_DEBUG(logger_, "Loaded Current chunk");
+        return current.get();
+    }
+
+    // the last chunk of a reopened store may be full already, hence the loop
+    while (current.get() == 0 || current->IsChunkFull())
+    {
+        if (current.get() != 0)
         {
             /* Close previous chunk and allocate new chunk */
-            Chunk* p_chunk = mCurrentAppendChunk.get();
+            Chunk* p_chunk = current.get();
             TurnOnWrite(p_chunk);
             p_chunk->Close();
+            ChunkManifestEntry entry;
+            p_chunk->GetManifestEntry(&entry);
+            mManifest.Update(entry);
 	        LOG4CXX_DEBUG(logger_, "Allocating next chunk, because current chunk is Full");	
             AllocNextChunk();
         }
-    }
-    try
-    {
-        mCurrentAppendChunk.reset(new Chunk(mRoot, mAppendChunkId, mMeta.maxChunkSize, true, mCodec, mCache, mMeta.blockIndexInterval));
-    }
-    catch (...)
-    {
-        LOG4CXX_ERROR(logger_, "[AppendStore] chunk is disabled for append, chunk id : " << mAppendChunkId);
-        throw;
-    }
+        else if (mAppendStripe < mResumeChunkIds.size())
+        {
+            // a reopened store goes on with its non-full chunks first
+            mAppendChunkId = mResumeChunkIds[mAppendStripe];
+        }
+        else if (mAppendStripe > 0)
+        {
+            // stripe 0 goes on with the last chunk, the others start new ones
+            AllocNextChunk();
+        }
+        try
+        {
+            current.reset(new Chunk(mRoot, mAppendChunkId, mMeta.maxChunkSize, true, mCodec, mCache, mMeta.blockIndexInterval));
+        }
+        catch (...)
+        {
+            LOG4CXX_ERROR(logger_, "[AppendStore] chunk is disabled for append, chunk id : " << mAppendChunkId);
+            throw;
+        }
 
-    if (0 == mCurrentAppendChunk.get())
-    {
-        THROW_EXCEPTION(AppendStoreWriteException, "Cannot get valid chunk for append");
+        if (0 == current.get())
+        {
+            THROW_EXCEPTION(AppendStoreWriteException, "Cannot get valid chunk for append");
+        }
+        // a new chunk goes into the manifest before readers can be handed its id
+        UpdateManifest();
     }
     LOG4CXX_TRACE(logger_, "Store::LoadedAppendChunk" ); 
-    return mCurrentAppendChunk.get();
+    return current.get();
 }
 
 Chunk* PanguAppendStore::LoadRandomChunk(ChunkIDType id) 
@@ -381,8 +544,14 @@ Chunk* PanguAppendStore::LoadRandomChunk(ChunkIDType id)
     }
 
     // still not found, have to open the chunk for read
-    mCurrentRandomChunk.reset(new Chunk(mRoot, id, mMeta.maxChunkSize, false, mCodec, mCache));
+    mCurrentRandomChunk.reset(new Chunk(mRoot, id, mMeta.maxChunkSize, false, mCodec, mCache,
+                                        mMeta.blockIndexInterval, mManifest.Find(id)));
     assert(mCurrentRandomChunk.get());
+    // the manifest lags behind the index files of the chunks being written
+    if (mTailing)
+    {
+        mCurrentRandomChunk->TailIndex();
+    }
     mChunkMap.insert(std::make_pair(id, mCurrentRandomChunk));
     LOG4CXX_TRACE(logger_, "Store::LoadedRandomChunk" );
     return mCurrentRandomChunk.get();
@@ -477,13 +646,16 @@ void PanguAppendStore::TurnOnRead(Chunk *reader)
     LOG4CXX_DEBUG(logger_, "reader rw: " << reader->CheckReadPermission() 
                   << " " << reader->CheckWritePermission());
 
-    if (mCurrentAppendChunk.get() != 0) {
-        LOG4CXX_DEBUG(logger_, "writer rw: " << mCurrentAppendChunk.get()->CheckReadPermission() 
-                  << " " << mCurrentAppendChunk.get()->CheckWritePermission());
-        if (reader->GetID() == mCurrentAppendChunk.get()->GetID()
-            && mCurrentAppendChunk.get()->CheckWritePermission()) {
-            LOG4CXX_DEBUG(logger_, "now turn off writer, chunk ID is " << mCurrentAppendChunk.get()->GetID());
-            mCurrentAppendChunk.get()->DisableWrite();
+    for (size_t i = 0; i < mAppendChunks.size(); i++) {
+        Chunk* writer = mAppendChunks[i].get();
+        if (writer == 0)
+            continue;
+        LOG4CXX_DEBUG(logger_, "writer rw: " << writer->CheckReadPermission() 
+                  << " " << writer->CheckWritePermission());
+        if (reader->GetID() == writer->GetID()
+            && writer->CheckWritePermission()) {
+            LOG4CXX_DEBUG(logger_, "now turn off writer, chunk ID is " << writer->GetID());
+            writer->DisableWrite();
         }
     }
 
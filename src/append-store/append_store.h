@@ -6,6 +6,7 @@
 #include "../include/exception.h"
 #include "append_store_types.h"
 #include "append_store_chunk.h"
+#include "append_store_manifest.h"
 #include "CompressionCodec.h"
 
 class PanguAppendStore : public Store
@@ -17,8 +18,10 @@ public:
     virtual void BatchAppend(const std::vector<std::string>& datavec, std::vector<std::string>& handlevec);
     virtual bool Read(const std::string& h, std::string* data);
     virtual void Remove(const std::string& h);
+    virtual void BatchRemove(const std::vector<std::string>& handlevec);
     virtual void Flush();
     void Reload(); 
+    virtual uint64_t Tail();
     virtual void GarbageCollection(bool force);  
     virtual Scanner* GetScanner();
     friend class PanguScanner;
@@ -29,6 +32,8 @@ private:
     bool ReadMetaInfo();
     void WriteMetaInfo(const std::string& root, const StoreMetaData&);
     void AllocNextChunk();
+    // record the state of the append chunks in the manifest, rewrite it if that changed anything
+    void UpdateManifest();
     Chunk* LoadAppendChunk();
     bool ValidChunkID(ChunkIDType id) const; 
     void CreateDirs(const std::string& root);
@@ -50,13 +55,18 @@ private:
     std::string   mRoot;
     bool          mAppend;
     ChunkIDType   mMaxChunkId;
-    ChunkIDType   mAppendChunkId;
+    ChunkIDType   mAppendChunkId;   // last chunk allocated for append
     uint32_t      mCompressionType;
     StoreMetaData mMeta;
+    StoreManifest mManifest;
+    bool          mTailing;         // Tail() was called, chunks are loaded up to the end of their index
     CachePtr            mCache;
     CompressionCodecPtr mCodec;
     FileSystemHelper*   mFileSystemHelper;
-    mutable std::auto_ptr<Chunk> mCurrentAppendChunk;  
+    std::vector<ChunkPtr>        mAppendChunks;     // one open append chunk per stripe
+    uint32_t                     mAppendStripe;     // stripe taking the current block
+    uint32_t                     mStripeAppends;    // records appended to it in this block
+    std::vector<ChunkIDType>     mResumeChunkIds;   // non-full chunks the stripes go on with after a reopen
     mutable ChunkPtr             mCurrentRandomChunk;  
     mutable ChunkPtr             mCurrentDeleteChunk;  
     ChunkMapType mChunkMap;          // for read map of chunk index 
@@ -9,7 +9,7 @@ const char* Defaults::LOG_DIR = "log/";
 
 Chunk::Chunk(const std::string& root, ChunkIDType chunk_id, 
              uint64_t max_chunk_sz, bool append_flag, CompressionCodecWeakPtr weakptr, 
-             CacheWeakPtr cacheptr, uint32_t index_interval)
+             CacheWeakPtr cacheptr, uint32_t index_interval, const ChunkManifestEntry* entry)
     : mRoot(root), 
       mChunkId(chunk_id), 
       mIndexFileName(GetIdxFname(root, chunk_id)), 
@@ -20,9 +20,13 @@ Chunk::Chunk(const std::string& root, ChunkIDType chunk_id,
       mMaxChunkSize(max_chunk_sz), 
       mFlushCount(0), 
       mDirty(append_flag), 
+      mSealed(false), 
       mChunkCodec(weakptr),
       mCachePtr(cacheptr),
-      mBlockIndexInterval(index_interval)
+      mBlockIndexInterval(index_interval),
+      mIndexLength(0),
+      mIndexChecksum(IndexVector::EMPTY_CHECKSUM),
+      mPendingChecksum(IndexVector::EMPTY_CHECKSUM)
 {
     mFileSystemHelper = FileSystemHelper::GetInstance(); 
 
@@ -30,9 +34,15 @@ Chunk::Chunk(const std::string& root, ChunkIDType chunk_id,
     mDataOutputFH = NULL;
     mIndexOutputFH = NULL;
     mDeleteLogFH = NULL;
+    mIndexWriter = NULL;
+    mDeleteWriter = NULL;
 
-    CheckIfNew();
-    LoadIndex();
+    // chunks in the manifest are known to exist
+    if (entry == NULL)
+    {
+        CheckIfNew();
+    }
+    LoadIndex(entry);
     LoadData(append_flag);
 }
 
@@ -40,19 +50,30 @@ Chunk::Chunk(const std::string& root, ChunkIDType chunk_id)
     : mRoot(root), 
       mChunkId(chunk_id), 
       mLogFileName(GetIdxLogFname(root, chunk_id)), 
-      mDirty(false)
+      mFlushCount(0), 
+      mDirty(false),
+      mSealed(false)
 {
     mFileSystemHelper = FileSystemHelper::GetInstance();
+
+    mDataInputFH = NULL;
+    mDataOutputFH = NULL;
+    mIndexOutputFH = NULL;
+    mDeleteLogFH = NULL;
+    mIndexWriter = NULL;
+    mDeleteWriter = NULL;
+
     LoadDeleteLog();
 }
 
 void Chunk::LoadDeleteLog()
 {
-    mDeleteLogFH = FileSystemHelper::GetInstance()->CreateFileHelper(mLogFileName, O_WRONLY | O_APPEND);
+    mDeleteLogFH = FileSystemHelper::GetInstance()->CreateFileHelper(mLogFileName, O_WRONLY | O_APPEND, ACCESS_APPEND);
     if(mFileSystemHelper->IsFileExists(mLogFileName) == false) {
         mDeleteLogFH->Create();
     }
     mDeleteLogFH->Open();
+    mDeleteWriter = new FramedRecordWriter(mDeleteLogFH);
     LOG4CXX_DEBUG(logger_, "Chunk::LoadDeleteLog() Completed");
 }
 
@@ -105,7 +126,10 @@ void Chunk::Flush()
         {
             AppendIndex();
         }
+        CommitIndex();
+        FlushIndexLog();
     }
+    FlushDeleteLog();
 }
 
 IndexType Chunk::Append(const std::string& data)
@@ -145,6 +169,15 @@ void Chunk::AppendIndex()
     {
         return;
     }
+    if (mSealed)
+    {
+        // a failed write-behind already lost the blocks before this one
+        LOG4CXX_ERROR(logger_, "drop " << mFlushCount << " records appended to sealed chunk " << mChunkId);
+        mFlushCount = 0;
+        mBlockStream.str("");
+        mBlockStream.clear();
+        return;
+    }
 
     OffsetType written = AppendRaw(mMaxIndex, mFlushCount, mBlockStream.str());
     mLastData = written;
@@ -153,32 +186,74 @@ void Chunk::AppendIndex()
     mBlockStream.str("");
     mBlockStream.clear();         //clear stringstream 
 
-    IndexRecord r;
-    r.mOffset = mLastData;
-    r.mIndex = mMaxIndex;
+    // the index record must not reach the disk before its data block does,
+    // keep it until the block is written so several blocks can be in flight
+    mPendingIndex.push_back(IndexRecord(mLastData, mMaxIndex));
+    if (mPendingIndex.size() >= DF_MAX_WRITE_BEHIND)
+    {
+        CommitIndex();
+    }
+}
 
-    char *buffer = new char[r.Size()];
+void Chunk::CommitIndex()
+{
+    if (mPendingIndex.empty())
+    {
+        return;
+    }
 
-    r.toBuffer(buffer);
+    try
+    {
+        mDataOutputFH->WaitForWrites();
+    }
+    catch(ExceptionBase& e)
+    {
+        LOG4CXX_ERROR(logger_, "DataOutputStream write behind fail : " << e.ToString());
+        mPendingIndex.clear();
+        mSealed = true;
+        throw;
+    }
 
+    bool due = false;
+    char buffer[sizeof(OffsetType) + sizeof(IndexType)];
+    for (size_t i = 0; i < mPendingIndex.size(); i++)
+    {
+        mPendingIndex[i].toBuffer(buffer);
+        due = mIndexWriter->Append(buffer, mPendingIndex[i].Size());
+        mPendingChecksum = IndexVector::Checksum(mPendingChecksum, buffer, mPendingIndex[i].Size());
+    }
+    mPendingIndex.clear();
+    if (due)
+    {
+        FlushIndexLog();
+    }
+}
+
+void Chunk::FlushIndexLog()
+{
+    if (mIndexWriter == NULL || mIndexWriter->GetPendingBytes() == 0)
+    {
+        return;
+    }
 
     int32_t retryCount = 0;
     do
     {
         try
         {
-            int fos = mIndexOutputFH->Write(buffer, r.Size());
+            size_t bytes = mIndexWriter->GetPendingBytes();
             LOG4CXX_DEBUG(logger_, "write to index: " << mIndexFileName
-                          << ", record index " << r.mIndex 
-                          << ", offset " << r.mOffset
-                          << ", record size is " << r.Size() 
-                          << ", index write position change to " << fos);
+                          << ", " << bytes << " bytes of records");
+            mIndexWriter->Flush();
+            // length and checksum move together so the manifest never pairs them wrongly
+            mIndexLength += bytes;
+            mIndexChecksum = mPendingChecksum;
             break;
         }
         catch(ExceptionBase& e)
         {
             // on error, close the index file and retry
-            LOG4CXX_ERROR(logger_, "IndexOutputStream corrupt << e.ToString()");
+            LOG4CXX_ERROR(logger_, "IndexOutputStream corrupt " << e.ToString());
             try
             {
                 mIndexOutputFH->Close();
@@ -187,14 +262,16 @@ void Chunk::AppendIndex()
             {
                 LOG4CXX_ERROR(logger_, "Failed close file after write fail " << e.ToString());
             }
+            mFileSystemHelper->DestroyFileHelper(mIndexOutputFH);
 
             if (++retryCount <= 1)
             {
                 usleep(3000000);
             }
 
-            mIndexOutputFH = mFileSystemHelper->CreateFileHelper(mIndexFileName, O_WRONLY | O_APPEND); 
+            mIndexOutputFH = mFileSystemHelper->CreateFileHelper(mIndexFileName, O_WRONLY | O_APPEND, ACCESS_APPEND); 
             mIndexOutputFH->Open();
+            mIndexWriter->SetFileHelper(mIndexOutputFH);
 
             if (retryCount > 1)
             {
@@ -203,7 +280,7 @@ void Chunk::AppendIndex()
             }
         }
     } while (retryCount <= 1);
-};
+}
 
 
 bool Chunk::Read(IndexType index, std::string* data) 
@@ -275,8 +352,33 @@ bool Chunk::ExtractDataFromBlock(const std::string& buf, IndexType index, std::s
 
 bool Chunk::Remove(const IndexType& index)
 {
+    // a single delete is logged before returning, only BatchRemove groups
+    // records since the writer's age limit is checked on the next Append
     DeleteRecord d(index);
     std::string tmp = d.ToString(); 
+    mDeleteWriter->Append(&tmp[0], tmp.size());
+    FlushDeleteLog();
+    return true;
+}
+
+bool Chunk::BatchRemove(const std::vector<IndexType>& indices)
+{
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        DeleteRecord d(indices[i]);
+        std::string tmp = d.ToString(); 
+        mDeleteWriter->Append(&tmp[0], tmp.size());
+    }
+    FlushDeleteLog();
+    return true;
+}
+
+void Chunk::FlushDeleteLog()
+{
+    if (mDeleteWriter == NULL)
+    {
+        return;
+    }
 
     // may retry once 
     int32_t retryCount = 0;
@@ -284,11 +386,9 @@ bool Chunk::Remove(const IndexType& index)
     {
         try
         {
-            mDeleteLogFH->Flush(&tmp[0], tmp.size());
+            mDeleteWriter->Flush(true);
             break;
         }
-        // CHKIT - this exceptions is not throwed from our write method !!! 
-        // this will be never called	
         catch(ExceptionBase& e)
         {
             LOG4CXX_ERROR(logger_, "DeleteLogStream corrupt " << e.ToString());
@@ -300,14 +400,16 @@ bool Chunk::Remove(const IndexType& index)
             {
                 LOG4CXX_ERROR(logger_, "Failed close file after write fail " << e.ToString());
             }
-            mDeleteLogFH->Seek(0);
+            mFileSystemHelper->DestroyFileHelper(mDeleteLogFH);
 
             if (++retryCount <= 1)
             {
                 usleep(3000000);
             }
 
-            mDeleteLogFH = mFileSystemHelper->CreateFileHelper(mLogFileName, O_WRONLY | O_APPEND); // WRITE);
+            mDeleteLogFH = mFileSystemHelper->CreateFileHelper(mLogFileName, O_WRONLY | O_APPEND, ACCESS_APPEND); // WRITE);
+            mDeleteLogFH->Open();
+            mDeleteWriter->SetFileHelper(mDeleteLogFH);
 
             if (retryCount > 1)
             {
@@ -316,19 +418,104 @@ bool Chunk::Remove(const IndexType& index)
             }
         }
     } while (retryCount <= 1);
+}
 
+bool Chunk::LoadIndex(const ChunkManifestEntry* entry)
+{
+    if (entry != NULL)
+    {
+        mIndexMap.reset(new IndexVector());
+        mIndexMap->Extend(mIndexFileName, entry->mIndexLength);
+        if (mIndexMap->GetLength() != entry->mIndexLength || mIndexMap->GetChecksum() != entry->mIndexChecksum)
+        {
+            LOG4CXX_WARN(logger_, "index file " << mIndexFileName << " doesn't match the manifest, "
+                         << mIndexMap->GetLength() << " of " << entry->mIndexLength << " bytes read, load the whole file");
+            entry = NULL;
+        }
+    }
+    if (entry == NULL)
+    {
+        mIndexMap.reset(new IndexVector(mIndexFileName));
+    }
+    SyncWithIndex();
     return true;
 }
 
-bool Chunk::LoadIndex()
+void Chunk::SyncWithIndex()
 {
-    mIndexMap.reset(new IndexVector(mIndexFileName));
+    mIndexLength = mIndexMap->GetLength();
+    mIndexChecksum = mIndexMap->GetChecksum();
+    mPendingChecksum = mIndexChecksum;
     uint32_t size = mIndexMap->size();
     if (size > 0)
     {
         mMaxIndex = mIndexMap->at(size-1).mIndex;
+        mLastData = mIndexMap->at(size-1).mOffset;
     }
-    return true;
+}
+
+void Chunk::ExtendIndex(const ChunkManifestEntry& entry)
+{
+    if (entry.mIndexLength <= mIndexMap->GetLength())
+    {
+        return;
+    }
+    mIndexMap->Extend(mIndexFileName, entry.mIndexLength);
+    if (mIndexMap->GetLength() != entry.mIndexLength || mIndexMap->GetChecksum() != entry.mIndexChecksum)
+    {
+        LOG4CXX_WARN(logger_, "index file " << mIndexFileName << " doesn't match the manifest, load the whole file");
+        LoadIndex();
+    }
+    else
+    {
+        SyncWithIndex();
+    }
+    // the data file grew as well, reopen it so the reader sees its new size
+    if (mDataInputFH != NULL)
+    {
+        DisableRead();
+        EnableRead();
+    }
+}
+
+IndexType Chunk::TailIndex()
+{
+    // a full chunk gets no more appends
+    if (IsChunkFull())
+    {
+        return 0;
+    }
+    long size = mFileSystemHelper->GetSize(mIndexFileName);
+    if (size <= 0 || (uint64_t)size <= mIndexMap->GetLength())
+    {
+        return 0;
+    }
+
+    // the writer commits an index record only after its data block is written,
+    // so every record read here points at readable data
+    IndexType old_max = mMaxIndex;
+    mIndexMap->Extend(mIndexFileName, size);
+    SyncWithIndex();
+    if (mMaxIndex == old_max)
+    {
+        return 0;
+    }
+    if (mDataInputFH != NULL)
+    {
+        DisableRead();
+        EnableRead();
+    }
+    LOG4CXX_DEBUG(logger_, "tail of index " << mIndexFileName << " : " << mMaxIndex - old_max << " new records");
+    return mMaxIndex - old_max;
+}
+
+void Chunk::GetManifestEntry(ChunkManifestEntry* entry) const
+{
+    entry->mChunkId = mChunkId;
+    entry->mDataSize = GetDataSize();
+    entry->mMaxIndex = mMaxIndex;
+    entry->mIndexLength = mIndexLength;
+    entry->mIndexChecksum = mIndexChecksum;
 }
 
 bool Chunk::LoadData(bool wrflag)
@@ -386,10 +573,14 @@ uint16_t Chunk::GetMaxChunkID(const std::string& root)
     return chunk_id;
 }
 
+uint64_t Chunk::GetDataSize() const
+{
+    return (mLastData& 0xFFFFFFFF)+((mLastData >> 32) & 0xFFFFFFFF)*64*1024*1024;
+}
+
 bool Chunk::IsChunkFull() const
 {
-    uint64_t size = (mLastData& 0xFFFFFFFF)+((mLastData >> 32) & 0xFFFFFFFF)*64*1024*1024;
-    return ((size >= mMaxChunkSize)||(mMaxIndex==(IndexType)-1));
+    return ((GetDataSize() >= mMaxChunkSize)||(mMaxIndex==(IndexType)-1)||mSealed);
 }
 
 inline IndexType Chunk::GenerateIndex()
@@ -471,6 +662,8 @@ bool Chunk::Close()
         // mDataOutputFH->Seek(0); // .reset();
     }
 
+    delete mIndexWriter;
+    mIndexWriter = NULL;
     if (mIndexOutputFH != NULL)
     {
         try
@@ -486,6 +679,8 @@ bool Chunk::Close()
         // mIndexOutputFH->Seek(0); //reset();
     }
 
+    delete mDeleteWriter;
+    mDeleteWriter = NULL;
     if (mDeleteLogFH != NULL)
     {
         try
@@ -512,14 +707,17 @@ bool Chunk::ReadRaw(const OffsetType& offset, std::string& data)
 {
     try
     {
-        mDataInputFH->Seek(offset);//Karim: goes to the given offset in the chunk data file
-        uint32_t read_len = mDataInputFH->GetNextLogSize();//Karim: get the data length from the dataInputFH=>put it in read_len
-        //Karim: Also remember that GetNextLogSize reads the whole header so the file offset now is at the beginning of the real data (chunk date)
+        // each block is framed by its length, read both by position so the
+        // data file can be shared by concurrent readers
+        uint32_t read_len = 0;
+        if (mDataInputFH->PRead(offset, (char*)&read_len, sizeof(read_len)) != sizeof(read_len))
+        {
+            THROW_EXCEPTION(AppendStoreReadException, "DataInputStream file read error, no block header");
+        }
         std::string blkdata;
         blkdata.resize(read_len, 0);
         uint32_t size = read_len;
-        // CHKIT
-        mDataInputFH->Read(&blkdata[0], read_len);
+        read_len = mDataInputFH->PRead(offset + sizeof(read_len), &blkdata[0], size);
 
         if (read_len != size)
         {
@@ -628,7 +826,7 @@ OffsetType Chunk::AppendRaw(const IndexType& index, const uint32_t numentry, con
             // CHKIT
             OffsetType fos = 0;            
             // std::cout << "\nactual data " << data.size() << ", data wrote : " << ssref.size();	
-            fos = mDataOutputFH->Write((char*)&ssref[0], ssref.size());	
+            fos = mDataOutputFH->WriteAsync((char*)&ssref[0], ssref.size());	
             //LOG4CXX_DEBUG(logger_, "flush -- data wrote ------- " << ssref);
             LOG4CXX_DEBUG(logger_, "flush -- data size wrote -- " << ssref.size());
             LOG4CXX_DEBUG(logger_, "flush return value is ----- " << fos);
@@ -642,6 +840,16 @@ OffsetType Chunk::AppendRaw(const IndexType& index, const uint32_t numentry, con
         {
 
             LOG4CXX_ERROR(logger_, "DataOutputStream FlushLog fail : " << e.ToString());
+            if (!mPendingIndex.empty())
+            {
+                // the error may belong to any queued block, rewriting this one
+                // alone would leave index records for data that was never written
+                LOG4CXX_ERROR(logger_, "write behind fail, drop " << mPendingIndex.size()
+                              << " blocks and seal chunk " << mChunkId);
+                mPendingIndex.clear();
+                mSealed = true;
+                throw;
+            }
             try
             {
                 mDataOutputFH->Close();
@@ -657,7 +865,7 @@ OffsetType Chunk::AppendRaw(const IndexType& index, const uint32_t numentry, con
                 usleep(3000000);
             }
 
-            mDataOutputFH = mFileSystemHelper->CreateFileHelper(mDataFileName, O_WRONLY | O_APPEND); //WRONLY
+            mDataOutputFH = mFileSystemHelper->CreateFileHelper(mDataFileName, O_WRONLY | O_APPEND, ACCESS_APPEND); //WRONLY
             mDataOutputFH->Open();
 
             if (retryCount > 1)
@@ -684,35 +892,56 @@ bool Chunk::CheckWritePermission()
 
 void Chunk::EnableWrite()
 {
+    uint64_t size;
     try
     {
-        mLastData = mFileSystemHelper->GetSize(mDataFileName);
+        size = mFileSystemHelper->GetSize(mDataFileName);
     }
     catch(ExceptionBase& e)
     {
         LOG4CXX_ERROR(logger_, "error on get data file size" << e.ToString());
         throw;
     }
+    // blocks whose index records never made it, from a writer that stopped
+    // before Flush/Close; a block appended after them would be read from the
+    // end of the last indexed block, so the chunk takes no more appends
+    if (size > GetDataSize())
+    {
+        LOG4CXX_WARN(logger_, "data file " << mDataFileName << " has " << size - GetDataSize()
+                     << " bytes past the last indexed block, seal the chunk");
+        mSealed = true;
+    }
+    else
+    {
+        mLastData = size;
+    }
     if (mDataOutputFH == NULL) {
-        mDataOutputFH = mFileSystemHelper->CreateFileHelper(mDataFileName, O_WRONLY | O_APPEND); // O_WRONLY);// WRITE);
+        mDataOutputFH = mFileSystemHelper->CreateFileHelper(mDataFileName, O_WRONLY | O_APPEND, ACCESS_APPEND); // O_WRONLY);// WRITE);
         mDataOutputFH->Open();
     }
     if (mIndexOutputFH == NULL) {
-        mIndexOutputFH = mFileSystemHelper->CreateFileHelper(mIndexFileName, O_WRONLY | O_APPEND); // O_WRONLY); //WRITE);
+        mIndexOutputFH = mFileSystemHelper->CreateFileHelper(mIndexFileName, O_WRONLY | O_APPEND, ACCESS_APPEND); // O_WRONLY); //WRITE);
         mIndexOutputFH->Open();
+        mIndexWriter = new FramedRecordWriter(mIndexOutputFH);
     }
 }
 
 void Chunk::EnableRead()
 {
     if (mDataInputFH == NULL) {
-        mDataInputFH = mFileSystemHelper->CreateFileHelper(mDataFileName, O_RDONLY); // READ);
+        mDataInputFH = mFileSystemHelper->CreateFileHelper(mDataFileName, O_RDONLY, ACCESS_RANDOM); // READ);
         mDataInputFH->Open();
     }
 }
 
 void Chunk::DisableWrite()
 {
+    if (mDataOutputFH != NULL && mIndexOutputFH != NULL) {
+        CommitIndex();
+        FlushIndexLog();
+    }
+    delete mIndexWriter;
+    mIndexWriter = NULL;
     if (mDataOutputFH != NULL) {
         mDataOutputFH->Close();
         FileSystemHelper::GetInstance()->DestroyFileHelper(mDataOutputFH);
@@ -8,7 +8,9 @@
 #include "../include/file_helper.h"
 #include "append_store_types.h"
 #include "append_store_index.h"
+#include "append_store_manifest.h"
 #include "CompressionCodec.h"
+#include "../fs/framed_record_writer.h"
 #include <stdio.h>
 #include <log4cxx/logger.h>
 
@@ -26,9 +28,11 @@ struct Defaults
 class Chunk
 {
 public:
+    // a reader given the manifest entry of the chunk loads the index only up to its length
     Chunk(const std::string& root, ChunkIDType chunk_id, 
           uint64_t max_chunk_sz, bool append, CompressionCodecWeakPtr weakptr,  
-          CacheWeakPtr cacheptr, uint32_t index_interval=DF_MAX_PENDING);
+          CacheWeakPtr cacheptr, uint32_t index_interval=DF_MAX_PENDING,
+          const ChunkManifestEntry* entry=NULL);
 
     Chunk(const std::string& root, ChunkIDType chunk_id);
 
@@ -40,6 +44,9 @@ public:
     bool Read(IndexType idx, std::string* data);
     
     bool Remove(const IndexType& idx);
+
+    // log the removal of all indices with one write to the delete log
+    bool BatchRemove(const std::vector<IndexType>& indices);
     
     ChunkIDType GetID() { return mChunkId; }
     
@@ -53,6 +60,21 @@ public:
 
     bool IsChunkFull() const;
 
+    uint64_t GetDataSize() const;
+
+    // write the buffered index records, reopen the index file and retry once on error
+    void FlushIndexLog();
+
+    // state of the chunk for the manifest, covers the index records written by FlushIndexLog
+    void GetManifestEntry(ChunkManifestEntry* entry) const;
+
+    // read the index records added since the chunk was loaded, up to the manifest entry
+    void ExtendIndex(const ChunkManifestEntry& entry);
+
+    // read the index records added since the chunk was loaded, up to the end of
+    // the index file, for readers following a writer; return the number of new records
+    IndexType TailIndex();
+
     friend class AppendStoreScanner;
     
     bool Close();
@@ -80,17 +102,25 @@ private:
     uint64_t   mMaxChunkSize;	///< max chunk size (soft limit)
     uint32_t   mFlushCount;
     bool       mDirty;
+    bool       mSealed;	///< data file has blocks without index records, take no more appends
     CompressionCodecWeakPtr mChunkCodec;
     CacheWeakPtr            mCachePtr;
     uint32_t   mBlockIndexInterval;
+    uint64_t   mIndexLength;	///< bytes written to the index file
+    uint32_t   mIndexChecksum;	///< checksum of the index records written
+    uint32_t   mPendingChecksum;	///< mIndexChecksum with the buffered index records
 
     FileSystemHelper* mFileSystemHelper;
     FileHelper* mDataInputFH;
     FileHelper* mDataOutputFH;
     FileHelper* mIndexOutputFH;
     FileHelper* mDeleteLogFH;
+    FramedRecordWriter* mIndexWriter;
+    FramedRecordWriter* mDeleteWriter;
     // CHKIT
     std::stringstream mBlockStream;
+    // index records of data blocks still being written
+    std::vector<IndexRecord> mPendingIndex;
 
     static const uint32_t OFF_MASK = 0x7fffffff;
 
@@ -106,10 +136,21 @@ private:
 
     void AppendIndex();
 
+    // wait for the queued data blocks, then write their index records
+    void CommitIndex();
+
+
+    // write and sync the buffered delete records, reopen the log and retry once on error
+    void FlushDeleteLog();
+
     void LoadDeleteLog();
 
-    // load the index into index map, find out the biggest index ID
-    bool LoadIndex();
+    // load the index into index map, find out the biggest index ID,
+    // only up to the manifest entry if there is one and it matches the file
+    bool LoadIndex(const ChunkManifestEntry* entry = NULL);
+
+    // take the index length, checksum, max index and end of data from the index map
+    void SyncWithIndex();
     
     // for write(append) mode, open data and index with write permission
     // for read mode, open the data file with read permission, index should have been loaded
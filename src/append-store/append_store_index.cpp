@@ -2,13 +2,26 @@
 #include "../include/exception.h"
 #include "../include/file_system_helper.h"
 #include "../include/file_helper.h"
+#include "../fs/framed_record_reader.h"
+#include "lzo/lzoconf.h"
 
 LoggerPtr IndexVector::logger_ = Logger::getLogger("BigArchive.AppendStore.Index");
 
+IndexVector::IndexVector()
+    : mLength(0), mChecksum(EMPTY_CHECKSUM)
+{
+}
+
 IndexVector::IndexVector(const std::string& fname)
+    : mLength(0), mChecksum(EMPTY_CHECKSUM)
 {
 	LoadFromFile(fname);
 }
+
+uint32_t IndexVector::Checksum(uint32_t checksum, const char* record, uint32_t size)
+{
+    return lzo_adler32(checksum, (const lzo_bytep)record, size);
+}
  
 IndexRecord IndexVector::at(uint32_t idx) const
 {
@@ -22,7 +35,7 @@ void IndexRecord::toBuffer(char *buffer) {
 	memcpy((buffer + (s_offset)), &mIndex, s_index);
 }
 
-void IndexRecord::fromBuffer(char *buffer) {
+void IndexRecord::fromBuffer(const char *buffer) {
 	uint32_t s_offset = sizeof(OffsetType);
 	uint32_t s_index = sizeof(IndexType);
 	memcpy(&mOffset, buffer, s_offset);
@@ -81,28 +94,36 @@ void IndexVector::LoadFromFile(const std::string& fname)
     	return;
     }
     LOG4CXX_DEBUG(logger_, "reading index file: " << fname << ", size is : " << file_size);
+    Extend(fname, file_size);
+}
 
-    FileHelper *qfsFH = FileSystemHelper::GetInstance()->CreateFileHelper(fname, O_RDONLY); 
+void IndexVector::Extend(const std::string& fname, uint64_t length)
+{
+    if (length <= mLength)
+    {
+        return;
+    }
+
+    FileHelper *qfsFH = FileSystemHelper::GetInstance()->CreateFileHelper(fname, O_RDONLY, ACCESS_SEQUENTIAL); 
     try
     {
-        do
+        qfsFH->Open();
+        if (mLength > 0)
         {
-            uint32_t indexSize = qfsFH->GetNextLogSize();
-			LOG4CXX_DEBUG(logger_, "Index size from getNextLogSize : " << indexSize);
-            if (indexSize != 0)
-            {
-                char *buffer = new char[indexSize]; // indexSize should be equal to IndexRecord Size !!!
-                qfsFH->Read(buffer, indexSize);
-                IndexRecord r;
-                r.fromBuffer(buffer);
-                mValues.push_back(r);
-            }
-            else 
-            {
-                break;
-            }
-
-        } while(true);
+            qfsFH->Seek(mLength);
+        }
+        FramedRecordReader reader(qfsFH, length - mLength);
+        const char* buffer;
+        uint32_t indexSize;
+        while (reader.Next(&buffer, &indexSize))
+        {
+            // indexSize should be equal to IndexRecord Size !!!
+            IndexRecord r;
+            r.fromBuffer(buffer);
+            mValues.push_back(r);
+            mChecksum = Checksum(mChecksum, buffer, indexSize);
+        }
+        mLength += reader.GetConsumed();
         qfsFH->Close();
         FileSystemHelper::GetInstance()->DestroyFileHelper(qfsFH);
     }
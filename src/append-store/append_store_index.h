@@ -51,7 +51,7 @@ public:
         return sizeof(mOffset)+sizeof(mIndex);
     }
 
-    void fromBuffer(char *buffer);
+    void fromBuffer(const char *buffer);
     void toBuffer(char  *buffer); 
 
 public:
@@ -65,6 +65,9 @@ public:
     typedef std::vector<IndexRecord>::const_iterator const_index_iterator;
 
 public:
+    // an empty index, filled by Extend()
+    IndexVector();
+
     // initialize from a chunk index file
     IndexVector(const std::string& file);
 
@@ -85,8 +88,26 @@ public:
 
     void LoadFromFile(const std::string& fname);
 
+    // read the records between GetLength() and length of the index file,
+    // a truncated record at the end is left for the next call
+    void Extend(const std::string& fname, uint64_t length);
+
+    // bytes of the index file loaded so far
+    uint64_t GetLength() const { return mLength; }
+
+    // checksum of the records loaded so far
+    uint32_t GetChecksum() const { return mChecksum; }
+
+    // add a serialized index record to a running checksum
+    static uint32_t Checksum(uint32_t checksum, const char* record, uint32_t size);
+
+    // checksum of an empty index
+    static const uint32_t EMPTY_CHECKSUM = 1;
+
 private:
     std::vector<IndexRecord> mValues;         // in memory index data
+    uint64_t mLength;
+    uint32_t mChecksum;
     static LoggerPtr logger_;
 
 private:
@@ -0,0 +1,173 @@
+#include "append_store_manifest.h"
+#include "../include/exception.h"
+#include "../include/file_system_helper.h"
+#include "../include/file_helper.h"
+#include "../fs/framed_record_reader.h"
+#include "lzo/lzoconf.h"
+
+LoggerPtr StoreManifest::logger_ = Logger::getLogger("BigArchive.AppendStore.Manifest");
+
+// the manifest is one framed record: version, number of entries,
+// the entries of ENTRY_SIZE bytes each, adler32 of all before it
+static const uint32_t ENTRY_SIZE = sizeof(ChunkIDType) + sizeof(uint64_t) + sizeof(IndexType)
+                                   + sizeof(uint64_t) + sizeof(uint32_t);
+
+template <typename T>
+static void Put(std::string& buf, const T& value)
+{
+    buf.append((const char*)&value, sizeof(value));
+}
+
+template <typename T>
+static const char* Get(const char* p, T& value)
+{
+    memcpy(&value, p, sizeof(value));
+    return p + sizeof(value);
+}
+
+bool ChunkManifestEntry::operator==(const ChunkManifestEntry& other) const
+{
+    return mChunkId == other.mChunkId && mDataSize == other.mDataSize && mMaxIndex == other.mMaxIndex
+        && mIndexLength == other.mIndexLength && mIndexChecksum == other.mIndexChecksum;
+}
+
+bool StoreManifest::Load(const std::string& root)
+{
+    std::string fname = root + ManifestFileName;
+    FileSystemHelper* fsh = FileSystemHelper::GetInstance();
+    std::string buf;
+    FileHelper* fh = NULL;
+    try
+    {
+        if (!fsh->IsFileExists(fname))
+        {
+            return false;
+        }
+        fh = fsh->CreateFileHelper(fname, O_RDONLY, ACCESS_SEQUENTIAL);
+        fh->Open();
+        FramedRecordReader reader(fh, (uint64_t)-1, 64 * 1024);
+        bool ok = reader.Next(&buf);
+        fh->Close();
+        fsh->DestroyFileHelper(fh);
+        if (!ok)
+        {
+            LOG4CXX_WARN(logger_, "manifest " << fname << " is empty or truncated");
+            return false;
+        }
+    }
+    catch (ExceptionBase& e)
+    {
+        LOG4CXX_WARN(logger_, "cannot read manifest " << fname << " : " << e.ToString());
+        if (fh != NULL)
+        {
+            fsh->DestroyFileHelper(fh);
+        }
+        return false;
+    }
+
+    uint32_t version, count, checksum;
+    if (buf.size() < 3 * sizeof(uint32_t))
+    {
+        LOG4CXX_WARN(logger_, "manifest " << fname << " is too short");
+        return false;
+    }
+    const char* p = Get(buf.data(), version);
+    p = Get(p, count);
+    if (version != MANIFEST_VERSION || buf.size() != 3 * sizeof(uint32_t) + (uint64_t)count * ENTRY_SIZE)
+    {
+        LOG4CXX_WARN(logger_, "manifest " << fname << " has version " << version << " and " << count << " entries in "
+                     << buf.size() << " bytes");
+        return false;
+    }
+    Get(buf.data() + buf.size() - sizeof(checksum), checksum);
+    if (checksum != lzo_adler32(1, (const lzo_bytep)buf.data(), buf.size() - sizeof(checksum)))
+    {
+        LOG4CXX_WARN(logger_, "manifest " << fname << " is corrupted");
+        return false;
+    }
+
+    mEntries.clear();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        ChunkManifestEntry entry;
+        p = Get(p, entry.mChunkId);
+        p = Get(p, entry.mDataSize);
+        p = Get(p, entry.mMaxIndex);
+        p = Get(p, entry.mIndexLength);
+        p = Get(p, entry.mIndexChecksum);
+        mEntries[entry.mChunkId] = entry;
+    }
+    LOG4CXX_DEBUG(logger_, "loaded manifest " << fname << " with " << count << " chunks");
+    return true;
+}
+
+void StoreManifest::Save(const std::string& root) const
+{
+    std::string buf;
+    Put(buf, MANIFEST_VERSION);
+    Put(buf, (uint32_t)mEntries.size());
+    EntryMapType::const_iterator it;
+    for (it = mEntries.begin(); it != mEntries.end(); ++it)
+    {
+        Put(buf, it->second.mChunkId);
+        Put(buf, it->second.mDataSize);
+        Put(buf, it->second.mMaxIndex);
+        Put(buf, it->second.mIndexLength);
+        Put(buf, it->second.mIndexChecksum);
+    }
+    Put(buf, (uint32_t)lzo_adler32(1, (const lzo_bytep)buf.data(), buf.size()));
+
+    // the file is rewritten in place, a torn write fails the checksum
+    // and readers fall back to listing the store
+    std::string fname = root + ManifestFileName;
+    FileSystemHelper* fsh = FileSystemHelper::GetInstance();
+    FileHelper* fh = fsh->CreateFileHelper(fname, O_WRONLY);
+    try
+    {
+        fh->Create();
+        fh->Flush(&buf[0], buf.size());
+        fh->Close();
+        fsh->DestroyFileHelper(fh);
+    }
+    catch (ExceptionBase& e)
+    {
+        fsh->DestroyFileHelper(fh);
+        THROW_EXCEPTION(AppendStoreWriteException, "Cannot write manifest " + fname + " " + e.ToString());
+    }
+    LOG4CXX_DEBUG(logger_, "saved manifest " << fname << " with " << mEntries.size() << " chunks");
+}
+
+const ChunkManifestEntry* StoreManifest::Find(ChunkIDType id) const
+{
+    EntryMapType::const_iterator it = mEntries.find(id);
+    return it == mEntries.end() ? NULL : &it->second;
+}
+
+bool StoreManifest::Update(const ChunkManifestEntry& entry)
+{
+    EntryMapType::iterator it = mEntries.find(entry.mChunkId);
+    if (it != mEntries.end() && it->second == entry)
+    {
+        return false;
+    }
+    mEntries[entry.mChunkId] = entry;
+    return true;
+}
+
+ChunkIDType StoreManifest::GetMaxChunkID() const
+{
+    return mEntries.empty() ? 0 : mEntries.rbegin()->first;
+}
+
+void StoreManifest::GetOpenChunkIDs(uint64_t maxChunkSize, size_t count, std::vector<ChunkIDType>* ids) const
+{
+    ids->clear();
+    EntryMapType::const_reverse_iterator it;
+    for (it = mEntries.rbegin(); it != mEntries.rend() && ids->size() < count; ++it)
+    {
+        if (it->second.mDataSize < maxChunkSize && it->second.mMaxIndex != (IndexType)-1)
+        {
+            ids->push_back(it->first);
+        }
+    }
+}
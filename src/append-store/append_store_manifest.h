@@ -0,0 +1,61 @@
+/*
+ * manifest of an append store: the state of every chunk as of the last Flush,
+ * so a store is opened with one small read instead of a directory listing,
+ * and chunk indexes are read lazily, only up to what the manifest vouches for
+ */
+#ifndef _APPENDSTORE_MANIFEST_H_
+#define _APPENDSTORE_MANIFEST_H_
+
+#include <string>
+#include <map>
+#include <vector>
+#include "append_store_types.h"
+#include <log4cxx/logger.h>
+
+using namespace log4cxx;
+
+const uint32_t MANIFEST_VERSION = 1;
+
+struct ChunkManifestEntry
+{
+    ChunkManifestEntry()
+        : mChunkId(0), mDataSize(0), mMaxIndex(0), mIndexLength(0), mIndexChecksum(0) {};
+
+    bool operator==(const ChunkManifestEntry& other) const;
+
+    ChunkIDType mChunkId;
+    uint64_t    mDataSize;       // bytes in the data file
+    IndexType   mMaxIndex;       // records appended to the chunk
+    uint64_t    mIndexLength;    // durable length of the index file
+    uint32_t    mIndexChecksum;  // IndexVector checksum of the records within mIndexLength
+};
+
+class StoreManifest
+{
+public:
+    // false if there is no manifest or it is damaged, the store is then listed instead
+    bool Load(const std::string& root);
+
+    // rewrite the manifest, throw exception on error
+    void Save(const std::string& root) const;
+
+    // NULL if the chunk is not in the manifest
+    const ChunkManifestEntry* Find(ChunkIDType id) const;
+
+    // true if the entry was added or changed
+    bool Update(const ChunkManifestEntry& entry);
+
+    ChunkIDType GetMaxChunkID() const;
+
+    // the highest count chunk ids with less than maxChunkSize bytes of data, highest first
+    void GetOpenChunkIDs(uint64_t maxChunkSize, size_t count, std::vector<ChunkIDType>* ids) const;
+
+    bool empty() const { return mEntries.empty(); }
+
+private:
+    typedef std::map<ChunkIDType, ChunkManifestEntry> EntryMapType;
+    EntryMapType mEntries;
+    static LoggerPtr logger_;
+};
+
+#endif
@@ -30,18 +30,33 @@ void AppendStoreScanner::InitScanner()
     
     mScannerCodec.reset(CompressionCodec::getCodec(compressAlgo.c_str(), 1024, false));
 
+    mScannerFH = NULL;
+    mRecordReader = NULL;
     if (!mChunkList.empty())
     {
-        mChunkId = mChunkList.front();
+        ChunkIDType chunk_id = mChunkList.front();
         mChunkList.pop_front();
-        std::string fileName = Chunk::GetDatFname(mRoot, mChunkId);
-        std::string logFileName = Chunk::GetLogFname(mRoot, mChunkId);
-        mScannerFH = mFileSystemHelper->CreateFileHelper(fileName, O_RDONLY); 
-        mScannerFH->Open();
-        ReadDeleteLog(logFileName);
+        OpenChunk(chunk_id);
     }
 }
 
+void AppendStoreScanner::OpenChunk(ChunkIDType chunk_id)
+{
+    if (mScannerFH)
+    {
+        delete mRecordReader;
+        mRecordReader = NULL;
+        mScannerFH->Close();
+        mFileSystemHelper->DestroyFileHelper(mScannerFH);
+    }
+    mChunkId = chunk_id;
+    std::string fileName = Chunk::GetDatFname(mRoot, mChunkId);
+    mScannerFH = mFileSystemHelper->CreateFileHelper(fileName, O_RDONLY, ACCESS_SEQUENTIAL); 
+    mScannerFH->Open();
+    mRecordReader = new FramedRecordReader(mScannerFH, mFileSystemHelper->GetSize(fileName));
+    ReadDeleteLog(Chunk::GetLogFname(mRoot, mChunkId));
+}
+
 void AppendStoreScanner::ReadDeleteLog(const std::string& fname)
 {
     mDeleteSet.clear();
@@ -59,28 +74,17 @@ void AppendStoreScanner::ReadDeleteLog(const std::string& fname)
     
     if (fexist) 
     {
-        FileHelper* deleteLogFH = mFileSystemHelper->CreateFileHelper(fname, O_RDONLY); 
+        FileHelper* deleteLogFH = mFileSystemHelper->CreateFileHelper(fname, O_RDONLY, ACCESS_SEQUENTIAL); 
         deleteLogFH->Open();
         try
         {
-            do
+            FramedRecordReader reader(deleteLogFH, mFileSystemHelper->GetSize(fname));
+            std::string buf;
+            while (reader.Next(&buf))
             {
-                uint32_t bufSize = deleteLogFH->GetNextLogSize();
-                if (bufSize!=0)
-                {
-                    std::string buf="";
-                    buf.resize(bufSize, '\0');
-                    deleteLogFH->Read(&buf[0], bufSize);
-                    DeleteRecord r(buf);
-                    mDeleteSet.insert(r.mIndex);
-                }
-                else
-                {
-                    break;
-                }
+                DeleteRecord r(buf);
+                mDeleteSet.insert(r.mIndex);
             }
-            // CHKIT
-            while (1);
             deleteLogFH->Close();
         }
         catch (ExceptionBase & e)
@@ -94,6 +98,7 @@ void AppendStoreScanner::ReadDeleteLog(const std::string& fname)
 
 AppendStoreScanner::~AppendStoreScanner()
 {
+    delete mRecordReader;
     if (mScannerFH)
     {
         try
@@ -156,25 +161,9 @@ bool AppendStoreScanner::Next(std::string* handle, std::string* item)
                     LOG4CXX_ERROR(logger_, "Error geting next : Bad data stream");
                 }
                     
-                // CHKIT
-                uint32_t bufSize = mScannerFH->GetNextLogSize();
-                if (bufSize > 0)
+                std::string buf;
+                if (mRecordReader != NULL && mRecordReader->Next(&buf))
                 {
-                    std::string buf;
-                    buf.resize(bufSize);
-
-                    // CHKIT - read is verified in file helpers !! 
-
-                    mScannerFH->Read(&buf[0], bufSize);
-
-                    /*
-                      if (rsize != bufSize)
-                      {
-                      LOG4CXX_ERROR(logger_, "Error file read error in Scanner");
-                      THROW_EXCEPTION(AppendStoreReadException, "file read error in Scanner");
-                      }
-                    */
-
                     std::stringstream ss(buf);
                     CompressedDataRecord crd;
                     crd.Deserialize(ss);
@@ -202,15 +191,9 @@ bool AppendStoreScanner::Next(std::string* handle, std::string* item)
                 }
                 else 
                 {
-                    mChunkId = mChunkList.front();
-                    std::string fileName = Chunk::GetDatFname(mRoot, mChunkList.front());
+                    ChunkIDType chunk_id = mChunkList.front();
                     mChunkList.pop_front();
-                    mScannerFH->Close();
-                    mFileSystemHelper->DestroyFileHelper(mScannerFH);
-                    mScannerFH = mFileSystemHelper->CreateFileHelper(fileName, O_RDONLY); 
-                    mScannerFH->Open();
-                    std::string logFileName = Chunk::GetLogFname(mRoot, mChunkList.front());
-                    ReadDeleteLog(logFileName);
+                    OpenChunk(chunk_id);
                     continue;
                 }
             }
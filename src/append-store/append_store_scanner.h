@@ -7,6 +7,7 @@
 #include "append_store_types.h"
 #include "../include/exception.h"
 #include "append_store_chunk.h"
+#include "../fs/framed_record_reader.h"
 #include <log4cxx/logger.h>
 
 using namespace std;
@@ -23,6 +24,8 @@ public:
 private:
     void InitScanner();
     void ReadDeleteLog(const std::string& fname);
+    // close the current data file and open the one of chunk_id
+    void OpenChunk(ChunkIDType chunk_id);
     void GetAllChunkID(const std::string& root);
     friend class PanguAppendStore;
 
@@ -35,6 +38,7 @@ private:
     // CHKIT
     // mutable apsara::pangu::LogFileInputStreamPtr mScannerFileStream;
     mutable FileHelper* mScannerFH;
+    FramedRecordReader* mRecordReader;
     // added file system helper !! CHKIT
     FileSystemHelper*   mFileSystemHelper;
     bool                mFileHasMore;
@@ -19,6 +19,8 @@ typedef uint64_t OffsetType;  // Offset of the data item
 const uint32_t DF_MAX_PENDING =  1000;
 const uint32_t DF_CHUNK_SZ = (1024 * 1024 * 1024);  //1G
 const uint32_t DF_MAX_BLOCK_SZ = (1024 * 1024 * 10); //8M
+//max number of data blocks in flight before their index records are written
+const uint32_t DF_MAX_WRITE_BEHIND = 4;
 
 const int DF_MINCOPY = 3;
 const int DF_MAXCOPY = 3;
@@ -29,6 +31,7 @@ const char AppName[] = "app_name"; // LOCALFILE_APPNAME;
 const char PartName[] = "part_name"; // LOCALFILE_PARTNAME; 
 
 const char* const MetaFileName = ".meta_";
+const char* const ManifestFileName = ".manifest_";
 
 const uint16_t MAJOR_VER = 1;
 const uint16_t MINOR_VER = 0;
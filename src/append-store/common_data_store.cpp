@@ -1,7 +1,12 @@
 #include <iostream>
 #include <fstream>
+#include <cassert>
 #include "common_data_store.h"
+#include "../include/exception.h"
+#include "../include/file_system_helper.h"
 #include <string.h>
+#include <algorithm>
+#include <pthread.h>
 
 #include <log4cxx/logger.h>
 #include <log4cxx/xml/domconfigurator.h>
@@ -28,6 +33,9 @@ namespace
 {
     const std::string DataFileSuffix  = "CDS.dat";
     const std::string IndexFileSuffix = "CDS.idx";
+    const std::string FixedIndexFileSuffix = "CDS.fidx";
+    const std::string SortedIndexFileSuffix = "CDS.sidx";
+    const std::string SpillFileSuffix = ".spill";
 
     const int DF_MINCOPY = 3;
     const int DF_MAXCOPY = 5;
@@ -36,6 +44,18 @@ namespace
 
     const int OffsetSize = 8;
 
+    // a CdsIndexRecord serialized by marshall: length + sha1 + length + offset
+    const size_t SerializedIndexRecordSize = 4 + 20 + 4 + 8;
+
+    // number of fixed index records read by one Next()
+    const size_t FixedReadRecords = 64 * 1024;
+
+    // number of index records partitioned per block
+    const size_t PartitionBlockRecords = 1 << 20;
+
+    // largest single read/write on a partition file
+    const size_t PartitionIOSize = 64 << 20;
+
 	// CHKIT
     const char AppName[]  = "BIGFILE_APPNAME";
     const char PartName[] = "BIGFILE_PARTNAME";
@@ -46,11 +66,50 @@ namespace
 // apsara::logging::Logger* CdsIndexReader::sLoggerReader = apsara::logging::GetLogger("/apsara/cds_reader");
 
 
-CDSUtility::CDSUtility(const std::string& panguPath, bool write)
+namespace
+{
+    /*
+     * decode the CdsIndexRecords packed in a MultiIndexRecord without
+     * going through a stringstream
+     */
+    void DecodeIndexRecords(const std::string& data, std::vector<CdsFixedIndexRecord>& outvec)
+    {
+        CdsFixedIndexRecord record;
+        uint32_t len;
+        for (size_t pos = 0; pos < data.size(); pos += SerializedIndexRecordSize)
+        {
+            if (pos + SerializedIndexRecordSize > data.size())
+            {
+                THROW_EXCEPTION(ExceptionBase, "truncated index record in DecodeIndexRecords()");
+            }
+            memcpy(&len, &data[pos], sizeof(len));
+            if (len != 20)
+            {
+                THROW_EXCEPTION(ExceptionBase, "bad sha1 length in DecodeIndexRecords()");
+            }
+            memcpy(record.mSha1Index, &data[pos + 4], 20);
+            memcpy(&len, &data[pos + 24], sizeof(len));
+            if (len != OffsetSize)
+            {
+                THROW_EXCEPTION(ExceptionBase, "bad offset length in DecodeIndexRecords()");
+            }
+            memcpy(&record.mOffset, &data[pos + 28], OffsetSize);
+            outvec.push_back(record);
+        }
+    }
+}
+
+CDSUtility::CDSUtility(const std::string& panguPath, bool write, bool fixedIndex)
     : mPath(panguPath), 
       mAppend(write),
       mFlushCount(0),
-      mIndexInterval(IndexInterval)
+      mIndexInterval(IndexInterval),
+      mDataSize(0),
+      mFixedIndex(fixedIndex),
+      mFileSystemHelper(NULL),
+      mDataInputFH(NULL),
+      mDataOutputFH(NULL),
+      mIndexOutputFH(NULL)
 {
     if (mPath.compare(mPath.size()-1, 1, "/"))
     {
@@ -58,7 +117,7 @@ CDSUtility::CDSUtility(const std::string& panguPath, bool write)
     }
 
     mDataFileName  = mPath + DataFileSuffix;
-    mIndexFileName = mPath + IndexFileSuffix;
+    mIndexFileName = mPath + (mFixedIndex ? FixedIndexFileSuffix : IndexFileSuffix);
 
     Init();
 }
@@ -117,9 +176,7 @@ CDSUtility::~CDSUtility()
 void CDSUtility::Init()
 {
     // InitPangu();
-    mFileSystemHelper = new QFSHelper();//FileSystem::GetInstance();
-	// CHKIT
-    mFileSystemHelper->Connect();//"host", 30000);
+    mFileSystemHelper = FileSystemHelper::GetInstance();
 
     bool direxist;
     try
@@ -153,6 +210,14 @@ void CDSUtility::Init()
         THROW_EXCEPTION(ExceptionBase, "CDS store Directory not exist and readonly");
     }
 
+    // an existing store keeps the index format it was created with
+    if (!mFixedIndex && !mFileSystemHelper->IsFileExists(mIndexFileName) &&
+        mFileSystemHelper->IsFileExists(mPath + FixedIndexFileSuffix))
+    {
+        mFixedIndex = true;
+        mIndexFileName = mPath + FixedIndexFileSuffix;
+    }
+
     bool dexist;
     bool iexist;
     try
@@ -173,14 +238,13 @@ void CDSUtility::Init()
 
     if (mAppend) 
     {
+        mDataOutputFH = mFileSystemHelper->CreateFileHelper(mDataFileName, O_APPEND);
+        mIndexOutputFH = mFileSystemHelper->CreateFileHelper(mIndexFileName, O_APPEND);
         if (!dexist && !iexist)
         {
             try
             {
-		// CHKIT
-		mDataOutputFH = new QFSFileHelper((QFSHelper *)mFileSystemHelper, mDataFileName, O_APPEND); // APPEND
 		mDataOutputFH->Create();
-		mIndexOutputFH = new QFSFileHelper((QFSHelper *)mFileSystemHelper, mIndexFileName, O_APPEND);
 		mIndexOutputFH->Create();
             }
             catch(ExceptionBase& e)
@@ -191,9 +255,12 @@ void CDSUtility::Init()
         }
         mDataOutputFH->Open();
         mIndexOutputFH->Open();
+        mDataSize = mFileSystemHelper->GetSize(mDataFileName);
+        mFixedIndexBuf.reserve(mFixedIndex ? mIndexInterval : 0);
     }
     else 
     {
+        mDataInputFH = mFileSystemHelper->CreateFileHelper(mDataFileName, O_RDONLY);
         mDataInputFH->Open(); // = PanguHelper::OpenLog4Read(mDataFileName);
     }
 }
@@ -206,22 +273,24 @@ bool CDSUtility::Read(const std::string& handle, std::string* data)
 
     try
     {
-        mDataInputFH->Seek(offset); 
-
-        uint32_t read_len = mDataInputFH->GetNextLogSize();
+        // the record is framed by its length
+        uint32_t read_len = 0;
+        if (mDataInputFH->PRead(offset, (char*)&read_len, sizeof(read_len)) != sizeof(read_len))
+        {
+            THROW_EXCEPTION(AppendStoreReadException, "DataInputStream file read error, no record header");
+        }
         
         data->clear();
         data->resize(read_len, '\0');
 
-	mDataInputFH->Read(&((*data)[0]), read_len);
-/*
+        uint32_t size = read_len;
+        read_len = mDataInputFH->PRead(offset + sizeof(read_len), &((*data)[0]), size);
         if (read_len != size)
         {
             std::stringstream ss;
             ss << "DataInputStream file read error, need size: " << size << " actual size: "<<read_len;
-            THROW_EXCEPTION(ExceptionBase, ss.str());
+            THROW_EXCEPTION(AppendStoreReadException, ss.str());
         }
-*/
     }
     catch (ExceptionBase& e)
     {
@@ -242,10 +311,26 @@ std::string CDSUtility::Append(const std::string index, const std::string& data)
     }
 
     assert(index.size() == 20);
-    uint64_t offset;
+    uint64_t offset = Append(index.data(), data.data(), data.size());
+
+    std::string ret;
+    ret.resize(OffsetSize, '\0');
+    memcpy(&ret[0], &offset, OffsetSize);
+    return ret; 
+}
+
+uint64_t CDSUtility::Append(const char* index, const char* data, uint32_t size)
+{
+    if (!mAppend)
+    {
+        THROW_EXCEPTION(ExceptionBase, "Cannot append to readOnly CDS store");
+    }
+
+    // Flush() returns the position after the record, Read() needs the position before it
+    uint64_t offset = mDataSize;
     try
     {
-	offset = mDataOutputFH->Flush((char*)&data[0], data.size());
+	mDataSize = mDataOutputFH->Flush(const_cast<char*>(data), size);
     }
     catch(ExceptionBase& e)
     {
@@ -253,19 +338,28 @@ std::string CDSUtility::Append(const std::string index, const std::string& data)
         throw;
     }
 
-    std::string ret;
-    ret.resize(OffsetSize, '\0');
-    memcpy(&ret[0], &offset, OffsetSize);
-
-    CdsIndexRecord ci(index, ret);
-    ci.Serialize(mIndexStream);
+    if (mFixedIndex)
+    {
+        CdsFixedIndexRecord record;
+        memcpy(record.mSha1Index, index, 20);
+        record.mOffset = offset;
+        mFixedIndexBuf.push_back(record);
+    }
+    else
+    {
+        std::string ret;
+        ret.resize(OffsetSize, '\0');
+        memcpy(&ret[0], &offset, OffsetSize);
+        CdsIndexRecord ci(std::string(index, 20), ret);
+        ci.Serialize(mIndexStream);
+    }
     ++mFlushCount;
     if (mFlushCount >= mIndexInterval)
     {
         AppendIndex();
     }
 
-    return ret; 
+    return offset; 
 }
 
 void CDSUtility::AppendIndex()
@@ -275,6 +369,23 @@ void CDSUtility::AppendIndex()
         return;
     }
 
+    if (mFixedIndex)
+    {
+        size_t len = mFixedIndexBuf.size() * sizeof(CdsFixedIndexRecord);
+        try
+        {
+            mIndexOutputFH->FlushData(reinterpret_cast<char*>(&mFixedIndexBuf[0]), len);
+        }
+        catch (ExceptionBase& e)
+        {
+            LOG4CXX_ERROR(cdslogger, "Error in AppendIndex(): " << e.ToString());
+            throw;
+        }
+        mFlushCount = 0;
+        mFixedIndexBuf.clear();
+        return;
+    }
+
     std::stringstream ssbuf;
     MultiIndexRecord mir(mFlushCount, mIndexStream.str().size(), mIndexStream.str());
     mir.Serialize(ssbuf);
@@ -414,13 +525,22 @@ void MultiIndexRecord::clear()
 
 
 CdsIndexReader::CdsIndexReader(const std::string& path)
-    : mPath(path), mPartition_id(-1)
+    : mPath(path), mPartition_id(-1), mFormat(CdsSerializedIndex), mNumRecords(0), 
+      mFileSystemHelper(NULL), mIndexInputFH(NULL), mRecordReader(NULL)
 {
     InitReader();
 }
    
 CdsIndexReader::CdsIndexReader(const std::string& path, uint32_t partition_id)
-    : mPath(path), mPartition_id(partition_id)
+    : mPath(path), mPartition_id(partition_id), mFormat(CdsSerializedIndex), mNumRecords(0), 
+      mFileSystemHelper(NULL), mIndexInputFH(NULL), mRecordReader(NULL)
+{
+    InitReader();
+}
+
+CdsIndexReader::CdsIndexReader(const std::string& path, uint32_t partition_id, CdsIndexFormat format)
+    : mPath(path), mPartition_id(partition_id), mFormat(format), mNumRecords(0), 
+      mFileSystemHelper(NULL), mIndexInputFH(NULL), mRecordReader(NULL)
 {
     InitReader();
 }
@@ -434,7 +554,27 @@ void CdsIndexReader::InitReader()
 	// CHKIT
     // InitPangu();
 
-    std::string IndexFileName = mPath + IndexFileSuffix;
+    mFileSystemHelper = FileSystemHelper::GetInstance();
+    // the whole index of a CDS store is in either format, see CDSUtility
+    if (mPartition_id < 0 && !mFileSystemHelper->IsFileExists(mPath + IndexFileSuffix) &&
+        mFileSystemHelper->IsFileExists(mPath + FixedIndexFileSuffix))
+    {
+        mFormat = CdsFixedIndex;
+    }
+
+    std::string IndexFileName = mPath;
+    switch (mFormat)
+    {
+    case CdsFixedIndex:
+        IndexFileName += FixedIndexFileSuffix;
+        break;
+    case CdsSortedIndex:
+        IndexFileName += SortedIndexFileSuffix;
+        break;
+    default:
+        IndexFileName += IndexFileSuffix;
+        break;
+    }
     if (mPartition_id >= 0)
     {
         std::stringstream ss;
@@ -457,16 +597,25 @@ void CdsIndexReader::InitReader()
         THROW_EXCEPTION(ExceptionBase, "IndexFileName not co-exist");
     }
 
-     // CHKIT whether initialized 
-	// IndexFileName
+    mIndexInputFH = mFileSystemHelper->CreateFileHelper(IndexFileName, O_RDONLY);
     mIndexInputFH->Open();
+    if (mFormat != CdsSerializedIndex)
+    {
+        mNumRecords = mFileSystemHelper->GetSize(IndexFileName) / sizeof(CdsFixedIndexRecord);
+    }
+    else
+    {
+        mRecordReader = new FramedRecordReader(mIndexInputFH, mFileSystemHelper->GetSize(IndexFileName));
+    }
 }
 
 CdsIndexReader::~CdsIndexReader()
 {
+    delete mRecordReader;
     if (mIndexInputFH)
     {
         mIndexInputFH->Close();
+        mFileSystemHelper->DestroyFileHelper(mIndexInputFH);
     }
     //UninitPangu();
 }
@@ -474,27 +623,19 @@ CdsIndexReader::~CdsIndexReader()
 bool CdsIndexReader::Next(MultiIndexRecord& out_record)
 {
     out_record.clear();
+    if (mFormat != CdsSerializedIndex)
+    {
+        THROW_EXCEPTION(ExceptionBase, "Next(MultiIndexRecord&) needs a serialized index");
+    }
 
     try
     {
-	// CHKIT
-        uint32_t indexSize = mIndexInputFH->GetNextLogSize();
-        if (indexSize > 0)
-        {
-            std::string buffer;
-            buffer.resize(indexSize, 0);
-	    mIndexInputFH->Read(&buffer[0], indexSize);
-		/*
-            if (rsize != indexSize)
-            {
-                LOG4CXX_ERROR( *cdsloggerReader cdslogger, ("Error", "file read error in IndexReader"));
-                THROW_EXCEPTION(ExceptionBase, "file read error in IndexReader");
-            }
-		*/
-
+        std::string buffer;
+        if (mRecordReader->Next(&buffer))
+        {
             std::stringstream ss(buffer);
             out_record.Deserialize(ss);
-            LOG4CXX_DEBUG(/*cdsloggerReader*/ cdslogger, ("CDS indexSize = ", indexSize));
+            LOG4CXX_DEBUG(/*cdsloggerReader*/ cdslogger, "CDS indexSize = " << buffer.size());
 
             return true;
         }
@@ -553,6 +694,61 @@ bool CdsIndexReader::Next(std::vector<CdsIndexRecord>& outvec)
     }
 }
 
+bool CdsIndexReader::Next(std::vector<CdsFixedIndexRecord>& outvec)
+{
+    outvec.clear();
+    if (mFormat == CdsSerializedIndex)
+    {
+        MultiIndexRecord mir;
+        if (Next(mir))
+        {
+            DecodeIndexRecords(mir.mData, outvec);
+        }
+        return !outvec.empty();
+    }
+
+    outvec.resize(FixedReadRecords);
+    int len = mIndexInputFH->Read(reinterpret_cast<char*>(&outvec[0]), FixedReadRecords * sizeof(CdsFixedIndexRecord));
+    outvec.resize(len > 0 ? len / sizeof(CdsFixedIndexRecord) : 0);
+    LOG4CXX_DEBUG(cdslogger, "in Next() : " << outvec.size());
+    return !outvec.empty();
+}
+
+bool CdsIndexReader::Find(const char* sha1, uint64_t* offset)
+{
+    if (mFormat != CdsSortedIndex)
+    {
+        THROW_EXCEPTION(ExceptionBase, "Find() needs a sorted partition");
+    }
+
+    CdsFixedIndexRecord record;
+    uint64_t lo = 0;
+    uint64_t hi = mNumRecords;
+    while (lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (mIndexInputFH->PRead(mid * sizeof(CdsFixedIndexRecord), (char*)&record, sizeof(record)) != sizeof(record))
+        {
+            THROW_EXCEPTION(ExceptionBase, "short read in Find()");
+        }
+        int cmp = memcmp(record.mSha1Index, sha1, 20);
+        if (cmp == 0)
+        {
+            memcpy(offset, &record.mOffset, OffsetSize);
+            return true;
+        }
+        if (cmp < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    return false;
+}
+
 uint32_t CdsIndexRecord::mod(const uint32_t no) const
 {
     assert(mSha1Index.size() == 20);
@@ -578,9 +774,7 @@ bool GeneratePartitionIndex(std::string& path, uint32_t no_partitions, std::stri
 {
     CdsIndexReader reader(path);
 
-	//CHKIT
-    FileSystemHelper* mFileSystemHelper = new QFSHelper();
-    mFileSystemHelper->Connect();//"host", 30000);	
+    FileSystemHelper* mFileSystemHelper = FileSystemHelper::GetInstance();
 
 
     std::string ipath = dest_path;
@@ -652,13 +846,13 @@ bool GeneratePartitionIndex(std::string& path, uint32_t no_partitions, std::stri
  
     // std::vector<LogFileOutputStreamPtr> istreamvec;
 	std::vector<FileHelper*> istreamvec;
-	QFSFileHelper *temp;
+	FileHelper *temp;
     for (uint32_t j=0; j<no_partitions; ++j)
     {
         try
         {
 		// CHKIT
-	    temp = new QFSFileHelper((QFSHelper *)mFileSystemHelper, ifilevec[j], O_APPEND); // WRITE
+	    temp = mFileSystemHelper->CreateFileHelper(ifilevec[j], O_APPEND); // WRITE
             // AppendStore::PanguHelper::CreateLogFile(ifilevec[j], DF_MINCOPY, DF_MAXCOPY, AppName, PartName);
         } 
         catch(ExceptionBase& e)
@@ -686,27 +880,14 @@ bool GeneratePartitionIndex(std::string& path, uint32_t no_partitions, std::stri
         streamvec.push_back(new std::stringstream());
     }
 
-    MultiIndexRecord record;
-    while (reader.Next(record)) 
+    // read through the any-format Next(), the store may have a fixed size index
+    std::vector<CdsFixedIndexRecord> records;
+    while (reader.Next(records)) 
     {
-        std::stringstream streamBuf(record.mData);
-        do
+        for (size_t i = 0; i < records.size(); ++i)
         {
-            if (streamBuf.peek() == EOF)
-            {
-                break;
-            }
-            if (streamBuf.eof()) 
-            {
-                break;
-            }
-            if (streamBuf.bad()) 
-            {
-                THROW_EXCEPTION(ExceptionBase, "streamBuf.bad() in GeneratePartitionIndex()");
-            }
-
-            CdsIndexRecord cr;
-            cr.Deserialize(streamBuf);
+            CdsIndexRecord cr(std::string(records[i].mSha1Index, 20),
+                              std::string((const char*)&records[i].mOffset, OffsetSize));
             uint32_t ith = cr.mod(no_partitions);
 
             cr.Serialize(*(streamvec[ith]));
@@ -732,7 +913,7 @@ bool GeneratePartitionIndex(std::string& path, uint32_t no_partitions, std::stri
                 streamvec[ith]->str(std::string());
                 streamvec[ith]->clear();
             }
-        } while (1);
+        }
     }
 
     for (uint32_t j=0; j<no_partitions; ++j)
@@ -777,3 +958,273 @@ bool GeneratePartitionIndex(std::string& path, uint32_t no_partitions, std::stri
     return true;
 }
 
+
+uint32_t CdsFixedIndexRecord::Partition(uint32_t no_partitions) const
+{
+    uint32_t prefix = (static_cast<uint32_t>(static_cast<uint8_t>(mSha1Index[0])) << 24) |
+                      (static_cast<uint32_t>(static_cast<uint8_t>(mSha1Index[1])) << 16) |
+                      (static_cast<uint32_t>(static_cast<uint8_t>(mSha1Index[2])) << 8) |
+                      static_cast<uint32_t>(static_cast<uint8_t>(mSha1Index[3]));
+    return static_cast<uint32_t>((static_cast<uint64_t>(prefix) * no_partitions) >> 32);
+}
+
+bool CdsFixedIndexRecord::operator<(const CdsFixedIndexRecord& other) const
+{
+    int cmp = memcmp(mSha1Index, other.mSha1Index, 20);
+    if (cmp != 0)
+    {
+        return cmp < 0;
+    }
+    return mOffset < other.mOffset;
+}
+
+namespace
+{
+    bool SameSha1(const CdsFixedIndexRecord& a, const CdsFixedIndexRecord& b)
+    {
+        return memcmp(a.mSha1Index, b.mSha1Index, 20) == 0;
+    }
+
+    template <typename Task>
+    void RunInThreads(void* (*worker)(void*), std::vector<Task>& tasks)
+    {
+        std::vector<pthread_t> threads(tasks.size());
+        std::vector<bool> started(tasks.size(), false);
+        for (size_t i = 0; i < tasks.size(); ++i)
+        {
+            started[i] = (pthread_create(&threads[i], NULL, worker, &tasks[i]) == 0);
+            if (!started[i])
+            {
+                worker(&tasks[i]);
+            }
+        }
+        for (size_t i = 0; i < tasks.size(); ++i)
+        {
+            if (started[i])
+            {
+                pthread_join(threads[i], NULL);
+            }
+        }
+    }
+
+    struct ScatterTask
+    {
+        const CdsFixedIndexRecord* mBegin;
+        const CdsFixedIndexRecord* mEnd;
+        std::vector<std::vector<CdsFixedIndexRecord> > mBuckets;
+    };
+
+    void* ScatterWorker(void* arg)
+    {
+        ScatterTask* task = static_cast<ScatterTask*>(arg);
+        uint32_t no_partitions = task->mBuckets.size();
+        for (size_t j = 0; j < no_partitions; ++j)
+        {
+            task->mBuckets[j].clear();
+        }
+        for (const CdsFixedIndexRecord* p = task->mBegin; p != task->mEnd; ++p)
+        {
+            task->mBuckets[p->Partition(no_partitions)].push_back(*p);
+        }
+        return NULL;
+    }
+
+    struct SortTask
+    {
+        std::string mSpillFile;
+        std::string mDestFile;
+        uint64_t    mRecords;
+        bool        mOk;
+    };
+
+    /*
+     * load one spilled partition, sort and dedupe it (the smallest offset
+     * of a sha1 is kept), and write it as a sorted partition file
+     */
+    void* SortWorker(void* arg)
+    {
+        SortTask* task = static_cast<SortTask*>(arg);
+        FileSystemHelper* fsh = FileSystemHelper::GetInstance();
+        task->mOk = false;
+        try
+        {
+            uint64_t size = fsh->GetSize(task->mSpillFile);
+            std::vector<CdsFixedIndexRecord> records(size / sizeof(CdsFixedIndexRecord));
+            char* buf = reinterpret_cast<char*>(records.empty() ? NULL : &records[0]);
+            size = records.size() * sizeof(CdsFixedIndexRecord);
+
+            FileHelper* in = fsh->CreateFileHelper(task->mSpillFile, O_RDONLY);
+            in->Open();
+            for (uint64_t pos = 0; pos < size; )
+            {
+                int len = in->Read(buf + pos, std::min(PartitionIOSize, static_cast<size_t>(size - pos)));
+                if (len <= 0)
+                {
+                    break;
+                }
+                pos += len;
+            }
+            in->Close();
+            fsh->DestroyFileHelper(in);
+
+            std::sort(records.begin(), records.end());
+            records.erase(std::unique(records.begin(), records.end(), SameSha1), records.end());
+            task->mRecords = records.size();
+            size = records.size() * sizeof(CdsFixedIndexRecord);
+
+            FileHelper* out = fsh->CreateFileHelper(task->mDestFile, O_WRONLY);
+            out->Create();
+            for (uint64_t pos = 0; pos < size; pos += PartitionIOSize)
+            {
+                size_t len = std::min(PartitionIOSize, static_cast<size_t>(size - pos));
+                if (out->WriteData(buf + pos, len) != static_cast<int>(len))
+                {
+                    THROW_EXCEPTION(ExceptionBase, "short write on " + task->mDestFile);
+                }
+            }
+            out->Close();
+            fsh->DestroyFileHelper(out);
+            fsh->RemoveFile(task->mSpillFile);
+            task->mOk = true;
+        }
+        catch (ExceptionBase& e)
+        {
+            LOG4CXX_ERROR(cdslogger, "Error sorting partition " << task->mDestFile << ": " << e.ToString());
+        }
+        return NULL;
+    }
+}
+
+bool GenerateSortedPartitionIndex(const std::string& path, uint32_t no_partitions, const std::string& dest_path, uint32_t num_threads)
+{
+    if (no_partitions < 1)
+    {
+        LOG4CXX_ERROR(cdslogger, "no_partitions has to be no less than 1.");
+        return false;
+    }
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+
+    FileSystemHelper* fsh = FileSystemHelper::GetInstance();
+    std::string ipath = dest_path;
+    if (ipath.compare(ipath.size()-1, 1, "/"))
+    {
+        ipath.append("/");
+    }
+
+    std::vector<std::string> destvec;
+    for (uint32_t j=0; j<no_partitions; ++j)
+    {
+        std::stringstream ss;
+        ss << ipath << SortedIndexFileSuffix << "." << j;
+        destvec.push_back(ss.str());
+        if (fsh->IsFileExists(destvec[j]))
+        {
+            LOG4CXX_ERROR(cdslogger, destvec[j] << " already exist");
+            return false;
+        }
+    }
+    if (!fsh->IsDirectoryExists(dest_path))
+    {
+        fsh->CreateDirectory(dest_path);
+    }
+
+    std::vector<FileHelper*> spillvec;
+    std::vector<ScatterTask> scatters(num_threads);
+    for (uint32_t j=0; j<no_partitions; ++j)
+    {
+        spillvec.push_back(fsh->CreateFileHelper(destvec[j] + SpillFileSuffix, O_WRONLY));
+        spillvec[j]->Create();
+    }
+    for (uint32_t t=0; t<num_threads; ++t)
+    {
+        scatters[t].mBuckets.resize(no_partitions);
+    }
+
+    // pass 1: stream the index in large blocks and scatter them by partition
+    bool ok = true;
+    uint64_t total = 0;
+    try
+    {
+        CdsIndexReader reader(path);
+        std::vector<CdsFixedIndexRecord> records;
+        std::vector<CdsFixedIndexRecord> block;
+        block.reserve(PartitionBlockRecords + FixedReadRecords);
+        bool more = true;
+        while (more)
+        {
+            block.clear();
+            while (block.size() < PartitionBlockRecords && (more = reader.Next(records)))
+            {
+                block.insert(block.end(), records.begin(), records.end());
+            }
+            if (block.empty())
+            {
+                break;
+            }
+            total += block.size();
+
+            for (uint32_t t=0; t<num_threads; ++t)
+            {
+                scatters[t].mBegin = &block[0] + block.size() * t / num_threads;
+                scatters[t].mEnd   = &block[0] + block.size() * (t + 1) / num_threads;
+            }
+            RunInThreads(ScatterWorker, scatters);
+
+            for (uint32_t j=0; j<no_partitions; ++j)
+            {
+                for (uint32_t t=0; t<num_threads; ++t)
+                {
+                    std::vector<CdsFixedIndexRecord>& bucket = scatters[t].mBuckets[j];
+                    if (bucket.empty())
+                    {
+                        continue;
+                    }
+                    size_t len = bucket.size() * sizeof(CdsFixedIndexRecord);
+                    if (spillvec[j]->WriteData(reinterpret_cast<char*>(&bucket[0]), len) != static_cast<int>(len))
+                    {
+                        THROW_EXCEPTION(ExceptionBase, "short write on " + destvec[j] + SpillFileSuffix);
+                    }
+                }
+            }
+        }
+    }
+    catch (ExceptionBase& e)
+    {
+        LOG4CXX_ERROR(cdslogger, "Error partitioning " << path << ": " << e.ToString());
+        ok = false;
+    }
+    for (uint32_t j=0; j<no_partitions; ++j)
+    {
+        spillvec[j]->Close();
+        fsh->DestroyFileHelper(spillvec[j]);
+    }
+    if (!ok)
+    {
+        return false;
+    }
+
+    // pass 2: sort num_threads partitions at a time
+    uint64_t unique = 0;
+    for (uint32_t first=0; first<no_partitions; first+=num_threads)
+    {
+        std::vector<SortTask> sorts(std::min(num_threads, no_partitions - first));
+        for (uint32_t t=0; t<sorts.size(); ++t)
+        {
+            sorts[t].mSpillFile = destvec[first + t] + SpillFileSuffix;
+            sorts[t].mDestFile  = destvec[first + t];
+            sorts[t].mRecords   = 0;
+        }
+        RunInThreads(SortWorker, sorts);
+        for (uint32_t t=0; t<sorts.size(); ++t)
+        {
+            ok = ok && sorts[t].mOk;
+            unique += sorts[t].mRecords;
+        }
+    }
+    LOG4CXX_INFO(cdslogger, "Partitioned " << total << " index records into " << no_partitions 
+                 << " sorted partitions, " << unique << " unique");
+    return ok;
+}
@@ -9,6 +9,7 @@
 
 #include "serialize.h"
 #include "../include/file_helper.h"
+#include "../fs/framed_record_reader.h"
 
 class CdsIndexRecord : public marshall::Serializable
 {
@@ -37,6 +38,34 @@ private:
     FileSystemHelper* mFileSystemHelper;
 };
 
+/*
+ * fixed size CDS index record (28 bytes), the record format of the sorted
+ * partition files, so they can be binary-searched or mapped directly
+ */
+struct CdsFixedIndexRecord
+{
+    char     mSha1Index[20];
+    uint64_t mOffset;
+
+    /*
+     * partition by hash prefix, partition j holds a contiguous range
+     * of the sorted index
+     */
+    uint32_t Partition(uint32_t no_partitions) const;
+
+    bool operator<(const CdsFixedIndexRecord& other) const;
+} __attribute__((packed));
+
+/*
+ * on-disk formats of CDS index files
+ */
+enum CdsIndexFormat
+{
+    CdsSerializedIndex,     // MultiIndexRecords of serialized CdsIndexRecords
+    CdsFixedIndex,          // CdsFixedIndexRecords in append order
+    CdsSortedIndex          // CdsFixedIndexRecords sorted by sha1
+};
+
 /*
 * record consisting of multiple CdsIndexRecord
 */
@@ -79,6 +108,14 @@ public:
     */
     CdsIndexReader(const std::string& path, uint32_t partition_id);
 
+    /*
+     * open a partition in the given format, GeneratePartitionIndex()
+     * writes CdsSerializedIndex, GenerateSortedPartitionIndex() writes
+     * CdsSortedIndex
+     * throw 
+    */
+    CdsIndexReader(const std::string& path, uint32_t partition_id, CdsIndexFormat format);
+
     ~CdsIndexReader();
 
     /*
@@ -91,6 +128,22 @@ public:
     */
     bool Next(std::vector<CdsIndexRecord>&);
 
+    /*
+     * read the next block of records in any format, fixed size records
+     * are read without decoding
+     * throw 
+    */
+    bool Next(std::vector<CdsFixedIndexRecord>&);
+
+    /*
+     * binary search a sorted partition for sha1 (20 bytes)
+     * return true and set offset if found
+     * throw 
+    */
+    bool Find(const char* sha1, uint64_t* offset);
+
+    uint64_t GetNumRecords() const { return mNumRecords; }
+
 	// CHKIT
     // static apsara::logging::Logger* sLoggerReader;
 
@@ -100,8 +153,11 @@ private:
 private:
     std::string mPath;
     int         mPartition_id;
+    CdsIndexFormat mFormat;
+    uint64_t    mNumRecords;    // only known for sorted partitions
     FileSystemHelper* mFileSystemHelper;
     mutable FileHelper* mIndexInputFH;
+    FramedRecordReader* mRecordReader;  // for CdsSerializedIndex
 };
 
 
@@ -110,6 +166,14 @@ private:
 */
 bool GeneratePartitionIndex(std::string& path, uint32_t no_partitions, std::string dest_path);
 
+/*
+ * split the CDS index file into no_partitions sorted partition files of
+ * CdsFixedIndexRecord, partitioned by hash prefix with num_threads threads;
+ * the index is streamed in large blocks and spilled per partition, then
+ * each partition is sorted and deduped in memory
+*/
+bool GenerateSortedPartitionIndex(const std::string& path, uint32_t no_partitions, const std::string& dest_path, uint32_t num_threads);
+
 
 /* utility class to generate/update CDS
  * CDS files on pangu
@@ -118,9 +182,11 @@ class CDSUtility
 {
 public:
     /*
+     * fixedIndex: write the index as CdsFixedIndexRecords instead of
+     *             serialized CdsIndexRecords
      * throw 
     */
-    CDSUtility(const std::string& panguPath, bool write=false);
+    CDSUtility(const std::string& panguPath, bool write=false, bool fixedIndex=false);
 
     ~CDSUtility();
 
@@ -141,6 +207,13 @@ public:
     */
     bool Read(const std::string& handle, std::string* data);
 
+    /*
+     * append size bytes of data whose sha1 hash is index (20 bytes)
+     * return the offset of data in file, which is the handle in Read()
+     * @throw exception on error.
+    */
+    uint64_t Append(const char* index, const char* data, uint32_t size);
+
     void Close();
 
 private:
@@ -166,7 +239,10 @@ private:
     uint32_t     mIndexInterval;    
     std::string  mIndexFileName; 
     std::string  mDataFileName;  
+    uint64_t     mDataSize;
     std::stringstream mIndexStream;
+    bool         mFixedIndex;
+    std::vector<CdsFixedIndexRecord> mFixedIndexBuf;
 
     FileSystemHelper* mFileSystemHelper;
     FileHelper* mDataInputFH; //     apsara::pangu::LogFileInputStreamPtr  mDataInputStream;
@@ -0,0 +1,359 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <map>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include "metrics.h"
+#include "timer.h"
+
+MetricHistogram::MetricHistogram(uint64_t first_bound, uint32_t num_buckets)
+    : count_(0), sum_(0)
+{
+    uint64_t bound = first_bound > 0 ? first_bound : 1;
+    for (uint32_t i = 0; i < num_buckets; i++, bound *= 2)
+        bounds_.push_back(bound);
+    buckets_.resize(bounds_.size() + 1, 0);
+}
+
+void MetricHistogram::Observe(uint64_t value)
+{
+    size_t i = 0;
+    while (i < bounds_.size() && value > bounds_[i])
+        i++;
+    __sync_fetch_and_add(&buckets_[i], 1);
+    __sync_fetch_and_add(&count_, 1);
+    __sync_fetch_and_add(&sum_, value);
+}
+
+enum MetricType { METRIC_COUNTER, METRIC_GAUGE, METRIC_HISTOGRAM };
+
+struct MetricEntry {
+    string name_;
+    string help_;
+    MetricType type_;
+    void* metric_;
+};
+
+/*
+ * metrics are created by static initializers of other files,
+ * so the registry is built on first use instead of at load time
+ */
+struct MetricRegistry {
+    vector<MetricEntry> entries_;		// in creation order
+    map<string, size_t> index_;
+    vector<pair<string, string> > labels_;
+};
+
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static MetricRegistry* registry = NULL;
+
+// call with metrics_lock held
+static MetricRegistry& GetRegistry()
+{
+    if (registry == NULL)
+        registry = new MetricRegistry();
+    return *registry;
+}
+
+static pthread_t reporter_thread;
+static pthread_mutex_t reporter_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reporter_cond = PTHREAD_COND_INITIALIZER;
+static bool reporter_running = false;
+static string reporter_prefix;
+static uint32_t reporter_interval = 0;
+
+LoggerPtr Metrics::logger_ = Logger::getLogger("BigArchive.Metrics");
+
+static void* GetMetric(const string& name, const string& help, MetricType type,
+                       uint64_t first_bound = 1, uint32_t num_buckets = 0)
+{
+    pthread_mutex_lock(&metrics_lock);
+    vector<MetricEntry>& metric_entries = GetRegistry().entries_;
+    map<string, size_t>& metric_index = GetRegistry().index_;
+    map<string, size_t>::iterator it = metric_index.find(name);
+    if (it != metric_index.end()) {
+        void* metric = metric_entries[it->second].type_ == type ? metric_entries[it->second].metric_ : NULL;
+        pthread_mutex_unlock(&metrics_lock);
+        return metric;
+    }
+    MetricEntry entry;
+    entry.name_ = name;
+    entry.help_ = help;
+    entry.type_ = type;
+    if (type == METRIC_COUNTER)
+        entry.metric_ = new MetricCounter();
+    else if (type == METRIC_GAUGE)
+        entry.metric_ = new MetricGauge();
+    else
+        entry.metric_ = new MetricHistogram(first_bound, num_buckets);
+    metric_index[name] = metric_entries.size();
+    metric_entries.push_back(entry);
+    pthread_mutex_unlock(&metrics_lock);
+    return entry.metric_;
+}
+
+MetricCounter* Metrics::Counter(const string& name, const string& help)
+{
+    MetricCounter* counter = (MetricCounter*)GetMetric(name, help, METRIC_COUNTER);
+    if (counter == NULL)
+        LOG4CXX_ERROR(logger_, "Metric " << name << " already registered with another type");
+    return counter;
+}
+
+MetricGauge* Metrics::Gauge(const string& name, const string& help)
+{
+    MetricGauge* gauge = (MetricGauge*)GetMetric(name, help, METRIC_GAUGE);
+    if (gauge == NULL)
+        LOG4CXX_ERROR(logger_, "Metric " << name << " already registered with another type");
+    return gauge;
+}
+
+MetricHistogram* Metrics::Histogram(const string& name, const string& help,
+                                    uint64_t first_bound, uint32_t num_buckets)
+{
+    MetricHistogram* histogram = (MetricHistogram*)GetMetric(name, help, METRIC_HISTOGRAM,
+                                                             first_bound, num_buckets);
+    if (histogram == NULL)
+        LOG4CXX_ERROR(logger_, "Metric " << name << " already registered with another type");
+    return histogram;
+}
+
+void Metrics::SetLabel(const string& key, const string& value)
+{
+    pthread_mutex_lock(&metrics_lock);
+    vector<pair<string, string> >& metric_labels = GetRegistry().labels_;
+    size_t i;
+    for (i = 0; i < metric_labels.size(); i++)
+        if (metric_labels[i].first == key)
+            break;
+    if (i == metric_labels.size())
+        metric_labels.push_back(make_pair(key, value));
+    else
+        metric_labels[i].second = value;
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+static string Escape(const string& s)
+{
+    string res;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '"' || s[i] == '\\')
+            res += '\\';
+        if (s[i] == '\n')
+            res += "\\n";
+        else
+            res += s[i];
+    }
+    return res;
+}
+
+// integral values (byte counts in gauges) are printed in full, not in exponent form
+static string FormatNumber(double value)
+{
+    stringstream ss;
+    if (value == floor(value) && fabs(value) < 1e15)
+        ss << (int64_t)value;
+    else
+        ss << setprecision(10) << value;
+    return ss.str();
+}
+
+// doubles as JSON numbers, inf and nan are not allowed
+static string JsonNumber(double value)
+{
+    if (isnan(value) || isinf(value))
+        return "null";
+    return FormatNumber(value);
+}
+
+// {k1="v1",k2="v2"} with the global labels and optional extra ones, call with metrics_lock held
+static string PromLabels(const string& extra_key = "", const string& extra_value = "",
+                         const string& extra_key2 = "", const string& extra_value2 = "")
+{
+    vector<pair<string, string> > labels = GetRegistry().labels_;
+    if (!extra_key.empty())
+        labels.push_back(make_pair(extra_key, extra_value));
+    if (!extra_key2.empty())
+        labels.push_back(make_pair(extra_key2, extra_value2));
+    if (labels.empty())
+        return "";
+    string res = "{";
+    for (size_t i = 0; i < labels.size(); i++) {
+        if (i > 0)
+            res += ",";
+        res += labels[i].first + "=\"" + Escape(labels[i].second) + "\"";
+    }
+    return res + "}";
+}
+
+void Metrics::DumpJson(ostream& os)
+{
+    pthread_mutex_lock(&metrics_lock);
+    const vector<MetricEntry>& metric_entries = GetRegistry().entries_;
+    const vector<pair<string, string> >& metric_labels = GetRegistry().labels_;
+    os << "{\n  \"timestamp\": " << time(NULL) << ",\n  \"labels\": {";
+    for (size_t i = 0; i < metric_labels.size(); i++)
+        os << (i > 0 ? ", " : "") << "\"" << Escape(metric_labels[i].first) << "\": \""
+            << Escape(metric_labels[i].second) << "\"";
+    os << "},\n  \"metrics\": {";
+    for (size_t i = 0; i < metric_entries.size(); i++) {
+        const MetricEntry& e = metric_entries[i];
+        os << (i > 0 ? "," : "") << "\n    \"" << Escape(e.name_) << "\": ";
+        if (e.type_ == METRIC_COUNTER)
+            os << ((MetricCounter*)e.metric_)->Get();
+        else if (e.type_ == METRIC_GAUGE)
+            os << JsonNumber(((MetricGauge*)e.metric_)->Get());
+        else {
+            MetricHistogram* h = (MetricHistogram*)e.metric_;
+            os << "{\"count\": " << h->GetCount() << ", \"sum\": " << h->GetSum() << ", \"buckets\": [";
+            for (size_t j = 0; j <= h->GetBounds().size(); j++) {
+                os << (j > 0 ? ", " : "") << "[";
+                if (j < h->GetBounds().size())
+                    os << h->GetBounds()[j];
+                else
+                    os << "null";
+                os << ", " << h->GetBucket(j) << "]";
+            }
+            os << "]}";
+        }
+    }
+    pthread_mutex_unlock(&metrics_lock);
+
+    os << "\n  },\n  \"timers\": {";
+    for (TimerId id = 0; id < TimerPool::GetNumTimers(); id++) {
+        TimerStats stats = TimerPool::GetStats(id);
+        os << (id > 0 ? "," : "") << "\n    \"" << Escape(TimerPool::GetName(id)) << "\": {\"count\": "
+            << stats.count_ << ", \"total_ms\": " << JsonNumber(stats.total_)
+            << ", \"p50_ms\": " << JsonNumber(stats.p50_) << ", \"p99_ms\": " << JsonNumber(stats.p99_)
+            << ", \"max_ms\": " << JsonNumber(stats.max_) << "}";
+    }
+    os << "\n  }\n}\n";
+}
+
+void Metrics::DumpPrometheus(ostream& os)
+{
+    pthread_mutex_lock(&metrics_lock);
+    const vector<MetricEntry>& metric_entries = GetRegistry().entries_;
+    string labels = PromLabels();
+    for (size_t i = 0; i < metric_entries.size(); i++) {
+        const MetricEntry& e = metric_entries[i];
+        os << "# HELP " << e.name_ << " " << e.help_ << "\n";
+        if (e.type_ == METRIC_COUNTER) {
+            os << "# TYPE " << e.name_ << " counter\n";
+            os << e.name_ << labels << " " << ((MetricCounter*)e.metric_)->Get() << "\n";
+        }
+        else if (e.type_ == METRIC_GAUGE) {
+            os << "# TYPE " << e.name_ << " gauge\n";
+            os << e.name_ << labels << " " << FormatNumber(((MetricGauge*)e.metric_)->Get()) << "\n";
+        }
+        else {
+            MetricHistogram* h = (MetricHistogram*)e.metric_;
+            os << "# TYPE " << e.name_ << " histogram\n";
+            uint64_t cumulative = 0;
+            for (size_t j = 0; j <= h->GetBounds().size(); j++) {
+                cumulative += h->GetBucket(j);
+                stringstream le;
+                if (j < h->GetBounds().size())
+                    le << h->GetBounds()[j];
+                else
+                    le << "+Inf";
+                os << e.name_ << "_bucket" << PromLabels("le", le.str()) << " " << cumulative << "\n";
+            }
+            os << e.name_ << "_sum" << labels << " " << h->GetSum() << "\n";
+            os << e.name_ << "_count" << labels << " " << h->GetCount() << "\n";
+        }
+    }
+
+    if (TimerPool::GetNumTimers() > 0) {
+        os << "# HELP bigarchive_timer_seconds Durations measured by TimerPool\n";
+        os << "# TYPE bigarchive_timer_seconds summary\n";
+        for (TimerId id = 0; id < TimerPool::GetNumTimers(); id++) {
+            TimerStats stats = TimerPool::GetStats(id);
+            string name = TimerPool::GetName(id);
+            os << "bigarchive_timer_seconds" << PromLabels("timer", name, "quantile", "0.5")
+                << " " << stats.p50_ / 1000 << "\n";
+            os << "bigarchive_timer_seconds" << PromLabels("timer", name, "quantile", "0.99")
+                << " " << stats.p99_ / 1000 << "\n";
+            os << "bigarchive_timer_seconds_sum" << PromLabels("timer", name) << " " << stats.total_ / 1000 << "\n";
+            os << "bigarchive_timer_seconds_count" << PromLabels("timer", name) << " " << stats.count_ << "\n";
+        }
+    }
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+static bool WriteFile(const string& pathname, const string& content)
+{
+    string tmp_pathname = pathname + ".tmp";
+    ofstream ofs(tmp_pathname.c_str(), ios::out | ios::trunc);
+    ofs << content;
+    ofs.close();
+    if (!ofs)
+        return false;
+    return rename(tmp_pathname.c_str(), pathname.c_str()) == 0;
+}
+
+bool Metrics::WriteFiles(const string& prefix)
+{
+    stringstream json, prom;
+    DumpJson(json);
+    DumpPrometheus(prom);
+    if (!WriteFile(prefix + ".json", json.str()) || !WriteFile(prefix + ".prom", prom.str())) {
+        LOG4CXX_ERROR(logger_, "Couldn't write metrics to " << prefix << ": " << strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void* Metrics::ReporterThread(void* arg)
+{
+    pthread_mutex_lock(&reporter_lock);
+    while (reporter_running) {
+        timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += reporter_interval;
+        pthread_cond_timedwait(&reporter_cond, &reporter_lock, &deadline);
+        if (!reporter_running)
+            break;
+        pthread_mutex_unlock(&reporter_lock);
+        WriteFiles(reporter_prefix);
+        pthread_mutex_lock(&reporter_lock);
+    }
+    pthread_mutex_unlock(&reporter_lock);
+    return NULL;
+}
+
+void Metrics::StartReporter(const string& prefix, uint32_t interval)
+{
+    pthread_mutex_lock(&reporter_lock);
+    if (reporter_running) {
+        pthread_mutex_unlock(&reporter_lock);
+        return;
+    }
+    reporter_prefix = prefix;
+    reporter_interval = interval > 0 ? interval : 1;
+    reporter_running = true;
+    pthread_mutex_unlock(&reporter_lock);
+    if (pthread_create(&reporter_thread, NULL, ReporterThread, NULL) != 0) {
+        LOG4CXX_ERROR(logger_, "Couldn't start metrics reporter");
+        reporter_running = false;
+    }
+}
+
+void Metrics::StopReporter()
+{
+    pthread_mutex_lock(&reporter_lock);
+    if (!reporter_running) {
+        pthread_mutex_unlock(&reporter_lock);
+        return;
+    }
+    reporter_running = false;
+    pthread_cond_signal(&reporter_cond);
+    pthread_mutex_unlock(&reporter_lock);
+    pthread_join(reporter_thread, NULL);
+    WriteFiles(reporter_prefix);
+}
@@ -0,0 +1,108 @@
+/*
+ * Process wide registry of counters, gauges and histograms, dumped as JSON
+ * and as Prometheus text format so jobs can be tracked without scraping logs.
+ * Metrics are created once (keep the returned pointer in a static) and
+ * updated lock free; the reporter thread rewrites the dump files periodically.
+ */
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <log4cxx/logger.h>
+
+using namespace std;
+using namespace log4cxx;
+
+class MetricCounter {
+public:
+    MetricCounter() : value_(0) {}
+
+    void Inc(uint64_t n = 1) { __sync_fetch_and_add(&value_, n); }
+
+    uint64_t Get() const { return value_; }
+
+private:
+    volatile uint64_t value_;
+};
+
+class MetricGauge {
+public:
+    MetricGauge() : value_(0.0) {}
+
+    void Set(double value) { value_ = value; }
+
+    double Get() const { return value_; }
+
+private:
+    volatile double value_;
+};
+
+/*
+ * Histogram of non-negative integer samples (bytes, microseconds),
+ * bucket i counts samples <= first_bound * 2^i, the last one is +Inf.
+ */
+class MetricHistogram {
+public:
+    MetricHistogram(uint64_t first_bound, uint32_t num_buckets);
+
+    void Observe(uint64_t value);
+
+    uint64_t GetCount() const { return count_; }
+    uint64_t GetSum() const { return sum_; }
+    const vector<uint64_t>& GetBounds() const { return bounds_; }
+
+    // number of samples in bucket i (not cumulative)
+    uint64_t GetBucket(uint32_t i) const { return buckets_[i]; }
+
+private:
+    vector<uint64_t> bounds_;
+    vector<uint64_t> buckets_;	// bounds_.size() + 1 for +Inf
+    volatile uint64_t count_;
+    volatile uint64_t sum_;
+};
+
+class Metrics {
+public:
+    /*
+     * get a metric by name, creating it on the first call;
+     * names follow Prometheus rules, e.g. bigarchive_fs_read_bytes_total
+     */
+    static MetricCounter* Counter(const string& name, const string& help);
+    static MetricGauge* Gauge(const string& name, const string& help);
+    static MetricHistogram* Histogram(const string& name, const string& help,
+                                      uint64_t first_bound = 1, uint32_t num_buckets = 24);
+
+    /*
+     * label attached to all metrics, e.g. the VM and snapshot of a job
+     */
+    static void SetLabel(const string& key, const string& value);
+
+    /*
+     * dump all metrics, TimerPool timers are included as summaries in seconds
+     */
+    static void DumpJson(ostream& os);
+    static void DumpPrometheus(ostream& os);
+
+    /*
+     * write <prefix>.json and <prefix>.prom on local disk,
+     * through a temp file and rename so readers never see partial files
+     */
+    static bool WriteFiles(const string& prefix);
+
+    /*
+     * rewrite the files every interval seconds in a background thread,
+     * stopping the reporter writes the files one last time
+     */
+    static void StartReporter(const string& prefix, uint32_t interval);
+    static void StopReporter();
+
+private:
+    static void* ReporterThread(void* arg);
+
+    static LoggerPtr logger_;
+};
+
+#endif	// _METRICS_H_
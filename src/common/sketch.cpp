@@ -0,0 +1,84 @@
+#include "sketch.h"
+#include <math.h>
+
+HyperLogLog::HyperLogLog(uint32_t precision)
+    : precision_(precision), registers_(1 << precision, 0)
+{
+}
+
+void HyperLogLog::Add(uint64_t hash)
+{
+    uint32_t index = hash >> (64 - precision_);
+    uint64_t rest = hash << precision_;
+    // position of the first one bit in the remaining bits
+    uint8_t rank = rest == 0 ? 64 - precision_ + 1 : __builtin_clzll(rest) + 1;
+    if (rank > registers_[index])
+        registers_[index] = rank;
+}
+
+double HyperLogLog::Estimate() const
+{
+    double m = registers_.size();
+    double sum = 0;
+    uint32_t zeros = 0;
+    for (size_t i = 0; i < registers_.size(); i++) {
+        sum += ldexp(1.0, -registers_[i]);
+        if (registers_[i] == 0)
+            zeros++;
+    }
+    double alpha = 0.7213 / (1 + 1.079 / m);
+    double estimate = alpha * m * m / sum;
+    // linear counting is more accurate for small cardinalities
+    if (estimate <= 2.5 * m && zeros != 0)
+        estimate = m * log(m / zeros);
+    return estimate;
+}
+
+void HyperLogLog::Merge(const HyperLogLog& other)
+{
+    for (size_t i = 0; i < registers_.size() && i < other.registers_.size(); i++)
+        if (other.registers_[i] > registers_[i])
+            registers_[i] = other.registers_[i];
+}
+
+CountMinSketch::CountMinSketch(uint32_t width, uint32_t depth)
+{
+    uint32_t w = 1;
+    while (w < width)
+        w *= 2;
+    mask_ = w - 1;
+    depth_ = depth;
+    counters_.assign((size_t)w * depth, 0);
+}
+
+uint32_t CountMinSketch::Add(uint64_t hash, uint32_t n)
+{
+    // row hashes are h1 + i * h2, two halves of the hash are enough
+    uint32_t h1 = hash, h2 = (hash >> 32) | 1;
+    uint32_t estimate = 0xffffffff;
+    for (uint32_t i = 0; i < depth_; i++) {
+        uint32_t& counter = counters_[(size_t)i * (mask_ + 1) + ((h1 + i * h2) & mask_)];
+        counter += n;
+        if (counter < estimate)
+            estimate = counter;
+    }
+    return estimate;
+}
+
+uint32_t CountMinSketch::Estimate(uint64_t hash) const
+{
+    uint32_t h1 = hash, h2 = (hash >> 32) | 1;
+    uint32_t estimate = 0xffffffff;
+    for (uint32_t i = 0; i < depth_; i++) {
+        uint32_t counter = counters_[(size_t)i * (mask_ + 1) + ((h1 + i * h2) & mask_)];
+        if (counter < estimate)
+            estimate = counter;
+    }
+    return estimate;
+}
+
+void CountMinSketch::Merge(const CountMinSketch& other)
+{
+    for (size_t i = 0; i < counters_.size() && i < other.counters_.size(); i++)
+        counters_[i] += other.counters_[i];
+}
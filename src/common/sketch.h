@@ -0,0 +1,70 @@
+/*
+ * Fixed size sketches over 64-bit hashes for streaming analytics:
+ * HyperLogLog estimates the number of distinct items, CountMinSketch
+ * over-estimates the count of an item. Both merge, so threads can keep
+ * their own sketches and combine them at the end.
+ */
+#ifndef _SKETCH_H_
+#define _SKETCH_H_
+
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+// finalizer of splitmix64, spreads any 64-bit value over all bits
+inline uint64_t MixHash(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+class HyperLogLog {
+public:
+    /*
+     * 2^precision one byte registers, the standard error is 1.04 / sqrt(2^precision)
+     */
+    HyperLogLog(uint32_t precision = 14);
+
+    void Add(uint64_t hash);
+
+    double Estimate() const;
+
+    // merge another sketch of the same precision
+    void Merge(const HyperLogLog& other);
+
+private:
+    uint32_t precision_;
+    vector<uint8_t> registers_;
+};
+
+class CountMinSketch {
+public:
+    /*
+     * depth rows of width counters, width is rounded up to a power of two;
+     * estimates exceed the true count by at most e / width of the total
+     * with probability 1 - exp(-depth)
+     */
+    CountMinSketch(uint32_t width = (1 << 20), uint32_t depth = 4);
+
+    /*
+     * add n to the item and return its new estimate
+     */
+    uint32_t Add(uint64_t hash, uint32_t n = 1);
+
+    uint32_t Estimate(uint64_t hash) const;
+
+    // merge another sketch of the same size
+    void Merge(const CountMinSketch& other);
+
+private:
+    uint32_t mask_;
+    uint32_t depth_;
+    vector<uint32_t> counters_;
+};
+
+#endif // _SKETCH_H_
@@ -1,7 +1,10 @@
+#include <pthread.h>
+#include <string.h>
 #include "timer.h"
 
 Timer::Timer()
 {
+    start_time_ = 0;
     duration_ = 0.0;
     is_running_ = false;
 }
@@ -11,7 +14,7 @@ void Timer::Start()
     if (is_running_)
         return;
     is_running_ = true;
-    gettimeofday(&start_time_, NULL);
+    start_time_ = MonotonicNanos();
 }
 
 double Timer::Stop()
@@ -20,12 +23,7 @@ double Timer::Stop()
         return 0.0;
 
     is_running_ = false;
-    timeval endTime;
-    long seconds, useconds;
-    gettimeofday(&endTime, NULL);
-    seconds  = endTime.tv_sec  - start_time_.tv_sec;
-    useconds = endTime.tv_usec - start_time_.tv_usec;
-    double last_duration = (seconds + useconds/1000000.0) * 1000;
+    double last_duration = (MonotonicNanos() - start_time_) / 1000000.0;
     duration_ += last_duration;
     return last_duration;
 }
@@ -43,41 +41,220 @@ double Timer::GetDuration()
     return duration_;
 }
 
+#ifndef DISABLE_TIMERS
+
+/*
+ * Latency histogram buckets in nanoseconds: values below 4 have their own bucket,
+ * every power of two above is split into 4 linear sub-buckets (<= 12.5% error).
+ */
+#define HISTOGRAM_SUB_BITS 2
+#define HISTOGRAM_BUCKETS (64 << HISTOGRAM_SUB_BITS)
+
+static inline uint32_t BucketOf(uint64_t nanos)
+{
+    if (nanos < (1 << HISTOGRAM_SUB_BITS))
+        return nanos;
+    uint32_t msb = 63 - __builtin_clzll(nanos);
+    uint32_t sub = (nanos >> (msb - HISTOGRAM_SUB_BITS)) & ((1 << HISTOGRAM_SUB_BITS) - 1);
+    return ((msb - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) + sub;
+}
+
+// middle of the value range covered by a bucket
+static inline double BucketValue(uint32_t bucket)
+{
+    if (bucket < (1 << HISTOGRAM_SUB_BITS))
+        return bucket;
+    uint32_t msb = (bucket >> HISTOGRAM_SUB_BITS) + HISTOGRAM_SUB_BITS - 1;
+    uint32_t sub = bucket & ((1 << HISTOGRAM_SUB_BITS) - 1);
+    double width = (double)(1ULL << (msb - HISTOGRAM_SUB_BITS));
+    return ((1 << HISTOGRAM_SUB_BITS) + sub) * width + width / 2;
+}
+
+// state of one timer in one thread
+struct TimerSlot {
+    uint64_t start_;
+    bool running_;
+    uint64_t count_;
+    uint64_t total_;
+    uint64_t max_;
+    uint64_t buckets_[HISTOGRAM_BUCKETS];
+};
+
+// timers of one thread, kept after the thread exits so its time is still reported
+struct ThreadTimers {
+    TimerSlot* slots_[MAX_TIMERS];
+    ThreadTimers* next_;
+};
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static map<string, TimerId> timer_ids;
+static string timer_names[MAX_TIMERS];
+static volatile size_t num_timers = 0;
+static ThreadTimers* all_threads = NULL;
+static __thread ThreadTimers* thread_timers = NULL;
+
+static TimerSlot* GetSlot(TimerId id)
+{
+    if (thread_timers == NULL) {
+        thread_timers = new ThreadTimers();
+        memset(thread_timers->slots_, 0, sizeof(thread_timers->slots_));
+        pthread_mutex_lock(&registry_lock);
+        thread_timers->next_ = all_threads;
+        all_threads = thread_timers;
+        pthread_mutex_unlock(&registry_lock);
+    }
+    TimerSlot* slot = thread_timers->slots_[id];
+    if (slot == NULL) {
+        slot = new TimerSlot();
+        memset(slot, 0, sizeof(TimerSlot));
+        thread_timers->slots_[id] = slot;
+    }
+    return slot;
+}
+
 LoggerPtr TimerPool::logger_ = Logger::getLogger("BigArchive.Timer");
 
-map<string, Timer> TimerPool::timer_map_;
+TimerId TimerPool::Register(const string& timer_name)
+{
+    pthread_mutex_lock(&registry_lock);
+    map<string, TimerId>::iterator it = timer_ids.find(timer_name);
+    if (it != timer_ids.end()) {
+        pthread_mutex_unlock(&registry_lock);
+        return it->second;
+    }
+    TimerId id;
+    if (num_timers < MAX_TIMERS - 1) {
+        id = num_timers;
+        timer_names[id] = timer_name;
+        num_timers = num_timers + 1;
+    }
+    else {
+        // all further timers share the last slot
+        id = MAX_TIMERS - 1;
+        if (num_timers < MAX_TIMERS) {
+            timer_names[id] = "[overflow]";
+            num_timers = MAX_TIMERS;
+            LOG4CXX_ERROR(logger_, "Too many timers, " << timer_name << " and later ones are merged");
+        }
+    }
+    timer_ids[timer_name] = id;
+    pthread_mutex_unlock(&registry_lock);
+    return id;
+}
 
-void TimerPool::Start(const string& timer_name)
+void TimerPool::Start(TimerId id)
 {
-    TimerPool::timer_map_[timer_name].Start();
+    TimerSlot* slot = GetSlot(id);
+    if (slot->running_)
+        return;
+    slot->running_ = true;
+    slot->start_ = MonotonicNanos();
 }
 
-double TimerPool::Stop(string const &timer_name)
+double TimerPool::Stop(TimerId id)
 {
-    return TimerPool::timer_map_[timer_name].Stop();
+    TimerSlot* slot = GetSlot(id);
+    if (!slot->running_)
+        return 0.0;
+    slot->running_ = false;
+    uint64_t duration = MonotonicNanos() - slot->start_;
+    slot->count_++;
+    slot->total_ += duration;
+    if (duration > slot->max_)
+        slot->max_ = duration;
+    slot->buckets_[BucketOf(duration)]++;
+    return duration / 1000000.0;
 }
 
-double TimerPool::Reset(string const &timer_name)
+double TimerPool::Reset(TimerId id)
 {
-    return TimerPool::timer_map_[timer_name].Reset();
+    TimerSlot* slot = GetSlot(id);
+    Stop(id);
+    double old_duration = slot->total_ / 1000000.0;
+    memset(slot, 0, sizeof(TimerSlot));
+    return old_duration;
 }
 
-void TimerPool::Print(const string& timer_name)
+void TimerPool::Print(TimerId id)
 {
-    double last_duration = TimerPool::timer_map_[timer_name].Stop();
-    double total_duration = TimerPool::timer_map_[timer_name].GetDuration();
-    LOG4CXX_INFO(logger_, "Duration of [" << timer_name << "] in ms: " <<
-                 "last " << last_duration << " , total " << total_duration);
+    double last_duration = Stop(id);
+    TimerStats stats = GetStats(id);
+    LOG4CXX_INFO(logger_, "Duration of [" << GetName(id) << "] in ms: " <<
+                 "last " << last_duration << " , total " << stats.total_);
 }
 
 void TimerPool::PrintAll()
 {
-    map<string, Timer>::iterator it;
-    double duration;
-    for (it = timer_map_.begin(); it != timer_map_.end(); it++) {
-        it->second.Stop();
-        duration = it->second.GetDuration();
-        LOG4CXX_INFO(logger_, "Total duration of ["<< it->first <<
-                     "] in ms: " << duration);
+    for (TimerId id = 0; id < GetNumTimers(); id++) {
+        Stop(id);
+        TimerStats stats = GetStats(id);
+        if (stats.count_ == 0)
+            continue;
+        LOG4CXX_INFO(logger_, "Total duration of ["<< GetName(id) <<
+                     "] in ms: " << stats.total_ << " , count " << stats.count_ <<
+                     " , p50 " << stats.p50_ << " , p99 " << stats.p99_ << " , max " << stats.max_);
     }
 }
+
+size_t TimerPool::GetNumTimers()
+{
+    return num_timers;
+}
+
+string TimerPool::GetName(TimerId id)
+{
+    pthread_mutex_lock(&registry_lock);
+    string name = id < num_timers ? timer_names[id] : "";
+    pthread_mutex_unlock(&registry_lock);
+    return name;
+}
+
+/*
+ * counters of running threads are read without locking,
+ * so the result is exact only once they stopped the timer
+ */
+TimerStats TimerPool::GetStats(TimerId id)
+{
+    TimerStats stats = {0, 0.0, 0.0, 0.0, 0.0};
+    uint64_t total = 0, max = 0;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+    memset(buckets, 0, sizeof(buckets));
+
+    pthread_mutex_lock(&registry_lock);
+    for (ThreadTimers* tt = all_threads; tt != NULL; tt = tt->next_) {
+        TimerSlot* slot = tt->slots_[id];
+        if (slot == NULL)
+            continue;
+        stats.count_ += slot->count_;
+        total += slot->total_;
+        if (slot->max_ > max)
+            max = slot->max_;
+        for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+            buckets[i] += slot->buckets_[i];
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    if (stats.count_ == 0)
+        return stats;
+    stats.total_ = total / 1000000.0;
+    stats.max_ = max / 1000000.0;
+
+    uint64_t p50_rank = (stats.count_ + 1) / 2;
+    uint64_t p99_rank = stats.count_ - stats.count_ / 100;
+    uint64_t seen = 0;
+    bool p50_found = false;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += buckets[i];
+        if (!p50_found && seen >= p50_rank) {
+            stats.p50_ = min(BucketValue(i), (double)max) / 1000000.0;
+            p50_found = true;
+        }
+        if (seen >= p99_rank) {
+            stats.p99_ = min(BucketValue(i), (double)max) / 1000000.0;
+            break;
+        }
+    }
+    return stats;
+}
+
+#endif	// DISABLE_TIMERS
@@ -2,8 +2,10 @@
 #define _TIMER_H_
 
 #include <stdlib.h>
-#include <sys/time.h>
+#include <stdint.h>
+#include <time.h>
 #include <map>
+#include <string>
 #include <log4cxx/logger.h>
 #include <log4cxx/xml/domconfigurator.h>
 
@@ -12,9 +14,17 @@ using namespace log4cxx;
 using namespace log4cxx::xml;
 using namespace log4cxx::helpers;
 
+// monotonic clock in nanoseconds
+inline uint64_t MonotonicNanos()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 class Timer {
 private:
-    timeval start_time_;
+    uint64_t start_time_;	// in nanoseconds
     double duration_;	 // in milliseconds
     bool is_running_;
 
@@ -33,50 +43,81 @@ public:
     double GetDuration();
 };
 
+typedef uint32_t TimerId;
+
+// aggregated statistics of a named timer over all threads, durations in ms
+struct TimerStats {
+    uint64_t count_;
+    double total_;
+    double p50_;
+    double p99_;
+    double max_;
+};
+
+/*
+ * Named timers are registered once and then addressed by TimerId, so the
+ * hot path is a thread local array lookup without locks or string building.
+ * Every thread accumulates its own totals and latency histogram, which are
+ * merged when printed; threads may start and stop the same timer concurrently.
+ * Build with -DDISABLE_TIMERS (scons timers=off) to compile timers out.
+ */
+#ifndef DISABLE_TIMERS
+
+#define MAX_TIMERS 256		// max number of distinct timer names in a process
 
 class TimerPool {
 private:
-    static map<string, Timer> timer_map_;
     static LoggerPtr logger_;
 
 public:
-    static void Start(const string& timer_name);
+    // get the id of a timer, registering it on the first call
+    static TimerId Register(const string& timer_name);
 
-    static double Stop(const string& timer_name);
+    static void Start(TimerId id);
+    static double Stop(TimerId id);
+    static double Reset(TimerId id);
+    static void Print(TimerId id);
 
-    static double Reset(const string& time_name);
+    static void Start(const string& timer_name) { Start(Register(timer_name)); }
+
+    static double Stop(const string& timer_name) { return Stop(Register(timer_name)); }
+
+    // reset timer of the calling thread
+    static double Reset(const string& time_name) { return Reset(Register(time_name)); }
 
     // stop the timer, print the last duration and total duration
-    static void Print(const string& timer_name);
-    
+    static void Print(const string& timer_name) { Print(Register(timer_name)); }
+
     static void PrintAll();
+
+    // registered timers and their statistics merged over threads
+    static size_t GetNumTimers();
+    static string GetName(TimerId id);
+    static TimerStats GetStats(TimerId id);
 };
 
 // At most of the time we only need to measure the time within a single function,
 // so we define the following local timer interface. If one want to start/stop timer
 // at different functions, he can use TimerPool directly.
+#define TIMER_NAME_ID(name)	\
+    static const TimerId timer_id = TimerPool::Register(string(__FILE__) + "::" + (name))
+
 #define TIMER_START()	\
     do {	\
-    	string timer_name = __FILE__;	\
-        timer_name += "::";	\
-    	timer_name += __PRETTY_FUNCTION__;    \
-    	TimerPool::Start(timer_name);               \
+        TIMER_NAME_ID(__PRETTY_FUNCTION__);	\
+    	TimerPool::Start(timer_id);	\
     } while (0)
 
 #define TIMER_STOP()	\
     do {	\
-    	string timer_name = __FILE__;	\
-        timer_name += "::";	\
-    	timer_name += __PRETTY_FUNCTION__;    \
-        TimerPool::Stop(timer_name);	\
+        TIMER_NAME_ID(__PRETTY_FUNCTION__);	\
+        TimerPool::Stop(timer_id);	\
     } while (0)
 
 #define TIMER_PRINT()	\
     do {	\
-    	string timer_name = __FILE__;	\
-        timer_name += "::";	\
-    	timer_name += __PRETTY_FUNCTION__;    \
-    	TimerPool::Print(timer_name);	\
+        TIMER_NAME_ID(__PRETTY_FUNCTION__);	\
+    	TimerPool::Print(timer_id);	\
     } while (0)
 
 #define TIMER_PRINT_ALL()	\
@@ -86,22 +127,46 @@ public:
 
 #define MEASURE(statement)	\
     do {	\
-    	string timer_name = __FILE__;	\
-        timer_name += "::";	\
-    	timer_name += #statement;	\
-        TimerPool::Start(timer_name);	\
+        TIMER_NAME_ID(#statement);	\
+        TimerPool::Start(timer_id);	\
         statement;	\
-        TimerPool::Stop(timer_name);	\
+        TimerPool::Stop(timer_id);	\
     } while (0)
-        
+
 #define MEASURE_AND_PRINT(statement)	\
     do {	\
-    	string timer_name = __FILE__;	\
-        timer_name += "::";	\
-    	timer_name += #statement;	\
-        TimerPool::Start(timer_name);	\
+        TIMER_NAME_ID(#statement);	\
+        TimerPool::Start(timer_id);	\
         statement;	\
-        TimerPool::Print(timer_name);	\
+        TimerPool::Print(timer_id);	\
     } while (0)
 
+#else	// DISABLE_TIMERS
+
+class TimerPool {
+public:
+    static TimerId Register(const string&) { return 0; }
+    static void Start(TimerId) {}
+    static double Stop(TimerId) { return 0.0; }
+    static double Reset(TimerId) { return 0.0; }
+    static void Print(TimerId) {}
+    static void Start(const string&) {}
+    static double Stop(const string&) { return 0.0; }
+    static double Reset(const string&) { return 0.0; }
+    static void Print(const string&) {}
+    static void PrintAll() {}
+    static size_t GetNumTimers() { return 0; }
+    static string GetName(TimerId) { return ""; }
+    static TimerStats GetStats(TimerId) { TimerStats s = {0, 0.0, 0.0, 0.0, 0.0}; return s; }
+};
+
+#define TIMER_START()	do {} while (0)
+#define TIMER_STOP()	do {} while (0)
+#define TIMER_PRINT()	do {} while (0)
+#define TIMER_PRINT_ALL()	do {} while (0)
+#define MEASURE(statement)	do { statement; } while (0)
+#define MEASURE_AND_PRINT(statement)	do { statement; } while (0)
+
+#endif	// DISABLE_TIMERS
+
 #endif	// _TIMER_H_
@@ -0,0 +1,65 @@
+#include "framed_record_reader.h"
+#include "qfs_file_helper.h"    // for Header
+
+LoggerPtr FramedRecordReader::logger_ = Logger::getLogger("BigArchive.FramedRecordReader");
+
+FramedRecordReader::FramedRecordReader(FileHelper* fh, uint64_t length, size_t buffer_size)
+    : fh_(fh), remaining_(length), buffer_(buffer_size), pos_(0), end_(0), consumed_(0)
+{
+}
+
+bool FramedRecordReader::Fill(size_t need)
+{
+    if (end_ - pos_ >= need)
+        return true;
+    // keep the partial frame and make room after it
+    if (pos_ > 0) {
+        memmove(&buffer_[0], &buffer_[pos_], end_ - pos_);
+        end_ -= pos_;
+        pos_ = 0;
+    }
+    if (buffer_.size() < need)
+        buffer_.resize(need);
+    while (end_ < need && remaining_ > 0) {
+        size_t want = buffer_.size() - end_;
+        if (want > remaining_)
+            want = remaining_;
+        int n = fh_->Read(&buffer_[end_], want);
+        if (n <= 0) {
+            remaining_ = 0;
+            break;
+        }
+        end_ += n;
+        remaining_ -= n;
+    }
+    return end_ - pos_ >= need;
+}
+
+bool FramedRecordReader::Next(const char** data, uint32_t* length)
+{
+    if (!Fill(sizeof(Header)))
+        return false;
+    Header header(0);
+    memcpy(&header, &buffer_[pos_], sizeof(Header));
+    if (header.data_length == 0)
+        return false;
+    if (!Fill(sizeof(Header) + header.data_length)) {
+        LOG4CXX_WARN(logger_, "Truncated record of " << header.data_length << " bytes at the end of log");
+        return false;
+    }
+    *data = &buffer_[pos_ + sizeof(Header)];
+    *length = header.data_length;
+    pos_ += sizeof(Header) + header.data_length;
+    consumed_ += sizeof(Header) + header.data_length;
+    return true;
+}
+
+bool FramedRecordReader::Next(std::string* record)
+{
+    const char* data;
+    uint32_t length;
+    if (!Next(&data, &length))
+        return false;
+    record->assign(data, length);
+    return true;
+}
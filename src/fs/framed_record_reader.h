@@ -0,0 +1,50 @@
+/*
+ * reads the length framed records written by FileHelper::Write/Flush in big
+ * chunks and hands them out in place, instead of one GetNextLogSize and one
+ * Read call per record
+ */
+#ifndef FRAMED_RECORD_READER_H
+#define FRAMED_RECORD_READER_H
+
+#include <string>
+#include <vector>
+#include "../include/file_helper.h"
+
+/* bytes read from the file at once */
+const size_t FRAMED_READ_BUFFER_SIZE = 1024 * 1024;
+
+class FramedRecordReader {
+public:
+    /*
+     * read the records from the current position of fh, up to length bytes
+     * or the end of file; fh stays owned by the caller
+     */
+    FramedRecordReader(FileHelper* fh, uint64_t length = (uint64_t)-1,
+                       size_t buffer_size = FRAMED_READ_BUFFER_SIZE);
+
+    /*
+     * the next record, the view is valid until the next call,
+     * false at the end of the log or on a zero length or truncated frame
+     */
+    bool Next(const char** data, uint32_t* length);
+
+    /* the next record copied into record */
+    bool Next(std::string* record);
+
+    /* bytes of the records returned so far, frames included */
+    uint64_t GetConsumed() const { return consumed_; }
+
+private:
+    /* make sure need bytes are buffered, false if the file ends before */
+    bool Fill(size_t need);
+
+    FileHelper* fh_;
+    uint64_t remaining_;
+    std::vector<char> buffer_;
+    size_t pos_;
+    size_t end_;
+    uint64_t consumed_;
+    static LoggerPtr logger_;
+};
+
+#endif /* FRAMED_RECORD_READER_H */
@@ -0,0 +1,35 @@
+#include "framed_record_writer.h"
+#include "qfs_file_helper.h"    // for Header
+#include "../common/timer.h"
+
+FramedRecordWriter::FramedRecordWriter(FileHelper* fh, size_t max_bytes, uint32_t max_delay_ms)
+    : fh_(fh), max_bytes_(max_bytes), max_delay_ns_(max_delay_ms * 1000000ull),
+      first_append_ns_(0), unsynced_(false)
+{
+}
+
+bool FramedRecordWriter::Append(const char* data, uint32_t length)
+{
+    if (buffer_.empty())
+        first_append_ns_ = MonotonicNanos();
+    Header header(length);
+    buffer_.append((const char*)&header, sizeof(Header));
+    buffer_.append(data, length);
+    return buffer_.size() >= max_bytes_ || MonotonicNanos() - first_append_ns_ >= max_delay_ns_;
+}
+
+void FramedRecordWriter::Flush(bool sync)
+{
+    if (!buffer_.empty()) {
+        if (sync)
+            fh_->FlushData(&buffer_[0], buffer_.size());
+        else
+            fh_->WriteData(&buffer_[0], buffer_.size());
+        buffer_.clear();
+        unsynced_ = !sync;
+    }
+    else if (sync && unsynced_) {
+        fh_->Sync();
+        unsynced_ = false;
+    }
+}
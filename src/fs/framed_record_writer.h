@@ -0,0 +1,52 @@
+/*
+ * group commit for logs of length framed records (index files, delete logs):
+ * records are framed like FileHelper::Write does and collected in memory,
+ * then written with one WriteData call
+ */
+#ifndef FRAMED_RECORD_WRITER_H
+#define FRAMED_RECORD_WRITER_H
+
+#include <string>
+#include "../include/file_helper.h"
+
+/* a buffer is due once it holds this many bytes ... */
+const size_t FRAMED_WRITE_BUFFER_SIZE = 64 * 1024;
+/* ... or its oldest record is this old */
+const uint32_t FRAMED_WRITE_MAX_DELAY_MS = 1000;
+
+class FramedRecordWriter {
+public:
+    /*
+     * write to the current position of fh, which stays owned by the caller
+     */
+    FramedRecordWriter(FileHelper* fh, size_t max_bytes = FRAMED_WRITE_BUFFER_SIZE,
+                       uint32_t max_delay_ms = FRAMED_WRITE_MAX_DELAY_MS);
+
+    /*
+     * buffer a record, return true if the buffer is due to be flushed;
+     * nothing is written here so the caller decides how to handle write errors
+     */
+    bool Append(const char* data, uint32_t length);
+
+    /*
+     * write out the buffered records with one I/O, and make everything
+     * written so far durable if sync is set; the records stay buffered
+     * if the write throws
+     */
+    void Flush(bool sync = false);
+
+    size_t GetPendingBytes() const { return buffer_.size(); }
+
+    /* write to another file helper from now on, e.g. after reopening the file */
+    void SetFileHelper(FileHelper* fh) { fh_ = fh; }
+
+private:
+    FileHelper* fh_;
+    std::string buffer_;
+    size_t max_bytes_;
+    uint64_t max_delay_ns_;
+    uint64_t first_append_ns_;
+    bool unsynced_;
+};
+
+#endif /* FRAMED_RECORD_WRITER_H */
@@ -0,0 +1,202 @@
+#include <cerrno>
+#include <log4cxx/logger.h>
+#include "local_file_helper.h"
+#include "qfs_file_helper.h"    // for Header
+
+using namespace log4cxx;
+
+/**
+   File helper on the local file system, with the same record format as QFSFileHelper
+*/
+LocalFileHelper::LocalFileHelper(LocalFSHelper *fshelper, string fname, int mode, FileAccessPattern access)
+{
+    this->fshelper = fshelper;
+    this->filename = fname;
+    this->local_path = fshelper->LocalPath(fname);
+    this->mode = mode;
+    this->access = access;
+    this->fd = -1;
+}
+
+LocalFileHelper::~LocalFileHelper()
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+void LocalFileHelper::Create()
+{
+    if (fd >= 0)
+        close(fd);
+    fd = open(local_path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd < 0) {
+        LOG4CXX_ERROR(logger_, "File Creation failed : " << filename << " :" << strerror(errno));
+        THROW_EXCEPTION(FileCreationException, "Failed while creating file : " + filename);
+    }
+}
+
+/**
+   Opens file on specified mode, O_APPEND opens for write at the end of file
+   like QFSFileHelper does
+*/
+void LocalFileHelper::Open()
+{
+    if (fd >= 0)
+        close(fd);
+    int flags = mode & (O_RDONLY | O_WRONLY | O_RDWR | O_APPEND);
+    if ((flags & O_APPEND) != 0)
+        flags = (flags & ~O_APPEND) | O_WRONLY;
+    if ((flags & (O_WRONLY | O_RDWR)) != 0)
+        flags |= O_CREAT;
+    fd = open(local_path.c_str(), flags, 0644);
+    if (fd < 0) {
+        LOG4CXX_ERROR(logger_, "Failed while opening file : " << filename << ", ERROR :" << strerror(errno));
+        THROW_EXCEPTION(FileOpenException, "Failed while opening file : " + filename);
+    }
+    if ((mode & O_APPEND) != 0)
+        lseek(fd, 0, SEEK_END);
+    if (access == ACCESS_SEQUENTIAL)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    else if (access == ACCESS_RANDOM)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+}
+
+void LocalFileHelper::Close()
+{
+    if (fd < 0) {
+        LOG4CXX_WARN(logger_, "file is not opened: " << filename);
+        return;
+    }
+    close(fd);
+    fd = -1;
+}
+
+int LocalFileHelper::Read(char *buffer, size_t length)
+{
+    if (fd == -1)
+        Open();
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = read(fd, buffer + done, length - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            LOG4CXX_ERROR(logger_, "Failed while reading from file(" << filename << ") - ERROR : " << strerror(errno));
+            THROW_EXCEPTION(AppendStoreReadException, "Failed while reading file(" + filename + ")");
+        }
+        if (n == 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+int LocalFileHelper::PRead(uint64_t offset, char *buffer, size_t length)
+{
+    if (fd == -1) {
+        LOG4CXX_ERROR(logger_, "PRead on file(" << filename << ") that is not opened");
+        THROW_EXCEPTION(FileOpenException, "PRead on a file that is not opened : " + filename);
+    }
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pread(fd, buffer + done, length - done, offset + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            LOG4CXX_ERROR(logger_, "Failed while reading from file(" << filename << ") - ERROR : " << strerror(errno));
+            THROW_EXCEPTION(AppendStoreReadException, "Failed while reading file(" + filename + ")");
+        }
+        if (n == 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+void LocalFileHelper::WriteFully(const char *buffer, size_t length)
+{
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = write(fd, buffer + done, length - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            LOG4CXX_ERROR(logger_, "Was able to write only " << done << " bytes , instead of " << length);
+            THROW_EXCEPTION(AppendStoreWriteException, "Failed while writing file(" + filename + ")");
+        }
+        done += n;
+    }
+}
+
+int LocalFileHelper::Write(char *buffer, size_t length)
+{
+    if (fd == -1)
+        Open();
+    Header header(length);
+    WriteFully((char*)&header, sizeof(Header));
+    WriteFully(buffer, length);
+    return lseek(fd, 0, SEEK_CUR);
+}
+
+int LocalFileHelper::WriteData(char *buffer, size_t length)
+{
+    if (fd == -1)
+        Open();
+    WriteFully(buffer, length);
+    return length;
+}
+
+int LocalFileHelper::Flush(char *buffer, size_t length)
+{
+    int pos = Write(buffer, length);
+    fdatasync(fd);
+    return pos;
+}
+
+int LocalFileHelper::FlushData(char *buffer, size_t length)
+{
+    int bytes_wrote = WriteData(buffer, length);
+    fdatasync(fd);
+    return bytes_wrote;
+}
+
+void LocalFileHelper::Sync()
+{
+    if (fd >= 0)
+        fdatasync(fd);
+}
+
+int LocalFileHelper::Append(char *buffer, int length)
+{
+    if (fd == -1)
+        Open();
+    lseek(fd, 0, SEEK_END);
+    Write(buffer, length);
+    return length + sizeof(Header);
+}
+
+void LocalFileHelper::Seek(uint64_t offset)
+{
+    if (fd == -1)
+        Open();
+    lseek(fd, offset, SEEK_SET);
+}
+
+uint32_t LocalFileHelper::GetNextLogSize()
+{
+    Header header(0);
+    if (Read((char*)&header, sizeof(Header)) != sizeof(Header))
+        return 0;
+    return header.data_length;
+}
+
+/**
+   Prefetch only hints the page cache, the next Read does the actual read
+*/
+int LocalFileHelper::ReadPrefetch(char *buffer, size_t length)
+{
+    if (fd == -1)
+        Open();
+    off_t pos = lseek(fd, 0, SEEK_CUR);
+    return posix_fadvise(fd, pos, length, POSIX_FADV_WILLNEED) == 0 ? 0 : -1;
+}
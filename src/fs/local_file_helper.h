@@ -0,0 +1,35 @@
+#ifndef LOCAL_FILE_HELPER_H
+#define LOCAL_FILE_HELPER_H
+
+#include "../include/file_helper.h"
+#include "../include/exception.h"
+#include "local_file_system_helper.h"
+#include <cstring>
+
+class LocalFileHelper : public FileHelper {
+public:
+    LocalFileHelper(LocalFSHelper *fshelper, string fname, int mode, FileAccessPattern access = ACCESS_DEFAULT);
+    ~LocalFileHelper();
+    void Create();
+    void Open();
+    void Close();
+    int Read(char *buffer, size_t length);
+    int Write(char *buffer, size_t length);
+    int WriteData(char *buffer, size_t length);
+    int Flush(char *buffer, size_t length);
+    int FlushData(char *buffer, size_t length);
+    void Sync();
+    int Append(char *buffer, int length);
+    void Seek(uint64_t offset);
+    uint32_t GetNextLogSize();
+    int PRead(uint64_t offset, char *buffer, size_t length);
+    int ReadPrefetch(char *buffer, size_t length);
+private:
+    /* write all of buffer at the current position */
+    void WriteFully(const char *buffer, size_t length);
+
+    LocalFSHelper *fshelper;
+    string local_path;
+};
+
+#endif
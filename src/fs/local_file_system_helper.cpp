@@ -0,0 +1,136 @@
+#include <cerrno>
+#include <cstdio>
+#include <sys/stat.h>
+#include <log4cxx/logger.h>
+#include "local_file_system_helper.h"
+#include "local_file_helper.h"
+
+using namespace log4cxx;
+
+LocalFSHelper::LocalFSHelper(const string& root_dir)
+    : root_dir_(root_dir)
+{
+    while (root_dir_.size() > 1 && root_dir_[root_dir_.size() - 1] == '/')
+        root_dir_.erase(root_dir_.size() - 1);
+}
+
+LocalFSHelper::~LocalFSHelper()
+{
+}
+
+void LocalFSHelper::Connect(const string& root_dir)
+{
+    if (p_instance_ != NULL) {
+        LOG4CXX_WARN(logger_, "File system helper is already initialized");
+        return;
+    }
+    LocalFSHelper* p_local_helper = new LocalFSHelper(root_dir);
+    p_local_helper->CreateDirectory("/");
+    LOG4CXX_INFO(logger_, "Using local file system at " << root_dir);
+    p_instance_ = p_local_helper;
+}
+
+string LocalFSHelper::LocalPath(const string& pathname) const
+{
+    if (!pathname.empty() && pathname[0] == '/')
+        return root_dir_ + pathname;
+    return root_dir_ + "/" + pathname;
+}
+
+FileHelper* LocalFSHelper::CreateFileHelper(string fname, int mode, FileAccessPattern access)
+{
+    return new LocalFileHelper(this, fname, mode, access);
+}
+
+void LocalFSHelper::DestroyFileHelper(FileHelper* p_fh)
+{
+    delete p_fh;
+}
+
+bool LocalFSHelper::IsFileExists(string fname)
+{
+    struct stat st;
+    return stat(LocalPath(fname).c_str(), &st) == 0;
+}
+
+bool LocalFSHelper::IsDirectoryExists(string dirname)
+{
+    struct stat st;
+    return stat(LocalPath(dirname).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+long LocalFSHelper::GetSize(string fname)
+{
+    struct stat st;
+    if (stat(LocalPath(fname).c_str(), &st) != 0)
+        return 0;
+    return st.st_size;
+}
+
+int LocalFSHelper::ListDir(string pathname, vector<string> &result)
+{
+    DIR* dir = opendir(LocalPath(pathname).c_str());
+    if (dir == NULL)
+        return -errno;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL)
+        result.push_back(entry->d_name);
+    closedir(dir);
+    return 0;
+}
+
+int LocalFSHelper::CreateDirectory(const string& pathname)
+{
+    // mkdir -p
+    string local_path = LocalPath(pathname);
+    for (size_t pos = 1; pos != string::npos; ) {
+        pos = local_path.find('/', pos + 1);
+        string dir = local_path.substr(0, pos);
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            LOG4CXX_ERROR(logger_, "Directory Creation failed : " << pathname << " :" << strerror(errno));
+            THROW_EXCEPTION(FileCreationException, "Failure in directory Creation : " + pathname);
+        }
+    }
+    return 0;
+}
+
+int LocalFSHelper::CreateFile(const string& pathname)
+{
+    int fd = open(LocalPath(pathname).c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) {
+        LOG4CXX_ERROR(logger_, "File Creation failed : " << pathname << " :" << strerror(errno));
+        THROW_EXCEPTION(FileCreationException, "Failed while creating file : " + pathname);
+    }
+    close(fd);
+    return 0;
+}
+
+int LocalFSHelper::RemoveFile(const string& pathname)
+{
+    if (unlink(LocalPath(pathname).c_str()) != 0) {
+        LOG4CXX_ERROR(logger_, "file deletion failed : " << pathname << " :" << strerror(errno));
+        THROW_EXCEPTION(FileDeletionException, "Failed while deleting file : " + pathname);
+    }
+    return 0;
+}
+
+int LocalFSHelper::RemoveDirectory(const string& dirname)
+{
+    // rm -r
+    vector<string> entries;
+    ListDir(dirname, entries);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i] == "." || entries[i] == "..")
+            continue;
+        string child = dirname + "/" + entries[i];
+        if (IsDirectoryExists(child))
+            RemoveDirectory(child);
+        else
+            RemoveFile(child);
+    }
+    if (rmdir(LocalPath(dirname).c_str()) != 0) {
+        LOG4CXX_ERROR(logger_, "directory deletion failed : " << dirname << " :" << strerror(errno));
+        THROW_EXCEPTION(DirectoryDeletionException, "Failed while deleting directory : " + dirname);
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * File system helper on the local file system, all pathnames are
+ * relative to a root directory, so the same code runs with or without QFS
+ */
+#ifndef LOCAL_FILESYSTEM_HELPER_H
+#define LOCAL_FILESYSTEM_HELPER_H
+
+#include <vector>
+#include <string>
+#include "../include/file_system_helper.h"
+#include "../include/file_helper.h"
+#include "../include/exception.h"
+
+using std::string;
+
+class LocalFileHelper;
+
+class LocalFSHelper : public FileSystemHelper {
+
+public:
+    /*
+     *  Create the single instance of file system helper rooted at root_dir,
+     *  shall be called at the beginning of main program instead of QFSHelper::Connect()
+     */
+    static void Connect(const string& root_dir);
+    /* override */ FileHelper* CreateFileHelper(string fname, int mode, FileAccessPattern access = ACCESS_DEFAULT);
+    /* override */ void DestroyFileHelper(FileHelper* p_fh);
+    /* override */ bool IsFileExists(string fname);
+    /* override */ bool IsDirectoryExists(string dirname);
+    /* override */ long GetSize(string fname);
+    /* override */ int ListDir(string pathname, vector<string> &result);
+    /* override */ int CreateDirectory(const string& pathname);
+    /* override */ int CreateFile(const string& pathname);
+    /* override */ int RemoveFile(const string& pathname);
+    /* override */ int RemoveDirectory(const string& dirname);
+    /* map a file system pathname to the local pathname */
+    string LocalPath(const string& pathname) const;
+protected:
+    LocalFSHelper(const string& root_dir);
+    ~LocalFSHelper();
+private:
+    string root_dir_;
+};
+
+#endif
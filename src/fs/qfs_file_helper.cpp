@@ -1,4 +1,6 @@
 #include "qfs_file_helper.h"
+#include "../common/metrics.h"
+#include "../common/timer.h"
 
 #include <iostream>
 #include <log4cxx/logger.h>
@@ -9,17 +11,32 @@ using namespace log4cxx::xml;
 using namespace log4cxx::helpers;
 
 //LoggerPtr logger_(Logger::getLogger( "appendstore.qfs_helper"));
+static MetricCounter* read_ops = Metrics::Counter("bigarchive_fs_read_ops_total", "Read calls to the file system");
+static MetricCounter* read_bytes = Metrics::Counter("bigarchive_fs_read_bytes_total", "Bytes read from the file system");
+static MetricHistogram* read_latency = Metrics::Histogram("bigarchive_fs_read_latency_us", "Latency of file system reads in microseconds");
+static MetricCounter* write_ops = Metrics::Counter("bigarchive_fs_write_ops_total", "Write and append calls to the file system");
+static MetricCounter* write_bytes = Metrics::Counter("bigarchive_fs_write_bytes_total", "Bytes written to the file system");
+static MetricHistogram* write_latency = Metrics::Histogram("bigarchive_fs_write_latency_us", "Latency of file system writes in microseconds");
+static MetricCounter* sync_ops = Metrics::Counter("bigarchive_fs_sync_ops_total", "Sync calls to the file system");
+static MetricCounter* prefetch_ops = Metrics::Counter("bigarchive_fs_prefetch_ops_total", "Read prefetches issued to the file system");
+static MetricHistogram* write_wait_latency = Metrics::Histogram("bigarchive_fs_write_wait_latency_us", "Time spent waiting for queued writes in microseconds");
+
 //Karim: Each QFSFileHelper object has a QFSHelper object, a filename, mode, and a file descriptor associated with it.
 
 /**
    Consturctor for File Helper, performs file related opereations
 */
-QFSFileHelper::QFSFileHelper(QFSHelper *qfshelper, string fname, int mode) {
+QFSFileHelper::QFSFileHelper(QFSHelper *qfshelper, string fname, int mode, FileAccessPattern access) {
     //DOMConfigurator::configure("Log4cxxConfig.xml");
     this->qfshelper = qfshelper;
     this->filename = fname;
     this->mode = mode;
+    this->access = access;
     this->fd = -1;
+    this->pending_bytes = 0;
+    this->prefetch_buffer = NULL;
+    this->prefetch_length = 0;
+    this->prefetch_pos = 0;
     LOG4CXX_DEBUG(logger_, "File helper created : " << fname );
 }
 
@@ -65,6 +82,8 @@ void QFSFileHelper::Open()
         THROW_EXCEPTION(FileOpenException, "Failed while opening file : " + filename + " ERROR : " + KFS::ErrorCodeToStr(fd));
     }
 
+    set_buffer_sizes();
+
     /* Seeking to the last */
     if(append) {
         LOG4CXX_DEBUG(logger_, "open under append mode: " << filename);
@@ -82,7 +101,11 @@ void QFSFileHelper::Close()
         LOG4CXX_WARN(logger_, "file is not opened: " << filename); 
     }
     else {
+        if(prefetch_buffer != NULL) {
+            CompletePrefetch();
+        }
         if((mode & O_WRONLY) != 0) {
+            WaitForWrites();
             qfshelper->kfsClient->Sync(fd);
         }
         qfshelper->kfsClient->Close(fd);
@@ -98,8 +121,20 @@ int QFSFileHelper::Read(char *buffer, size_t length) {
     }
     LOG4CXX_DEBUG(logger_, "Trying to read " << length << " bytes from file(" << filename << ") at " << qfshelper->kfsClient->Tell(fd));
 
+    /* a read of the prefetched range into the prefetch buffer completes the prefetch */
+    if (prefetch_buffer != NULL) {
+        if (prefetch_buffer != buffer || prefetch_length != length
+            || prefetch_pos != (uint64_t)qfshelper->kfsClient->Tell(fd)) {
+            CompletePrefetch();
+        }
+        prefetch_buffer = NULL;
+    }
+
     //Karim: If file already open then read "length" bytes and put them in buffer
+    uint64_t start = MonotonicNanos();
     size_t bytes_read = qfshelper->kfsClient->Read(fd, buffer, length);
+    read_latency->Observe((MonotonicNanos() - start) / 1000);
+    read_ops->Inc();
 
     if (bytes_read != length) {
         if (bytes_read < 0) {
@@ -110,10 +145,40 @@ int QFSFileHelper::Read(char *buffer, size_t length) {
             LOG4CXX_ERROR(logger_, "Less number of bytes read from file than specified");
         }
     }
+    read_bytes->Inc(bytes_read);
 
     return bytes_read;	
 }
 
+/**
+ * PRead - reads at offset and leaves the file position alone, the file must
+ * be opened. KfsClient::PRead does not use the file pointer, so an outstanding
+ * prefetch is left for the Read that completes it
+ */
+int QFSFileHelper::PRead(uint64_t offset, char *buffer, size_t length) {
+    if (fd == -1) {
+        LOG4CXX_ERROR(logger_, "PRead on file(" << filename << ") that is not opened");
+        THROW_EXCEPTION(FileOpenException, "PRead on a file that is not opened : " + filename);
+    }
+    LOG4CXX_DEBUG(logger_, "Trying to pread " << length << " bytes from file(" << filename << ") at " << offset);
+
+    uint64_t start = MonotonicNanos();
+    ssize_t bytes_read = qfshelper->kfsClient->PRead(fd, offset, buffer, length);
+    read_latency->Observe((MonotonicNanos() - start) / 1000);
+    read_ops->Inc();
+
+    if (bytes_read < 0) {
+        LOG4CXX_ERROR(logger_, "Failed while reading from file(" << filename << ") - ERROR : " << KFS::ErrorCodeToStr(bytes_read));
+        THROW_EXCEPTION(AppendStoreReadException, "Failed while reading file(" + filename + ") - ERROR : " + KFS::ErrorCodeToStr(bytes_read));
+    }
+    if ((size_t)bytes_read != length) {
+        LOG4CXX_ERROR(logger_, "Less number of bytes read from file than specified");
+    }
+    read_bytes->Inc(bytes_read);
+
+    return bytes_read;
+}
+
 /**
  * Write and Flush - returns the current write position (got by calling Tell)
  * WriteData and FlushData - returns the number of bytes wrote
@@ -124,6 +189,7 @@ int QFSFileHelper::Write(char *buffer, size_t length) {
     if(fd == -1) {	
         LOG4CXX_ERROR(logger_, "file not opened :" << filename);
     }
+    WaitForWrites();
 
     Header header(length);
     int dataLength = length + sizeof(Header);    
@@ -132,7 +198,10 @@ int QFSFileHelper::Write(char *buffer, size_t length) {
     memcpy(&data[0], &header, sizeof(Header));
     memcpy(&data[sizeof(Header)], buffer, length);
 
+    uint64_t start = MonotonicNanos();
     int bytes_wrote = qfshelper->kfsClient->Write(fd, data.c_str(), dataLength);
+    write_latency->Observe((MonotonicNanos() - start) / 1000);
+    write_ops->Inc();
 
     if( bytes_wrote != dataLength) {
         string bytes_wrote_str = "" + bytes_wrote;
@@ -141,6 +210,7 @@ int QFSFileHelper::Write(char *buffer, size_t length) {
         THROW_EXCEPTION(AppendStoreWriteException,  "Was able to write only " + bytes_wrote_str + ", instead of " + length_str);
     }
 
+    write_bytes->Inc(dataLength);
     LOG4CXX_DEBUG(logger_, "Wrote " << length << " bytes into file(" << filename << ")");    
     return qfshelper->kfsClient->Tell(fd);
     // return x;
@@ -154,7 +224,10 @@ int QFSFileHelper::Append(char *buffer, size_t length) {
     memcpy(&data[0], &header, sizeof(Header));
     memcpy(&data[sizeof(Header)], buffer, length);
 
+    uint64_t start = MonotonicNanos();
     int bytes_wrote = qfshelper->kfsClient->AtomicRecordAppend(fd, data.c_str(), dataLength);
+    write_latency->Observe((MonotonicNanos() - start) / 1000);
+    write_ops->Inc();
 
 
     if( bytes_wrote != dataLength) {
@@ -165,6 +238,7 @@ int QFSFileHelper::Append(char *buffer, size_t length) {
         THROW_EXCEPTION(AppendStoreWriteException,  "Was able to append only " + bytes_wrote_str + ", instead of " + length_str);
     }
 
+    write_bytes->Inc(dataLength);
     LOG4CXX_DEBUG(logger_, "Append " << length << " bytes into file(" << filename << ")");    
 
     return bytes_wrote;
@@ -175,8 +249,12 @@ int QFSFileHelper::WriteData(char *buffer, size_t length) {
     if(fd == -1) {
         LOG4CXX_ERROR(logger_, "file not opened :" << filename);
     }
+    WaitForWrites();
 
+    uint64_t start = MonotonicNanos();
     size_t bytes_wrote = qfshelper->kfsClient->Write(fd, buffer, length);
+    write_latency->Observe((MonotonicNanos() - start) / 1000);
+    write_ops->Inc();
     if( bytes_wrote != length) {
         string bytes_wrote_str = "" + bytes_wrote;
         string length_str = "" + length;
@@ -184,6 +262,7 @@ int QFSFileHelper::WriteData(char *buffer, size_t length) {
         THROW_EXCEPTION(AppendStoreWriteException,  "Was able to write only " + bytes_wrote_str + ", instead of " + length_str);
     }
 
+    write_bytes->Inc(length);
     LOG4CXX_DEBUG(logger_, "WriteDATA " << length << " bytes into file(" << filename << ")");    
 
     return bytes_wrote;
@@ -192,6 +271,7 @@ int QFSFileHelper::WriteData(char *buffer, size_t length) {
 int QFSFileHelper::Flush(char *buffer, size_t length) {
     int pos = Write(buffer, length);
     qfshelper->kfsClient->Sync(fd);
+    sync_ops->Inc();
     LOG4CXX_DEBUG(logger_, " calling tell instead of size in Flush : " << pos);
     return pos; 
 }
@@ -200,28 +280,146 @@ int QFSFileHelper::Flush(char *buffer, size_t length) {
 int QFSFileHelper::FlushData(char *buffer, size_t length) { 
     int bytes_wrote = WriteData(buffer, length);
     qfshelper->kfsClient->Sync(fd);
+    sync_ops->Inc();
     return bytes_wrote;
 }
 
 
+void QFSFileHelper::Sync() {
+    WaitForWrites();
+    qfshelper->kfsClient->Sync(fd);
+    sync_ops->Inc();
+}
+
+
 void QFSFileHelper::Seek(uint64_t offset) {
     LOG4CXX_DEBUG(logger_, "seek to " << offset);
     qfshelper->kfsClient->Seek(fd, offset);
 }
 
 
-//Karim: I think this function reads the header part from a file and return the real data length
+/* reads the length header of the next record, 0 at the end of file */
 uint32_t QFSFileHelper::GetNextLogSize() {
-    char *buffer = new char[sizeof(Header)];
-    /* setting the buffer to zero, to avoid garbage data */
-    memset(buffer, 0, sizeof(Header));
-    Header *header = new Header(-1);// Karim: I think the new here is unnecessary because the pointer will later be reassigned??
-    Read(buffer, sizeof(Header));
-    header = (Header *)buffer;
-    LOG4CXX_DEBUG(logger_, "GetNextLogSize - " << filename << " - " << header->data_length);    
-    return header->data_length;
+    Header header(0);
+    if (Read((char*)&header, sizeof(Header)) != sizeof(Header)) {
+        return 0;
+    }
+    LOG4CXX_DEBUG(logger_, "GetNextLogSize - " << filename << " - " << header.data_length);    
+    return header.data_length;
+}
+
+
+/**
+ * Prefetch - the data is read in the background into buffer, which must stay
+ * untouched until the next Read of the same range into it, any other Read
+ * (or Close) finishes the prefetch first.
+ */
+int QFSFileHelper::ReadPrefetch(char *buffer, size_t length) {
+    if (fd == -1) {
+        Open();
+    }
+    if (prefetch_buffer != NULL) {
+        CompletePrefetch();
+    }
+
+    int ret = qfshelper->kfsClient->ReadPrefetch(fd, buffer, length);
+    if (ret < 0) {
+        // not fatal, the next Read just reads synchronously
+        LOG4CXX_WARN(logger_, "Failed to prefetch from file(" << filename << ") - ERROR : " << KFS::ErrorCodeToStr(ret));
+        return ret;
+    }
+    prefetch_buffer = buffer;
+    prefetch_length = length;
+    prefetch_pos = qfshelper->kfsClient->Tell(fd);
+    prefetch_ops->Inc();
+    LOG4CXX_DEBUG(logger_, "Prefetch " << length << " bytes from file(" << filename << ") at " << prefetch_pos);
+    return ret;
+}
+
+void QFSFileHelper::CompletePrefetch() {
+    uint64_t pos = qfshelper->kfsClient->Tell(fd);
+    qfshelper->kfsClient->Seek(fd, prefetch_pos);
+    qfshelper->kfsClient->Read(fd, prefetch_buffer, prefetch_length);
+    qfshelper->kfsClient->Seek(fd, pos);
+    prefetch_buffer = NULL;
+}
+
+/**
+ * WriteAsync - the record is framed like Write and queued, the file position
+ * moves on at once so the returned position is the same Write would return.
+ * The record is copied, so the caller may reuse buffer.
+ */
+int QFSFileHelper::WriteAsync(char *buffer, size_t length) {
+    if(fd == -1) {
+        LOG4CXX_ERROR(logger_, "file not opened :" << filename);
+    }
+
+    Header header(length);
+    pending_writes.push_back(string(length + sizeof(Header), 0));
+    string& data = pending_writes.back();
+    memcpy(&data[0], &header, sizeof(Header));
+    memcpy(&data[sizeof(Header)], buffer, length);
+
+    int ret = qfshelper->kfsClient->WriteAsync(fd, data.c_str(), data.size());
+    if (ret < 0) {
+        LOG4CXX_WARN(logger_, "Failed to queue write to file(" << filename << "), write synchronously - ERROR : " << KFS::ErrorCodeToStr(ret));
+        pending_writes.pop_back();
+        return Write(buffer, length);
+    }
+    write_ops->Inc();
+    write_bytes->Inc(data.size());
+    pending_bytes += data.size();
+    LOG4CXX_DEBUG(logger_, "Queued " << length << " bytes for file(" << filename << ")");
+
+    int pos = qfshelper->kfsClient->Tell(fd);
+    if (pending_writes.size() >= QFS_MAX_PENDING_WRITES || pending_bytes >= QFS_MAX_PENDING_BYTES) {
+        WaitForWrites();
+    }
+    return pos;
+}
+
+void QFSFileHelper::WaitForWrites() {
+    if (pending_writes.empty()) {
+        return;
+    }
+
+    uint64_t start = MonotonicNanos();
+    int ret = qfshelper->kfsClient->WriteAsyncCompletionHandler(fd);
+    write_wait_latency->Observe((MonotonicNanos() - start) / 1000);
+    size_t num_writes = pending_writes.size();
+    pending_writes.clear();
+    pending_bytes = 0;
+
+    if (ret < 0) {
+        LOG4CXX_ERROR(logger_, "Failed to complete " << num_writes << " queued writes to file(" << filename << ")");
+        THROW_EXCEPTION(AppendStoreWriteException, "Failed to complete queued writes to file(" + filename + ")");
+    }
 }
 
+/**
+   Scans get big buffers and read-ahead, random reads get small ones so that a
+   block read doesn't drag in megabytes after it, appends need no read-ahead
+*/
+void QFSFileHelper::set_buffer_sizes() {
+    switch(access) {
+    case ACCESS_SEQUENTIAL :
+        qfshelper->kfsClient->SetIoBufferSize(fd, QFS_SEQUENTIAL_BUFFER_SIZE);
+        qfshelper->kfsClient->SetReadAheadSize(fd, QFS_SEQUENTIAL_BUFFER_SIZE);
+        break;
+    case ACCESS_RANDOM :
+        qfshelper->kfsClient->SetIoBufferSize(fd, QFS_RANDOM_BUFFER_SIZE);
+        qfshelper->kfsClient->SetReadAheadSize(fd, QFS_RANDOM_BUFFER_SIZE);
+        break;
+    case ACCESS_APPEND :
+        qfshelper->kfsClient->SetIoBufferSize(fd, QFS_APPEND_BUFFER_SIZE);
+        qfshelper->kfsClient->SetReadAheadSize(fd, 0);
+        break;
+    default :
+        return;
+    }
+    LOG4CXX_DEBUG(logger_, "io buffer of " << filename << " is " << qfshelper->kfsClient->GetIoBufferSize(fd)
+                  << ", read ahead is " << qfshelper->kfsClient->GetReadAheadSize(fd));
+}
 
 string QFSFileHelper::get_mode() {
     switch(mode) {
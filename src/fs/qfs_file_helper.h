@@ -6,10 +6,11 @@
 #include "../include/exception.h"
 #include "qfs_file_system_helper.h"
 #include <cstring>
+#include <list>
 
 class QFSFileHelper : public FileHelper {
 public:
-	QFSFileHelper(QFSHelper *qfshelper, string fname, int mode);
+	QFSFileHelper(QFSHelper *qfshelper, string fname, int mode, FileAccessPattern access = ACCESS_DEFAULT);
 	void Create();
 	void Open();
 	void Close();
@@ -18,9 +19,14 @@ public:
 	int WriteData(char *buffer, size_t length);
 	int Flush(char *buffer, size_t length);
 	int FlushData(char *buffer, size_t length);
+	void Sync();
     int Append(char *buffer, size_t length);
 	void Seek(uint64_t offset);
 	uint32_t GetNextLogSize();
+	int PRead(uint64_t offset, char *buffer, size_t length);
+	int ReadPrefetch(char *buffer, size_t length);
+	int WriteAsync(char *buffer, size_t length);
+	void WaitForWrites();
 private:
     /*
      * store a pointer to the file system helper instance,
@@ -28,8 +34,28 @@ private:
      */
 	QFSHelper *qfshelper;
 	string get_mode();
+	/* size the client buffers of the opened file for its access pattern */
+	void set_buffer_sizes();
+	/* finish an outstanding prefetch that the next read doesn't consume */
+	void CompletePrefetch();
+
+	/* records queued by WriteAsync, kept until their completion */
+	std::list<string> pending_writes;
+	size_t pending_bytes;
+	char *prefetch_buffer;
+	size_t prefetch_length;
+	uint64_t prefetch_pos;
 };
 
+/* buffer and read-ahead sizes per access pattern */
+const size_t QFS_SEQUENTIAL_BUFFER_SIZE = 8 * 1024 * 1024;
+const size_t QFS_RANDOM_BUFFER_SIZE = 64 * 1024;
+const size_t QFS_APPEND_BUFFER_SIZE = 8 * 1024 * 1024;
+
+/* WriteAsync waits for the queued writes once they pass either limit */
+const size_t QFS_MAX_PENDING_WRITES = 8;
+const size_t QFS_MAX_PENDING_BYTES = 32 * 1024 * 1024;
+
 
 struct Header {
     Header(uint32_t len) : data_length(len) {}
@@ -33,19 +33,22 @@ void QFSHelper::Connect(string metaserverhost, int metaserverport)
     if (p_qfs_helper->kfsClient == NULL) {
 		LOG4CXX_ERROR(logger_, "Failed to Connect to QFS Master Node ==> " << metaserverhost << ":" << metaserverport);
     }
-    else
+    else {
+        // for the prefetch and write-behind of QFSFileHelper
+        p_qfs_helper->kfsClient->EnableAsyncRW();
         LOG4CXX_INFO(logger_, "Connected to QFS Master Node");
+    }
     p_instance_ = dynamic_cast<FileSystemHelper*>(p_qfs_helper);
 }
 
-FileHelper* QFSHelper::CreateFileHelper(string fname, int mode)
+FileHelper* QFSHelper::CreateFileHelper(string fname, int mode, FileAccessPattern access)
 {
     QFSHelper* p_qfsh = dynamic_cast<QFSHelper*>(FileSystemHelper::GetInstance());
     if (p_qfsh == NULL) {
         LOG4CXX_ERROR(logger_, "QFS file system helper is not initialized");
         return NULL;
     }
-    FileHelper* p_fh = new QFSFileHelper(p_qfsh, fname, mode);
+    FileHelper* p_fh = new QFSFileHelper(p_qfsh, fname, mode, access);
     return p_fh;
 }
 
@@ -23,7 +23,7 @@ public:
      */
     static void Connect(); 
     static void Connect(string metaserverhost, int metaserverport);
-    /* override */ FileHelper* CreateFileHelper(string fname, int mode);
+    /* override */ FileHelper* CreateFileHelper(string fname, int mode, FileAccessPattern access = ACCESS_DEFAULT);
     /* override */ void DestroyFileHelper(FileHelper* p_fh);
     /* override */ bool IsFileExists(string fname);
     /* override */ bool IsDirectoryExists(string dirname);
@@ -22,6 +22,7 @@ using namespace log4cxx::helpers;
 class FileHelper {
 public:
     FileHelper() {}
+    virtual ~FileHelper() {}
     /* Creates a file */
     virtual void Create() {}
     /* Opens a file on specified mode */
@@ -36,6 +37,8 @@ public:
     virtual int Flush(char *buffer, size_t length) {return -1;}
     /* Write Data and Sync it */
     virtual int FlushData(char *buffer, size_t length) {return -1;}
+    /* Makes the written data durable */
+    virtual void Sync() {}
     /* Append */
     virtual int Append(char *buffer, int legnt) {return -1;}
     /* Seeks to position */
@@ -44,11 +47,25 @@ public:
     virtual uint32_t GetNextLogSize() {return 0;}
     /* Closes the file */
     virtual void Close() {}
+    /* Reads from offset without moving the file position, the file must be
+       opened. The local and QFS helpers allow concurrent calls on one handle,
+       this default goes through Seek and Read and does not */
+    virtual int PRead(uint64_t offset, char *buffer, size_t length) {Seek(offset); return Read(buffer, length);}
+    /* Starts reading length bytes at the current position into buffer without
+       moving the position, the next Read of buffer completes it */
+    virtual int ReadPrefetch(char *buffer, size_t length) {return 0;}
+    /* Queues a Write and returns the write position after it, buffer may be
+       reused at once */
+    virtual int WriteAsync(char *buffer, size_t length) {return Write(buffer, length);}
+    /* Waits until the queued writes are done, throws if one of them failed */
+    virtual void WaitForWrites() {}
 protected:
     /*file descriptor*/
     int fd;
     /* file modes - r, w, rw, a etc.*/
     int mode; 
+    /* expected access pattern */
+    FileAccessPattern access;
     /* filename of the file that we are dealing with*/
     string filename;
     /* logger for logging messages */
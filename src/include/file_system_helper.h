@@ -22,12 +22,20 @@ using namespace log4cxx::helpers;
 
 class FileHelper;
 
+/* how a file will be accessed, lets the file system size its buffers */
+enum FileAccessPattern {
+    ACCESS_DEFAULT,     /* file system defaults */
+    ACCESS_SEQUENTIAL,  /* reads through the whole file, e.g. scans and index loads */
+    ACCESS_RANDOM,      /* small reads at scattered offsets */
+    ACCESS_APPEND       /* writes at the end only */
+};
+
 class FileSystemHelper {
 public:
     /* return the global single instance of file system helper */
     static FileSystemHelper* GetInstance();
     /* create and return a file helper object to manipulate files */
-    virtual FileHelper* CreateFileHelper(string fname, int mode) = 0;
+    virtual FileHelper* CreateFileHelper(string fname, int mode, FileAccessPattern access = ACCESS_DEFAULT) = 0;
     /* destroy a file helper */
     virtual void DestroyFileHelper(FileHelper* p_fh) = 0;
     /* list file contents */
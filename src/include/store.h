@@ -54,11 +54,20 @@ public:
     virtual bool Read(const std::string& h, std::string* data) = 0;
 
     /**
-     * \brief remove a data block referred by handle
+     * \brief remove a data block referred by handle, the delete is
+     *        logged when it returns
      * @param h handle of the data
      */
     virtual void Remove(const std::string& h) = 0;
 
+    /**
+     * \brief Batch mode: remove the data blocks referred by handlevec
+     *        with one write per chunk
+     * @param handlevec handles of the data
+     * @throw exception on error.
+     */
+    virtual void BatchRemove(const std::vector<std::string>& handlevec) = 0;
+
     /**
      * \brief flush data to disk
      *  
@@ -72,6 +81,15 @@ public:
      */
     virtual void Reload() = 0;
 
+    /**
+     * \brief follow a store that is still appended to: pick up the records
+     *        written since the last call, without dropping the loaded
+     *        indexes or the cache
+     * @return number of records that became readable in the loaded chunks
+     * @throw exception on error.
+     */
+    virtual uint64_t Tail() = 0;
+
     /**
      * force release data index hold in memory.
      */
@@ -90,7 +108,7 @@ class StoreParameter
 {
 public:
     StoreParameter() 
-      : mMaxChunkSize(0), mAppend(false), mBlockIndexInterval(1000), mCompressionFlag(COMPRESSOR_LZO) {};
+      : mMaxChunkSize(0), mAppend(false), mBlockIndexInterval(1000), mCompressionFlag(COMPRESSOR_LZO), mNumStripes(1) {};
 
     std::string mPath;
     uint64_t    mMaxChunkSize;
@@ -98,6 +116,9 @@ public:
     bool        mAppend;
     uint32_t    mBlockIndexInterval;
     DataFileCompressionFlag  mCompressionFlag;
+    // number of chunks appended to at the same time, blocks are spread
+    // round-robin over them so writes go to several chunkservers
+    uint32_t    mNumStripes;
 };
 
 class StoreFactory 
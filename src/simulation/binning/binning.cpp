@@ -1,106 +1,277 @@
 /*
- * this program split list of blocks into large segments,
- * using archor to determine the boundary of segments
+ * this program groups the segments of snapshot traces into bins by their
+ * min-hash and simulates the dedup process in every bin, next to the
+ * theoretical (global) dedup.
+ *
+ * bins and blocks are hash partitioned, a partition only holds the bins whose
+ * min-hash and the blocks whose hash fall into it. Worker threads take one
+ * partition at a time and stream all traces from memory-mapped files, so more
+ * partitions use less memory per thread at the cost of more passes over the
+ * traces.
  */
 
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <map>
-#include <sstream>
+#include <vector>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
 
-#include "dedup_types.hpp"
+#include "../../snapshot/trace_types.h"
+#include "../../snapshot/trace_reader.h"
 
 using namespace std;
 
 void usage(char *progname)
 {
-    pr_msg("This program group a list of segments into bins by their min-hash, then simulate the dedupe process in every bin.\n"
-           "Usage: %s segment_file", progname);
+    cout << "This program group a list of segments into bins by their min-hash, then simulate the dedupe process in every bin." << endl
+         << "Usage: " << progname << " <parameters> trace_files" << endl
+         << "Parameters may be one of:" << endl
+         << "  --tracefile <path> - file containing list of traces" << endl
+         << "  --traceprefix <string> - trace file paths get this prefix" << endl
+         << "  --tracesuffix <string> - trace file paths get this suffix" << endl
+         << "  --vmlistfile <path> - file containing list of tracefiles for VMs" << endl
+         << "  --partitions <count> - hash partitions, each one is a pass over the traces (default 8)" << endl
+         << "  --threads <count> - partitions simulated at the same time (default all cores)" << endl
+         << "  --  - indicates end of paramers (remaining args are trace paths" << endl;
 }
 
 /*
- * Load a 2MB segment from trace
+ * open addressing table of fixed size entries probed by Entry::Hash(),
+ * entries are never removed
  */
+template <class Entry>
+class FlatTable {
+public:
+    FlatTable() : slots_(1024), used_(1024, 0), size_(0) {}
 
-bool load_segment(Segment& seg, ifstream& is)
-{
-    Block blk;
-    seg.Init();
-    while (blk.Load(is)) {
-        if (blk.GetSize() == 0) {	// fix the zero-sized block bug in scanner
-            //pr_msg("ignore zero-sized block");
-            continue;
+    /*
+     * find the entry with the key of e or insert e, inserted tells which one happened
+     */
+    Entry& Insert(const Entry& e, bool& inserted)
+    {
+        size_t i = Probe(e);
+        inserted = !used_[i];
+        if (inserted) {
+            slots_[i] = e;
+            used_[i] = 1;
+            if (++size_ * 4 > slots_.size() * 3) {
+                Grow();
+                i = Probe(e);
+            }
         }
-        seg.AddBlock(blk);
-        if (seg.GetSize() >= 2*1024*1024)
-            break;
+        return slots_[i];
     }
-    seg.Final();
-    //seg.Final();
-    if (seg.GetSize() == 0 || seg.blocklist_.size() == 0) 
-        return false;
-    else
-        return true;
+
+    size_t Size() const { return size_; }
+
+private:
+    size_t Probe(const Entry& e) const
+    {
+        size_t mask = slots_.size() - 1;
+        size_t i = e.Hash() & mask;
+        while (used_[i] && !slots_[i].SameKey(e))
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    void Grow()
+    {
+        vector<Entry> slots(slots_.size() * 2);
+        vector<uint8_t> used(used_.size() * 2, 0);
+        slots.swap(slots_);
+        used.swap(used_);
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (!used[i])
+                continue;
+            size_t j = Probe(slots[i]);
+            slots_[j] = slots[i];
+            used_[j] = 1;
+        }
+    }
+
+    vector<Entry> slots_;
+    vector<uint8_t> used_;
+    size_t size_;
+};
+
+// fingerprints are SHA-1, so their first 8 bytes are already a good hash
+inline uint64_t cksum_prefix(const char* cksum)
+{
+    uint64_t prefix;
+    memcpy(&prefix, cksum, sizeof(prefix));
+    return prefix;
 }
 
-//load a segment, and make random changes
-//each block read has a <blk_threshold> chance of being randomly modified
-//if consistency is desired, seed the random number generator consistently
-bool load_rand_segment(Segment& seg, ifstream& is, double blk_threshold)
+/*
+ * a bin, keyed by the min-hash of its segments
+ */
+struct BinEntry {
+    char min_hash_[CKSUM_LEN];
+    uint32_t bin_;
+
+    uint64_t Hash() const { return cksum_prefix(min_hash_); }
+    bool SameKey(const BinEntry& other) const { return memcmp(min_hash_, other.min_hash_, CKSUM_LEN) == 0; }
+};
+
+/*
+ * a block stored in a bin
+ */
+struct BinBlockEntry {
+    char cksum_[CKSUM_LEN];
+    uint32_t bin_;
+
+    uint64_t Hash() const { return cksum_prefix(cksum_) + bin_ * 0x9e3779b97f4a7c15ULL; }
+    bool SameKey(const BinBlockEntry& other) const { return bin_ == other.bin_ && memcmp(cksum_, other.cksum_, CKSUM_LEN) == 0; }
+};
+
+/*
+ * a block in the theoretical index
+ */
+struct BlockEntry {
+    char cksum_[CKSUM_LEN];
+
+    uint64_t Hash() const { return cksum_prefix(cksum_); }
+    bool SameKey(const BlockEntry& other) const { return memcmp(cksum_, other.cksum_, CKSUM_LEN) == 0; }
+};
+
+struct PartitionStat {
+    uint64_t bins_;
+    uint64_t segments_;
+    uint64_t size_;
+    uint64_t blocks_;
+    uint64_t dedup_size_;
+    uint64_t dedup_blocks_;
+    uint64_t theory_dedup_size_;
+    uint64_t theory_dedup_blocks_;
+    uint64_t records_;		// records scanned, for the throughput
+
+    PartitionStat()
+    {
+        bins_ = segments_ = size_ = blocks_ = 0;
+        dedup_size_ = dedup_blocks_ = theory_dedup_size_ = theory_dedup_blocks_ = 0;
+        records_ = 0;
+    }
+};
+
+struct BinningParams {
+    vector<string> traces_;
+    uint32_t partitions_;
+    vector<PartitionStat> stats_;
+    volatile uint32_t next_partition_;
+};
+
+void bin_partition(const BinningParams& params, uint32_t parti, PartitionStat& stat)
 {
-    if (blk_threshold == 0)
-        return load_segment(seg,is);
-    Block blk;
-    seg.Init();
-    double rd;
-    while (blk.Load(is)) {
-        if (blk.GetSize() == 0) {	// fix the zero-sized block bug in scanner
-            //pr_msg("ignore zero-sized block");
+    FlatTable<BinEntry> bins;
+    FlatTable<BinBlockEntry> bin_blocks;
+    FlatTable<BlockEntry> blocks;
+    BinEntry bin;
+    BinBlockEntry bin_block;
+    BlockEntry block;
+    bool inserted;
+
+    for (size_t t = 0; t < params.traces_.size(); t++) {
+        TraceReader reader;
+        if (!reader.Open(params.traces_[t]))
             continue;
+        stat.records_ += reader.GetNumRecords();
+        SegmentCursor cursor(reader.GetRecords(), SegmentPolicy::Fixed());
+        TraceSpan seg;
+        while (cursor.Next(seg)) {
+            // only bin segments in current partition
+            const TraceRecord& min_rec = seg[seg.GetMinHashIndex()];
+            bool in_partition = min_rec.GetChecksum().Middle4Bytes() % params.partitions_ == parti;
+            if (in_partition) {
+                memcpy(bin.min_hash_, min_rec.cksum_, CKSUM_LEN);
+                bin.bin_ = bins.Size();
+                bin_block.bin_ = bins.Insert(bin, inserted).bin_;
+                stat.segments_++;
+            }
+            for (size_t i = 0; i < seg.Size(); i++) {
+                const TraceRecord& rec = seg[i];
+                if (rec.size_ == 0)		// fix the zero-sized block bug in scanner
+                    continue;
+                if (in_partition) {
+                    stat.size_ += rec.size_;
+                    stat.blocks_++;
+                    memcpy(bin_block.cksum_, rec.cksum_, CKSUM_LEN);
+                    bin_blocks.Insert(bin_block, inserted);
+                    if (inserted) {
+                        stat.dedup_size_ += rec.size_;
+                        stat.dedup_blocks_++;
+                    }
+                }
+                // theoretical dedup for any blocks in current partition
+                if (rec.GetChecksum().Middle4Bytes() % params.partitions_ == parti) {
+                    memcpy(block.cksum_, rec.cksum_, CKSUM_LEN);
+                    blocks.Insert(block, inserted);
+                    if (inserted) {
+                        stat.theory_dedup_size_ += rec.size_;
+                        stat.theory_dedup_blocks_++;
+                    }
+                }
+            }
         }
-        rd = (double)rand() / RAND_MAX;
-        if (rd <= blk_threshold)
-        {
-            rd = (double)rand() / RAND_MAX;
-            memcpy(&blk.cksum_[4],&rd,sizeof(rd));
-        }
-        seg.AddBlock(blk);
-        if (seg.GetSize() >= 2*1024*1024)
-            break;
     }
-    seg.Final();
-    //seg.Final();
-    if (seg.GetSize() == 0 || seg.blocklist_.size() == 0) 
+    stat.bins_ = bins.Size();
+}
+
+void* bin_worker(void* arg)
+{
+    BinningParams* params = (BinningParams*)arg;
+    uint32_t parti;
+    while ((parti = __sync_fetch_and_add(&params->next_partition_, 1)) < params->partitions_)
+        bin_partition(*params, parti, params->stats_[parti]);
+    return NULL;
+}
+
+void print_summary(const PartitionStat& total)
+{
+    cout << "Bins: " << total.bins_ << endl;
+    cout << "Segments: " << total.segments_ << endl;
+    cout << "Global Size: " << total.size_ << endl;
+    cout << "Global Dedup Size: " << total.dedup_size_ << endl;
+    cout << "Global Dedup Size Ratio: " << ((double)total.dedup_size_ / (double)total.size_)*100 << "%" << endl;
+    cout << "Global Blocks: " << total.blocks_ << endl;
+    cout << "Global Dedup Blocks: " << total.dedup_blocks_ << endl;
+    cout << "Global Dedup Blocks Ratio: " << ((double)total.dedup_blocks_ / (double)total.blocks_)*100 << "%" << endl;
+}
+
+double now_seconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/*
+ * append the non-empty lines of a list file to lines
+ */
+bool read_list(const string& path, vector<string>& lines)
+{
+    ifstream is(path.c_str(), std::ios_base::in);
+    if (!is.is_open())
         return false;
-    else
-        return true;
+    string line;
+    while (getline(is, line))
+        if (line.length() > 0)
+            lines.push_back(line);
+    return true;
 }
 
 int main(int argc, char **argv)
 {
-    int partitions = 8;
-    Segment current_seg;
-    ifstream current_input, trace_input, vmlist_input;
+    BinningParams params;
+    params.partitions_ = 8;
+    uint32_t num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    string tracefile_name, vmlist_name;
     bool use_trace_file = false;
     bool use_vm_list = false;
-    int vmtraceindex = 0;
-    int vmindex = 0;
-    int trace_index = 0;
     int argindex = 1;
 
-    map<string, Bin> binmap;
-    map<Hash, int> theoreticalIndex;
-    uint64_t theory_dedup_size = 0;
-    Segment seg;
-    int total_bins = 0;
-    uint64_t total_size = 0;
-    uint64_t total_dedup_size = 0;
-    uint64_t total_blocks = 0;
-    uint64_t total_dedup_blocks = 0;
-    uint64_t total_segments = 0;
-    uint64_t theory_dedup_blocks = 0;
-
     string tracefile_prefix, tracefile_suffix;
 
     while(argindex < argc && argv[argindex][0] == '-')
@@ -112,11 +283,7 @@ int main(int argc, char **argv)
                 usage(argv[0]);
                 return 0;
             }
-            trace_input.open(argv[argindex++], std::ios_base::in);
-            if (!trace_input.is_open()) {
-                pr_msg("unable to open %s", argv[argindex-1]);
-                exit(1);
-            }
+            tracefile_name = argv[argindex++];
 	} else if (strcmp(argv[argindex],"--traceprefix") == 0) {
             argindex++;
             if (argindex >= argc) {
@@ -138,11 +305,21 @@ int main(int argc, char **argv)
                 usage(argv[0]);
                 return 0;
             }
-            vmlist_input.open(argv[argindex++], std::ios_base::in);
-            if (!vmlist_input.is_open()) {
-                pr_msg("unable to open %s", argv[argindex-1]);
-                exit(1);
+            vmlist_name = argv[argindex++];
+        } else if (strcmp(argv[argindex],"--partitions") == 0) {
+            argindex++;
+            if (argindex >= argc) {
+                usage(argv[0]);
+                return 0;
+            }
+            params.partitions_ = atoi(argv[argindex++]);
+        } else if (strcmp(argv[argindex],"--threads") == 0) {
+            argindex++;
+            if (argindex >= argc) {
+                usage(argv[0]);
+                return 0;
             }
+            num_threads = atoi(argv[argindex++]);
         } else if (strcmp(argv[argindex],"--") == 0) {
             argindex++;
             break;
@@ -152,190 +329,84 @@ int main(int argc, char **argv)
             return 0;
         }
     }
+    if (params.partitions_ == 0 || num_threads == 0) {
+        usage(argv[0]);
+        return 0;
+    }
 
-    int argstart = argindex;
-    map<string, Bin>::iterator it;
-    
-    for(int parti = 0; parti < partitions; parti++) {
-        cout << "Starting partition " << (parti+1) << " of " << partitions << endl;
-        argindex = argstart;
-        vmtraceindex = 0;
-        vmindex = 0;
-        trace_index = 0;
-        binmap.clear();
-        theoreticalIndex.clear();
-        if (use_vm_list) {
-            vmlist_input.clear();
-            vmlist_input.seekg(0,ios::beg);
+    // collect the trace paths once, every partition scans all of them in this order
+    vector<string> vm_files, names;
+    if (use_vm_list) {
+        if (!read_list(vmlist_name, vm_files)) {
+            cout << "unable to open " << vmlist_name << endl;
+            exit(1);
         }
-        if (trace_input.is_open()) {
-            trace_input.clear();
-            trace_input.seekg(0,ios::beg);
-        }
-
-        
-        while((!use_trace_file && argindex < argc) ||
-                (use_trace_file && !use_vm_list && trace_input.good()) ||
-                (use_vm_list && vmlist_input.good())) {
-            string line;
-            //const char *cur_vm_path;
-            vmtraceindex = 0;
-            if (use_vm_list) {
-                getline(vmlist_input,line);
-                if (line.length() < 1 || line[0] == '\n') {
-                    //cout << "bad vmfile name: " << line << endl;
-                    continue;
-                }
-                if (trace_input.is_open()) {
-                    trace_input.close();
-                }
-                //cur_vm_path = line.c_str();
-                trace_input.open(line.c_str(), std::ios_base::in);
-                if (!trace_input.is_open()) {
-                    pr_msg("unable to open %s", line.c_str());
-                    continue;
-                } else {
-                    cout << "VM file (" << vmindex << "): " << line << endl;
-                    use_trace_file = true;
-                }
-            }
-            while((!use_trace_file && argindex < argc) ||
-                    (use_trace_file && trace_input.good())) {
-                //const char *cur_trace_path;
-                string cur_tracefile_name;
-                stringstream tracepath_stream;
-                Hash curHash;
-                std::vector<Block>::iterator iter;
-                if (use_trace_file) {
-                    getline(trace_input,cur_tracefile_name);
-                } else {
-                    cur_tracefile_name = argv[argindex++];
-                }
-                tracepath_stream << tracefile_prefix << cur_tracefile_name << tracefile_suffix;
-
-                if (cur_tracefile_name.length() < 1 || cur_tracefile_name[0] == '\n') {
-                    //cout << "bad tracefile name: " << cur_tracefile_name << endl;
-                    continue;
-                }
-                cur_tracefile_name = tracepath_stream.str();
-                if (current_input.is_open()) {
-                    current_input.close();
-                }
-                printf("snapshot trace file %d.%d: %s\n", vmindex, vmtraceindex,cur_tracefile_name.c_str());
-                //cur_trace_path = cur_tracefile_name.c_str();
-                current_input.open(cur_tracefile_name.c_str(), std::ios_base::in | std::ios_base::binary);
-                if (!current_input.is_open()) {
-                    pr_msg("unable to open %s", cur_tracefile_name.c_str());
-                    continue;
-                }
-                //theoretical(indexBlocks, current_input, blk_threshold, seed);
-
-                while (load_segment(seg,current_input)) {
-                    //only srb segments in current partition
-                    if (seg.minhash_.Middle4Bytes() % partitions == parti) {
-                        binmap[seg.GetMinHashString()].AddSegment(seg);
-                        //add to total any blocks from segments in current partition
-                        //this lets us get intermediate results for srb (but no longer for theo)
-                        for(iter = seg.blocklist_.begin();iter != seg.blocklist_.end(); ++iter) {
-                            total_size += (*iter).size_;
-                            total_blocks++;
-                        }
-                        total_segments++;
-                    }
-                    for(iter = seg.blocklist_.begin();iter != seg.blocklist_.end(); ++iter) {
-                        curHash.setHash(*iter);
-                        //theoretical dedup for any blocks in current partition
-                        //note that theoretical is no longer lined up with srb until end of run
-                        if (curHash.Middle4Bytes() % partitions == parti) {
-                            theoreticalIndex[curHash]++;
-                            if (theoreticalIndex[curHash] == 1) {
-                                theory_dedup_size += (uint64_t)((*iter).size_);
-                            }
-                        }
-                    }
-                }
-                if (!use_vm_list) {
-                    //vm_blocks.clear();
-                }
-
-                //output.close();
-                //parent_input.close();
-                current_input.close();
-                
-                //int num_bins = total_bins + binmap.size();
-                //uint64_t current_dedup_size = total_dedup_size;
-                //uint64_t current_dedup_blocks = total_dedup_blocks;
-                //for (it=binmap.begin(); it != binmap.end(); it ++) {
-                //    //total_size += (*it).second.getTotalSize();
-                //    current_dedup_size += (*it).second.getDedupSize();
-                //    //total_blocks += (*it).second.getTotalBlocks();
-                //    current_dedup_blocks += (*it).second.getDedupBlocks();
-                //    //total_segments += (*it).second.getTotalSegments();
-                //    //pr_msg("%s", (*it).second.ToString().c_str());
-                //}
-                //        //theory_dedup_blocks = (uint64_t)theoreticalIndex.size();
-                //            cout << "Current Partition Summary: " << endl;
-                //cout << "Bins: " << num_bins << endl;
-                //cout << "Segments: " << total_segments << endl;
-                //cout << "Global Size: " << total_size << endl;
-                //cout << "Global Dedup Size: " << current_dedup_size << endl;
-                //cout << "Global Dedup Size Ratio: " << ((double)current_dedup_size / (double)total_size)*100 << "%" << endl;
-                //cout << "Global Blocks: " << total_blocks << endl;
-                //cout << "Global Dedup Blocks: " << current_dedup_blocks << endl;
-                //cout << "Global Dedup Blocks Ratio: " << ((double)current_dedup_blocks / (double)total_blocks)*100 << "%" << endl;
-                ////cout << "Theoretical Dedup Size: " << theory_dedup_size << endl;
-                ////cout << "Theoretical Dedup Size Ratio: " << ((double)theory_dedup_size / (double)total_size)*100 << "%" << endl;
-                ////cout << "Theoretical Dedup Blocks: " << theory_dedup_blocks << endl;
-                ////cout << "Theoretical Dedup Blocks Ratio: " << ((double)(theory_dedup_blocks) / (double)total_blocks)*100 << "%" << endl;
-                ////cout << "Percent of Theoretical Blocks Deduped: " << ((double)(total_blocks - current_dedup_blocks) / (double)(total_blocks - theory_dedup_blocks))*100 << "%" << endl;
-                trace_index++;
-                vmtraceindex++;
+    } else if (use_trace_file) {
+        vm_files.push_back(tracefile_name);
+    }
+    for (size_t vmindex = 0; vmindex < vm_files.size() || (vmindex == 0 && !use_trace_file && !use_vm_list); vmindex++) {
+        names.clear();
+        if (use_trace_file || use_vm_list) {
+            if (!read_list(vm_files[vmindex], names)) {
+                cout << "unable to open " << vm_files[vmindex] << endl;
+                continue;
             }
-            if (!use_trace_file) {
-                break;
+            if (use_vm_list)
+                cout << "VM file (" << vmindex << "): " << vm_files[vmindex] << endl;
+        } else {
+            for (; argindex < argc; argindex++)
+                names.push_back(argv[argindex]);
+        }
+        for (size_t vmtraceindex = 0; vmtraceindex < names.size(); vmtraceindex++) {
+            string path = tracefile_prefix + names[vmtraceindex] + tracefile_suffix;
+            cout << "snapshot trace file " << vmindex << "." << vmtraceindex << ": " << path << endl;
+            if (access(path.c_str(), R_OK) != 0) {
+                cout << "unable to open " << path << endl;
+                continue;
             }
-            //vm_blocks.clear(); //clear the set for the next vm
-            vmindex++;
+            params.traces_.push_back(path);
         }
+    }
 
-        theory_dedup_blocks += theoreticalIndex.size();
-        total_bins += binmap.size();
-        for (it=binmap.begin(); it != binmap.end(); it ++) {
-            //total_size += (*it).second.getTotalSize();
-            total_dedup_size += (*it).second.getDedupSize();
-            //total_blocks += (*it).second.getTotalBlocks();
-            total_dedup_blocks += (*it).second.getDedupBlocks();
-            //total_segments += (*it).second.getTotalSegments();
-            //pr_msg("%s", (*it).second.ToString().c_str());
-        }
+    if (num_threads > params.partitions_)
+        num_threads = params.partitions_;
+    cout << "Binning " << params.traces_.size() << " traces in " << params.partitions_
+         << " partitions with " << num_threads << " threads" << endl;
+    params.stats_.resize(params.partitions_);
+    params.next_partition_ = 0;
+    double start = now_seconds();
+    vector<pthread_t> threads(num_threads);
+    for (uint32_t i = 0; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, bin_worker, &params);
+    for (uint32_t i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+    double seconds = now_seconds() - start;
 
+    PartitionStat total;
+    uint64_t records = 0;
+    for (uint32_t parti = 0; parti < params.partitions_; parti++) {
+        const PartitionStat& stat = params.stats_[parti];
+        total.bins_ += stat.bins_;
+        total.segments_ += stat.segments_;
+        total.size_ += stat.size_;
+        total.blocks_ += stat.blocks_;
+        total.dedup_size_ += stat.dedup_size_;
+        total.dedup_blocks_ += stat.dedup_blocks_;
+        total.theory_dedup_size_ += stat.theory_dedup_size_;
+        total.theory_dedup_blocks_ += stat.theory_dedup_blocks_;
+        records += stat.records_;
+        cout << "Partition " << (parti+1) << " of " << params.partitions_ << endl;
         cout << "Final Partition Summary: " << endl;
-        cout << "Bins: " << total_bins << endl;
-        cout << "Segments: " << total_segments << endl;
-        cout << "Global Size: " << total_size << endl;
-        cout << "Global Dedup Size: " << total_dedup_size << endl;
-        cout << "Global Dedup Size Ratio: " << ((double)total_dedup_size / (double)total_size)*100 << "%" << endl;
-        cout << "Global Blocks: " << total_blocks << endl;
-        cout << "Global Dedup Blocks: " << total_dedup_blocks << endl;
-        cout << "Global Dedup Blocks Ratio: " << ((double)total_dedup_blocks / (double)total_blocks)*100 << "%" << endl;
-        //binmap.clear();
-    } //end of partition loop
-
-            //theory_dedup_blocks = (uint64_t)theoreticalIndex.size();
-            cout << "Final Dedup Summary: " << endl;
-    cout << "Bins: " << total_bins << endl;
-    cout << "Segments: " << total_segments << endl;
-    cout << "Global Size: " << total_size << endl;
-    cout << "Global Dedup Size: " << total_dedup_size << endl;
-    cout << "Global Dedup Size Ratio: " << ((double)total_dedup_size / (double)total_size)*100 << "%" << endl;
-    cout << "Global Blocks: " << total_blocks << endl;
-    cout << "Global Dedup Blocks: " << total_dedup_blocks << endl;
-    cout << "Global Dedup Blocks Ratio: " << ((double)total_dedup_blocks / (double)total_blocks)*100 << "%" << endl;
-    cout << "Theoretical Dedup Size: " << theory_dedup_size << endl;
-    cout << "Theoretical Dedup Size Ratio: " << ((double)theory_dedup_size / (double)total_size)*100 << "%" << endl;
-    cout << "Theoretical Dedup Blocks: " << theory_dedup_blocks << endl;
-    cout << "Theoretical Dedup Blocks Ratio: " << ((double)(theory_dedup_blocks) / (double)total_blocks)*100 << "%" << endl;
-    cout << "Percent of Theoretical Blocks Deduped: " << ((double)(total_blocks - total_dedup_blocks) / (double)(total_blocks - theory_dedup_blocks))*100 << "%" << endl;
-    ////cout << "Percent of Theoretical Size Deduped: " << (double)(total_size - total_dedup_size) / (double)(total_size - theory_dedup_size) << "%" << endl;
+        print_summary(total);
+    }
+
+    cout << "Final Dedup Summary: " << endl;
+    print_summary(total);
+    cout << "Theoretical Dedup Size: " << total.theory_dedup_size_ << endl;
+    cout << "Theoretical Dedup Size Ratio: " << ((double)total.theory_dedup_size_ / (double)total.size_)*100 << "%" << endl;
+    cout << "Theoretical Dedup Blocks: " << total.theory_dedup_blocks_ << endl;
+    cout << "Theoretical Dedup Blocks Ratio: " << ((double)(total.theory_dedup_blocks_) / (double)total.blocks_)*100 << "%" << endl;
+    cout << "Percent of Theoretical Blocks Deduped: " << ((double)(total.blocks_ - total.dedup_blocks_) / (double)(total.blocks_ - total.theory_dedup_blocks_))*100 << "%" << endl;
+    cout << "Elapsed: " << seconds << " s, " << (seconds > 0 ? records / seconds : 0) << " records/s scanned" << endl;
     return 0;
 }
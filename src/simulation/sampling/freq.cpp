@@ -9,6 +9,9 @@
 #include <map>
 #include <set>
 #include <exception>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
 #include "dedup_types.hpp"
 #include "lru_cache.hpp"
 
@@ -23,6 +26,9 @@ class Hash {
     Hash(Block& blk) {
         memcpy(cksum_, blk.cksum_, CKSUM_LEN * sizeof(uint8_t));
     }
+    Hash(const uint8_t* cksum) {
+        memcpy(cksum_, cksum, CKSUM_LEN * sizeof(uint8_t));
+    }
     Hash(const Hash& h)
     {
         memcpy(cksum_, h.cksum_, CKSUM_LEN * sizeof(uint8_t));
@@ -62,10 +68,40 @@ void usage(char *progname)
                 "  --traceprefix <string> - trace file paths get this prefix\n"
                 "  --tracesuffix <string> - trace file paths get this suffix\n"
                 "  --vmlistfile <path> - file containing list of tracefiles for VMs\n"
+                "  --threads <count> - count block freqs of VMs in parallel, only the\n"
+                "                      final statistics are printed (no --containers\n"
+                "                      or --cdsevery)\n"
                 "  --  - indicates end of paramers (remaining args are trace paths\n"
                 );
 }
 
+/*
+ * rand() sequence of glibc for one stream, so traces scanned by different
+ * threads see the same modifications as with srand(seed) in a single thread
+ */
+class FreqRng {
+public:
+    FreqRng(unsigned int seed) {
+        memset(&data_, 0, sizeof(data_));
+        initstate_r(seed, state_, sizeof(state_), &data_);
+    }
+
+    double NextRatio() {
+        int32_t r;
+        random_r(&data_, &r);
+        return (double)r / RAND_MAX;
+    }
+
+private:
+    char state_[128];		// same state size as rand()
+    struct random_data data_;
+};
+
+double next_ratio(FreqRng* rng)
+{
+    return rng ? rng->NextRatio() : (double)rand() / RAND_MAX;
+}
+
 /*
  * Load a 2MB segment from trace
  */
@@ -91,11 +127,12 @@ bool load_segment(Segment& seg, ifstream& is)
 }
 
 //loads a segment and makes random modifications
-bool load_rand_segment(Segment& seg, ifstream& is, double blk_threshold, double seg_threshold)
+//  (with rand() unless a generator is given)
+bool load_rand_segment(Segment& seg, ifstream& is, double blk_threshold, double seg_threshold, FreqRng* rng = NULL)
 {
     if (blk_threshold == 0 || seg_threshold == 0)
         return load_segment(seg,is);
-    if (((double)rand() / RAND_MAX) > seg_threshold)
+    if (next_ratio(rng) > seg_threshold)
         return load_segment(seg,is);
 
     Block blk;
@@ -106,10 +143,10 @@ bool load_rand_segment(Segment& seg, ifstream& is, double blk_threshold, double
             //pr_msg("ignore zero-sized block");
             continue;
         }
-        rd = (double)rand() / RAND_MAX;
+        rd = next_ratio(rng);
         if (rd <= blk_threshold)
         {
-            rd = (double)rand() / RAND_MAX;
+            rd = next_ratio(rng);
             memcpy(&blk.cksum_[4],&rd,sizeof(rd));
         }
         seg.AddBlock(blk);
@@ -212,8 +249,13 @@ void insert_min(int *heap, int *len, int n)
 
 void topk_heap(int* heap, int* cur_length, int max_length, int n)
 {
-    if (*cur_length >= max_length)
+    // keep the heap minimum when n doesn't beat it, so the result doesn't
+    // depend on the order the counts come in
+    if (*cur_length >= max_length) {
+        if (max_length <= 0 || n <= heap[0])
+            return;
         delete_min(heap,cur_length);
+    }
     insert_min(heap,cur_length, n);
 }
 
@@ -385,6 +427,288 @@ void do_container_freq(map<Hash, int>& container_index, set<int>& vm_containers,
     }*/
 }
 
+/*
+ * Parallel block frequencies: each thread takes whole VMs and counts their
+ * blocks into its own table split in FREQ_SHARDS shards by the first hash
+ * byte. An entry remembers the last VM that counted it, so a block is counted
+ * once per VM without a per-VM set. At the end shard s of every thread is
+ * merged into shard s of the first thread, the shards spread over the threads.
+ */
+#define FREQ_SHARDS 256
+#define FREQ_SHARD_LOAD 0.7
+
+struct FreqEntry {
+    Checksum cksum_;
+    uint32_t count_;		// 0 marks an empty slot
+    int32_t last_vm_;
+};
+
+class FreqShard {
+public:
+    FreqShard() : slots_(1024), size_(0) {
+        memset(&slots_[0], 0, slots_.size() * sizeof(FreqEntry));
+    }
+
+    /*
+     * add count to the block, or count it once for vm if vm >= 0;
+     * returns true if the block was counted
+     */
+    bool Add(const uint8_t* cksum, uint32_t count, int32_t vm) {
+        FreqEntry& entry = Find(cksum);
+        if (entry.count_ == 0) {
+            memcpy(entry.cksum_, cksum, CKSUM_LEN);
+            entry.last_vm_ = vm;
+            entry.count_ = count;
+            if (++size_ > slots_.size() * FREQ_SHARD_LOAD)
+                Grow();
+            return true;
+        }
+        if (vm >= 0) {
+            if (entry.last_vm_ == vm)
+                return false;
+            entry.last_vm_ = vm;
+        }
+        entry.count_ += count;
+        return true;
+    }
+
+    size_t Size() const { return size_; }
+
+    vector<FreqEntry> slots_;
+
+private:
+    FreqEntry& Find(const uint8_t* cksum) {
+        // --rand rewrites bytes 4-11 of modified blocks, so hash both halves
+        uint64_t a, b;
+        memcpy(&a, cksum + 4, sizeof(a));
+        memcpy(&b, cksum + 12, sizeof(b));
+        size_t mask = slots_.size() - 1;
+        size_t i = (a ^ b) & mask;
+        while (slots_[i].count_ != 0 && memcmp(slots_[i].cksum_, cksum, CKSUM_LEN) != 0)
+            i = (i + 1) & mask;
+        return slots_[i];
+    }
+
+    void Grow() {
+        vector<FreqEntry> old(slots_.size() * 2);
+        old.swap(slots_);
+        memset(&slots_[0], 0, slots_.size() * sizeof(FreqEntry));
+        for (size_t i = 0; i < old.size(); i++)
+            if (old[i].count_ != 0)
+                Find(old[i].cksum_) = old[i];
+    }
+
+    size_t size_;
+};
+
+/*
+ * the traces of one VM (or one trace if there is no VM list) in one loop
+ */
+struct FreqJob {
+    int vmindex_;
+    vector<string> trace_paths_;
+    double blk_threshold_;
+    double seg_threshold_;
+    unsigned int seed_;
+};
+
+struct FreqWorker;
+
+struct FreqParams {
+    vector<FreqJob> jobs_;
+    vector<FreqWorker*> workers_;
+    volatile uint32_t next_job_;
+    volatile uint32_t next_shard_;
+    pthread_mutex_t lock_;
+};
+
+struct FreqWorker {
+    FreqParams* params_;
+    FreqShard shards_[FREQ_SHARDS];
+    unsigned long int blocks_;
+    double seconds_;
+};
+
+double now_seconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void count_vm_blocks(FreqWorker& worker, const FreqJob& job)
+{
+    stringstream log;
+    Segment current_seg;
+    ifstream current_input;
+    vector<char> buf(READ_BUFFER_SIZE);
+    unsigned long int blocks = 0, uniq_blocks = 0;
+
+    for (size_t t = 0; t < job.trace_paths_.size(); t++) {
+        const char *cur_trace_path = job.trace_paths_[t].c_str();
+        current_input.rdbuf()->pubsetbuf(&buf[0], buf.size());
+        current_input.open(cur_trace_path, std::ios_base::in | std::ios_base::binary);
+        if (!current_input.is_open()) {
+            pr_msg("unable to open %s", cur_trace_path);
+            exit(1);
+        }
+        // like srand(seed) at the start of every trace
+        FreqRng rng(job.seed_);
+        while (load_rand_segment(current_seg, current_input, job.blk_threshold_, job.seg_threshold_, &rng)) {
+            for (size_t i = 0; i < current_seg.blocklist_.size(); i++) {
+                const uint8_t* cksum = current_seg.blocklist_[i].cksum_;
+                if (worker.shards_[cksum[0]].Add(cksum, 1, job.vmindex_))
+                    uniq_blocks++;
+            }
+            blocks += current_seg.blocklist_.size();
+        }
+        current_input.close();
+        current_input.clear();
+        log << "snapshot trace file " << job.vmindex_ << "." << t << ": " << cur_trace_path << endl;
+    }
+    worker.blocks_ += blocks;
+    log << "VM summary (" << job.vmindex_ << ") Blocks read: " << blocks << endl;
+    log << "VM summary (" << job.vmindex_ << ") Unique blocks read: " << uniq_blocks << endl;
+    pthread_mutex_lock(&worker.params_->lock_);
+    cout << log.str();
+    pthread_mutex_unlock(&worker.params_->lock_);
+}
+
+void* count_worker(void* arg)
+{
+    FreqWorker* worker = (FreqWorker*)arg;
+    FreqParams* params = worker->params_;
+    double start = now_seconds();
+    uint32_t i;
+    while ((i = __sync_fetch_and_add(&params->next_job_, 1)) < params->jobs_.size())
+        count_vm_blocks(*worker, params->jobs_[i]);
+    worker->seconds_ = now_seconds() - start;
+    return NULL;
+}
+
+void* merge_worker(void* arg)
+{
+    FreqParams* params = (FreqParams*)arg;
+    uint32_t s;
+    while ((s = __sync_fetch_and_add(&params->next_shard_, 1)) < FREQ_SHARDS) {
+        FreqShard& merged = params->workers_[0]->shards_[s];
+        for (size_t w = 1; w < params->workers_.size(); w++) {
+            FreqShard& partial = params->workers_[w]->shards_[s];
+            for (size_t i = 0; i < partial.slots_.size(); i++)
+                if (partial.slots_[i].count_ != 0)
+                    merged.Add(partial.slots_[i].cksum_, partial.slots_[i].count_, -1);
+            // release the partial counts as soon as they are merged
+            vector<FreqEntry>().swap(partial.slots_);
+        }
+    }
+    return NULL;
+}
+
+void print_parallel_block_freq(FreqShard* shards, map<Hash, int>& cds, double cds_percent)
+{
+    unsigned long int index_size = 0;
+    for (int s = 0; s < FREQ_SHARDS; s++)
+        index_size += shards[s].Size();
+    printf("Index size: %lu\n", index_size);
+
+    unsigned long int sum = 0;
+    unsigned long int cds_sum = 0;
+    int max = 0;
+    int maxCount = 0;
+    int cds_hits = 0;
+    int entries = 0;
+    int cds_size = cds_percent > 0 ? (int)((double)index_size * cds_percent) : 0;
+    int cds_len = 0;
+    int *cds_entries = (int*)malloc(sizeof(int) * (cds_size + 1));
+
+    for (int s = 0; s < FREQ_SHARDS; s++) {
+        vector<FreqEntry>& slots = shards[s].slots_;
+        for (size_t i = 0; i < slots.size(); i++) {
+            int count = slots[i].count_;
+            if (count == 0)
+                continue;
+            if (cds_percent < 0 && cds.find(Hash(slots[i].cksum_)) != cds.end()) {
+                cds_sum += (unsigned long int)count;
+                cds_hits++;
+            } else if (cds_percent > 0) {
+                topk_heap(cds_entries, &cds_len, cds_size, count);
+            }
+            if (count > max) {
+                max = count;
+                maxCount = 1;
+            } else if (count == max) {
+                maxCount++;
+            }
+            sum += (unsigned long int)count;
+            entries++;
+        }
+    }
+
+    if (cds_percent < 0) {
+        printf("Max links: %d\nCDS size: %d\nCDS blocks used: %d\n",max,(int)cds.size(),cds_hits);
+        printf("Avg links (including CDS blocks): %g\n", (double)sum / (double)entries);
+        printf("Avg links (excluding CDS blocks): %g\n", (double)(sum-cds_sum) / (double)(entries - cds_hits));
+        printf("Avg CDS block links: %g\n", (double)cds_sum / (double)cds.size());
+    } else if (cds_percent > 0) {
+        for (int i = 0; i < cds_len; i++)
+            cds_sum += (unsigned long int)cds_entries[i];
+        printf("Max links: %d\nCDS entries: %d\n",max,cds_len);
+        printf("Avg links (including CDS blocks): %g\n", (double)sum / (double)entries);
+        printf("Avg links (excluding CDS blocks): %g\n", (double)(sum-cds_sum) / (double)(entries - cds_len));
+        printf("Avg CDS block links: %g\n", (double)cds_sum / (double)cds_len);
+    } else {
+        printf("Max: %d\nMax Entries: %d\nAvg: %g\n", max, maxCount, (double)sum / (double)entries);
+    }
+    free(cds_entries);
+}
+
+int parallel_block_freq(FreqParams& params, unsigned int num_threads, map<Hash, int>& cds, double cds_percent)
+{
+    uint32_t i;
+    cout << "Counting block freqs of " << params.jobs_.size() << " VMs with " << num_threads << " threads" << endl;
+    params.next_job_ = 0;
+    params.next_shard_ = 0;
+    pthread_mutex_init(&params.lock_, NULL);
+    for (i = 0; i < num_threads; i++) {
+        FreqWorker* worker = new FreqWorker();
+        worker->params_ = &params;
+        worker->blocks_ = 0;
+        worker->seconds_ = 0;
+        params.workers_.push_back(worker);
+    }
+
+    double start = now_seconds();
+    vector<pthread_t> threads(num_threads);
+    for (i = 0; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, count_worker, params.workers_[i]);
+    for (i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+    double count_seconds = now_seconds() - start;
+
+    for (i = 0; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, merge_worker, &params);
+    for (i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+    double seconds = now_seconds() - start;
+    pthread_mutex_destroy(&params.lock_);
+
+    unsigned long int blocks = 0;
+    for (i = 0; i < num_threads; i++) {
+        FreqWorker* worker = params.workers_[i];
+        blocks += worker->blocks_;
+        printf("Thread %u: %lu blocks in %.3f s (%.0f blocks/s)\n", i, worker->blocks_,
+               worker->seconds_, worker->seconds_ > 0 ? worker->blocks_ / worker->seconds_ : 0);
+    }
+    printf("Blocks read: %lu\n", blocks);
+    printf("Count time: %.3f s, merge time: %.3f s\n", count_seconds, seconds - count_seconds);
+    printf("Throughput: %.0f blocks/s\n", seconds > 0 ? blocks / seconds : 0);
+
+    print_parallel_block_freq(params.workers_[0]->shards_, cds, cds_percent);
+    for (i = 0; i < num_threads; i++)
+        delete params.workers_[i];
+    return 0;
+}
+
 void sampled(std::vector<Segment>& indexBlocks, ifstream& trace, int cache_size, double blk_threshold, double seg_threshold, unsigned int seed, bool do_dirty, bool do_parent)
 {
     trace.clear();
@@ -536,8 +860,9 @@ int main(int argc, char** argv)
     double cds_percent = 0;
     int cds_every = 1;
     int trace_index = 0;
-    unsigned int seed;
+    unsigned int seed = 1;
     unsigned int loops = 1;
+    unsigned int num_threads = 0;
     unsigned int loopindex = 0;
 
     string tracefile_prefix, tracefile_suffix;
@@ -634,6 +959,13 @@ int main(int argc, char** argv)
                 pr_msg("unable to open %s", argv[argindex-1]);
                 exit(1);
             }
+        } else if (strcmp(argv[argindex],"--threads") == 0) {
+            argindex++;
+            if (argindex >= argc) {
+                usage(argv[0]);
+                return 0;
+            }
+            num_threads = (unsigned int)atol(argv[argindex++]);
         } else if (strcmp(argv[argindex],"--") == 0) {
             argindex++;
             break;
@@ -658,6 +990,61 @@ int main(int argc, char** argv)
     
     int start_argindex = argindex;
 
+    if (num_threads > 0) {
+        if (do_containers) {
+            pr_msg("--threads only counts block freqs, container numbers depend on the trace order");
+            exit(1);
+        }
+        if (cds_every != 1) {
+            pr_msg("--threads builds one CDS over all VMs, --cdsevery is not supported");
+            exit(1);
+        }
+        // same traces, loops and seeds as the sequential scan below
+        FreqParams params;
+        for (loopindex = 0; loopindex < loops; loopindex++) {
+            vector<string> lines;
+            string line;
+            if (use_vm_list) {
+                vmlist_input.clear();
+                vmlist_input.seekg(0,ios::beg);
+                while (getline(vmlist_input, line))
+                    lines.push_back(line);
+            } else if (use_trace_file) {
+                trace_input.clear();
+                trace_input.seekg(0,ios::beg);
+                while (getline(trace_input, line))
+                    lines.push_back(line);
+            } else {
+                for (argindex = start_argindex; argindex < argc; argindex++)
+                    lines.push_back(argv[argindex]);
+            }
+            for (i = 0; i < lines.size(); i++) {
+                if (lines[i].length() < 1)
+                    continue;
+                FreqJob job;
+                job.vmindex_ = params.jobs_.size();
+                job.blk_threshold_ = loopindex > 0 ? blk_threshold : 0;
+                job.seg_threshold_ = loopindex > 0 ? seg_threshold : 0;
+                job.seed_ = seed;
+                if (use_vm_list) {
+                    ifstream vm_input(lines[i].c_str(), std::ios_base::in);
+                    if (!vm_input.is_open()) {
+                        pr_msg("unable to open %s", lines[i].c_str());
+                        exit(1);
+                    }
+                    while (getline(vm_input, line))
+                        if (line.length() > 0)
+                            job.trace_paths_.push_back(tracefile_prefix + line + tracefile_suffix);
+                } else {
+                    job.trace_paths_.push_back(tracefile_prefix + lines[i] + tracefile_suffix);
+                }
+                params.jobs_.push_back(job);
+            }
+            seed = seed * 13 + 1;
+        }
+        return parallel_block_freq(params, num_threads, cds, use_cds_file ? -1 : cds_percent);
+    }
+
     while(loopindex < loops) {
         loopindex++;
         double tseg_threshold = 0;
@@ -689,12 +1076,13 @@ int main(int argc, char** argv)
             vmtraceindex = 0;
             if (use_vm_list) {
                 getline(vmlist_input,line);
-                if (strlen(cur_vm_path) < 1 || cur_vm_path[0] == '\n') {
+                if (line.length() < 1) {
                     continue;
                 }
                 if (trace_input.is_open()) {
                     trace_input.close();
                 }
+                trace_input.clear();
                 cur_vm_path = line.c_str();
                 cout << "VM file (" << vmindex << "): " << cur_vm_path << endl;
                 trace_input.open(cur_vm_path, std::ios_base::in);
@@ -707,7 +1095,7 @@ int main(int argc, char** argv)
             }
             while((!use_trace_file && argindex < argc) || (use_trace_file && trace_input.good())) {
                 const char *cur_trace_path;
-                string cur_tracefile_name;
+                string cur_tracefile_name, cur_trace_string;
                 stringstream tracepath_stream;
                 double temp_cds_percent;
                 if (use_trace_file) {
@@ -716,7 +1104,8 @@ int main(int argc, char** argv)
                     cur_tracefile_name = argv[argindex++];
                 }
                 tracepath_stream << tracefile_prefix << cur_tracefile_name << tracefile_suffix;
-                cur_trace_path = tracepath_stream.str().c_str();
+                cur_trace_string = tracepath_stream.str();
+                cur_trace_path = cur_trace_string.c_str();
                 if (cur_tracefile_name.length() < 1 || cur_trace_path[0] == '\n') {
                     continue;
                 }
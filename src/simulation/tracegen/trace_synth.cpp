@@ -0,0 +1,124 @@
+/*
+ * this program synthesizes a snapshot trace from scratch, so benchmarks can
+ * run without real VM scans; tracegen then derives later snapshots from it.
+ * Optionally writes a CDS trace holding a given fraction of the blocks.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../sampling/dedup_types.hpp"
+
+using namespace std;
+
+void usage(char *progname)
+{
+    pr_msg( "This program synthesizes a snapshot trace with random block hashes\n"
+            "Usage: %s [options] output_trace", progname);
+    pr_msg( "Possible options are:\n"
+            "  --size <MB>           size of the snapshot (default 1024)\n"
+            "  --minblk <bytes>      min block size (default 2048)\n"
+            "  --maxblk <bytes>      max block size (default 16384)\n"
+            "  --dup <ratio>         fraction of blocks duplicating an earlier block (default 0.1)\n"
+            "  --rseed <seed>        random seed (default 1)\n"
+            "  --cdsfile <path>      also write a CDS trace\n"
+            "  --cdsoverlap <ratio>  fraction of blocks that are put into the CDS (default 0.3)\n");
+}
+
+// random bytes from rand(), reproducible for a given seed
+void random_hash(Checksum& cksum)
+{
+    for (int i = 0; i < CKSUM_LEN; i++)
+        cksum[i] = rand() & 0xff;
+}
+
+double random_ratio()
+{
+    return (double)rand() / RAND_MAX;
+}
+
+int main(int argc, char** argv)
+{
+    uint64_t snapshot_size = 1024ULL * 1024 * 1024;
+    uint32_t min_block = 2048, max_block = 16384;
+    double dup_ratio = 0.1, cds_overlap = 0.3;
+    unsigned int seed = 1;
+    string cds_file;
+
+    int argi = 1;
+    for (; argi + 1 < argc && strncmp(argv[argi], "--", 2) == 0; argi += 2) {
+        if (strcmp(argv[argi], "--size") == 0)
+            snapshot_size = strtoull(argv[argi + 1], NULL, 10) << 20;
+        else if (strcmp(argv[argi], "--minblk") == 0)
+            min_block = atoi(argv[argi + 1]);
+        else if (strcmp(argv[argi], "--maxblk") == 0)
+            max_block = atoi(argv[argi + 1]);
+        else if (strcmp(argv[argi], "--dup") == 0)
+            dup_ratio = atof(argv[argi + 1]);
+        else if (strcmp(argv[argi], "--rseed") == 0)
+            seed = atoi(argv[argi + 1]);
+        else if (strcmp(argv[argi], "--cdsfile") == 0)
+            cds_file = argv[argi + 1];
+        else if (strcmp(argv[argi], "--cdsoverlap") == 0)
+            cds_overlap = atof(argv[argi + 1]);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argi + 1 != argc || min_block == 0 || min_block > max_block) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    ofstream trace_output(argv[argi], ios_base::out | ios_base::binary | ios_base::trunc);
+    if (!trace_output.is_open()) {
+        pr_msg("unable to open %s", argv[argi]);
+        return 1;
+    }
+    ofstream cds_output;
+    if (!cds_file.empty()) {
+        cds_output.open(cds_file.c_str(), ios_base::out | ios_base::binary | ios_base::trunc);
+        if (!cds_output.is_open()) {
+            pr_msg("unable to open %s", cds_file.c_str());
+            return 1;
+        }
+    }
+
+    srand(seed);
+    vector<Block> unique_blocks;
+    Block blk;
+    uint64_t offset = 0, num_blocks = 0, num_dups = 0, cds_offset = 0, num_cds = 0;
+    blk.file_id_ = 0;
+    while (offset < snapshot_size) {
+        if (!unique_blocks.empty() && random_ratio() < dup_ratio) {
+            blk.SetValue(unique_blocks[rand() % unique_blocks.size()]);
+            num_dups++;
+        }
+        else {
+            random_hash(blk.cksum_);
+            blk.size_ = min_block + rand() % (max_block - min_block + 1);
+            unique_blocks.push_back(blk);
+            if (cds_output.is_open() && random_ratio() < cds_overlap) {
+                blk.offset_ = cds_offset;
+                blk.Save(cds_output);
+                cds_offset += blk.size_;
+                num_cds++;
+            }
+        }
+        blk.offset_ = offset;
+        blk.Save(trace_output);
+        offset += blk.size_;
+        num_blocks++;
+    }
+    trace_output.close();
+    if (cds_output.is_open())
+        cds_output.close();
+
+    pr_msg("%llu blocks, %llu bytes, %llu duplicate blocks, %llu blocks in CDS",
+           (unsigned long long)num_blocks, (unsigned long long)offset,
+           (unsigned long long)num_dups, (unsigned long long)num_cds);
+    return 0;
+}
@@ -6,6 +6,8 @@
 #include <map>
 #include <set>
 #include <exception>
+#include <pthread.h>
+#include <unistd.h>
 #include "../sampling/dedup_types.hpp"
 
 //AA??????????????????a.1000-????-ttttt-full.vhd.bv4
@@ -22,7 +24,13 @@ void usage(char *progname)
                 "  --parent\n"*/
                 "  --segthresh <segment threshold>\n"
                 "  --blkthresh <block threshold>\n"
+                "  --tsegthresh <segment threshold of later snapshots>\n"
+                "  --tblkthresh <block threshold of later snapshots>\n"
+                "  --snapshots <snapshots per VM>\n"
+                "  --loops <number of times the VM list is used>\n"
+                "  --startloop <first loop>\n"
                 "  --rseed <seed>\n"
+                "  --threads <VMs generated in parallel, output does not depend on it>\n"
                 "  --cdsfile <path>\n"
                 "  --outputdir <path> - traceprefix is prepended\n"
                 /*"  --tracefile <path> - file containing list of traces\n"*/
@@ -62,15 +70,125 @@ class Hash {
     }
 };
 
+/*
+ * rand() sequence of glibc for one stream: every snapshot draws from its own
+ * generator, so threads can generate snapshots in any order and the output
+ * stays the same as the single threaded one for the same seed
+ */
+class TraceRng {
+public:
+    TraceRng(unsigned int seed) {
+        memset(&data_, 0, sizeof(data_));
+        initstate_r(seed, state_, sizeof(state_), &data_);
+    }
+
+    double NextRatio() {
+        int32_t r;
+        random_r(&data_, &r);
+        return (double)r / RAND_MAX;
+    }
+
+private:
+    char state_[128];		// same state size as rand()
+    struct random_data data_;
+};
+
+/*
+ * reads trace records in READ_BUFFER_SIZE chunks
+ */
+class TraceInput {
+public:
+    TraceInput() : buf_(READ_BUFFER_SIZE), pos_(0), len_(0) {}
+
+    bool Open(const char* path) {
+        is_.open(path, std::ios_base::in | std::ios_base::binary);
+        return is_.is_open();
+    }
+
+    bool Next(Block& blk) {
+        if (pos_ + RECORD_SIZE > len_) {
+            // keep a partial record and refill
+            memmove(&buf_[0], &buf_[pos_], len_ - pos_);
+            len_ -= pos_;
+            pos_ = 0;
+            is_.read(&buf_[len_], buf_.size() - len_);
+            len_ += is_.gcount();
+            if (len_ < RECORD_SIZE)
+                return false;
+        }
+        const char* rec = &buf_[pos_];
+        memcpy(blk.cksum_, rec, CKSUM_LEN);
+        memcpy(&blk.file_id_, rec + CKSUM_LEN, sizeof(Block::file_id_));
+        memcpy(&blk.size_, rec + CKSUM_LEN + sizeof(Block::file_id_), sizeof(Block::size_));
+        memcpy(&blk.offset_, rec + CKSUM_LEN + sizeof(Block::file_id_) + sizeof(Block::size_), sizeof(Block::offset_));
+        pos_ += RECORD_SIZE;
+        return true;
+    }
+
+private:
+    ifstream is_;
+    vector<char> buf_;
+    size_t pos_;
+    size_t len_;
+};
+
+/*
+ * writes trace records in READ_BUFFER_SIZE chunks
+ */
+class TraceOutput {
+public:
+    TraceOutput() : buf_(READ_BUFFER_SIZE), len_(0) {}
+
+    ~TraceOutput() {
+        Close();
+    }
+
+    bool Open(const string& path) {
+        os_.open(path.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        return os_.is_open();
+    }
+
+    void Save(const Segment& seg) {
+        for (size_t i = 0; i < seg.blocklist_.size(); i++) {
+            if (len_ + RECORD_SIZE > buf_.size())
+                Flush();
+            const Block& blk = seg.blocklist_[i];
+            char* rec = &buf_[len_];
+            memcpy(rec, blk.cksum_, CKSUM_LEN);
+            memcpy(rec + CKSUM_LEN, &blk.file_id_, sizeof(Block::file_id_));
+            memcpy(rec + CKSUM_LEN + sizeof(Block::file_id_), &blk.size_, sizeof(Block::size_));
+            memcpy(rec + CKSUM_LEN + sizeof(Block::file_id_) + sizeof(Block::size_), &blk.offset_, sizeof(Block::offset_));
+            len_ += RECORD_SIZE;
+        }
+    }
+
+    void Flush() {
+        os_.write(&buf_[0], len_);
+        len_ = 0;
+    }
+
+    void Close() {
+        if (os_.is_open()) {
+            Flush();
+            os_.close();
+        }
+    }
+
+private:
+    ofstream os_;
+    vector<char> buf_;
+    size_t len_;
+};
+
 /*
  * Load a 2MB segment from trace
  */
 
-bool load_segment(Segment& seg, ifstream& is)
+bool load_segment(Segment& seg, TraceInput& is)
 {
     Block blk;
     seg.Init();
-    while (blk.Load(is)) {
+    while (is.Next(blk)) {
         if (blk.GetSize() == 0) {	// fix the zero-sized block bug in scanner
             //pr_msg("ignore zero-sized block");
             continue;
@@ -86,40 +204,120 @@ bool load_segment(Segment& seg, ifstream& is)
         return true;
 }
 
-//loads a segment and makes random modifications
-bool load_rand_segment(Segment& seg, ifstream& is, double blk_threshold, double seg_threshold, unsigned long int &seg_changed, unsigned long int &blk_changed)
+/*
+ * makes random modifications to a loaded segment; segment boundaries only
+ * depend on block sizes, so the segments of a generated snapshot are exactly
+ * the segments of its parent and a whole chain of snapshots can be derived
+ * segment by segment in one pass
+ */
+void rand_segment(Segment& seg, TraceRng& rng, double blk_threshold, double seg_threshold, unsigned long int &seg_changed, unsigned long int &blk_changed)
 {
     if (blk_threshold == 0 || seg_threshold == 0)
-        return load_segment(seg,is);
-    if (((double)rand() / RAND_MAX) > seg_threshold)
-        return load_segment(seg,is);
+        return;
+    if (rng.NextRatio() > seg_threshold)
+        return;
 
-    Block blk;
-    seg.Init();
     double rd;
-    while (blk.Load(is)) {
-        if (blk.GetSize() == 0) {	// fix the zero-sized block bug in scanner
-            //pr_msg("ignore zero-sized block");
-            continue;
-        }
-        rd = (double)rand() / RAND_MAX;
+    for (size_t i = 0; i < seg.blocklist_.size(); i++) {
+        rd = rng.NextRatio();
         if (rd <= blk_threshold)
         {
             blk_changed++;
-            rd = (double)rand() / RAND_MAX;
-            memcpy(&blk.cksum_[4],&rd,sizeof(rd));
+            rd = rng.NextRatio();
+            memcpy(&seg.blocklist_[i].cksum_[4],&rd,sizeof(rd));
         }
-        seg.AddBlock(blk);
-        if (seg.GetSize() >= 2*1024*1024)
-            break;
     }
-    //seg.Final();
-    if (seg.GetSize() == 0 || seg.blocklist_.size() == 0) 
-        return false;
-    else {
-        seg_changed++;
-        return true;
+    seg_changed++;
+}
+
+/*
+ * the snapshot history of one VM in one loop
+ */
+struct VMJob {
+    int vmindex_;
+    unsigned long int vmid_;
+    string trace_path_;
+};
+
+struct GenParams {
+    vector<VMJob> jobs_;
+    string tracefile_prefix_;
+    string tracefile_suffix_;
+    string output_dir_;
+    unsigned int seed_;
+    unsigned int snapshot_count_;
+    double blk_threshold_;
+    double seg_threshold_;
+    double tblk_threshold_;
+    double tseg_threshold_;
+    volatile uint32_t next_job_;
+    pthread_mutex_t lock_;
+};
+
+void generate_vm(GenParams& params, const VMJob& job)
+{
+    stringstream log;
+    unsigned int n = params.snapshot_count_;
+    vector<TraceOutput*> outputs(n);
+    vector<TraceRng*> rngs(n);
+    vector<unsigned long int> seg_changed(n, 0), blk_changed(n, 0);
+    unsigned long int seg_count = 0, blk_count = 0;
+
+    TraceInput input;
+    if (!input.Open(job.trace_path_.c_str())) {
+        pr_msg("unable to open %s", job.trace_path_.c_str());
+        exit(1);
+    }
+    log << "snapshot trace file " << job.vmindex_ << ".0: " << job.trace_path_ << endl;
+    for (unsigned int k = 0; k < n; k++) {
+        stringstream outpath_stream;
+        outpath_stream << setfill('0');
+        outpath_stream << params.tracefile_prefix_ << params.output_dir_ << "/" << setw(21) << job.vmid_ << ".1000-0000-" << setw(5) << k << "-full.vhd" << params.tracefile_suffix_;
+        outputs[k] = new TraceOutput();
+        if (!outputs[k]->Open(outpath_stream.str())) {
+            pr_msg("unable to open %s", outpath_stream.str().c_str());
+            exit(1);
+        }
+        unsigned int tseed = params.seed_ * ((unsigned int)job.vmid_) * (k+1);
+        rngs[k] = new TraceRng(tseed);
+        log << "output snapshot (" << job.vmid_ << "." << k << "): " << outpath_stream.str() << endl;
+        log << "  Seed: " << tseed << endl;
+    }
+
+    // snapshot k is derived from snapshot k - 1, the first one from the input trace
+    Segment seg;
+    while (load_segment(seg, input)) {
+        seg_count++;
+        blk_count += seg.blocklist_.size();
+        for (unsigned int k = 0; k < n; k++) {
+            if (k == 0)
+                rand_segment(seg, *rngs[k], params.blk_threshold_, params.seg_threshold_, seg_changed[k], blk_changed[k]);
+            else
+                rand_segment(seg, *rngs[k], params.tblk_threshold_, params.tseg_threshold_, seg_changed[k], blk_changed[k]);
+            outputs[k]->Save(seg);
+        }
+    }
+
+    for (unsigned int k = 0; k < n; k++) {
+        outputs[k]->Close();
+        delete outputs[k];
+        delete rngs[k];
+        log << "snapshot " << job.vmid_ << "." << k << endl;
+        log << "  Changed " << seg_changed[k] << "/" << seg_count << " Segments (" << ((100.0 * seg_changed[k]) / seg_count) << "%)" << endl;
+        log << "  Changed " << blk_changed[k] << "/" << blk_count << " Blocks (" << ((100.0 * blk_changed[k]) / blk_count) << "%)" << endl;
     }
+    pthread_mutex_lock(&params.lock_);
+    cout << log.str();
+    pthread_mutex_unlock(&params.lock_);
+}
+
+void* generate_worker(void* arg)
+{
+    GenParams* params = (GenParams*)arg;
+    uint32_t i;
+    while ((i = __sync_fetch_and_add(&params->next_job_, 1)) < params->jobs_.size())
+        generate_vm(*params, params->jobs_[i]);
+    return NULL;
 }
 
 int main(int argc, char** argv)
@@ -132,10 +330,10 @@ int main(int argc, char** argv)
     //std::vector<Segment> indexBlocks;
     //std::vector<Block>::iterator it;
     Segment current_seg;
-    ifstream current_input, trace_input, cds_input, vmlist_input;
-    ofstream current_output;
+    ifstream trace_input, vmlist_input;
+    TraceInput cds_input;
     //ofstream output;
-    uint32_t i, j, k;
+    uint32_t i;
     //bool isdup;
     Block blk;
     map<Hash, int> cds;
@@ -147,7 +345,6 @@ int main(int argc, char** argv)
     //}
     int argindex = 1;
 
-    int vmtraceindex = 0;
     int vmindex = 0;
 
     bool do_containers = false;
@@ -158,14 +355,12 @@ int main(int argc, char** argv)
     double tblk_threshold = 0;
     double tseg_threshold = 0;
     int cds_every = 1;
-    int trace_index = 0;
-    unsigned int seed;
-    unsigned int tseed;
+    unsigned int seed = 1;
+    unsigned int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
     unsigned int loops = 1;
     unsigned int loopindex = 0;
     unsigned int start_loop = 0;
     unsigned int snapshot_count = 1;
-    unsigned int snapshot_index = 0;
     unsigned long int vmid = 0;
 
     string tracefile_prefix, tracefile_suffix, output_dir;
@@ -228,6 +423,13 @@ int main(int argc, char** argv)
                 return 0;
             }
             seed = (unsigned int)atol(argv[argindex++]);
+        } else if (strcmp(argv[argindex],"--threads") == 0) {
+            argindex++;
+            if (argindex >= argc) {
+                usage(argv[0]);
+                return 0;
+            }
+            num_threads = (unsigned int)atol(argv[argindex++]);
         } else if (strcmp(argv[argindex],"--cdsfile") == 0) {
             use_cds_file = true;
             argindex++;
@@ -235,8 +437,7 @@ int main(int argc, char** argv)
                 usage(argv[0]);
                 return 0;
             }
-            cds_input.open(argv[argindex++], std::ios_base::in);
-            if (!cds_input.is_open()) {
+            if (!cds_input.Open(argv[argindex++])) {
                 pr_msg("unable to open %s", argv[argindex-1]);
                 exit(1);
             }
@@ -294,6 +495,20 @@ int main(int argc, char** argv)
         }
     }
     
+    GenParams params;
+    params.tracefile_prefix_ = tracefile_prefix;
+    params.tracefile_suffix_ = tracefile_suffix;
+    params.output_dir_ = output_dir;
+    params.seed_ = seed;
+    params.snapshot_count_ = snapshot_count;
+    params.blk_threshold_ = blk_threshold;
+    params.seg_threshold_ = seg_threshold;
+    params.tblk_threshold_ = tblk_threshold;
+    params.tseg_threshold_ = tseg_threshold;
+    params.next_job_ = 0;
+    pthread_mutex_init(&params.lock_, NULL);
+
+    // collect the VM histories to generate, the first trace of each VM is the base
     loopindex = start_loop;
 
     while(loopindex < loops) {
@@ -302,123 +517,35 @@ int main(int argc, char** argv)
             vmlist_input.clear();
             vmlist_input.seekg(0,ios::beg);
         }
-        cout << "Beggining loop " << loopindex << endl;
         vmid = (unsigned long int)1009 * (unsigned long int)(loopindex+1);
 
         while(vmlist_input.good()) {
             string line;
-            const char *cur_vm_path;
-            int cds_containers = 0;
-            vmtraceindex = 0;
-            snapshot_index = 0;
-
             getline(vmlist_input,line);
-            cur_vm_path = line.c_str();
-            if (strlen(cur_vm_path) < 1 || cur_vm_path[0] == '\n') {
+            if (line.length() < 1) {
                 continue;
             }
             if (trace_input.is_open()) {
                 trace_input.close();
             }
-            cout << "VM file (" << vmindex << "): " << cur_vm_path << endl;
-            trace_input.open(cur_vm_path, std::ios_base::in);
+            trace_input.clear();
+            trace_input.open(line.c_str(), std::ios_base::in);
             if (!trace_input.is_open()) {
-                pr_msg("unable to open %s", cur_vm_path);
+                pr_msg("unable to open %s", line.c_str());
                 exit(1);
             }
 
             while(trace_input.good()) {
-                unsigned long int seg_changed = 0;
-                unsigned long int blk_changed = 0;
-                unsigned long int seg_count = 0;
-                unsigned long int blk_count = 0;
-                const char *cur_trace_path;
                 string cur_tracefile_name;
-                stringstream tracepath_stream;
-                double temp_cds_percent;
-
                 getline(trace_input,cur_tracefile_name);
-
-                tracepath_stream << tracefile_prefix << cur_tracefile_name << tracefile_suffix;
-                cur_trace_path = tracepath_stream.str().c_str();
-                if (cur_tracefile_name.length() < 1 || cur_trace_path[0] == '\n') {
+                if (cur_tracefile_name.length() < 1) {
                     continue;
                 }
-
-                current_input.open(cur_trace_path, std::ios_base::in | std::ios_base::binary);
-                if (!current_input.is_open()) {
-                    pr_msg("unable to open %s", cur_trace_path);
-                    exit(1);
-                }
-                printf("snapshot trace file %d.%d: %s\n", vmindex, vmtraceindex,cur_trace_path);
-                stringstream outpath_stream;
-                outpath_stream << setfill('0');
-                outpath_stream << tracefile_prefix << output_dir << "/" << setw(21) << vmid << ".1000-0000-" << setw(5) << snapshot_index << "-full.vhd" << tracefile_suffix;
-                cout << "output snapshot (" << vmid << "." << snapshot_index << "): " << outpath_stream.str() << endl;
-                current_output.open(outpath_stream.str().c_str(), std::ios_base::out | std::ios_base::binary);
-                if (!current_output.is_open()) {
-                    pr_msg("unable to open %s", outpath_stream.str().c_str());
-                    exit(1);
-                }
-
-
-
-                tseed = seed * ((unsigned int)vmid) * (snapshot_index+1);
-                srand(tseed);
-                cout << "  Seed: " << tseed << endl;
-                seg_count = 0;
-                blk_count = 0;
-                seg_changed = 0;
-                blk_changed = 0;
-                while(load_rand_segment(current_seg, current_input, blk_threshold, seg_threshold, seg_changed, blk_changed)) {
-                    seg_count++;
-                    blk_count += current_seg.blocklist_.size();
-                    current_seg.Save(current_output);
-                }
-                cout << "  Changed " << seg_changed << "/" << seg_count << " Segments (" << ((100.0 * seg_changed) / seg_count) << "%)" << endl;
-                cout << "  Changed " << blk_changed << "/" << blk_count << " Blocks (" << ((100.0 * blk_changed) / blk_count) << "%)" << endl;
-                snapshot_index++;
-
-                current_input.close();
-                current_output.close();
-
-                while (snapshot_index < snapshot_count) {
-                    current_input.open(outpath_stream.str().c_str(), std::ios_base::in | std::ios_base::binary);
-                    if (!current_input.is_open()) {
-                        pr_msg("unable to open %s", outpath_stream.str().c_str());
-                        exit(1);
-                    }
-                    outpath_stream.str(std::string());
-                    outpath_stream << tracefile_prefix << output_dir << "/" << setw(21) << vmid << ".1000-0000-" << setw(5) << snapshot_index << "-full.vhd" << tracefile_suffix;
-                    cout << "output snapshot (" << vmid << "." << snapshot_index << "): " << outpath_stream.str() << endl;
-                    current_output.open(outpath_stream.str().c_str(), std::ios_base::out | std::ios_base::binary);
-                    if (!current_input.is_open()) {
-                        pr_msg("unable to open %s", outpath_stream.str().c_str());
-                        exit(1);
-                    }
-
-                    tseed = seed * ((unsigned int)vmid) * (snapshot_index+1);
-                    cout << "  Seed: " << tseed << endl;
-                    srand(tseed);
-                    seg_count = 0;
-                    blk_count = 0;
-                    seg_changed = 0;
-                    blk_changed = 0;
-                    while(load_rand_segment(current_seg, current_input, tblk_threshold, tseg_threshold, seg_changed, blk_changed)) {
-                        seg_count++;
-                        blk_count += current_seg.blocklist_.size();
-                        current_seg.Save(current_output);
-                    }
-                    cout << "  Changed " << seg_changed << "/" << seg_count << " Segments (" << ((100.0 * seg_changed) / seg_count) << "%)" << endl;
-                    cout << "  Changed " << blk_changed << "/" << blk_count << " Blocks (" << ((100.0 * blk_changed) / blk_count) << "%)" << endl;
-
-                    current_input.close();
-                    current_output.close();
-                    snapshot_index++;
-                }
-
-                trace_index++;
-                vmtraceindex++;
+                VMJob job;
+                job.vmindex_ = vmindex;
+                job.vmid_ = vmid;
+                job.trace_path_ = tracefile_prefix + cur_tracefile_name + tracefile_suffix;
+                params.jobs_.push_back(job);
                 break; // move on to the next VM
             }
 
@@ -427,5 +554,16 @@ int main(int argc, char** argv)
         }
         loopindex++;
     }
+
+    cout << "Generating " << snapshot_count << " snapshots for " << params.jobs_.size()
+         << " VMs with " << num_threads << " threads" << endl;
+    if (snapshot_count == 0 || num_threads == 0)
+        return 0;
+    vector<pthread_t> threads(num_threads);
+    for (i = 0; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, generate_worker, &params);
+    for (i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&params.lock_);
     return 0;
 }
@@ -0,0 +1,178 @@
+/*
+ * Bulk version of cds_loader for large CDS:
+ * 1. Copy the data file to QFS with large buffered writes
+ * 2. Sort and dedupe the index with several threads
+ * 3. Write the index file for the embedded cds index
+ * 4. Optionally push the index to memcached over several connections,
+ *    with pipelined noreply sets
+ * Set LOCAL_FS_ROOT to write the CDS data file into a local directory instead of QFS
+ */
+
+#include <iostream>
+#include <thread>
+#include "cds_index.h"
+#include "cds_embedded_index.h"
+#include "../include/file_helper.h"
+#include "../include/file_system_helper.h"
+#include "../fs/qfs_file_system_helper.h"
+#include "../fs/local_file_system_helper.h"
+#include "data_source.h"
+#include "trace_types.h"
+#include "snapshot_types.h"
+#include "../common/timer.h"
+
+using namespace std;
+using namespace log4cxx;
+using namespace log4cxx::xml;
+using namespace log4cxx::helpers;
+
+#define DEFAULT_WRITE_BUFFER_SIZE (64 * 1024 * 1024)
+#define BULK_SET_BATCH 4096
+
+LoggerPtr cds_bulk_logger(Logger::getLogger("BigArchive.CDS.BulkLoader"));
+
+void usage(char* progname)
+{
+    cout << "Usage: " << progname << ": [options] cds_name cds_file sample_file" << endl
+         << "  --index FILE      write the embedded cds index to FILE" << endl
+         << "  --threads N       sort the index with N threads (default 4)" << endl
+         << "  --memcached N     push the index to memcached over N connections (default 0, no push)" << endl
+         << "  --buffer MB       size of the data write buffer (default 64)" << endl;
+}
+
+/*
+ * copy block data of the cds to QFS and collect its index entries
+ */
+bool load_data(DataSource& source, FileHelper* fh, size_t buffer_size, vector<CdsIndexEntry>& entries)
+{
+    BlockMeta bm;
+    CdsIndexEntry entry;
+    uint64_t offset = 0;
+    char* buffer = new char[buffer_size];
+    size_t used = 0;
+    bool ok = true;
+
+    entries.reserve(source.GetSnapshotSize() / AVG_BLOCK_SIZE);
+    while (ok && source.GetBlock(bm)) {
+        if (used + bm.size_ > buffer_size) {
+            ok = (fh->WriteData(buffer, used) == (int)used);
+            used = 0;
+        }
+        memcpy(buffer + used, bm.data_, bm.size_);
+        used += bm.size_;
+        memcpy(entry.cksum_, bm.cksum_.data_, CKSUM_LEN);
+        entry.offset_ = offset;
+        entries.push_back(entry);
+        offset += bm.size_;
+    }
+    if (ok && used > 0)
+        ok = (fh->WriteData(buffer, used) == (int)used);
+    if (!ok)
+        LOG4CXX_ERROR(cds_bulk_logger, "Couldn't write cds data at offset " << offset);
+    delete[] buffer;
+    return ok;
+}
+
+/*
+ * every connection pushes a contiguous slice of the entries from its own thread
+ */
+size_t push_to_memcached(const vector<CdsIndexEntry>& entries, int num_conns)
+{
+    vector<size_t> num_sent(num_conns, 0);
+    vector<thread> workers;
+    for (int i = 0; i < num_conns; ++i) {
+        workers.push_back(thread([&entries, &num_sent, num_conns, i]() {
+            CdsIndex cds(kCdsIndexOptions);
+            size_t begin = entries.size() * i / num_conns;
+            size_t end = entries.size() * (i + 1) / num_conns;
+            for (size_t pos = begin; pos < end; pos += BULK_SET_BATCH)
+                num_sent[i] += cds.BatchSet(&entries[pos], min((size_t)BULK_SET_BATCH, end - pos));
+        }));
+    }
+    size_t total = 0;
+    for (int i = 0; i < num_conns; ++i) {
+        workers[i].join();
+        total += num_sent[i];
+    }
+    return total;
+}
+
+int main(int argc, char** argv)
+{
+    string index_pathname;
+    int num_threads = 4;
+    int num_conns = 0;
+    size_t buffer_size = DEFAULT_WRITE_BUFFER_SIZE;
+    int argi = 1;
+    for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi += 2) {
+        if (argi + 1 >= argc) {
+            usage(argv[0]);
+            return -1;
+        }
+        if (strcmp(argv[argi], "--index") == 0)
+            index_pathname = argv[argi + 1];
+        else if (strcmp(argv[argi], "--threads") == 0)
+            num_threads = atoi(argv[argi + 1]);
+        else if (strcmp(argv[argi], "--memcached") == 0)
+            num_conns = atoi(argv[argi + 1]);
+        else if (strcmp(argv[argi], "--buffer") == 0)
+            buffer_size = (size_t)atoi(argv[argi + 1]) * 1024 * 1024;
+        else {
+            cout << "Unknown option: " << argv[argi] << endl;
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (argc - argi != 3 || buffer_size < MAX_BLOCK_SIZE) {
+        usage(argv[0]);
+        return -1;
+    }
+    DOMConfigurator::configure("Log4cxxConfig.xml");
+    string cds_name(argv[argi]);
+    string cds_pathname(argv[argi + 1]);
+    string sample_pathname(argv[argi + 2]);
+    string qfs_cds_dir = "/cds";
+    string qfs_cds_file = qfs_cds_dir + "/" + cds_name;
+
+    DataSource source(cds_pathname, sample_pathname);
+    vector<CdsIndexEntry> entries;
+    bool ok = false;
+
+    const char* local_fs_root = getenv("LOCAL_FS_ROOT");
+    if (local_fs_root != NULL)
+        LocalFSHelper::Connect(local_fs_root);
+    else
+        QFSHelper::Connect();
+
+    if (FileSystemHelper::GetInstance()->IsDirectoryExists(qfs_cds_dir)) {
+        FileSystemHelper::GetInstance()->RemoveDirectory(qfs_cds_dir);
+    }
+    FileSystemHelper::GetInstance()->CreateDirectory(qfs_cds_dir);
+
+    FileHelper* fh = FileSystemHelper::GetInstance()->CreateFileHelper(qfs_cds_file, O_WRONLY);
+    fh->Create();
+    MEASURE(ok = load_data(source, fh, buffer_size, entries));
+    fh->Close();
+    FileSystemHelper::GetInstance()->DestroyFileHelper(fh);
+    if (!ok)
+        return -1;
+
+    size_t num_blocks = entries.size();
+    MEASURE(CdsEmbeddedIndex::SortEntries(entries, num_threads));
+    LOG4CXX_INFO(cds_bulk_logger, num_blocks << " blocks loaded, " << entries.size() << " unique");
+
+    if (!index_pathname.empty()) {
+        MEASURE(ok = CdsEmbeddedIndex::WriteSortedIndexFile(entries, index_pathname));
+        if (!ok)
+            return -1;
+    }
+
+    if (num_conns > 0) {
+        size_t num_sent = 0;
+        MEASURE(num_sent = push_to_memcached(entries, num_conns));
+        LOG4CXX_INFO(cds_bulk_logger, num_sent << " index entries pushed to memcached");
+    }
+
+    TIMER_PRINT_ALL();
+    exit(0);
+}
@@ -51,6 +51,11 @@ CdsCache::CdsCache(const string& mc_options)
 void CdsCache::Init()
 {
     memcached_return_t rc;
+    // no memcached options, the subclass doesn't keep its data in memcached
+    if (options_.empty()) {
+        p_memcache_ = NULL;
+        return;
+    }
     p_memcache_ = memcached(options_.c_str(), options_.size());
     hashkit_st *p_newkit = hashkit_create(NULL);
     if (p_newkit != NULL) {
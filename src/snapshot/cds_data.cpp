@@ -6,12 +6,17 @@ LoggerPtr cds_data_logger(Logger::getLogger("BigArchive.CDS.Data"));
 CdsData::CdsData(const string& cds_name, const string& mc_options) : CdsCache(mc_options)
 {
     string cds_datafile = "/cds/" + cds_name;
-    p_cdsdata_ = FileSystemHelper::GetInstance()->CreateFileHelper(cds_datafile, O_RDONLY);
+    p_cdsdata_ = FileSystemHelper::GetInstance()->CreateFileHelper(cds_datafile, O_RDONLY, ACCESS_RANDOM);
     p_cdsdata_->Open();
+    has_prefetch_ = false;
+    prefetch_offset_ = 0;
+    prefetch_len_ = 0;
 }
 
 bool CdsData::GetFromCache(const Checksum& cksum, char *buf, size_t* len)
 {
+    if (p_memcache_ == NULL)
+        return false;
     memcached_return_t rc;
     char* value = memcached_get(p_memcache_, cksum.data_, CKSUM_LEN, len, uint32_t(0), &rc);
     if (rc != MEMCACHED_SUCCESS) {
@@ -29,6 +34,8 @@ bool CdsData::GetFromCache(const Checksum& cksum, char *buf, size_t* len)
 
 bool CdsData::PutToCache(const Checksum& cksum, char *buf, size_t len)
 {
+    if (p_memcache_ == NULL)
+        return false;
     memcached_return_t rc;
     rc = memcached_set(p_memcache_, cksum.data_, CKSUM_LEN, buf, len, (time_t)0, (uint32_t)0);
     if (rc != MEMCACHED_SUCCESS) {
@@ -40,13 +47,48 @@ bool CdsData::PutToCache(const Checksum& cksum, char *buf, size_t len)
 
 int CdsData::ReadFromFS(uint64_t offset, char* buf, size_t len)
 {
-    p_cdsdata_->Seek(offset);
-    return p_cdsdata_->Read(buf, len);
+    // a prefetched block must be read at the file position to complete it
+    if (has_prefetch_ && offset == prefetch_offset_ && buf == prefetch_buf_) {
+        has_prefetch_ = false;
+        p_cdsdata_->Seek(offset);
+        return p_cdsdata_->Read(buf, len);
+    }
+    // PRead leaves an outstanding prefetch alone, complete it before
+    // prefetch_buf_ can be reused
+    if (has_prefetch_) {
+        has_prefetch_ = false;
+        p_cdsdata_->Seek(prefetch_offset_);
+        p_cdsdata_->Read(prefetch_buf_, prefetch_len_);
+    }
+    return p_cdsdata_->PRead(offset, buf, len);
+}
+
+void CdsData::Prefetch(const BlockMeta& bm)
+{
+    if (bm.size_ > MAX_BLOCK_SIZE)
+        return;
+    p_cdsdata_->Seek(bm.handle_);
+    if (p_cdsdata_->ReadPrefetch(prefetch_buf_, bm.size_) < 0)
+        return;
+    has_prefetch_ = true;
+    prefetch_offset_ = bm.handle_;
+    prefetch_len_ = bm.size_;
 }
 
 int CdsData::Read(BlockMeta& bm)
 {
     size_t s;
+    // the prefetched data is already on its way, skip memcache
+    if (has_prefetch_ && prefetch_offset_ == bm.handle_ && prefetch_len_ == bm.size_) {
+        s = ReadFromFS(bm.handle_, prefetch_buf_, bm.size_);
+        if (s == bm.size_)
+            PutToCache(bm.cksum_, prefetch_buf_, bm.size_);
+        else
+            LOG4CXX_ERROR(logger_, "Read " << s << "from FS, expect " << bm.size_);
+        string tmp(prefetch_buf_, s);
+        bm.DeserializeData(tmp);
+        return s;
+    }
     // first try to get data from memcache, key is the checksum
     if (GetFromCache(bm.cksum_, buf_, &s)) {
         if (s == bm.size_) {
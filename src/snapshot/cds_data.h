@@ -32,6 +32,12 @@ public:
      */
     int Read(BlockMeta& bm);
 
+    /*
+     * start reading a block from the CDS data file in the background,
+     * a following Read of the same block completes it
+     */
+    void Prefetch(const BlockMeta& bm);
+
 private:
     /*
      * read from file system
@@ -41,6 +47,10 @@ private:
 private:
     FileHelper* p_cdsdata_;
     char buf_[MAX_BLOCK_SIZE];
+    char prefetch_buf_[MAX_BLOCK_SIZE];
+    bool has_prefetch_;
+    uint64_t prefetch_offset_;
+    size_t prefetch_len_;
 };
 
 #endif
@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <thread>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "cds_embedded_index.h"
+#include "../include/exception.h"
+#include "../common/timer.h"
+
+static bool entry_less(const CdsIndexEntry& a, const CdsIndexEntry& b)
+{
+    int cmp = memcmp(a.cksum_, b.cksum_, CKSUM_LEN);
+    if (cmp != 0)
+        return cmp < 0;
+    return a.offset_ < b.offset_;
+}
+
+static bool entry_equal(const CdsIndexEntry& a, const CdsIndexEntry& b)
+{
+    return memcmp(a.cksum_, b.cksum_, CKSUM_LEN) == 0;
+}
+
+CdsEmbeddedIndex::CdsEmbeddedIndex(const string& pathname)
+    : CdsIndex(string()), pathname_(pathname), map_addr_(NULL), map_size_(0), 
+      num_entries_(0), buckets_(NULL), entries_(NULL)
+{
+    int fd = open(pathname.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG4CXX_ERROR(logger_, "Couldn't open cds index " << pathname << ": " << strerror(errno));
+        THROW_EXCEPTION(FileOpenException, pathname);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CdsIndexFileHeader)) {
+        close(fd);
+        LOG4CXX_ERROR(logger_, "Cds index " << pathname << " is too small");
+        THROW_EXCEPTION(StreamCorruptedException, pathname);
+    }
+    map_size_ = st.st_size;
+    void* addr = mmap(NULL, map_size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        LOG4CXX_ERROR(logger_, "Couldn't mmap cds index " << pathname << ": " << strerror(errno));
+        THROW_EXCEPTION(FileOpenException, pathname);
+    }
+    map_addr_ = (char*)addr;
+
+    const CdsIndexFileHeader* header = (const CdsIndexFileHeader*)map_addr_;
+    num_entries_ = header->num_entries_;
+    if (memcmp(header->magic_, CDS_INDEX_MAGIC, CDS_INDEX_MAGIC_LEN) != 0 ||
+        map_size_ != sizeof(CdsIndexFileHeader) + num_entries_ * sizeof(CdsIndexEntry)) {
+        munmap(map_addr_, map_size_);
+        map_addr_ = NULL;
+        LOG4CXX_ERROR(logger_, "Bad cds index file " << pathname);
+        THROW_EXCEPTION(StreamCorruptedException, pathname);
+    }
+    buckets_ = header->buckets_;
+    entries_ = (const CdsIndexEntry*)(map_addr_ + sizeof(CdsIndexFileHeader));
+    madvise(map_addr_, map_size_, MADV_RANDOM);
+    LOG4CXX_INFO(logger_, "Cds index " << pathname << " mapped, " << num_entries_ << " entries");
+}
+
+CdsEmbeddedIndex::~CdsEmbeddedIndex()
+{
+    if (map_addr_ != NULL)
+        munmap(map_addr_, map_size_);
+}
+
+void CdsEmbeddedIndex::LoadCds(istream& is)
+{
+    LOG4CXX_ERROR(logger_, "Embedded cds index is read-only, rebuild " << pathname_ << " instead");
+}
+
+bool CdsEmbeddedIndex::Set(Checksum& cksum, uint64_t offset)
+{
+    LOG4CXX_ERROR(logger_, "Embedded cds index is read-only, rebuild " << pathname_ << " instead");
+    return false;
+}
+
+size_t CdsEmbeddedIndex::BatchSet(const CdsIndexEntry* entries, size_t num_entries)
+{
+    LOG4CXX_ERROR(logger_, "Embedded cds index is read-only, rebuild " << pathname_ << " instead");
+    return 0;
+}
+
+const CdsIndexEntry* CdsEmbeddedIndex::Find(const char* cksum) const
+{
+    uint32_t bucket = BucketOf(cksum);
+    uint64_t lo = buckets_[bucket], hi = buckets_[bucket + 1];
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(entries_[mid].cksum_, cksum, CKSUM_LEN);
+        if (cmp == 0)
+            return &entries_[mid];
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+
+bool CdsEmbeddedIndex::Get(const Checksum& cksum, uint64_t* offset)
+{
+    uint64_t start = MonotonicNanos();
+    const CdsIndexEntry* entry = Find(cksum.data_);
+    CountQueries(1, entry != NULL, (MonotonicNanos() - start) / 1000);
+    if (entry == NULL)
+        return false;
+    memcpy(offset, &entry->offset_, sizeof(uint64_t));
+    return true;
+}
+
+bool CdsEmbeddedIndex::BatchGet(const Checksum* cksums, size_t num_cksums, bool *results, uint64_t *offsets)
+{
+    uint64_t start = MonotonicNanos();
+    // touch the middle of each bucket first so page faults overlap
+    for (size_t i = 0; i < num_cksums; ++i) {
+        uint32_t bucket = BucketOf(cksums[i].data_);
+        __builtin_prefetch(&entries_[(buckets_[bucket] + buckets_[bucket + 1]) / 2]);
+    }
+    size_t num_hits = 0;
+    for (size_t i = 0; i < num_cksums; ++i) {
+        const CdsIndexEntry* entry = Find(cksums[i].data_);
+        results[i] = entry != NULL;
+        if (entry != NULL) {
+            memcpy(&offsets[i], &entry->offset_, sizeof(uint64_t));
+            num_hits++;
+        }
+    }
+    CountQueries(num_cksums, num_hits, (MonotonicNanos() - start) / 1000);
+    return true;
+}
+
+void CdsEmbeddedIndex::SortEntries(vector<CdsIndexEntry>& entries, int num_threads)
+{
+    if (num_threads < 1)
+        num_threads = 1;
+    vector<size_t> bounds;
+    for (int i = 0; i <= num_threads; ++i)
+        bounds.push_back(entries.size() * i / num_threads);
+
+    // sort one slice per thread, then merge neighbouring slices pairwise
+    vector<thread> workers;
+    for (int i = 0; i < num_threads; ++i)
+        workers.push_back(thread([&entries, &bounds, i]() {
+            sort(entries.begin() + bounds[i], entries.begin() + bounds[i + 1], entry_less);
+        }));
+    for (size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+    for (int width = 1; width < num_threads; width *= 2) {
+        workers.clear();
+        for (int i = 0; i + width < num_threads; i += 2 * width) {
+            size_t lo = bounds[i], mid = bounds[i + width], hi = bounds[min(i + 2 * width, num_threads)];
+            workers.push_back(thread([&entries, lo, mid, hi]() {
+                inplace_merge(entries.begin() + lo, entries.begin() + mid, entries.begin() + hi, entry_less);
+            }));
+        }
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+    }
+    entries.erase(unique(entries.begin(), entries.end(), entry_equal), entries.end());
+}
+
+bool CdsEmbeddedIndex::WriteIndexFile(vector<CdsIndexEntry>& entries, const string& pathname, int num_threads)
+{
+    SortEntries(entries, num_threads);
+    return WriteSortedIndexFile(entries, pathname);
+}
+
+bool CdsEmbeddedIndex::WriteSortedIndexFile(const vector<CdsIndexEntry>& entries, const string& pathname)
+{
+    CdsIndexFileHeader* header = new CdsIndexFileHeader;
+    memset(header, 0, sizeof(CdsIndexFileHeader));
+    memcpy(header->magic_, CDS_INDEX_MAGIC, CDS_INDEX_MAGIC_LEN);
+    header->num_entries_ = entries.size();
+    uint64_t pos = 0;
+    for (uint32_t bucket = 0; bucket <= CDS_INDEX_BUCKETS; ++bucket) {
+        while (pos < entries.size() && BucketOf(entries[pos].cksum_) < bucket)
+            ++pos;
+        header->buckets_[bucket] = pos;
+    }
+
+    // write to a temp file then rename, so readers never map a partial index
+    string tmp_pathname = pathname + ".tmp";
+    FILE* fp = fopen(tmp_pathname.c_str(), "wb");
+    if (fp == NULL) {
+        LOG4CXX_ERROR(logger_, "Couldn't create " << tmp_pathname << ": " << strerror(errno));
+        delete header;
+        return false;
+    }
+    bool ok = fwrite(header, sizeof(CdsIndexFileHeader), 1, fp) == 1;
+    if (ok && !entries.empty())
+        ok = fwrite(&entries[0], sizeof(CdsIndexEntry), entries.size(), fp) == entries.size();
+    ok = (fclose(fp) == 0) && ok;
+    delete header;
+    if (!ok || rename(tmp_pathname.c_str(), pathname.c_str()) != 0) {
+        LOG4CXX_ERROR(logger_, "Couldn't write cds index " << pathname << ": " << strerror(errno));
+        unlink(tmp_pathname.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool CdsEmbeddedIndex::BuildFromTrace(istream& is, const string& pathname)
+{
+    vector<CdsIndexEntry> entries;
+    CdsIndexEntry entry;
+    Block blk;
+    uint64_t offset = 0;
+    while (blk.FromStream(is)) {
+        memcpy(entry.cksum_, blk.cksum_.data_, CKSUM_LEN);
+        entry.offset_ = offset;
+        entries.push_back(entry);
+        offset += blk.size_;
+    }
+    return WriteIndexFile(entries, pathname);
+}
+
+CdsIndex* OpenCdsIndex(const string& index_file)
+{
+    if (index_file.empty())
+        return new CdsIndex();
+    return new CdsEmbeddedIndex(index_file);
+}
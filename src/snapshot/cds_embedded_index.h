@@ -0,0 +1,101 @@
+/*
+ * CDS index embedded in the process
+ *
+ * The index is a read-only file of fixed size entries (block hash -> offset
+ * in the CDS data file), sorted by block hash and prefixed with a bucket
+ * table on the first two bytes of the hash. Opening it is a single mmap, so
+ * all processes on a host share the same pages through the page cache and
+ * no memcached round trip is needed per lookup.
+ */
+
+#ifndef _CDS_EMBEDDED_INDEX_H_
+#define _CDS_EMBEDDED_INDEX_H_
+
+#include <string>
+#include <vector>
+#include "cds_index.h"
+#include "trace_types.h"
+
+#define CDS_INDEX_MAGIC "CDSIDX01"
+#define CDS_INDEX_MAGIC_LEN 8
+#define CDS_INDEX_BUCKETS 65536     // buckets on the first 2 bytes of hash
+
+struct CdsIndexFileHeader
+{
+    char magic_[CDS_INDEX_MAGIC_LEN];
+    uint64_t num_entries_;
+    uint64_t buckets_[CDS_INDEX_BUCKETS + 1];  // first entry of each bucket
+};
+
+class CdsEmbeddedIndex : public CdsIndex
+{
+public:
+    /*
+     * map an index file built by WriteIndexFile()
+     */
+    CdsEmbeddedIndex(const string& pathname);
+
+    ~CdsEmbeddedIndex();
+
+    /*
+     * the embedded index is read-only, use WriteIndexFile() to rebuild it
+     */
+    /* override */ void LoadCds(istream& is);
+
+    /* override */ bool Set(Checksum& cksum, uint64_t offset);
+
+    /* override */ size_t BatchSet(const CdsIndexEntry* entries, size_t num_entries);
+
+    /* override */ bool Get(const Checksum& cksum, uint64_t* offset);
+
+    /* override */ bool BatchGet(const Checksum* cksums, size_t num_cksums, bool *results, uint64_t *offsets);
+
+    uint64_t GetNumEntries() const { return num_entries_; }
+
+    /*
+     * sort entries by block hash with num_threads threads and drop
+     * duplicated hashes, the smallest offset of a hash is kept
+     */
+    static void SortEntries(vector<CdsIndexEntry>& entries, int num_threads = 1);
+
+    /*
+     * write entries already sorted by SortEntries() as an index file
+     * return false on IO error
+     */
+    static bool WriteSortedIndexFile(const vector<CdsIndexEntry>& entries, const string& pathname);
+
+    /*
+     * sort entries and write them as an index file
+     */
+    static bool WriteIndexFile(vector<CdsIndexEntry>& entries, const string& pathname, int num_threads = 1);
+
+    /*
+     * build an index file from a cds trace, offsets are the positions of
+     * the blocks when the trace is laid out sequentially (as cds_loader does)
+     */
+    static bool BuildFromTrace(istream& is, const string& pathname);
+
+    static uint32_t BucketOf(const char* cksum)
+    {
+        return ((uint32_t)(uint8_t)cksum[0] << 8) | (uint8_t)cksum[1];
+    }
+
+private:
+    const CdsIndexEntry* Find(const char* cksum) const;
+
+private:
+    string pathname_;
+    char* map_addr_;
+    size_t map_size_;
+    uint64_t num_entries_;
+    const uint64_t* buckets_;
+    const CdsIndexEntry* entries_;
+};
+
+/*
+ * open the cds index: the embedded index in index_file if it's given,
+ * the memcached index otherwise
+ */
+CdsIndex* OpenCdsIndex(const string& index_file);
+
+#endif
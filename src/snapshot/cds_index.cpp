@@ -1,5 +1,17 @@
 #include <unordered_map>
 #include "cds_index.h"
+#include "../common/metrics.h"
+#include "../common/timer.h"
+
+void CdsIndex::CountQueries(size_t num_queries, size_t num_hits, uint64_t latency_us)
+{
+    static MetricCounter* queries = Metrics::Counter("bigarchive_cds_queries_total", "Block hashes looked up in the CDS index");
+    static MetricCounter* hits = Metrics::Counter("bigarchive_cds_hits_total", "Block hashes found in the CDS index");
+    static MetricHistogram* latency = Metrics::Histogram("bigarchive_cds_query_latency_us", "Latency of CDS index (batch) lookups in microseconds");
+    queries->Inc(num_queries);
+    hits->Inc(num_hits);
+    latency->Observe(latency_us);
+}
 
 void CdsIndex::LoadCds(istream &is)
 {
@@ -23,22 +35,47 @@ bool CdsIndex::Set(Checksum& cksum, uint64_t offset)
     return true;
 }
 
+size_t CdsIndex::BatchSet(const CdsIndexEntry* entries, size_t num_entries)
+{
+    memcached_behavior_set(p_memcache_, MEMCACHED_BEHAVIOR_BUFFER_REQUESTS, 1);
+    memcached_behavior_set(p_memcache_, MEMCACHED_BEHAVIOR_NOREPLY, 1);
+    memcached_return_t rc;
+    size_t num_sent = 0;
+    for (size_t i = 0; i < num_entries; ++i) {
+        rc = memcached_set(p_memcache_, entries[i].cksum_, CKSUM_LEN, (char*)&entries[i].offset_, sizeof(uint64_t), (time_t)0, (uint32_t)0);
+        if (rc == MEMCACHED_SUCCESS || rc == MEMCACHED_BUFFERED)
+            ++ num_sent;
+        else
+            LOG4CXX_ERROR(logger_, "Couldn't set key: " << memcached_strerror(p_memcache_, rc));
+    }
+    rc = memcached_flush_buffers(p_memcache_);
+    if (rc != MEMCACHED_SUCCESS)
+        LOG4CXX_ERROR(logger_, "Couldn't flush buffered sets: " << memcached_strerror(p_memcache_, rc));
+    memcached_behavior_set(p_memcache_, MEMCACHED_BEHAVIOR_NOREPLY, 0);
+    memcached_behavior_set(p_memcache_, MEMCACHED_BEHAVIOR_BUFFER_REQUESTS, 0);
+    return num_sent;
+}
+
 bool CdsIndex::Get(const Checksum& cksum, uint64_t* offset)
 {
     memcached_return_t rc;
     size_t len = 0;
+    uint64_t start = MonotonicNanos();
     char* value = memcached_get(p_memcache_, cksum.data_, CKSUM_LEN, &len, uint32_t(0), &rc);
     if (rc != MEMCACHED_SUCCESS || len != sizeof(uint64_t)) {
         if (value != NULL) free(value);
+        CountQueries(1, 0, (MonotonicNanos() - start) / 1000);
         return false;
     }
     memcpy((char*)offset, value, sizeof(uint64_t));
     if (value != NULL) free(value);
+    CountQueries(1, 1, (MonotonicNanos() - start) / 1000);
     return true;
 }
 
 bool CdsIndex::BatchGet(const Checksum* cksums, size_t num_cksums, bool *results, uint64_t *offsets)
 {
+    uint64_t start = MonotonicNanos();
     size_t *key_length = new size_t[num_cksums];
     for (size_t i = 0; i < num_cksums; ++i)
         key_length[i] = CKSUM_LEN;
@@ -67,6 +104,7 @@ bool CdsIndex::BatchGet(const Checksum* cksums, size_t num_cksums, bool *results
         memcached_result_free(p_result);
     }
 
+    CountQueries(num_cksums, result_map.size(), (MonotonicNanos() - start) / 1000);
     for (size_t i = 0; i < num_cksums; ++i) {
         unordered_map<string, uint64_t>::iterator it = result_map.find(string(p_cksums[i], CKSUM_LEN));
         if (it == result_map.end())
@@ -81,22 +119,3 @@ bool CdsIndex::BatchGet(const Checksum* cksums, size_t num_cksums, bool *results
     delete[] key_length;
     return true;
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
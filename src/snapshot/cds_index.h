@@ -9,6 +9,15 @@
 #include "cds_cache.h"
 #include "trace_types.h"
 
+/*
+ * one cds index entry, also the on-disk record of the embedded index
+ */
+struct CdsIndexEntry
+{
+    char cksum_[CKSUM_LEN];
+    uint64_t offset_;
+} __attribute__((packed));
+
 class CdsIndex : public CdsCache
 {
 public:
@@ -16,29 +25,42 @@ public:
 
     CdsIndex(const string& mc_options) : CdsCache(mc_options) {};
 
-    ~CdsIndex() {};
+    virtual ~CdsIndex() {};
 
     /*
      * load cds index into memcached
      */
-    void LoadCds(istream& is);
+    virtual void LoadCds(istream& is);
 
     /*
      * set one cds index entry
      */
-    bool Set(Checksum& cksum, uint64_t offset);
+    virtual bool Set(Checksum& cksum, uint64_t offset);
+
+    /*
+     * set many cds index entries without waiting for replies,
+     * requests are buffered and flushed once at the end
+     * return the number of entries sent
+     */
+    virtual size_t BatchSet(const CdsIndexEntry* entries, size_t num_entries);
 
     /*
      * query cds index by block hash
      * return true on found, false on not found
      * if found, the offset of that block in CDS data file is stored in offset
      */
-    bool Get(const Checksum& cksum, uint64_t* offset);
+    virtual bool Get(const Checksum& cksum, uint64_t* offset);
 
     /*
      * query cds index by multiple keys
      */
-    bool BatchGet(const Checksum* cksums, size_t num_cksums, bool *results, uint64_t *offsets);
+    virtual bool BatchGet(const Checksum* cksums, size_t num_cksums, bool *results, uint64_t *offsets);
+
+protected:
+    /*
+     * account queries of any cds index implementation in the metrics registry
+     */
+    static void CountQueries(size_t num_queries, size_t num_hits, uint64_t latency_us);
 };
 
 #endif
@@ -0,0 +1,44 @@
+/*
+ * Build the embedded cds index file from a cds trace
+ */
+
+#include <fstream>
+#include "cds_embedded_index.h"
+#include "../common/timer.h"
+
+using namespace std;
+using namespace log4cxx;
+using namespace log4cxx::xml;
+using namespace log4cxx::helpers;
+
+void usage(char* progname)
+{
+    cout << "Usage: " << progname << ": cds_file index_file" << endl;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3) {
+        usage(argv[0]);
+        return -1;
+    }
+    DOMConfigurator::configure("Log4cxxConfig.xml");
+    string cds_pathname(argv[1]);
+    string index_pathname(argv[2]);
+    ifstream is(cds_pathname, ios::in | ios::binary);
+    if (!is) {
+        cout << "Couldn't open " << cds_pathname << endl;
+        return -1;
+    }
+
+    bool ok = false;
+    MEASURE(ok = CdsEmbeddedIndex::BuildFromTrace(is, index_pathname));
+    is.close();
+    if (!ok)
+        return -1;
+
+    CdsEmbeddedIndex index(index_pathname);
+    cout << index.GetNumEntries() << " entries written to " << index_pathname << endl;
+    TIMER_PRINT_ALL();
+    exit(0);
+}
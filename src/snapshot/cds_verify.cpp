@@ -1,9 +1,11 @@
 /*
- * Verify that CDS is set properly in memcached
+ * Verify that CDS is set properly in memcached, or in the embedded
+ * index file if one is given
  */
 
 #include <fstream>
 #include "cds_index.h"
+#include "cds_embedded_index.h"
 #include "data_source.h"
 #include "trace_types.h"
 #include "snapshot_types.h"
@@ -16,19 +18,19 @@ using namespace log4cxx::helpers;
 
 void usage(char* progname)
 {
-    cout << "Usage: " << progname << ": cds_file" << endl;
+    cout << "Usage: " << progname << ": cds_file [index_file]" << endl;
 }
 
 int main(int argc, char** argv)
 {
-    if (argc != 2) {
+    if (argc != 2 && argc != 3) {
         usage(argv[0]);
         return -1;
     }
     DOMConfigurator::configure("Log4cxxConfig.xml");
     string cds_pathname(argv[1]);
     ifstream is(cds_pathname, ios::in | ios::binary);
-    CdsIndex cds;
+    CdsIndex* cds = OpenCdsIndex(argc == 3 ? argv[2] : "");
     Block blk;
     uint64_t offset_in_cds = 0, offset_in_trace = 0;
     uint64_t num_total = 0, num_hits = 0, num_misses = 0, num_errs = 0;
@@ -37,7 +39,7 @@ int main(int argc, char** argv)
     while (blk.FromStream(is)) {
         ++ num_total;
         bool result = false;
-        result = cds.Get(blk.cksum_, &offset_in_cds);
+        result = cds->Get(blk.cksum_, &offset_in_cds);
         if (!result) {
             cout << "Block not found in CDS: " << blk.ToString() 
                  << " offset: " << offset_in_trace << endl;
@@ -76,7 +78,7 @@ int main(int argc, char** argv)
             results[num_queries] = false;
             cksums[num_queries++] = seg.blocklist_[i].cksum_;
         }
-        cds.BatchGet(cksums, num_queries, results, offsets);
+        cds->BatchGet(cksums, num_queries, results, offsets);
         for (size_t i = 0; i < num_queries; i++) {
             if (!results[i])
                 cout << "Block not found in CDS" << endl;
@@ -89,6 +91,7 @@ int main(int argc, char** argv)
     delete[] cksums;
     delete[] results;
     delete[] offsets;
+    delete cds;
     is.close();
     exit(0);
 }
@@ -0,0 +1,156 @@
+#include "counting_table.h"
+#include <string.h>
+#include <algorithm>
+
+bool FingerprintCount::operator<(const FingerprintCount& other) const
+{
+    return memcmp(cksum_, other.cksum_, CKSUM_LEN) < 0;
+}
+
+void FingerprintCount::ToBlock(Block& blk) const
+{
+    memcpy(blk.cksum_.data_, cksum_, CKSUM_LEN);
+    blk.size_ = size_;
+    blk.file_id_ = file_id_;
+    blk.offset_ = offset_;
+}
+
+CountingTable::CountingTable(uint64_t capacity)
+{
+    uint64_t slots = 1024;
+    while (slots * 2 <= capacity)
+        slots *= 2;
+    slots_ = new FingerprintCount[slots];
+    memset(slots_, 0, slots * sizeof(FingerprintCount));
+    mask_ = slots - 1;
+    size_ = 0;
+    limit_ = (uint64_t)(slots * COUNTING_TABLE_LOAD);
+}
+
+CountingTable::~CountingTable()
+{
+    delete[] slots_;
+}
+
+void CountingTable::Add(const TraceRecord& rec, uint32_t order)
+{
+    // fingerprints are SHA-1, so their first 8 bytes are already a good hash
+    uint64_t prefix;
+    memcpy(&prefix, rec.cksum_, sizeof(prefix));
+    uint64_t i = prefix & mask_;
+    while (slots_[i].count_ != 0) {
+        FingerprintCount& entry = slots_[i];
+        if (memcmp(entry.cksum_, rec.cksum_, CKSUM_LEN) == 0) {
+            entry.count_++;
+            return;
+        }
+        i = (i + 1) & mask_;
+    }
+    FingerprintCount& entry = slots_[i];
+    memcpy(entry.cksum_, rec.cksum_, CKSUM_LEN);
+    entry.count_ = 1;
+    entry.size_ = rec.size_;
+    entry.file_id_ = rec.file_id_;
+    entry.offset_ = rec.offset_;
+    entry.order_ = order;
+    size_++;
+}
+
+bool CountingTable::Spill(const string& pathname)
+{
+    // pack the entries to the front, sort and write them in one go
+    uint64_t n = 0;
+    for (uint64_t i = 0; i <= mask_; i++)
+        if (slots_[i].count_ != 0)
+            slots_[n++] = slots_[i];
+    sort(slots_, slots_ + n);
+
+    ofstream os(pathname.c_str(), ios::out | ios::binary | ios::trunc);
+    os.write((char*)slots_, n * sizeof(FingerprintCount));
+    os.close();
+
+    memset(slots_, 0, (mask_ + 1) * sizeof(FingerprintCount));
+    size_ = 0;
+    return !os.fail();
+}
+
+/*
+ * order of the run heads: smallest fingerprint first, then the first occurrence
+ */
+struct RunHeadGreater {
+    const vector<FingerprintCount>* heads_;
+
+    RunHeadGreater(const vector<FingerprintCount>* heads) : heads_(heads) {}
+
+    bool operator()(size_t a, size_t b) const
+    {
+        const FingerprintCount& x = (*heads_)[a];
+        const FingerprintCount& y = (*heads_)[b];
+        int c = memcmp(x.cksum_, y.cksum_, CKSUM_LEN);
+        if (c != 0)
+            return c > 0;
+        if (x.order_ != y.order_)
+            return x.order_ > y.order_;
+        return a > b;
+    }
+};
+
+CountRunMerger::~CountRunMerger()
+{
+    Close();
+}
+
+bool CountRunMerger::Open(const vector<string>& runs)
+{
+    Close();
+    heads_.resize(runs.size());
+    valid_.resize(runs.size());
+    for (size_t i = 0; i < runs.size(); i++) {
+        inputs_.push_back(new ifstream(runs[i].c_str(), ios::in | ios::binary));
+        if (!inputs_[i]->is_open())
+            return false;
+        Advance(i);
+    }
+    return true;
+}
+
+bool CountRunMerger::Advance(size_t i)
+{
+    inputs_[i]->read((char*)&heads_[i], sizeof(FingerprintCount));
+    valid_[i] = inputs_[i]->gcount() == sizeof(FingerprintCount);
+    return valid_[i];
+}
+
+bool CountRunMerger::Next(FingerprintCount& entry)
+{
+    // the run heads are few, a linear scan is cheaper than keeping a heap
+    RunHeadGreater greater(&heads_);
+    size_t min_run = heads_.size();
+    for (size_t i = 0; i < heads_.size(); i++)
+        if (valid_[i] && (min_run == heads_.size() || greater(min_run, i)))
+            min_run = i;
+    if (min_run == heads_.size())
+        return false;
+
+    entry = heads_[min_run];
+    Advance(min_run);
+    for (size_t i = 0; i < heads_.size(); i++) {
+        // a run holds each fingerprint once, so one step per run is enough
+        if (valid_[i] && memcmp(heads_[i].cksum_, entry.cksum_, CKSUM_LEN) == 0) {
+            entry.count_ += heads_[i].count_;
+            Advance(i);
+        }
+    }
+    return true;
+}
+
+void CountRunMerger::Close()
+{
+    for (size_t i = 0; i < inputs_.size(); i++) {
+        inputs_[i]->close();
+        delete inputs_[i];
+    }
+    inputs_.clear();
+    heads_.clear();
+    valid_.clear();
+}
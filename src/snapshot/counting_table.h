@@ -0,0 +1,93 @@
+/*
+ * Compact counter of block fingerprints for CDS distilling over a whole fleet:
+ * an open addressing table of packed 44-byte entries probed by the fingerprint
+ * prefix, spilled to disk as runs sorted by fingerprint once it fills up, and a
+ * merger streaming the runs back as one sorted sequence with summed counts.
+ */
+#ifndef _COUNTING_TABLE_H_
+#define _COUNTING_TABLE_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include "trace_types.h"
+#include "trace_reader.h"
+
+using namespace std;
+
+#define COUNTING_TABLE_LOAD 0.75		// table spills at this load factor
+
+/*
+ * count of one fingerprint, the size, file id and offset are kept from the
+ * first occurrence, i.e. the one with the smallest order_
+ */
+struct FingerprintCount {
+    char cksum_[CKSUM_LEN];
+    uint32_t count_;
+    uint32_t size_;
+    uint32_t file_id_;
+    uint64_t offset_;
+    uint32_t order_;
+
+    bool operator<(const FingerprintCount& other) const;
+
+    void ToBlock(Block& blk) const;
+} __attribute__((packed));
+
+class CountingTable {
+public:
+    /*
+     * capacity is rounded down to a power of two
+     */
+    CountingTable(uint64_t capacity);
+
+    ~CountingTable();
+
+    /*
+     * count one occurrence of rec seen at the given order,
+     * callers check IsFull() and spill before adding more
+     */
+    void Add(const TraceRecord& rec, uint32_t order);
+
+    bool IsFull() const { return size_ >= limit_; }
+
+    uint64_t Size() const { return size_; }
+
+    uint64_t Capacity() const { return mask_ + 1; }
+
+    /*
+     * write the entries sorted by fingerprint to pathname and clear the table
+     */
+    bool Spill(const string& pathname);
+
+private:
+    FingerprintCount* slots_;		// empty slots have count_ 0
+    uint64_t mask_;
+    uint64_t size_;
+    uint64_t limit_;
+};
+
+/*
+ * k-way merge of sorted runs; equal fingerprints are combined, ties on order_
+ * go to the run listed first, so runs of one writer are listed in spill order
+ */
+class CountRunMerger {
+public:
+    ~CountRunMerger();
+
+    bool Open(const vector<string>& runs);
+
+    bool Next(FingerprintCount& entry);
+
+    void Close();
+
+private:
+    bool Advance(size_t i);
+
+private:
+    vector<ifstream*> inputs_;
+    vector<FingerprintCount> heads_;
+    vector<bool> valid_;
+};
+
+#endif // _COUNTING_TABLE_H_
@@ -5,15 +5,14 @@
 DataSource::DataSource(const string& trace_file, const string& sample_file)
 {
     sample_data_ = NULL;
+    snapshot_size_ = 0;
     try {
-        // read the last record to get the snapshot size
-        trace_stream_.open(trace_file.c_str(), ios_base::binary | ios_base::in);
-        trace_stream_.seekg(-RECORD_SIZE, ios::end);
-        Block blk;
-        blk.FromStream(trace_stream_);
-        snapshot_size_ = blk.offset_ + blk.size_;
-        trace_stream_.clear();
-        trace_stream_.seekg(0, ios::beg);
+        if (!trace_reader_.Open(trace_file)) {
+            cout << "Error : unable to map trace " << trace_file << endl;
+            return;
+        }
+        snapshot_size_ = trace_reader_.GetSnapshotSize();
+        cursor_ = SegmentCursor(trace_reader_.GetRecords(), SegmentPolicy::Fixed());
 
         // read some sample data from file
         ifstream sample_data_stream(sample_file.c_str(), ios_base::binary | ios_base::in);
@@ -35,8 +34,7 @@ DataSource::DataSource(const string& trace_file, const string& sample_file)
 
 DataSource::~DataSource()
 {
-    if (trace_stream_.is_open())
-        trace_stream_.close();
+    trace_reader_.Close();
     if (sample_data_ != NULL)
         delete[] sample_data_;
 }
@@ -45,25 +43,25 @@ bool DataSource::GetBlock(BlockMeta& bm)
 {
     if (sample_data_ == NULL)
         return false;
-    Block blk;
-    if (blk.FromStream(trace_stream_) && BlockToBlockMeta(bm, blk))
+    const TraceRecord* rec;
+    if (cursor_.NextRecord(rec) && BlockToBlockMeta(bm, *rec))
         return true;
     return false;
 }
 
-bool DataSource::BlockToBlockMeta(BlockMeta &bm, const Block& blk)
+bool DataSource::BlockToBlockMeta(BlockMeta &bm, const TraceRecord& rec)
 {
-    if (blk.size_ == 0) {
+    if (rec.size_ == 0) {
         cout << "Error: encounter zero size block" << endl;
         return false;
     }
-    if (blk.size_ > RESERVED_REGION_SIZE) {
-        cout << "Error : block size is too big: " << blk.size_ << endl;
+    if (rec.size_ > RESERVED_REGION_SIZE) {
+        cout << "Error : block size is too big: " << rec.size_ << endl;
         return false;
     }
-    bm.cksum_ = blk.cksum_;
-    bm.end_offset_ = blk.size_;
-    bm.size_ = blk.size_;
+    bm.cksum_ = rec.GetChecksum();
+    bm.end_offset_ = rec.size_;
+    bm.size_ = rec.size_;
     bm.handle_ = 0;
     bm.flags_ = 0;
     bm.data_ = &sample_data_[bm.cksum_.First4Bytes() % SAMPLE_REGION_SIZE];
@@ -72,20 +70,22 @@ bool DataSource::BlockToBlockMeta(BlockMeta &bm, const Block& blk)
 
 bool DataSource::GetSegment(SegmentMeta& sm)
 {
-    Segment seg;
+    TraceSpan seg;
     BlockMeta bm;
-    if (seg.LoadFixSize(trace_stream_)) {
+    if (cursor_.Next(seg)) {
         sm.segment_recipe_.clear();
-        sm.segment_recipe_.reserve(seg.blocklist_.size());
+        sm.segment_recipe_.reserve(seg.Size());
         uint32_t offset = 0;
-        for (size_t i = 0; i < seg.blocklist_.size(); ++i) {
-            if (!BlockToBlockMeta(bm, seg.blocklist_[i]))
+        for (size_t i = 0; i < seg.Size(); ++i) {
+            if (seg[i].size_ == 0)
+                continue;
+            if (!BlockToBlockMeta(bm, seg[i]))
                 return false;
-            offset += seg.blocklist_[i].size_;
+            offset += seg[i].size_;
             bm.end_offset_ = offset;
             sm.segment_recipe_.push_back(bm);
         }
-        sm.cksum_ = seg.cksum_;
+        seg.GetChecksum(sm.cksum_);
         sm.end_offset_ = offset;
         sm.size_ = offset;
         sm.handle_ = 0;
@@ -7,6 +7,7 @@
 #include <fstream>
 #include <cstdlib>
 #include "snapshot_types.h"
+#include "trace_reader.h"
 
 using namespace std;
 
@@ -31,11 +32,12 @@ public:
     uint64_t GetSnapshotSize();
 
 private:
-    bool BlockToBlockMeta(BlockMeta& bm, const Block& blk);
+    bool BlockToBlockMeta(BlockMeta& bm, const TraceRecord& rec);
 
 private:
     char* sample_data_;
-    ifstream trace_stream_;
+    TraceReader trace_reader_;
+    SegmentCursor cursor_;
     uint64_t snapshot_size_;
 };
 
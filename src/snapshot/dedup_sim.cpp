@@ -0,0 +1,288 @@
+#include "dedup_sim.h"
+#include <string.h>
+#include <pthread.h>
+#include <algorithm>
+
+void SnapshotDedupStat::Add(const SnapshotDedupStat& other)
+{
+    raw_.Add(other.raw_);
+    l1_.Add(other.l1_);
+    l2_.Add(other.l2_);
+    l3_.Add(other.l3_);
+    new_.Add(other.new_);
+}
+
+FingerprintSet::FingerprintSet()
+    : slots_(1024), used_(1024, 0), size_(0), records_(0)
+{
+}
+
+bool FingerprintSet::Load(const string& pathname)
+{
+    TraceReader reader;
+    if (!reader.Open(pathname))
+        return false;
+    const TraceSpan& records = reader.GetRecords();
+    for (size_t i = 0; i < records.Size(); i++)
+        Insert(records[i].GetChecksum());
+    records_ += records.Size();
+    return true;
+}
+
+size_t FingerprintSet::Probe(const Checksum& cksum) const
+{
+    // fingerprints are SHA-1, so their first 8 bytes are already a good hash
+    uint64_t prefix;
+    memcpy(&prefix, cksum.data_, sizeof(prefix));
+    size_t mask = slots_.size() - 1;
+    size_t i = prefix & mask;
+    while (used_[i] && slots_[i] != cksum)
+        i = (i + 1) & mask;
+    return i;
+}
+
+void FingerprintSet::Insert(const Checksum& cksum)
+{
+    size_t i = Probe(cksum);
+    if (used_[i])
+        return;
+    slots_[i] = cksum;
+    used_[i] = 1;
+    // keep the load under a half so misses end quickly
+    if (++size_ * 2 > slots_.size())
+        Grow();
+}
+
+bool FingerprintSet::Contains(const Checksum& cksum) const
+{
+    return used_[Probe(cksum)] != 0;
+}
+
+void FingerprintSet::Grow()
+{
+    vector<Checksum> slots(slots_.size() * 2);
+    vector<uint8_t> used(used_.size() * 2, 0);
+    slots.swap(slots_);
+    used.swap(used_);
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (!used[i])
+            continue;
+        size_t j = Probe(slots[i]);
+        slots_[j] = slots[i];
+        used_[j] = 1;
+    }
+}
+
+SnapshotRecipe::SnapshotRecipe()
+{
+}
+
+bool SnapshotRecipe::Open(const string& pathname, const SegmentPolicy& policy)
+{
+    if (!reader_.Open(pathname))
+        return false;
+    SegmentCursor cursor(reader_.GetRecords(), policy);
+    TraceSpan seg;
+    Checksum cksum;
+    while (cursor.Next(seg)) {
+        segments_.push_back(seg);
+        seg.GetChecksum(cksum);
+        cksums_.push_back(cksum);
+        min_idx_.push_back(seg.GetMinHashIndex());
+    }
+    sorted_.resize(segments_.size());
+    is_sorted_.assign(segments_.size(), 0);
+    return true;
+}
+
+const vector<Checksum>& SnapshotRecipe::GetSorted(size_t seg_id)
+{
+    vector<Checksum>& sorted = sorted_[seg_id];
+    if (!is_sorted_[seg_id]) {
+        const TraceSpan& seg = segments_[seg_id];
+        sorted.reserve(seg.Size());
+        for (size_t i = 0; i < seg.Size(); i++)
+            if (seg[i].size_ != 0)
+                sorted.push_back(seg[i].GetChecksum());
+        sort(sorted.begin(), sorted.end());
+        is_sorted_[seg_id] = 1;
+    }
+    return sorted;
+}
+
+bool SnapshotRecipe::SearchInSegment(size_t seg_id, const Checksum& cksum)
+{
+    if (seg_id >= segments_.size())
+        return false;
+    const vector<Checksum>& sorted = GetSorted(seg_id);
+    return binary_search(sorted.begin(), sorted.end(), cksum);
+}
+
+const vector<size_t>* SnapshotRecipe::FindSimilarSegments(const Checksum& min_hash)
+{
+    if (min_hash_index_.empty() && !segments_.empty()) {
+        min_hash_index_.reserve(segments_.size());
+        for (size_t i = 0; i < segments_.size(); i++)
+            min_hash_index_.push_back(make_pair(GetMinHash(i), i));
+        sort(min_hash_index_.begin(), min_hash_index_.end());
+    }
+    vector< pair<Checksum, size_t> >::const_iterator it;
+    it = lower_bound(min_hash_index_.begin(), min_hash_index_.end(), make_pair(min_hash, (size_t)0));
+    similar_.clear();
+    for (; it != min_hash_index_.end() && it->first == min_hash; ++it)
+        similar_.push_back(it->second);
+    return similar_.empty() ? NULL : &similar_;
+}
+
+void SnapshotRecipe::InheritSorted(SnapshotRecipe& parent, size_t seg_id)
+{
+    if (is_sorted_[seg_id] || !parent.is_sorted_[seg_id])
+        return;
+    sorted_[seg_id].swap(parent.sorted_[seg_id]);
+    is_sorted_[seg_id] = 1;
+    parent.is_sorted_[seg_id] = 0;
+}
+
+void SimilarSegmentL2::BeginSegment(SnapshotRecipe& parent, SnapshotRecipe& child, size_t seg_id)
+{
+    seg_id_ = seg_id;
+    similar_.clear();
+    const vector<size_t>* similar = parent.FindSimilarSegments(child.GetMinHash(seg_id));
+    if (similar != NULL)
+        similar_.assign(similar->begin(), similar->begin() + min(similar->size(), max_search_));
+    // no need to search the offset-aligned segment twice
+    search_aligned_ = find(similar_.begin(), similar_.end(), seg_id) == similar_.end();
+}
+
+bool SimilarSegmentL2::Find(SnapshotRecipe& parent, const Checksum& cksum)
+{
+    for (size_t i = 0; i < similar_.size(); i++)
+        if (parent.SearchInSegment(similar_[i], cksum))
+            return true;
+    return search_aligned_ && parent.SearchInSegment(seg_id_, cksum);
+}
+
+DedupSimulator::DedupSimulator(const L2Policy& l2, const L3Policy& l3)
+    : l2_(l2), l3_(l3)
+{
+}
+
+bool DedupSimulator::SimulateVM(const vector<string>& snapshots, vector<SnapshotDedupStat>& stats) const
+{
+    L2Policy* l2 = l2_.Clone();
+    bool ret = SimulateVM(snapshots, *l2, stats);
+    delete l2;
+    return ret;
+}
+
+bool DedupSimulator::SimulateVM(const vector<string>& snapshots, L2Policy& l2, vector<SnapshotDedupStat>& stats) const
+{
+    stats.assign(snapshots.size(), SnapshotDedupStat());
+    SnapshotRecipe* parent = NULL;
+    for (size_t j = 0; j < snapshots.size(); j++) {
+        SnapshotRecipe* child = new SnapshotRecipe();
+        if (!child->Open(snapshots[j])) {
+            delete child;
+            delete parent;
+            return false;
+        }
+        SnapshotDedupStat& stat = stats[j];
+        vector<size_t> l1_segs;
+        for (size_t seg_id = 0; seg_id < child->GetNumSegments(); seg_id++) {
+            const TraceSpan& seg = child->GetSegment(seg_id);
+            uint64_t seg_bytes = 0, seg_blocks = 0;
+            for (size_t i = 0; i < seg.Size(); i++) {
+                if (seg[i].size_ != 0) {
+                    seg_bytes += seg[i].size_;
+                    seg_blocks++;
+                }
+            }
+            stat.raw_.Add(seg_bytes, seg_blocks);
+            // level 1: the same segment as the parent
+            if (parent != NULL && seg_id < parent->GetNumSegments()
+                && child->GetSegmentChecksum(seg_id) == parent->GetSegmentChecksum(seg_id)) {
+                stat.l1_.Add(seg_bytes, seg_blocks);
+                l1_segs.push_back(seg_id);
+                continue;
+            }
+            if (parent != NULL)
+                l2.BeginSegment(*parent, *child, seg_id);
+            for (size_t i = 0; i < seg.Size(); i++) {
+                const TraceRecord& rec = seg[i];
+                if (rec.size_ == 0)		// fix the zero-sized block bug in scanner
+                    continue;
+                if (parent != NULL && l2.Find(*parent, rec.GetChecksum()))
+                    stat.l2_.Add(rec.size_, 1);
+                else if (l3_.Find(rec.GetChecksum()))
+                    stat.l3_.Add(rec.size_, 1);
+                else
+                    stat.new_.Add(rec.size_, 1);
+            }
+        }
+        // unchanged segments don't need to be sorted again when the child becomes a parent
+        if (parent != NULL) {
+            for (size_t i = 0; i < l1_segs.size(); i++)
+                child->InheritSorted(*parent, l1_segs[i]);
+            delete parent;
+        }
+        parent = child;
+    }
+    delete parent;
+    return true;
+}
+
+struct SimulatorJob {
+    const DedupSimulator* simulator_;
+    const vector< vector<string> >* vms_;
+    vector< vector<SnapshotDedupStat> >* stats_;
+    vector<bool>* ok_;
+    L2Policy* l2_;
+    volatile uint32_t* next_vm_;
+    pthread_mutex_t* lock_;
+};
+
+void* DedupSimulator::RunWorker(void* arg)
+{
+    SimulatorJob* job = (SimulatorJob*)arg;
+    uint32_t i;
+    while ((i = __sync_fetch_and_add(job->next_vm_, 1)) < job->vms_->size()) {
+        bool ok = job->simulator_->SimulateVM((*job->vms_)[i], *job->l2_, (*job->stats_)[i]);
+        // vector<bool> packs flags into shared words
+        pthread_mutex_lock(job->lock_);
+        (*job->ok_)[i] = ok;
+        pthread_mutex_unlock(job->lock_);
+    }
+    return NULL;
+}
+
+void DedupSimulator::Run(const vector< vector<string> >& vms, uint32_t num_threads,
+                         vector< vector<SnapshotDedupStat> >& stats, vector<bool>& ok) const
+{
+    stats.assign(vms.size(), vector<SnapshotDedupStat>());
+    ok.assign(vms.size(), false);
+    if (num_threads == 0)
+        num_threads = 1;
+    if (num_threads > vms.size())
+        num_threads = vms.size();
+
+    volatile uint32_t next_vm = 0;
+    pthread_mutex_t lock;
+    pthread_mutex_init(&lock, NULL);
+    vector<SimulatorJob> jobs(num_threads);
+    vector<pthread_t> threads(num_threads);
+    for (uint32_t t = 0; t < num_threads; t++) {
+        jobs[t].simulator_ = this;
+        jobs[t].vms_ = &vms;
+        jobs[t].stats_ = &stats;
+        jobs[t].ok_ = &ok;
+        jobs[t].l2_ = l2_.Clone();
+        jobs[t].next_vm_ = &next_vm;
+        jobs[t].lock_ = &lock;
+        pthread_create(&threads[t], NULL, RunWorker, &jobs[t]);
+    }
+    for (uint32_t t = 0; t < num_threads; t++) {
+        pthread_join(threads[t], NULL);
+        delete jobs[t].l2_;
+    }
+    pthread_mutex_destroy(&lock);
+}
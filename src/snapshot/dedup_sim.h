@@ -0,0 +1,229 @@
+/*
+ * Engine of the L1/L2/L3 dedup simulations (cds_sim, fp_del_sim, local_minhash):
+ * the snapshots of a VM are deduplicated in order, segment by segment, first
+ * against the same segment of the parent (L1), then block by block against the
+ * parent (L2) and the CDS (L3). L2 and L3 are pluggable policies. Snapshots are
+ * mapped with TraceReader and the sorted fingerprints of a segment are cached
+ * and handed down to children holding the same segment. Independent VMs are
+ * simulated in parallel.
+ */
+#ifndef _DEDUP_SIM_H_
+#define _DEDUP_SIM_H_
+
+#include <string>
+#include <vector>
+#include "trace_types.h"
+#include "trace_reader.h"
+
+using namespace std;
+
+struct DedupCounter {
+    uint64_t num_bytes_;
+    uint64_t num_blocks_;
+
+    DedupCounter() {num_bytes_ = 0; num_blocks_ = 0;}
+
+    void Add(uint64_t bytes, uint64_t blocks) {num_bytes_ += bytes; num_blocks_ += blocks;}
+
+    void Add(const DedupCounter& other) {Add(other.num_bytes_, other.num_blocks_);}
+};
+
+/*
+ * where the data of one snapshot was deduplicated, raw_ = l1_ + l2_ + l3_ + new_
+ */
+struct SnapshotDedupStat {
+    DedupCounter raw_;
+    DedupCounter l1_;
+    DedupCounter l2_;
+    DedupCounter l3_;
+    DedupCounter new_;
+
+    void Add(const SnapshotDedupStat& other);
+};
+
+/*
+ * set of fingerprints in an open addressing table probed by the fingerprint
+ * prefix, used for CDS membership instead of binary searching a sorted vector
+ */
+class FingerprintSet {
+public:
+    FingerprintSet();
+
+    /*
+     * load the fingerprints of a CDS file (or any trace), false if it can't be read
+     */
+    bool Load(const string& pathname);
+
+    void Insert(const Checksum& cksum);
+
+    bool Contains(const Checksum& cksum) const;
+
+    size_t Size() const { return size_; }
+
+    // records read by Load, duplicates included
+    size_t GetNumRecords() const { return records_; }
+
+private:
+    size_t Probe(const Checksum& cksum) const;
+
+    void Grow();
+
+    vector<Checksum> slots_;
+    vector<uint8_t> used_;
+    size_t size_;
+    size_t records_;
+};
+
+/*
+ * a mapped snapshot trace cut into fixed size segments, the checksums are
+ * computed on open, sorted fingerprints and the min-hash index on first use
+ */
+class SnapshotRecipe {
+public:
+    SnapshotRecipe();
+
+    bool Open(const string& pathname, const SegmentPolicy& policy = SegmentPolicy::Fixed());
+
+    size_t GetNumSegments() const { return segments_.size(); }
+
+    const TraceSpan& GetSegment(size_t seg_id) const { return segments_[seg_id]; }
+
+    const Checksum& GetSegmentChecksum(size_t seg_id) const { return cksums_[seg_id]; }
+
+    const Checksum& GetMinHash(size_t seg_id) const { return segments_[seg_id][min_idx_[seg_id]].GetChecksum(); }
+
+    /*
+     * binary search in the sorted fingerprints of the segment, false if there is no such segment
+     */
+    bool SearchInSegment(size_t seg_id, const Checksum& cksum);
+
+    /*
+     * ids of the segments with this min-hash in ascending order, NULL if there is none
+     */
+    const vector<size_t>* FindSimilarSegments(const Checksum& min_hash);
+
+    /*
+     * take over the sorted fingerprints of the same segment in the parent,
+     * only valid if both segments have the same checksum
+     */
+    void InheritSorted(SnapshotRecipe& parent, size_t seg_id);
+
+private:
+    const vector<Checksum>& GetSorted(size_t seg_id);
+
+    TraceReader reader_;
+    vector<TraceSpan> segments_;
+    vector<Checksum> cksums_;
+    vector<uint32_t> min_idx_;
+    vector< vector<Checksum> > sorted_;
+    vector<uint8_t> is_sorted_;
+    vector< pair<Checksum, size_t> > min_hash_index_;
+    vector<size_t> similar_;
+};
+
+/*
+ * level 2: blocks of a changed segment found in the parent snapshot,
+ * each simulated VM works on its own Clone()
+ */
+class L2Policy {
+public:
+    virtual ~L2Policy() {}
+
+    virtual L2Policy* Clone() const = 0;
+
+    /*
+     * called before the blocks of segment seg_id of the child are searched
+     */
+    virtual void BeginSegment(SnapshotRecipe& parent, SnapshotRecipe& child, size_t seg_id) = 0;
+
+    virtual bool Find(SnapshotRecipe& parent, const Checksum& cksum) = 0;
+};
+
+/*
+ * level 3: blocks found in global data such as the CDS, shared by all VMs
+ */
+class L3Policy {
+public:
+    virtual ~L3Policy() {}
+
+    virtual bool Find(const Checksum& cksum) const = 0;
+};
+
+/*
+ * search the offset-aligned segment of the parent only
+ */
+class AlignedSegmentL2 : public L2Policy {
+public:
+    AlignedSegmentL2() : seg_id_(0) {}
+
+    L2Policy* Clone() const { return new AlignedSegmentL2(); }
+
+    void BeginSegment(SnapshotRecipe& parent, SnapshotRecipe& child, size_t seg_id) { seg_id_ = seg_id; }
+
+    bool Find(SnapshotRecipe& parent, const Checksum& cksum) { return parent.SearchInSegment(seg_id_, cksum); }
+
+private:
+    size_t seg_id_;
+};
+
+/*
+ * search the first max_search parent segments with the same min-hash,
+ * then the offset-aligned segment if it was not one of them
+ */
+class SimilarSegmentL2 : public L2Policy {
+public:
+    SimilarSegmentL2(size_t max_search) : max_search_(max_search), seg_id_(0), search_aligned_(true) {}
+
+    L2Policy* Clone() const { return new SimilarSegmentL2(max_search_); }
+
+    void BeginSegment(SnapshotRecipe& parent, SnapshotRecipe& child, size_t seg_id);
+
+    bool Find(SnapshotRecipe& parent, const Checksum& cksum);
+
+private:
+    size_t max_search_;
+    size_t seg_id_;
+    bool search_aligned_;
+    vector<size_t> similar_;
+};
+
+class CdsL3 : public L3Policy {
+public:
+    CdsL3(const FingerprintSet& cds) : cds_(cds) {}
+
+    bool Find(const Checksum& cksum) const { return cds_.Contains(cksum); }
+
+private:
+    const FingerprintSet& cds_;
+};
+
+class DedupSimulator {
+public:
+    /*
+     * the policies must outlive the simulator
+     */
+    DedupSimulator(const L2Policy& l2, const L3Policy& l3);
+
+    /*
+     * dedup the snapshot traces of one VM in order, each against its parent;
+     * false if a trace can't be opened
+     */
+    bool SimulateVM(const vector<string>& snapshots, vector<SnapshotDedupStat>& stats) const;
+
+    /*
+     * simulate the VMs on num_threads threads, results of each VM are
+     * stored in stats[i] and ok[i] as SimulateVM() returns them
+     */
+    void Run(const vector< vector<string> >& vms, uint32_t num_threads,
+             vector< vector<SnapshotDedupStat> >& stats, vector<bool>& ok) const;
+
+private:
+    bool SimulateVM(const vector<string>& snapshots, L2Policy& l2, vector<SnapshotDedupStat>& stats) const;
+
+    static void* RunWorker(void* arg);
+
+    const L2Policy& l2_;
+    const L3Policy& l3_;
+};
+
+#endif // _DEDUP_SIM_H_
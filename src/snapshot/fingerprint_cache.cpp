@@ -0,0 +1,103 @@
+#include <sstream>
+#include "fingerprint_cache.h"
+
+FingerprintCache::FingerprintCache(size_t capacity)
+    : capacity_(capacity), hits_(0), misses_(0), evictions_(0)
+{
+}
+
+bool FingerprintCache::Lookup(const Checksum& cksum, HandleType& handle, uint16_t& flags)
+{
+    auto it = index_.find(cksum);
+    if (it == index_.end()) {
+        misses_++;
+        return false;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    handle = it->second->handle_;
+    flags = it->second->flags_;
+    hits_++;
+    return true;
+}
+
+void FingerprintCache::Insert(const Checksum& cksum, HandleType handle, uint16_t flags)
+{
+    if (capacity_ == 0)
+        return;
+    auto it = index_.find(cksum);
+    if (it != index_.end()) {
+        lru_.splice(lru_.begin(), lru_, it->second);
+        it->second->handle_ = handle;
+        it->second->flags_ = flags;
+        return;
+    }
+    if (index_.size() >= capacity_)
+        Evict();
+    Entry e;
+    e.cksum_ = cksum;
+    e.handle_ = handle;
+    e.flags_ = flags;
+    lru_.push_front(e);
+    index_[cksum] = lru_.begin();
+}
+
+void FingerprintCache::Evict()
+{
+    index_.erase(lru_.back().cksum_);
+    lru_.pop_back();
+    evictions_++;
+}
+
+void FingerprintCache::Resize(size_t capacity)
+{
+    capacity_ = capacity;
+    while (index_.size() > capacity_)
+        Evict();
+}
+
+void FingerprintCache::Clear()
+{
+    index_.clear();
+    lru_.clear();
+}
+
+string FingerprintCache::ToString() const
+{
+    stringstream ss;
+    ss << "entries " << index_.size() << "/" << capacity_ 
+        << " hits " << hits_ << " misses " << misses_ << " evictions " << evictions_;
+    return ss.str();
+}
+
+/*
+ * on disk: number of entries, then (checksum, handle, flags) from lru to mru
+ */
+void FingerprintCache::Serialize(ostream& os) const
+{
+    uint64_t num_entries = lru_.size();
+    os.write((char*)&num_entries, sizeof(num_entries));
+    for (EntryList::const_reverse_iterator it = lru_.rbegin(); it != lru_.rend(); ++it) {
+        it->cksum_.ToStream(os);
+        os.write((char*)&it->handle_, sizeof(HandleType));
+        os.write((char*)&it->flags_, sizeof(uint16_t));
+    }
+}
+
+bool FingerprintCache::Deserialize(istream& is)
+{
+    Clear();
+    uint64_t num_entries = 0;
+    if (!is.read((char*)&num_entries, sizeof(num_entries)))
+        return false;
+    Checksum cksum;
+    HandleType handle;
+    uint16_t flags;
+    for (uint64_t i = 0; i < num_entries; ++i) {
+        if (!cksum.FromStream(is) 
+            || !is.read((char*)&handle, sizeof(HandleType)) 
+            || !is.read((char*)&flags, sizeof(uint16_t)))
+            return false;
+        Insert(cksum, handle, flags);
+    }
+    return true;
+}
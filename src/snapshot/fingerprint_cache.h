@@ -0,0 +1,82 @@
+/*
+ * Per-VM LRU cache of block fingerprints (checksum -> handle) seen in recent
+ * snapshots of the VM. It catches duplicates that are no longer in the parent
+ * snapshot, e.g. data deleted and restored between backups. Bounded by number
+ * of entries, and saved in the VM directory between backups.
+ */
+#ifndef _FINGERPRINT_CACHE_H_
+#define _FINGERPRINT_CACHE_H_
+
+#include <list>
+#include <unordered_map>
+#include <iostream>
+#include <string>
+#include "trace_types.h"
+#include "snapshot_types.h"
+
+using namespace std;
+
+#define DF_FP_CACHE_ENTRIES (1024 * 1024)	// default capacity, ~100 bytes per entry
+
+struct ChecksumHash
+{
+    size_t operator()(const Checksum& cksum) const { return cksum.First4Bytes(); }
+};
+
+class FingerprintCache
+{
+public:
+    explicit FingerprintCache(size_t capacity = DF_FP_CACHE_ENTRIES);
+
+    /*
+     * find the handle and flags of a block by its checksum,
+     * a hit moves the entry to the most recently used position
+     */
+    bool Lookup(const Checksum& cksum, HandleType& handle, uint16_t& flags);
+
+    /*
+     * add or refresh a block, evicts the least recently used entry when full
+     */
+    void Insert(const Checksum& cksum, HandleType handle, uint16_t flags);
+
+    /*
+     * change capacity, evicts least recently used entries if shrinking
+     */
+    void Resize(size_t capacity);
+
+    void Clear();
+
+    size_t Size() const { return index_.size(); }
+    size_t Capacity() const { return capacity_; }
+
+    // hits, misses and evictions since construction
+    string ToString() const;
+
+    /*
+     * entries are written from least to most recently used,
+     * so loading them back restores the LRU order
+     */
+    void Serialize(ostream& os) const;
+    bool Deserialize(istream& is);
+
+private:
+    struct Entry
+    {
+        Checksum cksum_;
+        HandleType handle_;
+        uint16_t flags_;
+    };
+    typedef list<Entry> EntryList;
+
+    void Evict();
+
+private:
+    size_t capacity_;
+    EntryList lru_;		// most recently used at front
+    unordered_map<Checksum, EntryList::iterator, ChecksumHash> index_;
+    uint64_t hits_;
+    uint64_t misses_;
+    uint64_t evictions_;
+};
+
+#endif // _FINGERPRINT_CACHE_H_
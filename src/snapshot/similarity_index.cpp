@@ -0,0 +1,65 @@
+#include <algorithm>
+#include "similarity_index.h"
+
+void SimilarityIndex::Add(const Checksum& min_hash, HandleType handle)
+{
+    vector<HandleType>& handles = index_[min_hash];
+    if (handles.size() >= MAX_HANDLES_PER_MIN_HASH)
+        return;
+    if (find(handles.begin(), handles.end(), handle) == handles.end())
+        handles.push_back(handle);
+}
+
+void SimilarityIndex::Find(const Checksum& min_hash, vector<HandleType>& handles, size_t max_results) const
+{
+    handles.clear();
+    map<Checksum, vector<HandleType> >::const_iterator it = index_.find(min_hash);
+    if (it == index_.end())
+        return;
+    size_t num = min(max_results, it->second.size());
+    handles.assign(it->second.begin(), it->second.begin() + num);
+}
+
+void SimilarityIndex::Clear()
+{
+    index_.clear();
+}
+
+size_t SimilarityIndex::Size() const
+{
+    return index_.size();
+}
+
+/*
+ * on disk: number of entries, then (min-hash, handle) pairs
+ */
+void SimilarityIndex::Serialize(ostream& os) const
+{
+    uint64_t num_entries = 0;
+    map<Checksum, vector<HandleType> >::const_iterator it;
+    for (it = index_.begin(); it != index_.end(); ++it)
+        num_entries += it->second.size();
+    os.write((char*)&num_entries, sizeof(num_entries));
+    for (it = index_.begin(); it != index_.end(); ++it) {
+        for (size_t i = 0; i < it->second.size(); ++i) {
+            it->first.ToStream(os);
+            os.write((char*)&it->second[i], sizeof(HandleType));
+        }
+    }
+}
+
+bool SimilarityIndex::Deserialize(istream& is)
+{
+    index_.clear();
+    uint64_t num_entries = 0;
+    if (!is.read((char*)&num_entries, sizeof(num_entries)))
+        return false;
+    Checksum min_hash;
+    HandleType handle;
+    for (uint64_t i = 0; i < num_entries; ++i) {
+        if (!min_hash.FromStream(is) || !is.read((char*)&handle, sizeof(HandleType)))
+            return false;
+        Add(min_hash, handle);
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+/*
+ * Sparse index of a snapshot for similarity based dedup:
+ * maps the min-hash of each segment to the handles of segment recipes
+ * in the VM's append store, so segments that moved inside the disk image
+ * can still be found by their min-hash.
+ */
+#ifndef _SIMILARITY_INDEX_H_
+#define _SIMILARITY_INDEX_H_
+
+#include <map>
+#include <vector>
+#include <iostream>
+#include "trace_types.h"
+#include "snapshot_types.h"
+
+using namespace std;
+
+#define MAX_SIMILAR_SEGMENTS 4			// max similar segments loaded for one segment
+#define MAX_HANDLES_PER_MIN_HASH 16		// max segments remembered for one min-hash
+
+class SimilarityIndex
+{
+public:
+    /*
+     * add a segment recipe handle under its min-hash
+     */
+    void Add(const Checksum& min_hash, HandleType handle);
+
+    /*
+     * get up to max_results handles of segments sharing min_hash
+     */
+    void Find(const Checksum& min_hash, vector<HandleType>& handles, size_t max_results) const;
+
+    void Clear();
+
+    // number of min-hashes in index
+    size_t Size() const;
+
+    void Serialize(ostream& os) const;
+    bool Deserialize(istream& is);
+
+private:
+    map<Checksum, vector<HandleType> > index_;
+};
+
+#endif // _SIMILARITY_INDEX_H_
@@ -1,4 +1,5 @@
 #include "snapshot_control.h"
+#include "../common/metrics.h"
 
 const string kBasePath = "root";
 
@@ -29,6 +30,8 @@ void SnapshotControl::Init()
     ss_meta_pathname_ = vm_path_ + "/" + ss_meta_.snapshot_id_ + ".meta";
     primary_filter_pathname_ = vm_path_ + "/" + ss_meta_.snapshot_id_ + ".bm1";
     secondary_filter_pathname_ = vm_path_ + "/" + ss_meta_.snapshot_id_ + ".bm2";
+    similarity_index_pathname_ = vm_path_ + "/" + ss_meta_.snapshot_id_ + ".sim";
+    fingerprint_cache_pathname_ = vm_path_ + "/fp.cache";
     ss_meta_.size_ = 0;
     store_ptr_ = NULL;
 }
@@ -128,6 +131,19 @@ bool SnapshotControl::LoadSegmentRecipe(SegmentMeta& sm, uint32_t idx)
     return true;
 }
 
+bool SnapshotControl::LoadSegmentRecipeByHandle(SegmentMeta& sm, HandleType handle)
+{
+    string data;
+    string handle_str((char*)&handle, sizeof(handle));
+    if (!store_ptr_->Read(handle_str, &data))
+        return false;
+
+    stringstream ss(data);
+    sm.DeserializeRecipe(ss);
+    sm.handle_ = handle;
+    return true;
+}
+
 bool SnapshotControl::SaveSegmentRecipe(SegmentMeta& sm)
 {
     stringstream buffer;
@@ -222,10 +238,12 @@ bool SnapshotControl::InitBloomFilters(uint64_t snapshot_size)
 
 void SnapshotControl::UpdateBloomFilters(const SegmentMeta& sm)
 {
+    static MetricCounter* inserts = Metrics::Counter("bigarchive_bloomfilter_inserts_total", "Block hashes added to snapshot bloom filters");
     for (size_t i = 0; i < sm.segment_recipe_.size(); i++) {
         primary_filter_ptr_->AddElement(sm.segment_recipe_[i].cksum_);
         secondary_filter_ptr_->AddElement(sm.segment_recipe_[i].cksum_);
     }
+    inserts->Inc(sm.segment_recipe_.size());
 }
 
 bool SnapshotControl::SaveBloomFilters()
@@ -247,6 +265,8 @@ bool SnapshotControl::SaveBloomFilter(BloomFilter<Checksum>* pbf, const string&
 	stringstream buffer;
 	pbf->Serialize(buffer);
 	LOG4CXX_DEBUG(logger_, "Bloom filter primary size " << buffer.str().size());
+    static MetricCounter* saved_bytes = Metrics::Counter("bigarchive_bloomfilter_saved_bytes_total", "Bytes of bloom filters saved");
+    saved_bytes->Inc(buffer.str().size());
     fh->Write((char *)buffer.str().c_str(), buffer.str().size());
 
     fh->Close();
@@ -291,13 +311,100 @@ bool SnapshotControl::LoadBloomFilter(BloomFilter<Checksum>* pbf, const string&
     return true;
 }
 
+void SnapshotControl::UpdateSimilarityIndex(const SegmentMeta& sm)
+{
+    if (sm.segment_recipe_.size() == 0)
+        return;
+    similarity_index_.Add(sm.GetMinHash(), sm.handle_);
+}
+
+void SnapshotControl::FindSimilarSegments(const SegmentMeta& sm, vector<HandleType>& handles, size_t max_results)
+{
+    similarity_index_.Find(sm.GetMinHash(), handles, max_results);
+}
+
+bool SnapshotControl::SaveSimilarityIndex()
+{
+	if (!FileSystemHelper::GetInstance()->IsDirectoryExists(vm_path_))
+		FileSystemHelper::GetInstance()->CreateDirectory(vm_path_);
+	if (FileSystemHelper::GetInstance()->IsFileExists(similarity_index_pathname_))
+		FileSystemHelper::GetInstance()->RemoveFile(similarity_index_pathname_);
+
+	FileHelper* fh = FileSystemHelper::GetInstance()->CreateFileHelper(similarity_index_pathname_, O_WRONLY);
+	fh->Create();
+
+	stringstream buffer;
+	similarity_index_.Serialize(buffer);
+	LOG4CXX_DEBUG(logger_, "Similarity index size " << buffer.str().size());
+	fh->Write((char *)buffer.str().c_str(), buffer.str().size());
 
+	fh->Close();
+	FileSystemHelper::GetInstance()->DestroyFileHelper(fh);
+	return true;
+}
+
+bool SnapshotControl::LoadSimilarityIndex()
+{
+	if (!FileSystemHelper::GetInstance()->IsFileExists(similarity_index_pathname_)) {
+		LOG4CXX_WARN(logger_, "Couldn't find similarity index: " << similarity_index_pathname_);
+		return false;
+	}
+	FileHelper* fh = FileSystemHelper::GetInstance()->CreateFileHelper(similarity_index_pathname_, O_RDONLY);
+	fh->Open();
+	int read_length = fh->GetNextLogSize();
+	char *data = new char[read_length];
+	fh->Read(data, read_length);
 
+	stringstream buffer;
+	buffer.write(data, read_length);
+	bool res = similarity_index_.Deserialize(buffer);
+	LOG4CXX_INFO(logger_, "Similarity index loaded: " << similarity_index_.Size() << " min-hashes");
 
+	fh->Close();
+	FileSystemHelper::GetInstance()->DestroyFileHelper(fh);
+	delete[] data;
+	return res;
+}
 
+bool SnapshotControl::SaveFingerprintCache(const FingerprintCache& cache)
+{
+	if (!FileSystemHelper::GetInstance()->IsDirectoryExists(vm_path_))
+		FileSystemHelper::GetInstance()->CreateDirectory(vm_path_);
+	if (FileSystemHelper::GetInstance()->IsFileExists(fingerprint_cache_pathname_))
+		FileSystemHelper::GetInstance()->RemoveFile(fingerprint_cache_pathname_);
 
+	FileHelper* fh = FileSystemHelper::GetInstance()->CreateFileHelper(fingerprint_cache_pathname_, O_WRONLY);
+	fh->Create();
 
+	stringstream buffer;
+	cache.Serialize(buffer);
+	LOG4CXX_DEBUG(logger_, "Fingerprint cache size " << buffer.str().size());
+	fh->Write((char *)buffer.str().c_str(), buffer.str().size());
 
+	fh->Close();
+	FileSystemHelper::GetInstance()->DestroyFileHelper(fh);
+	return true;
+}
 
+bool SnapshotControl::LoadFingerprintCache(FingerprintCache& cache)
+{
+	if (!FileSystemHelper::GetInstance()->IsFileExists(fingerprint_cache_pathname_)) {
+		LOG4CXX_WARN(logger_, "Couldn't find fingerprint cache: " << fingerprint_cache_pathname_);
+		return false;
+	}
+	FileHelper* fh = FileSystemHelper::GetInstance()->CreateFileHelper(fingerprint_cache_pathname_, O_RDONLY);
+	fh->Open();
+	int read_length = fh->GetNextLogSize();
+	char *data = new char[read_length];
+	fh->Read(data, read_length);
 
+	stringstream buffer;
+	buffer.write(data, read_length);
+	bool res = cache.Deserialize(buffer);
+	LOG4CXX_INFO(logger_, "Fingerprint cache loaded: " << cache.Size() << " entries");
 
+	fh->Close();
+	FileSystemHelper::GetInstance()->DestroyFileHelper(fh);
+	delete[] data;
+	return res;
+}
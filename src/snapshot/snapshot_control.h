@@ -17,6 +17,8 @@
 #include <log4cxx/xml/domconfigurator.h>
 #include "bloom_filter.h"
 #include "bloom_filter_functions.h"
+#include "similarity_index.h"
+#include "fingerprint_cache.h"
 
 using namespace std;
 using namespace log4cxx;
@@ -54,6 +56,10 @@ public:
      */
     bool LoadSegmentRecipe(SegmentMeta& sm, uint32_t idx);
     bool SaveSegmentRecipe(SegmentMeta& sm);
+    /*
+     * Load only the block list of a segment recipe by its append store handle
+     */
+    bool LoadSegmentRecipeByHandle(SegmentMeta& sm, HandleType handle);
 
     /*
      * Save or load one block data from append store
@@ -80,6 +86,28 @@ public:
      */
     void UpdateBloomFilters(const SegmentMeta& sm);
 
+    /*
+     * Add a saved segment (with its recipe handle) to the similarity index
+     */
+    void UpdateSimilarityIndex(const SegmentMeta& sm);
+
+    /*
+     * Save or load snapshot's similarity index
+     */
+    bool SaveSimilarityIndex();
+    bool LoadSimilarityIndex();
+
+    /*
+     * Find recipe handles of segments sharing the min-hash of sm
+     */
+    void FindSimilarSegments(const SegmentMeta& sm, vector<HandleType>& handles, size_t max_results);
+
+    /*
+     * Save or load the VM's fingerprint cache, shared by all snapshots of the VM
+     */
+    bool SaveFingerprintCache(const FingerprintCache& cache);
+    bool LoadFingerprintCache(FingerprintCache& cache);
+
 public:
     string trace_file_;					// location of the trace file (.bv4)
     string os_type_;					// type of operating system
@@ -90,6 +118,8 @@ public:
     string ss_meta_pathname_;			// path to the snapshot metadata file
     string primary_filter_pathname_;	// path to the primary bloom filter file
     string secondary_filter_pathname_;	// path to the secondary bloom filter file
+    string similarity_index_pathname_;	// path to the similarity index file
+    string fingerprint_cache_pathname_;	// path to the VM's fingerprint cache file
     SnapshotMeta ss_meta_;				// the in-memory snapshot metadata
     VMMeta vm_meta_;					// the in-memory VM metadata
 
@@ -101,6 +131,7 @@ private:
     PanguAppendStore* store_ptr_;					// pointer to the append store instance
     BloomFilter<Checksum>* primary_filter_ptr_;		// pointer to the primary bloom filter instance
     BloomFilter<Checksum>* secondary_filter_ptr_;	// pointer to the secondary bloom filter instace
+    SimilarityIndex similarity_index_;				// min-hash of segments to their recipe handles
     static LoggerPtr logger_;						// logger
 };
 
@@ -3,6 +3,10 @@
  * If a current VM disk already exist, then we can avoid reading data
  * from append store by copying duplicate segments from existing VM image.
  * Usage: snapshot_read sample_data output_file snapshot_trace [current_trace]
+ * Set LOCAL_FS_ROOT to read the backup from a local directory instead of QFS
+ * Set CDS_DATA_OPTIONS to the memcached options of the CDS data cache, empty for no cache
+ * Set METRICS_FILE to dump metrics to METRICS_FILE.json and METRICS_FILE.prom
+ * every METRICS_INTERVAL seconds (default 10)
  */
 
 #include <iostream>
@@ -13,6 +17,8 @@
 #include "snapshot_control.h"
 #include "cds_data.h"
 #include "../fs/qfs_file_system_helper.h"
+#include "../fs/local_file_system_helper.h"
+#include "../common/metrics.h"
 
 using namespace std;
 using namespace log4cxx;
@@ -64,8 +70,18 @@ int main(int argc, char** argv)
     // output snapshot file
     ofstream output(data_file, ios::out | ios::binary | ios::trunc);
 
+    const char* metrics_file = getenv("METRICS_FILE");
+    if (metrics_file != NULL) {
+        const char* metrics_interval = getenv("METRICS_INTERVAL");
+        Metrics::StartReporter(metrics_file, metrics_interval != NULL ? atoi(metrics_interval) : 10);
+    }
+
     // init file system
-    QFSHelper::Connect();
+    const char* local_fs_root = getenv("LOCAL_FS_ROOT");
+    if (local_fs_root != NULL)
+        LocalFSHelper::Connect(local_fs_root);
+    else
+        QFSHelper::Connect();
 
     // some data come from current VM image
     DataSource* pds = NULL;
@@ -74,7 +90,8 @@ int main(int argc, char** argv)
     }
 
     // init cds data
-    CdsData cds_data(cds_name, kCdsDataOptions);
+    const char* cds_data_options = getenv("CDS_DATA_OPTIONS");
+    CdsData cds_data(cds_name, cds_data_options != NULL ? cds_data_options : kCdsDataOptions);
 
     // init snapshot controller for IO with QFS
     SnapshotControl ssctrl(snapshot_trace);
@@ -85,10 +102,15 @@ int main(int argc, char** argv)
         return -1;
     }
     ssctrl.SetAppendStore(pas);
+    Metrics::SetLabel("vm", ssctrl.ss_meta_.vm_id_);
+    Metrics::SetLabel("snapshot", ssctrl.ss_meta_.snapshot_id_);
 
     if (!ssctrl.LoadSnapshotMeta())
         return -1;
 
+    MetricCounter* local_bytes = Metrics::Counter("bigarchive_restore_local_bytes_total", "Bytes restored from the current VM image");
+    MetricCounter* cds_bytes = Metrics::Counter("bigarchive_restore_cds_bytes_total", "Bytes restored from the common data store");
+    MetricCounter* store_bytes = Metrics::Counter("bigarchive_restore_appendstore_bytes_total", "Bytes restored from the VM's append store");
     SegmentMeta cur_seg, ss_seg;
     uint32_t size_read;
     for (size_t segid = 0; segid < ssctrl.ss_meta_.snapshot_recipe_.size(); segid++) {
@@ -98,6 +120,7 @@ int main(int argc, char** argv)
                 // write cur_seg data to disk
                 for (size_t blkid = 0; blkid < cur_seg.segment_recipe_.size(); blkid++)
                     cur_seg.segment_recipe_[blkid].SerializeData(output);
+                local_bytes->Inc(cur_seg.size_);
                 continue;
             }
         }
@@ -110,12 +133,22 @@ int main(int argc, char** argv)
                     LOG4CXX_ERROR(logger, "Read CDS data fail");
                     return -1;
                 }
+                cds_bytes->Inc(size_read);
+                // overlap the next CDS block with the append store reads before it
+                for (size_t next = blkid + 1; next < ss_seg.segment_recipe_.size(); next++) {
+                    if (ss_seg.segment_recipe_[next].flags_ & IN_CDS) {
+                        if (next > blkid + 1)
+                            cds_data.Prefetch(ss_seg.segment_recipe_[next]);
+                        break;
+                    }
+                }
             }
             else {
                 if (!ssctrl.LoadBlockData(ss_seg.segment_recipe_[blkid])) {
                     LOG4CXX_ERROR(logger, "Read append store data fail");
                     return -1;
                 }
+                store_bytes->Inc(ss_seg.segment_recipe_[blkid].size_);
             }
         }
         // 3. save data to disk
@@ -126,6 +159,7 @@ int main(int argc, char** argv)
     output.close();
     if (pds != NULL)
         delete pds;
+    Metrics::StopReporter();
 }
 
 
@@ -195,6 +195,18 @@ BlockMeta* SegmentMeta::SearchBlock(const Checksum& cksum)
     return it->second;
 }
 
+Checksum SegmentMeta::GetMinHash() const
+{
+    Checksum min_hash;
+    if (segment_recipe_.size() == 0)
+        return min_hash;
+    min_hash = segment_recipe_[0].cksum_;
+    for (size_t i = 1; i < segment_recipe_.size(); ++i)
+        if (segment_recipe_[i].cksum_ < min_hash)
+            min_hash = segment_recipe_[i].cksum_;
+    return min_hash;
+}
+
 /************************** SnapshotMeta ***************************/
 
 void SnapshotMeta::Serialize(ostream& os) const
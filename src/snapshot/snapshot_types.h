@@ -79,6 +79,8 @@ public:
     string GetHandle();
     void BuildIndex();
     BlockMeta* SearchBlock(const Checksum& cksum);
+    // the smallest block hash in recipe, used as the segment's representative
+    Checksum GetMinHash() const;
 
 private:
     map<Checksum, BlockMeta*> blkmap_;
@@ -1,6 +1,11 @@
 /*
  * Writes a snapshot into append store
  * Usage: snapshot_write sample_data current_trace [parent_trace]
+ * Set CDS_INDEX_FILE to query an embedded cds index instead of memcached
+ * Set FP_CACHE_ENTRIES to resize the VM's fingerprint cache (0 disables it)
+ * Set LOCAL_FS_ROOT to keep the backup in a local directory instead of QFS
+ * Set METRICS_FILE to dump metrics to METRICS_FILE.json and METRICS_FILE.prom
+ * every METRICS_INTERVAL seconds (default 10)
  */
 #include <iostream>
 #include <cstdlib>
@@ -12,11 +17,14 @@
 #include "../append-store/append_store_types.h"
 #include "../append-store/append_store.h"
 #include "../fs/qfs_file_system_helper.h"
+#include "../fs/local_file_system_helper.h"
 #include "data_source.h"
 #include "snapshot_control.h"
 #include "snapshot_types.h"
 #include "cds_index.h"
+#include "cds_embedded_index.h"
 #include "../common/timer.h"
+#include "../common/metrics.h"
 #include <execinfo.h>
 #include <signal.h>
 
@@ -82,6 +90,29 @@ PanguAppendStore* init_as_read(string& vm_id)
     return NULL;
 }
 
+/*
+ * remember where the blocks of a resolved segment are stored
+ */
+void update_fingerprint_cache(FingerprintCache& fp_cache, const SegmentMeta& sm)
+{
+    for (size_t i = 0; i < sm.segment_recipe_.size(); ++i) {
+        const BlockMeta& blk = sm.segment_recipe_[i];
+        fp_cache.Insert(blk.cksum_, blk.handle_, blk.flags_ & ~IN_PARENT);
+    }
+}
+
+/*
+ * save buffered segment recipes in a batch, so they are placed sequencially on disk
+ */
+void flush_segment_metas(SnapshotControl* current, vector<SegmentMeta>& seg_meta_buf)
+{
+    for (size_t i = 0; i < seg_meta_buf.size(); i++) {
+        current->SaveSegmentRecipe(seg_meta_buf[i]);
+        current->UpdateSnapshotRecipe(seg_meta_buf[i]);
+        current->UpdateSimilarityIndex(seg_meta_buf[i]);
+    }
+    seg_meta_buf.clear();
+}
 
 int main(int argc, char *argv[]) {
     signal(SIGSEGV, crash_handler);
@@ -92,7 +123,11 @@ int main(int argc, char *argv[]) {
 	}
 
     DOMConfigurator::configure("Log4cxxConfig.xml");
-    QFSHelper::Connect();
+	const char* local_fs_root = getenv("LOCAL_FS_ROOT");
+	if (local_fs_root != NULL)
+		LocalFSHelper::Connect(local_fs_root);
+	else
+		QFSHelper::Connect();
 	string sample_file(argv[1]);
 	string snapshot_file(argv[2]);
     string parent_file;
@@ -103,6 +138,12 @@ int main(int argc, char *argv[]) {
     }
 
 
+    const char* metrics_file = getenv("METRICS_FILE");
+    if (metrics_file != NULL) {
+        const char* metrics_interval = getenv("METRICS_INTERVAL");
+        Metrics::StartReporter(metrics_file, metrics_interval != NULL ? atoi(metrics_interval) : 10);
+    }
+
     DataSource ds(snapshot_file, sample_file);
     SnapshotControl* current = NULL;
     SnapshotControl* parent = NULL;
@@ -117,6 +158,8 @@ int main(int argc, char *argv[]) {
             return -1;
         }
     }
+    Metrics::SetLabel("vm", current->ss_meta_.vm_id_);
+    Metrics::SetLabel("snapshot", current->ss_meta_.snapshot_id_);
     current->InitBloomFilters(ds.GetSnapshotSize());
 
     // 1. init append store
@@ -133,15 +176,50 @@ int main(int argc, char *argv[]) {
         //pas = init_as_read(current->ss_meta_.vm_id_);
         parent->SetAppendStore(pas);
         parent->LoadSnapshotMeta();
+        parent->LoadSimilarityIndex();
+    }
+
+    // fingerprints of recent snapshots of this VM
+    FingerprintCache fp_cache;
+    const char* fp_cache_entries = getenv("FP_CACHE_ENTRIES");
+    if (fp_cache_entries != NULL)
+        fp_cache.Resize(strtoull(fp_cache_entries, NULL, 10));
+    if (fp_cache.Capacity() > 0) {
+        TimerPool::Start("LoadFPCache");
+        current->LoadFingerprintCache(fp_cache);
+        TimerPool::Stop("LoadFPCache");
     }
 
-    uint64_t l1_blocks = 0, l1_size = 0, l2_blocks = 0, l2_size = 0, 
-        l3_size = 0, l3_blocks = 0, new_blocks = 0, new_size = 0, tot_blocks = 0, tot_size = 0;
+    uint64_t l1_blocks = 0, l1_size = 0, l2_blocks = 0, l2_size = 0, l2s_blocks = 0, l2s_size = 0, 
+        l2c_blocks = 0, l2c_size = 0, l3_size = 0, l3_blocks = 0, new_blocks = 0, new_size = 0, tot_blocks = 0, tot_size = 0;
+    // dedup statistics also go to the metrics registry, refreshed once per segment
+    const char* stat_levels[] = {"total", "l1", "l2", "l2_similar", "l2_cache", "l3", "new"};
+    uint64_t* stat_values[] = {&tot_blocks, &tot_size, &l1_blocks, &l1_size, &l2_blocks, &l2_size, 
+        &l2s_blocks, &l2s_size, &l2c_blocks, &l2c_size, &l3_blocks, &l3_size, &new_blocks, &new_size};
+    vector<MetricGauge*> stat_gauges;
+    for (size_t i = 0; i < sizeof(stat_levels) / sizeof(char*); i++) {
+        stat_gauges.push_back(Metrics::Gauge(string("bigarchive_snapshot_") + stat_levels[i] + "_blocks", 
+                                             string("Blocks of the snapshot resolved at level ") + stat_levels[i]));
+        stat_gauges.push_back(Metrics::Gauge(string("bigarchive_snapshot_") + stat_levels[i] + "_bytes", 
+                                             string("Bytes of the snapshot resolved at level ") + stat_levels[i]));
+    }
+    MetricGauge* dedup_ratio = Metrics::Gauge("bigarchive_snapshot_dedup_ratio", "Snapshot bytes divided by bytes newly written");
+    auto publish_stats = [&]() {
+        for (size_t i = 0; i < stat_gauges.size(); i++)
+            stat_gauges[i]->Set(*stat_values[i]);
+        dedup_ratio->Set(new_size > 0 ? (double)tot_size / new_size : 0.0);
+    };
     uint64_t last_pos = 0;
-    SegmentMeta cur_seg, par_seg;
+    HandleType cached_handle;
+    uint16_t cached_flags;
+    SegmentMeta cur_seg, par_seg, sim_seg;
+    vector<BlockMeta*> unresolved;	// blocks not deduped by parent yet
+    vector<HandleType> similar_handles;
+    bool par_seg_loaded = false;
     vector<SegmentMeta> seg_meta_buf;
     BlockMeta* bm;
-    CdsIndex cds_index;
+    const char* cds_index_file = getenv("CDS_INDEX_FILE");
+    CdsIndex* cds_index = OpenCdsIndex(cds_index_file != NULL ? cds_index_file : "");
     int num_queries = 0;	// number of CDS queries
     uint32_t seg_id = 0;	// numberical id of segment
     Checksum* cksums = new Checksum[BATCH_QUERY_BUFFER_SIZE];
@@ -151,6 +229,7 @@ int main(int argc, char *argv[]) {
     // 3. for every loaded segment, do
     TimerPool::Start("SnapshotWrite");
     while (ds.GetSegment(cur_seg)) {
+        publish_stats();
         // data generator does not calculate the offset of segment
         last_pos += cur_seg.size_;
         cur_seg.end_offset_ = last_pos;
@@ -160,12 +239,16 @@ int main(int argc, char *argv[]) {
         current->UpdateBloomFilters(cur_seg);
         TimerPool::Stop("UpdateFilter");
         tot_blocks += cur_seg.segment_recipe_.size(); tot_size += cur_seg.size_;	// stat total
-        if (has_parent && parent->LoadSegmentRecipe(par_seg, seg_id++)) {
+        unresolved.clear();
+        par_seg_loaded = has_parent && parent->LoadSegmentRecipe(par_seg, seg_id++);
+        if (par_seg_loaded) {
             //  a) first compare parent segment meta by cksum
             if (cur_seg.cksum_ == par_seg.cksum_) {
                 TimerPool::Start("L1");
                 cur_seg.handle_ = par_seg.handle_;
                 current->UpdateSnapshotRecipe(cur_seg);
+                current->UpdateSimilarityIndex(cur_seg);
+                update_fingerprint_cache(fp_cache, par_seg);
                 //l1_blocks += par_seg.segment_recipe_.size(); l1_size += par_seg.size_;	// stat l1
                 l1_blocks += cur_seg.segment_recipe_.size(); l1_size += cur_seg.size_;	// stat l1
                 LOG4CXX_DEBUG(ss_write_logger, "parent segment size: " << par_seg.size_
@@ -187,25 +270,69 @@ int main(int argc, char *argv[]) {
                     l2_blocks += 1; l2_size += cur_seg.segment_recipe_[i].size_;	// stat l2
                 }
                 else {
-                    // these blocks are not found in parent snapshot's segment, will ask CDS
-                    cksums[num_queries] = cur_seg.segment_recipe_[i].cksum_;
-                    blks_to_query[num_queries++] = &cur_seg.segment_recipe_[i];
+                    // these blocks are not found in parent snapshot's segment
+                    unresolved.push_back(&cur_seg.segment_recipe_[i]);
                 }
             }
             TimerPool::Stop("L2");
         }
         else {
-            // if there's no parent, then we can only ask CDS
-            TimerPool::Start("L3AndWriteData");
-            for (size_t i = 0; i < cur_seg.segment_recipe_.size(); ++i) {
-                cksums[num_queries]= cur_seg.segment_recipe_[i].cksum_;
-                blks_to_query[num_queries++] = &cur_seg.segment_recipe_[i];
+            for (size_t i = 0; i < cur_seg.segment_recipe_.size(); ++i)
+                unresolved.push_back(&cur_seg.segment_recipe_[i]);
+        }
+
+        //  b') then compare with parent segments sharing the same min-hash,
+        //  which finds data shifted away from its old position in the disk image
+        if (has_parent && !unresolved.empty()) {
+            TimerPool::Start("L2Similar");
+            parent->FindSimilarSegments(cur_seg, similar_handles, MAX_SIMILAR_SEGMENTS);
+            for (size_t j = 0; j < similar_handles.size() && !unresolved.empty(); ++j) {
+                if (par_seg_loaded && similar_handles[j] == par_seg.handle_)
+                    continue;	// already compared above
+                if (!parent->LoadSegmentRecipeByHandle(sim_seg, similar_handles[j]))
+                    continue;
+                sim_seg.BuildIndex();
+                size_t num_left = 0;
+                for (size_t i = 0; i < unresolved.size(); ++i) {
+                    bm = sim_seg.SearchBlock(unresolved[i]->cksum_);
+                    if (bm != NULL) {
+                        unresolved[i]->handle_ = bm->handle_;
+                        unresolved[i]->flags_ = bm->flags_ | IN_PARENT;
+                        l2s_blocks += 1; l2s_size += unresolved[i]->size_;	// stat l2 similar
+                    }
+                    else
+                        unresolved[num_left++] = unresolved[i];
+                }
+                unresolved.resize(num_left);
             }
-            TimerPool::Stop("L3AndWriteData");
+            TimerPool::Stop("L2Similar");
+        }
+
+        //  b'') then look up fingerprints of older snapshots and of this one
+        if (fp_cache.Capacity() > 0 && !unresolved.empty()) {
+            TimerPool::Start("L2Cache");
+            size_t num_left = 0;
+            for (size_t i = 0; i < unresolved.size(); ++i) {
+                if (fp_cache.Lookup(unresolved[i]->cksum_, cached_handle, cached_flags)) {
+                    unresolved[i]->handle_ = cached_handle;
+                    unresolved[i]->flags_ = cached_flags;
+                    l2c_blocks += 1; l2c_size += unresolved[i]->size_;	// stat l2 cache
+                }
+                else
+                    unresolved[num_left++] = unresolved[i];
+            }
+            unresolved.resize(num_left);
+            TimerPool::Stop("L2Cache");
+        }
+
+        // blocks left will ask CDS
+        for (size_t i = 0; i < unresolved.size(); ++i) {
+            cksums[num_queries] = unresolved[i]->cksum_;
+            blks_to_query[num_queries++] = unresolved[i];
         }
         //  c) check with cds
         TimerPool::Start("L3AndWriteData");
-        cds_index.BatchGet(cksums, num_queries, results, offsets);
+        cds_index->BatchGet(cksums, num_queries, results, offsets);
         for (int i = 0; i < num_queries; i++) {
             if (results[i] == true) {
                 // if found in CDS, it should return the data offset in CDS data file
@@ -222,22 +349,22 @@ int main(int argc, char *argv[]) {
             }
         }
         TimerPool::Stop("L3AndWriteData");
+        update_fingerprint_cache(fp_cache, cur_seg);
         //  e) write segment recipe
         // to make segment meta data placed sequencially on disk, we buffer it and write in batch mode
         TimerPool::Start("WriteSegMeta");
         seg_meta_buf.push_back(cur_seg);
-        if (seg_meta_buf.size() >= DF_MAX_PENDING) {
-            for (size_t i = 0; i < seg_meta_buf.size(); i++) {
-                current->SaveSegmentRecipe(seg_meta_buf[i]);
-                current->UpdateSnapshotRecipe(seg_meta_buf[i]);
-            }
-            seg_meta_buf.clear();
-        }
+        if (seg_meta_buf.size() >= DF_MAX_PENDING)
+            flush_segment_metas(current, seg_meta_buf);
         // current->SaveSegmentRecipe(cur_seg);
         // current->UpdateSnapshotRecipe(cur_seg);
         TimerPool::Stop("WriteSegMeta");
     }
 
+    TimerPool::Start("WriteSegMeta");
+    flush_segment_metas(current, seg_meta_buf);
+    TimerPool::Stop("WriteSegMeta");
+
     // 4. write snapshot meta to qfs
     TimerPool::Start("WriteSSMeta");
     current->SaveSnapshotMeta();
@@ -245,24 +372,38 @@ int main(int argc, char *argv[]) {
     TimerPool::Start("WriteFilters");
     current->SaveBloomFilters();
     TimerPool::Stop("WriteFilters");
+    TimerPool::Start("WriteSimIndex");
+    current->SaveSimilarityIndex();
+    TimerPool::Stop("WriteSimIndex");
+    if (fp_cache.Capacity() > 0) {
+        TimerPool::Start("WriteFPCache");
+        current->SaveFingerprintCache(fp_cache);
+        TimerPool::Stop("WriteFPCache");
+    }
 	pas->Flush();
 	pas->Close();
 
     TimerPool::Stop("SnapshotWrite");
+    publish_stats();
 
     LOG4CXX_INFO(ss_write_logger, "total: " << tot_blocks << " " << tot_size);
     LOG4CXX_INFO(ss_write_logger, "l1: " << l1_blocks << " " << l1_size);
     LOG4CXX_INFO(ss_write_logger, "l2: " << l2_blocks << " " << l2_size);
+    LOG4CXX_INFO(ss_write_logger, "l2 similar: " << l2s_blocks << " " << l2s_size);
+    LOG4CXX_INFO(ss_write_logger, "l2 cache: " << l2c_blocks << " " << l2c_size);
     LOG4CXX_INFO(ss_write_logger, "l3: " << l3_blocks << " " << l3_size);
     LOG4CXX_INFO(ss_write_logger, "new: " << new_blocks << " " << new_size);
+    LOG4CXX_INFO(ss_write_logger, "fingerprint cache: " << fp_cache.ToString());
 
     TimerPool::PrintAll();
+    Metrics::StopReporter();
 
     delete pas;
     delete[] cksums;
     delete[] results;
     delete[] offsets;
     delete[] blks_to_query;
+    delete cds_index;
 	return 0;
 }
 
@@ -0,0 +1,201 @@
+#include "trace_reader.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+void TraceRecord::ToBlock(Block& blk) const
+{
+    memcpy(blk.cksum_.data_, cksum_, CKSUM_LEN);
+    blk.file_id_ = file_id_;
+    blk.size_ = size_;
+    blk.offset_ = offset_;
+}
+
+uint64_t TraceSpan::GetBytes() const
+{
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < size_; i++)
+        bytes += begin_[i].size_;
+    return bytes;
+}
+
+void TraceSpan::GetChecksum(Checksum& cksum) const
+{
+    SHA_CTX ctx;
+    SHA1_Init(&ctx);
+    for (size_t i = 0; i < size_; i++)
+        if (begin_[i].size_ != 0)
+            SHA1_Update(&ctx, begin_[i].cksum_, CKSUM_LEN);
+    SHA1_Final((unsigned char*)cksum.data_, &ctx);
+}
+
+size_t TraceSpan::GetMinHashIndex() const
+{
+    size_t min_idx = size_;
+    for (size_t i = 0; i < size_; i++) {
+        if (begin_[i].size_ == 0)
+            continue;
+        if (min_idx == size_ || memcmp(begin_[i].cksum_, begin_[min_idx].cksum_, CKSUM_LEN) < 0)
+            min_idx = i;
+    }
+    return min_idx;
+}
+
+void TraceSpan::ToSegment(Segment& seg) const
+{
+    Block blk;
+    seg.Init();
+    for (size_t i = 0; i < size_; i++) {
+        if (begin_[i].size_ == 0)
+            continue;
+        begin_[i].ToBlock(blk);
+        seg.AddBlock(blk);
+    }
+    seg.Final();
+}
+
+SegmentPolicy SegmentPolicy::Fixed(uint32_t size)
+{
+    SegmentPolicy policy;
+    policy.kind_ = FIXED;
+    policy.fix_size_ = size;
+    policy.min_size_ = policy.max_size_ = size;
+    policy.anchor_mask_ = 0;
+    return policy;
+}
+
+SegmentPolicy SegmentPolicy::Anchor(uint32_t avg_size)
+{
+    SegmentPolicy policy;
+    policy.kind_ = ANCHOR;
+    policy.fix_size_ = avg_size;
+    policy.min_size_ = avg_size / 4;
+    policy.max_size_ = avg_size * 4;
+    // one anchor every avg_size / AVG_BLOCK_SIZE blocks, rounded to a power of two
+    uint32_t blocks = 1;
+    while (blocks * 2 <= avg_size / AVG_BLOCK_SIZE)
+        blocks *= 2;
+    policy.anchor_mask_ = blocks - 1;
+    return policy;
+}
+
+bool SegmentPolicy::IsBoundary(const TraceRecord& rec, uint64_t bytes) const
+{
+    if (kind_ == FIXED)
+        return bytes >= fix_size_;
+    if (bytes >= max_size_)
+        return true;
+    return bytes >= min_size_ && (rec.GetChecksum().Last4Bytes() & anchor_mask_) == 0;
+}
+
+bool SegmentCursor::Next(TraceSpan& seg)
+{
+    size_t start = pos_;
+    uint64_t bytes = 0;
+    while (pos_ < span_.Size()) {
+        const TraceRecord& rec = span_[pos_++];
+        if (rec.size_ == 0)		// fix the zero-sized block bug in scanner
+            continue;
+        bytes += rec.size_;
+        if (policy_.IsBoundary(rec, bytes))
+            break;
+    }
+    if (bytes == 0)
+        return false;
+    seg = span_.SubSpan(start, pos_ - start);
+    return true;
+}
+
+bool SegmentCursor::NextRecord(const TraceRecord*& rec)
+{
+    if (pos_ >= span_.Size())
+        return false;
+    rec = &span_[pos_++];
+    return true;
+}
+
+TraceReader::TraceReader()
+{
+    fd_ = -1;
+    addr_ = NULL;
+    length_ = 0;
+}
+
+TraceReader::~TraceReader()
+{
+    Close();
+}
+
+bool TraceReader::Open(const string& pathname)
+{
+    Close();
+    int fd = open(pathname.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    size_t num_records = st.st_size / RECORD_SIZE;
+    if (num_records > 0) {
+        length_ = st.st_size;
+        addr_ = mmap(NULL, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr_ == MAP_FAILED) {
+            addr_ = NULL;
+            length_ = 0;
+            close(fd);
+            return false;
+        }
+        madvise(addr_, length_, MADV_SEQUENTIAL);
+    }
+    fd_ = fd;
+    records_ = TraceSpan((const TraceRecord*)addr_, num_records);
+    return true;
+}
+
+void TraceReader::Close()
+{
+    if (addr_ != NULL)
+        munmap(addr_, length_);
+    if (fd_ >= 0)
+        close(fd_);
+    fd_ = -1;
+    addr_ = NULL;
+    length_ = 0;
+    records_ = TraceSpan();
+}
+
+uint64_t TraceReader::GetSnapshotSize() const
+{
+    if (records_.Empty())
+        return 0;
+    const TraceRecord& last = records_[records_.Size() - 1];
+    return last.offset_ + last.size_;
+}
+
+void TraceReader::Partition(uint32_t n, const SegmentPolicy& policy, vector<TraceSpan>& parts) const
+{
+    parts.clear();
+    if (n <= 1 || records_.Size() < n) {
+        parts.push_back(records_);
+        return;
+    }
+    // only sizes (and hashes for anchors) are touched, far cheaper than the work on the parts
+    SegmentCursor cursor(records_, policy);
+    TraceSpan seg;
+    size_t start = 0;
+    while (cursor.Next(seg)) {
+        size_t end = cursor.GetPosition();
+        if (end - start >= (records_.Size() - start) / (n - parts.size())) {
+            parts.push_back(records_.SubSpan(start, end - start));
+            start = end;
+            if (parts.size() == n - 1)
+                break;
+        }
+    }
+    if (start < records_.Size())
+        parts.push_back(records_.SubSpan(start, records_.Size() - start));
+}
@@ -0,0 +1,156 @@
+/*
+ * Memory mapped reader of scan traces (.bv4/.v4). Records are used in place as
+ * packed 36-byte TraceRecord and segments are spans over the mapping, so tools
+ * walking traces of tens of GB never parse or copy a record they do not need.
+ */
+#ifndef _TRACE_READER_H_
+#define _TRACE_READER_H_
+
+#include <string>
+#include <vector>
+#include "trace_types.h"
+
+using namespace std;
+
+/*
+ * one record of a scan trace as laid out on disk
+ */
+struct TraceRecord {
+    char cksum_[CKSUM_LEN];
+    uint32_t file_id_;
+    uint32_t size_;
+    uint64_t offset_;
+
+    const Checksum& GetChecksum() const { return *reinterpret_cast<const Checksum*>(cksum_); }
+
+    void ToBlock(Block& blk) const;
+} __attribute__((packed));
+
+typedef char TraceRecordSizeCheck[sizeof(TraceRecord) == RECORD_SIZE ? 1 : -1];
+
+/*
+ * a range of records inside a mapped trace, valid while the reader is open
+ */
+class TraceSpan {
+public:
+    TraceSpan() : begin_(NULL), size_(0) {}
+
+    TraceSpan(const TraceRecord* begin, size_t size) : begin_(begin), size_(size) {}
+
+    const TraceRecord* begin() const { return begin_; }
+    const TraceRecord* end() const { return begin_ + size_; }
+    const TraceRecord& operator[](size_t i) const { return begin_[i]; }
+
+    size_t Size() const { return size_; }
+    bool Empty() const { return size_ == 0; }
+
+    TraceSpan SubSpan(size_t pos, size_t n) const { return TraceSpan(begin_ + pos, n); }
+
+    /*
+     * the following skip zero-sized records, just as Segment::LoadFixSize,
+     * so a span gives the same checksum and min-hash as the loaded Segment
+     */
+    uint64_t GetBytes() const;
+    void GetChecksum(Checksum& cksum) const;
+    size_t GetMinHashIndex() const;		// Size() if there is no non-zero record
+    void ToSegment(Segment& seg) const;
+
+private:
+    const TraceRecord* begin_;
+    size_t size_;
+};
+
+/*
+ * how a trace is cut into segments:
+ * FIXED ends a segment once it holds fix_size_ bytes, as Segment::LoadFixSize;
+ * ANCHOR ends it after a block whose hash has the low anchor_mask_ bits clear,
+ * once it holds min_size_ bytes, or at max_size_ bytes, so segment boundaries
+ * survive insertions in front of them
+ */
+struct SegmentPolicy {
+    enum Kind { FIXED, ANCHOR };
+
+    Kind kind_;
+    uint32_t fix_size_;
+    uint32_t min_size_;
+    uint32_t max_size_;
+    uint32_t anchor_mask_;
+
+    static SegmentPolicy Fixed(uint32_t size = FIX_SEGMENT_SIZE);
+
+    /*
+     * average segment size of about avg_size bytes with AVG_BLOCK_SIZE blocks,
+     * min and max are a quarter and four times of it
+     */
+    static SegmentPolicy Anchor(uint32_t avg_size = FIX_SEGMENT_SIZE);
+
+    bool IsBoundary(const TraceRecord& rec, uint64_t bytes) const;
+};
+
+/*
+ * walks a span segment by segment or record by record, both share one position
+ */
+class SegmentCursor {
+public:
+    SegmentCursor() : pos_(0) {}
+
+    SegmentCursor(const TraceSpan& span, const SegmentPolicy& policy) : span_(span), policy_(policy), pos_(0) {}
+
+    /*
+     * next segment, trailing records of zero size are dropped and
+     * false is returned at the end of the span
+     */
+    bool Next(TraceSpan& seg);
+
+    /*
+     * next record including zero-sized ones
+     */
+    bool NextRecord(const TraceRecord*& rec);
+
+    size_t GetPosition() const { return pos_; }
+
+private:
+    TraceSpan span_;
+    SegmentPolicy policy_;
+    size_t pos_;
+};
+
+class TraceReader {
+public:
+    TraceReader();
+
+    ~TraceReader();
+
+    /*
+     * map the trace read only, a partial record at the end is ignored
+     */
+    bool Open(const string& pathname);
+
+    void Close();
+
+    bool IsOpen() const { return fd_ >= 0; }
+
+    const TraceSpan& GetRecords() const { return records_; }
+
+    size_t GetNumRecords() const { return records_.Size(); }
+
+    /*
+     * end offset of the last record
+     */
+    uint64_t GetSnapshotSize() const;
+
+    /*
+     * split the trace into at most n spans of about the same number of records
+     * for parallel processing; spans are cut on segment boundaries of the policy,
+     * so their segments are exactly the segments of the whole trace
+     */
+    void Partition(uint32_t n, const SegmentPolicy& policy, vector<TraceSpan>& parts) const;
+
+private:
+    int fd_;
+    void* addr_;
+    size_t length_;
+    TraceSpan records_;
+};
+
+#endif // _TRACE_READER_H_
@@ -0,0 +1,292 @@
+// benchmark PanguAppendStore: append throughput, open/reload time, random read latency,
+// sequential-handle read and scan throughput
+// Usage: append_store_bench [options] store_path
+//   --local DIR           run on the local file system rooted at DIR instead of QFS
+//   --records N           number of records to append (default 100000)
+//   --size DIST           record sizes: fixed:S, uniform:MIN:MAX or exp:MEAN (default fixed:4096)
+//   --zero-ratio R        fraction of each record filled with zeros, 0 is incompressible (default 0.5)
+//   --compression C       none or lzo (default lzo)
+//   --index-interval N    block index interval of the store (default 1000)
+//   --chunk-size MB       max chunk size (default store default)
+//   --reads N             number of random reads (default 10000)
+//   --stripes N           number of chunks appended to at the same time (default 1)
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+
+#include <log4cxx/logger.h>
+#include <log4cxx/xml/domconfigurator.h>
+
+#include "../append-store/append_store.h"
+#include "../fs/qfs_file_system_helper.h"
+#include "../fs/local_file_system_helper.h"
+#include "../common/timer.h"
+
+using namespace std;
+using namespace log4cxx;
+using namespace log4cxx::xml;
+using namespace log4cxx::helpers;
+
+struct BenchOptions {
+    string local_root;
+    string store_path;
+    uint64_t num_records;
+    string size_dist;
+    double zero_ratio;
+    DataFileCompressionFlag compression;
+    uint32_t index_interval;
+    uint64_t chunk_size;
+    uint64_t num_reads;
+    uint32_t num_stripes;
+};
+
+void usage(const char* prog)
+{
+    cout << "Usage: " << prog << " [--local DIR] [--records N] [--size fixed:S|uniform:MIN:MAX|exp:MEAN]" << endl
+         << "       [--zero-ratio R] [--compression none|lzo] [--index-interval N] [--chunk-size MB]" << endl
+         << "       [--reads N] [--stripes N] store_path" << endl;
+}
+
+bool parse_options(int argc, char** argv, BenchOptions& opts)
+{
+    opts.num_records = 100000;
+    opts.size_dist = "fixed:4096";
+    opts.zero_ratio = 0.5;
+    opts.compression = COMPRESSOR_LZO;
+    opts.index_interval = 1000;
+    opts.chunk_size = 0;
+    opts.num_reads = 10000;
+    opts.num_stripes = 1;
+
+    int i;
+    for (i = 1; i + 1 < argc && strncmp(argv[i], "--", 2) == 0; i += 2) {
+        string opt(argv[i]);
+        string val(argv[i + 1]);
+        if (opt == "--local")
+            opts.local_root = val;
+        else if (opt == "--records")
+            opts.num_records = strtoull(val.c_str(), NULL, 10);
+        else if (opt == "--size")
+            opts.size_dist = val;
+        else if (opt == "--zero-ratio")
+            opts.zero_ratio = atof(val.c_str());
+        else if (opt == "--compression" && (val == "none" || val == "lzo"))
+            opts.compression = val == "none" ? NO_COMPRESSION : COMPRESSOR_LZO;
+        else if (opt == "--index-interval")
+            opts.index_interval = atoi(val.c_str());
+        else if (opt == "--chunk-size")
+            opts.chunk_size = strtoull(val.c_str(), NULL, 10) << 20;
+        else if (opt == "--reads")
+            opts.num_reads = strtoull(val.c_str(), NULL, 10);
+        else if (opt == "--stripes")
+            opts.num_stripes = atoi(val.c_str());
+        else
+            return false;
+    }
+    if (i + 1 != argc)
+        return false;
+    opts.store_path = argv[i];
+    return true;
+}
+
+/*
+ * draws record sizes from the distribution given as fixed:S, uniform:MIN:MAX or exp:MEAN
+ */
+class SizeGenerator {
+public:
+    SizeGenerator() : kind_(0), a_(4096), b_(4096) {}
+
+    bool Init(const string& dist)
+    {
+        string kind = dist.substr(0, dist.find(':'));
+        unsigned long a = 0, b = 0;
+        if (kind == "fixed" && sscanf(dist.c_str(), "fixed:%lu", &a) == 1)
+            kind_ = 0, a_ = b_ = a;
+        else if (kind == "uniform" && sscanf(dist.c_str(), "uniform:%lu:%lu", &a, &b) == 2 && a <= b)
+            kind_ = 1, a_ = a, b_ = b;
+        else if (kind == "exp" && sscanf(dist.c_str(), "exp:%lu", &a) == 1)
+            kind_ = 2, a_ = a, b_ = a * 16;
+        else
+            return false;
+        return a_ > 0;
+    }
+
+    uint32_t Next()
+    {
+        if (kind_ == 0)
+            return a_;
+        if (kind_ == 1)
+            return a_ + rand() % (b_ - a_ + 1);
+        // exponential with mean a_, capped at 16 times the mean
+        double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+        uint64_t size = (uint64_t)(-log(u) * a_) + 1;
+        return min(size, b_);
+    }
+
+    uint64_t Max() const { return b_; }
+
+private:
+    int kind_;
+    uint64_t a_;
+    uint64_t b_;
+};
+
+void report(const string& name, uint64_t num_records, uint64_t num_bytes, double ms)
+{
+    cout << name << ": " << num_records << " records, " << num_bytes << " bytes in " << ms << " ms, "
+         << (ms > 0 ? num_records * 1000.0 / ms : 0) << " records/sec, "
+         << (ms > 0 ? num_bytes / 1048.576 / ms : 0) << " MB/sec" << endl;
+}
+
+void report_latency(const string& name, vector<double>& latencies)
+{
+    if (latencies.empty())
+        return;
+    sort(latencies.begin(), latencies.end());
+    size_t n = latencies.size();
+    double sum = 0;
+    for (size_t i = 0; i < n; i++)
+        sum += latencies[i];
+    cout << name << " latency in ms: avg " << sum / n
+         << ", p50 " << latencies[n / 2]
+         << ", p90 " << latencies[n * 90 / 100]
+         << ", p99 " << latencies[n * 99 / 100]
+         << ", max " << latencies[n - 1] << endl;
+}
+
+PanguAppendStore* open_store(const BenchOptions& opts, bool append)
+{
+    StoreParameter sp;
+    sp.mPath = opts.store_path;
+    sp.mAppend = append;
+    sp.mMaxChunkSize = opts.chunk_size;
+    sp.mBlockIndexInterval = opts.index_interval;
+    sp.mCompressionFlag = opts.compression;
+    sp.mNumStripes = opts.num_stripes;
+    return new PanguAppendStore(sp, append);
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions opts;
+    SizeGenerator sizes;
+    if (!parse_options(argc, argv, opts)) {
+        usage(argv[0]);
+        return -1;
+    }
+    if (!sizes.Init(opts.size_dist)) {
+        cout << "Bad size distribution: " << opts.size_dist << endl;
+        return -1;
+    }
+
+    DOMConfigurator::configure("Log4cxxConfig.xml");
+    if (opts.local_root.empty())
+        QFSHelper::Connect();
+    else
+        LocalFSHelper::Connect(opts.local_root);
+    if (FileSystemHelper::GetInstance()->IsDirectoryExists(opts.store_path))
+        FileSystemHelper::GetInstance()->RemoveDirectory(opts.store_path);
+
+    // record contents: random bytes with a zero filled tail for compressibility
+    string pattern(sizes.Max(), 0);
+    for (size_t i = 0; i < pattern.size(); i++)
+        pattern[i] = rand();
+
+    vector<string> handles;
+    vector<uint32_t> record_sizes;
+    handles.reserve(opts.num_records);
+    record_sizes.reserve(opts.num_records);
+    Timer timer;
+    uint64_t total_bytes = 0;
+
+    try {
+        // 1. append
+        PanguAppendStore* pas = open_store(opts, true);
+        string record;
+        timer.Start();
+        for (uint64_t i = 0; i < opts.num_records; i++) {
+            uint32_t size = sizes.Next();
+            uint32_t random_len = size - (uint32_t)(size * opts.zero_ratio);
+            size_t start = rand() % (pattern.size() - random_len + 1);
+            record.assign(pattern, start, random_len);
+            record.resize(size, 0);
+            memcpy(&record[0], &i, min((size_t)size, sizeof(i)));	// keep records distinct
+            handles.push_back(pas->Append(record));
+            record_sizes.push_back(size);
+            total_bytes += size;
+        }
+        pas->Flush();
+        pas->Close();
+        report("append", opts.num_records, total_bytes, timer.Stop());
+        delete pas;
+
+        // 2. open and reload
+        timer.Reset();
+        timer.Start();
+        pas = open_store(opts, false);
+        cout << "open: " << timer.Stop() << " ms" << endl;
+        timer.Reset();
+        timer.Start();
+        pas->Reload();
+        cout << "reload: " << timer.Stop() << " ms" << endl;
+
+        // 3. random reads
+        string data;
+        vector<double> latencies;
+        uint64_t read_bytes = 0, errors = 0;
+        Timer total;
+        total.Start();
+        for (uint64_t i = 0; i < opts.num_reads && !handles.empty(); i++) {
+            size_t k = rand() % handles.size();
+            timer.Reset();
+            timer.Start();
+            if (!pas->Read(handles[k], &data) || data.size() != record_sizes[k])
+                errors++;
+            latencies.push_back(timer.Stop());
+            read_bytes += data.size();
+        }
+        report("random read", latencies.size(), read_bytes, total.Stop());
+        report_latency("random read", latencies);
+        delete pas;
+
+        // 4. reads in append order, from a fresh store so no chunk is cached yet
+        pas = open_store(opts, false);
+        read_bytes = 0;
+        timer.Reset();
+        timer.Start();
+        for (uint64_t i = 0; i < handles.size(); i++) {
+            if (!pas->Read(handles[i], &data) || data.size() != record_sizes[i])
+                errors++;
+            read_bytes += data.size();
+        }
+        report("sequential read", handles.size(), read_bytes, timer.Stop());
+
+        // 5. scan
+        Scanner* scanner = pas->GetScanner();
+        string handle;
+        uint64_t num_scanned = 0;
+        read_bytes = 0;
+        timer.Reset();
+        timer.Start();
+        while (scanner->Next(&handle, &data)) {
+            num_scanned++;
+            read_bytes += data.size();
+        }
+        report("scan", num_scanned, read_bytes, timer.Stop());
+        delete scanner;
+        delete pas;
+
+        if (errors > 0 || num_scanned != handles.size()) {
+            cout << "FAILED: " << errors << " bad reads, " << num_scanned << " records scanned" << endl;
+            return 1;
+        }
+    }
+    catch (ExceptionBase& e) {
+        cout << "FAILED: " << e.ToString() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,218 @@
+// test the append store manifest: Flush/Tail/Reload round trips, a corrupted
+// manifest, manifest entries that don't match the index files and BatchRemove
+//
+// Set LOCAL_FS_ROOT to run against a local directory instead of QFS
+#include <stdlib.h>
+
+#include <log4cxx/logger.h>
+#include <log4cxx/xml/domconfigurator.h>
+
+#include "../append-store/append_store.h"
+#include "../append-store/append_store_manifest.h"
+#include "../include/file_system_helper.h"
+#include "../include/file_helper.h"
+#include "../fs/qfs_file_system_helper.h"
+#include "../fs/local_file_system_helper.h"
+
+using namespace std;
+using namespace log4cxx;
+using namespace log4cxx::xml;
+using namespace log4cxx::helpers;
+
+LoggerPtr as_manifest_logger(Logger::getLogger("AppendStoreManifestTest"));
+
+static const string test_path("/asmanifesttest");
+
+static string make_data(uint64_t i)
+{
+    string data(100 + (i * 7919) % 3000, 0);
+    for (size_t k = 0; k < data.size(); k++)
+    {
+        data[k] = (char)((i * 131 + k * 7) % 251);
+    }
+    return data;
+}
+
+static StoreParameter make_param(bool append)
+{
+    StoreParameter sp = StoreParameter();
+    sp.mPath = test_path;
+    sp.mAppend = append;
+    sp.mMaxChunkSize = 1 << 20;
+    sp.mNumStripes = 2;
+    return sp;
+}
+
+// number of handles that don't read back what was appended
+static uint64_t verify(PanguAppendStore* pas, const vector<string>& handles)
+{
+    uint64_t bad = 0;
+    string data;
+    for (uint64_t i = 0; i < handles.size(); i++)
+    {
+        if (!pas->Read(handles[i], &data) || data != make_data(i))
+        {
+            bad++;
+        }
+    }
+    return bad;
+}
+
+// a new reader loads every chunk from the manifest, or by listing the store without one
+static uint64_t verify_reopen(const vector<string>& handles)
+{
+    PanguAppendStore pas(make_param(false), false);
+    pas.Reload();
+    uint64_t bad = verify(&pas, handles);
+    pas.Close();
+    return bad;
+}
+
+static void append(PanguAppendStore* pas, vector<string>& handles, uint64_t count)
+{
+    for (uint64_t i = handles.size(), end = handles.size() + count; i < end; i++)
+    {
+        handles.push_back(pas->Append(make_data(i)));
+    }
+}
+
+static bool check(const string& step, uint64_t bad)
+{
+    LOG4CXX_INFO(as_manifest_logger, step << ": " << bad << " bad records");
+    return bad == 0;
+}
+
+// change every entry of the manifest so it no longer matches the index files
+static void damage_entries(bool length)
+{
+    StoreManifest manifest;
+    manifest.Load(test_path + "/");
+    for (ChunkIDType id = 0; id <= manifest.GetMaxChunkID(); id++)
+    {
+        const ChunkManifestEntry* found = manifest.Find(id);
+        if (found == NULL || found->mIndexLength == 0)
+        {
+            continue;
+        }
+        ChunkManifestEntry entry = *found;
+        if (length)
+        {
+            entry.mIndexLength--;
+        }
+        else
+        {
+            entry.mIndexChecksum++;
+        }
+        manifest.Update(entry);
+    }
+    manifest.Save(test_path + "/");
+}
+
+static void corrupt_manifest()
+{
+    FileSystemHelper* fsh = FileSystemHelper::GetInstance();
+    FileHelper* fh = fsh->CreateFileHelper(test_path + "/" + ManifestFileName, O_WRONLY);
+    string garbage(64, 'x');
+    fh->Create();
+    fh->Flush(&garbage[0], garbage.size());
+    fh->Close();
+    fsh->DestroyFileHelper(fh);
+}
+
+static uint64_t count_records()
+{
+    PanguAppendStore pas(make_param(false), false);
+    pas.Reload();
+    Scanner* scanner = pas.GetScanner();
+    string handle, data;
+    uint64_t count = 0;
+    while (scanner->Next(&handle, &data))
+    {
+        count++;
+    }
+    delete scanner;
+    pas.Close();
+    return count;
+}
+
+int main(int argc, char* argv[]) {
+    DOMConfigurator::configure("Log4cxxConfig.xml");
+    const char* local_fs_root = getenv("LOCAL_FS_ROOT");
+    if (local_fs_root != NULL)
+        LocalFSHelper::Connect(local_fs_root);
+    else
+        QFSHelper::Connect();
+
+    FileSystemHelper* fsh = FileSystemHelper::GetInstance();
+    if (fsh->IsDirectoryExists(test_path))
+    {
+        fsh->RemoveDirectory(test_path);
+    }
+
+    bool correctness = true;
+    vector<string> handles;
+    try
+    {
+        LOG4CXX_INFO(as_manifest_logger, "-------------testing Flush and Reload--------------");
+        PanguAppendStore* writer = new PanguAppendStore(make_param(true), true);
+        PanguAppendStore* reader = NULL;
+        for (int round = 0; round < 3; round++)
+        {
+            append(writer, handles, 3000);
+            writer->Flush();
+            if (reader == NULL)
+            {
+                reader = new PanguAppendStore(make_param(false), false);
+            }
+            reader->Reload();
+            correctness = check("reload", verify(reader, handles)) && correctness;
+        }
+
+        LOG4CXX_INFO(as_manifest_logger, "-------------testing Tail--------------");
+        append(writer, handles, 3000);
+        writer->Flush();
+        reader->Tail();
+        correctness = check("tail", verify(reader, handles)) && correctness;
+        reader->Close();
+        delete reader;
+        writer->Close();
+        delete writer;
+
+        LOG4CXX_INFO(as_manifest_logger, "-------------testing writer reopen--------------");
+        writer = new PanguAppendStore(make_param(true), false);
+        append(writer, handles, 3000);
+        writer->Close();
+        delete writer;
+        correctness = check("reopen", verify_reopen(handles)) && correctness;
+
+        LOG4CXX_INFO(as_manifest_logger, "-------------testing manifest mismatch--------------");
+        damage_entries(false);
+        correctness = check("index checksum mismatch", verify_reopen(handles)) && correctness;
+        damage_entries(true);
+        correctness = check("index length mismatch", verify_reopen(handles)) && correctness;
+        corrupt_manifest();
+        correctness = check("corrupted manifest", verify_reopen(handles)) && correctness;
+
+        LOG4CXX_INFO(as_manifest_logger, "-------------testing BatchRemove--------------");
+        writer = new PanguAppendStore(make_param(true), false);
+        vector<string> removed;
+        for (uint64_t i = 0; i < handles.size(); i += 2)
+        {
+            removed.push_back(handles[i]);
+        }
+        writer->BatchRemove(removed);
+        writer->Close();
+        delete writer;
+        uint64_t present = count_records();
+        LOG4CXX_INFO(as_manifest_logger, "records after BatchRemove: " << present << " of " << handles.size());
+        correctness = (present == handles.size() - removed.size()) && correctness;
+    }
+    catch (ExceptionBase& e)
+    {
+        LOG4CXX_ERROR(as_manifest_logger, "append store manifest test failed: " << e.ToString());
+        correctness = false;
+    }
+
+    LOG4CXX_INFO(as_manifest_logger, "append store manifest correctness: " << correctness);
+    return correctness ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+// benchmark CDS index records per second, serialized CdsIndexRecord vs fixed CdsFixedIndexRecord
+// Usage: cds_index_bench [num_records] [store_path]
+#include <iostream>
+#include <sstream>
+#include <cstring>
+
+#include <log4cxx/logger.h>
+#include <log4cxx/xml/domconfigurator.h>
+
+#include "../append-store/common_data_store.h"
+#include "../fs/qfs_file_system_helper.h"
+#include "../common/timer.h"
+
+using namespace std;
+using namespace log4cxx;
+using namespace log4cxx::xml;
+using namespace log4cxx::helpers;
+
+const uint32_t kIndexInterval = 1000;   // records per MultiIndexRecord, as CDSUtility
+const uint32_t kDataSize = 64;
+
+void report(const string& name, uint64_t num_records, double ms)
+{
+    cout << name << ": " << num_records << " records in " << ms << " ms, "
+         << (ms > 0 ? num_records * 1000.0 / ms : 0) << " records/sec" << endl;
+}
+
+void random_hashes(vector<string>& hashes, uint64_t num_records)
+{
+    hashes.resize(num_records);
+    for (uint64_t i = 0; i < num_records; ++i) {
+        hashes[i].resize(20);
+        for (size_t j = 0; j < 20; ++j)
+            hashes[i][j] = rand();
+    }
+}
+
+// encode and decode in memory, no file system involved
+void bench_codec(const vector<string>& hashes)
+{
+    uint64_t n = hashes.size();
+    Timer timer;
+    vector<string> blocks;
+
+    timer.Start();
+    stringstream index_stream;
+    for (uint64_t i = 0; i < n; ++i) {
+        string offset(8, 0);
+        memcpy(&offset[0], &i, 8);
+        CdsIndexRecord(hashes[i], offset).Serialize(index_stream);
+        if ((i + 1) % kIndexInterval == 0 || i + 1 == n) {
+            stringstream ssbuf;
+            MultiIndexRecord(kIndexInterval, index_stream.str().size(), index_stream.str()).Serialize(ssbuf);
+            blocks.push_back(ssbuf.str());
+            index_stream.str("");
+        }
+    }
+    report("serialized encode", n, timer.Stop());
+
+    timer.Reset();
+    timer.Start();
+    uint64_t decoded = 0;
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        stringstream ss(blocks[b]);
+        MultiIndexRecord mir;
+        mir.Deserialize(ss);
+        stringstream records(mir.mData);
+        vector<CdsIndexRecord> outvec;
+        while (records.peek() != EOF) {
+            CdsIndexRecord cr;
+            cr.Deserialize(records);
+            outvec.push_back(cr);
+        }
+        decoded += outvec.size();
+    }
+    report("serialized decode", decoded, timer.Stop());
+
+    timer.Reset();
+    timer.Start();
+    vector<CdsFixedIndexRecord> fixed;
+    fixed.reserve(kIndexInterval);
+    string fixed_data;
+    for (uint64_t i = 0; i < n; ++i) {
+        CdsFixedIndexRecord record;
+        memcpy(record.mSha1Index, hashes[i].data(), 20);
+        record.mOffset = i;
+        fixed.push_back(record);
+        if (fixed.size() == kIndexInterval || i + 1 == n) {
+            fixed_data.append((const char*)&fixed[0], fixed.size() * sizeof(CdsFixedIndexRecord));
+            fixed.clear();
+        }
+    }
+    report("fixed encode", n, timer.Stop());
+
+    timer.Reset();
+    timer.Start();
+    vector<CdsFixedIndexRecord> outvec(fixed_data.size() / sizeof(CdsFixedIndexRecord));
+    memcpy(&outvec[0], fixed_data.data(), fixed_data.size());
+    report("fixed decode", outvec.size(), timer.Stop());
+}
+
+// write n records through CDSUtility and read the index back
+void bench_store(const vector<string>& hashes, const string& path, bool fixed)
+{
+    string name = fixed ? "fixed" : "serialized";
+    string store_path = path + "/" + name;
+    if (FileSystemHelper::GetInstance()->IsDirectoryExists(store_path))
+        FileSystemHelper::GetInstance()->RemoveDirectory(store_path);
+
+    uint64_t n = hashes.size();
+    char data[kDataSize];
+    memset(data, 'x', kDataSize);
+    Timer timer;
+
+    timer.Start();
+    {
+        CDSUtility cds(store_path, true, fixed);
+        for (uint64_t i = 0; i < n; ++i)
+            cds.Append(hashes[i].data(), data, kDataSize);
+    }
+    report(name + " store write", n, timer.Stop());
+
+    timer.Reset();
+    timer.Start();
+    uint64_t num_read = 0;
+    CdsIndexReader reader(store_path);
+    if (fixed) {
+        vector<CdsFixedIndexRecord> outvec;
+        while (reader.Next(outvec))
+            num_read += outvec.size();
+    }
+    else {
+        vector<CdsIndexRecord> outvec;
+        while (reader.Next(outvec))
+            num_read += outvec.size();
+    }
+    report(name + " index read", num_read, timer.Stop());
+}
+
+int main(int argc, char** argv)
+{
+    DOMConfigurator::configure("Log4cxxConfig.xml");
+    uint64_t num_records = argc > 1 ? atoll(argv[1]) : 1000000;
+    vector<string> hashes;
+    random_hashes(hashes, num_records);
+
+    bench_codec(hashes);
+
+    if (argc > 2) {
+        QFSHelper::Connect();
+        bench_store(hashes, argv[2], false);
+        bench_store(hashes, argv[2], true);
+    }
+    return 0;
+}
@@ -7,7 +7,13 @@
 #include <algorithm>
 #include <math.h>
 #include <cstring>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "../snapshot/trace_types.h"
+#include "../snapshot/trace_reader.h"
+#include "../snapshot/counting_table.h"
 
 using namespace std;
 
@@ -27,23 +33,25 @@ struct CdsCount {
 
 void usage(char* progname)
 {
-    cout << "Usage: " << progname << " cds_name vm_list [prefix] [suffix]" << endl;
+    cout << "Usage: " << progname << " --cdsname cds_name --vmlistfile vm_list [--prefix prefix] [--suffix suffix]" << endl;
+    cout << "       [--cdsstart n] [--cdsevery n] [--nolocal] [--compact [--threads n] [--memory MB] [--tmpdir dir]]" << endl;
     cout << "vm_list is a list of vm description files." << endl;
     cout << "each vm description file is a list of vm snapshot traces." << endl;
     cout << "prefix is used to specify the path to vm snapshot trace files." << endl;
     cout << "suffix is used to specify the trace type, such like .bv4 or .v4" << endl;
+    cout << "--nolocal counts every block instead of deduping each snapshot with its parent first." << endl;
+    cout << "--compact counts in compact tables spilled to sorted runs under tmpdir (default cds_name.runs)" << endl;
+    cout << "  with the given threads and memory budget (default all cores, 1024MB) instead of one map;" << endl;
+    cout << "  the CDS files are the same, --cdsstart is not supported." << endl;
 }
 
-void analysis_cds(map<Block, uint32_t>& global_index, const string& cds_name, bool write_out = false)
+/*
+ * print the coverage of a CDS holding 1% to 4% of the unique blocks and get the
+ * frequency threshold of each, num_to_add blocks are taken at the threshold
+ */
+void select_cds(map<uint32_t, CdsCount>& cds_counter, uint64_t* cds_freq_threshold, uint64_t* num_to_add)
 {
-    // aggregate by count
-    map<Block, uint32_t>::iterator it;
-    map<uint32_t, CdsCount> cds_counter;
     map<uint32_t, CdsCount>::reverse_iterator rit;
-    for (it = global_index.begin(); it != global_index.end(); it++) {
-        cds_counter[it->second].num_blocks += 1;
-        cds_counter[it->second].total_size += it->first.size_;
-    }
 
     // calculate the dedup size
     dedup_size = 0;
@@ -61,8 +69,6 @@ void analysis_cds(map<Block, uint32_t>& global_index, const string& cds_name, bo
         //cout << cds_size_threshold[i] << endl;
     }
 
-    uint64_t cds_freq_threshold[10];		// this is the frequency threshold
-    uint64_t num_to_add[10];
     for (int i = 0; i < 4; i++) {
         uint64_t cds_size = 0;
         uint64_t cds_data_coverage = 0;
@@ -88,36 +94,357 @@ void analysis_cds(map<Block, uint32_t>& global_index, const string& cds_name, bo
                  << endl;
         //}
     }
+}
+
+void open_cds_outputs(ofstream* cds_output, const string& cds_name)
+{
+    for (int i = 0; i < 4; i++) {
+        stringstream ss;
+        ss << cds_name << "." << setfill('0') << setw(3) << (i+1);
+        cds_output[i].open(ss.str().c_str(), ios::out | ios::binary | ios::app);
+    }
+}
+
+/*
+ * write a block with the given frequency to the CDS files it is selected for
+ */
+void write_cds_block(ofstream* cds_output, const Block& blk, uint32_t freq,
+                     const uint64_t* cds_freq_threshold, uint64_t* num_to_add)
+{
+    for (int i = 0; i < 4; ++i) {
+        if (freq > cds_freq_threshold[i]) {
+            blk.ToStream(cds_output[i]);
+            continue;
+        }
+        if (freq == cds_freq_threshold[i]) {
+            if (num_to_add[i] > 0) {
+                blk.ToStream(cds_output[i]);
+                --num_to_add[i];
+            }
+        }
+    }
+}
+
+void analysis_cds(map<Block, uint32_t>& global_index, const string& cds_name, bool write_out = false)
+{
+    // aggregate by count
+    map<Block, uint32_t>::iterator it;
+    map<uint32_t, CdsCount> cds_counter;
+    for (it = global_index.begin(); it != global_index.end(); it++) {
+        cds_counter[it->second].num_blocks += 1;
+        cds_counter[it->second].total_size += it->first.size_;
+    }
+
+    uint64_t cds_freq_threshold[10];		// this is the frequency threshold
+    uint64_t num_to_add[10];
+    select_cds(cds_counter, cds_freq_threshold, num_to_add);
 
     // scan the global index to generate CDS index according to threshold
     // we will only generate CDS from 1% to 5%
     if (write_out) {
         ofstream cds_output[5];
-        for (int i = 0; i < 4; i++) {
-            stringstream ss;
-            ss << cds_name << "." << setfill('0') << setw(3) << (i+1);
-            cds_output[i].open(ss.str().c_str(), ios::out | ios::binary | ios::app);
-        }
+        open_cds_outputs(cds_output, cds_name);
 
         for (it = global_index.begin(); it != global_index.end(); ++ it) {
-            for (int i = 0; i < 4; ++i) {
-                if (it->second > cds_freq_threshold[i]) {
-                    it->first.ToStream(cds_output[i]);
-                    continue;
-                }
-                if (it->second == cds_freq_threshold[i]) {
-                    if (num_to_add[i] > 0) {
-                        it->first.ToStream(cds_output[i]);
-                        --num_to_add[i];
+            write_cds_block(cds_output, it->first, it->second, cds_freq_threshold, num_to_add);
+        }
+
+        for (int i = 0; i < 4; ++i) {
+            cds_output[i].close();
+        }
+    }
+}
+
+/*
+ * compact mode: VMs are distilled in parallel, every thread counts into one
+ * CountingTable per key space partition and spills it as a sorted run when
+ * it fills up; the runs of each partition are merged back in fingerprint
+ * order, so the CDS selected per partition is the same as with the map
+ */
+struct DistillWorker {
+    pthread_t thread_;
+    uint32_t id_;
+    vector<CountingTable*> tables_;			// one per partition
+    vector<vector<string> > runs_;			// spilled runs per partition, in spill order
+    vector<uint64_t> raw_blocks_;
+    vector<uint64_t> raw_size_;
+    vector<uint64_t> total_blocks_;
+    vector<uint64_t> total_size_;
+    struct DistillJob* job_;
+};
+
+struct DistillJob {
+    vector<string> vm_files_;
+    string fprefix_;
+    string fsuffix_;
+    string tmpdir_;
+    bool localized_dedup_;
+    unsigned int partition_count_;
+    volatile uint32_t next_vm_;
+    volatile bool failed_;
+    pthread_mutex_t lock_;
+    vector<DistillWorker> workers_;
+};
+
+struct RecordLess {
+    bool operator()(const TraceRecord& a, const TraceRecord& b) const
+    {
+        return memcmp(a.cksum_, b.cksum_, CKSUM_LEN) < 0;
+    }
+};
+
+bool spill_table(DistillJob* job, DistillWorker* worker, unsigned int p)
+{
+    stringstream ss;
+    ss << job->tmpdir_ << "/run." << p << "." << worker->id_ << "." << worker->runs_[p].size();
+    worker->runs_[p].push_back(ss.str());
+    if (!worker->tables_[p]->Spill(ss.str())) {
+        cout << "failed to write " << ss.str() << endl;
+        return false;
+    }
+    return true;
+}
+
+bool distill_vm(DistillJob* job, DistillWorker* worker, uint32_t vm_index)
+{
+    const string& vm_fname = job->vm_files_[vm_index];
+    ifstream ss_ifs(vm_fname.c_str(), ios::in);
+
+    // map all the snapshots for that VM
+    string ss_fname;
+    vector<TraceReader*> traces;
+    vector<SegmentCursor> cursors;
+    while (ss_ifs.good()) {
+        std::getline(ss_ifs, ss_fname);
+        if (ss_fname.length() == 0) {
+            continue;
+        }
+        string trace_fname = job->fprefix_ + ss_fname + job->fsuffix_;
+        traces.push_back(new TraceReader());
+        if (!traces.back()->Open(trace_fname)) {
+            cout << "failed to open " << trace_fname << endl;
+        }
+        cursors.push_back(SegmentCursor(traces.back()->GetRecords(), SegmentPolicy::Fixed()));
+    }
+    int num_ss = traces.size();
+    pthread_mutex_lock(&job->lock_);
+    cout << "processing " << num_ss << " snapshots in " << vm_fname << endl;
+    pthread_mutex_unlock(&job->lock_);
+
+    // dedup each snapshot with its parent, count new blocks
+    vector<TraceRecord> cur, par;
+    Checksum cur_cksum, par_cksum;
+    TraceSpan seg;
+    bool finished = false;
+    bool ok = true;
+    while (!finished && ok) {
+        finished = true;
+        for (int j = 0; j < num_ss; j++) {
+            cur.swap(par);
+            par_cksum = cur_cksum;
+            cur.clear();
+            if (!cursors[j].Next(seg))
+                seg = TraceSpan();
+            for (size_t i = 0; i < seg.Size(); i++)
+                if (seg[i].size_ != 0)
+                    cur.push_back(seg[i]);
+            seg.GetChecksum(cur_cksum);
+            sort(cur.begin(), cur.end(), RecordLess());
+            if (!cur.empty())
+                finished = false;
+            // level 1
+            if (j > 0 && job->localized_dedup_ && cur_cksum == par_cksum) {
+                continue;
+            }
+            // level 2
+            for (size_t i = 0; i < cur.size(); i++) {
+                unsigned int p = cur[i].GetChecksum().Middle4Bytes() % job->partition_count_;
+                worker->raw_blocks_[p]++;
+                worker->raw_size_[p] += cur[i].size_;
+                if (j == 0 || !job->localized_dedup_ ||
+                    !binary_search(par.begin(), par.end(), cur[i], RecordLess())) {
+                    worker->total_blocks_[p]++;
+                    worker->total_size_[p] += cur[i].size_;
+                    worker->tables_[p]->Add(cur[i], vm_index);
+                    if (worker->tables_[p]->IsFull() && !spill_table(job, worker, p)) {
+                        ok = false;
+                        break;
                     }
                 }
             }
         }
+    }
+
+    // clean up
+    for (int j = 0; j < num_ss; j++) {
+        delete traces[j];
+    }
+    return ok;
+}
+
+void* distill_worker(void* arg)
+{
+    DistillWorker* worker = (DistillWorker*)arg;
+    DistillJob* job = worker->job_;
+    uint32_t vm_index;
+    // VMs are taken in list order, so a table never sees an earlier VM after a later one
+    while (!job->failed_ && (vm_index = __sync_fetch_and_add(&job->next_vm_, 1)) < job->vm_files_.size()) {
+        if (!distill_vm(job, worker, vm_index))
+            job->failed_ = true;
+    }
+    for (unsigned int p = 0; p < job->partition_count_ && !job->failed_; p++) {
+        if (worker->tables_[p]->Size() > 0 && !spill_table(job, worker, p))
+            job->failed_ = true;
+    }
+    for (unsigned int p = 0; p < job->partition_count_; p++) {
+        delete worker->tables_[p];
+        worker->tables_[p] = NULL;
+    }
+    return NULL;
+}
+
+/*
+ * runs of one partition, the runs of a worker stay in spill order
+ */
+void partition_runs(DistillJob& job, unsigned int p, vector<string>& runs)
+{
+    runs.clear();
+    for (size_t w = 0; w < job.workers_.size(); w++)
+        runs.insert(runs.end(), job.workers_[w].runs_[p].begin(), job.workers_[w].runs_[p].end());
+}
+
+int distill_compact(const string& cds_name, const string& list_fname, const string& fprefix, const string& fsuffix,
+                    bool localized_dedup, uint32_t num_threads, uint64_t memory_mb, const string& tmpdir)
+{
+    DistillJob job;
+    job.fprefix_ = fprefix;
+    job.fsuffix_ = fsuffix;
+    job.tmpdir_ = tmpdir;
+    job.localized_dedup_ = localized_dedup;
+    job.partition_count_ = 8;
+    job.next_vm_ = 0;
+    job.failed_ = false;
+    pthread_mutex_init(&job.lock_, NULL);
+
+    string vm_fname;
+    ifstream vm_ifs(list_fname.c_str(), ios::in);
+    while (vm_ifs.good()) {
+        std::getline(vm_ifs, vm_fname);
+        if (vm_fname.length() != 0)
+            job.vm_files_.push_back(vm_fname);
+    }
+    vm_ifs.close();
+    if (mkdir(tmpdir.c_str(), 0755) != 0 && errno != EEXIST) {
+        cout << "cannot create " << tmpdir << endl;
+        return 1;
+    }
+
+    // the memory budget is shared by all tables of all workers
+    uint64_t table_capacity = (memory_mb << 20) / sizeof(FingerprintCount) / num_threads / job.partition_count_;
+    cout << "Distilling " << job.vm_files_.size() << " VMs with " << num_threads << " threads, "
+         << job.partition_count_ << " partitions, " << table_capacity << " entries per table" << endl;
+    job.workers_.resize(num_threads);
+    for (uint32_t w = 0; w < num_threads; w++) {
+        DistillWorker& worker = job.workers_[w];
+        worker.id_ = w;
+        worker.job_ = &job;
+        worker.runs_.resize(job.partition_count_);
+        worker.raw_blocks_.assign(job.partition_count_, 0);
+        worker.raw_size_.assign(job.partition_count_, 0);
+        worker.total_blocks_.assign(job.partition_count_, 0);
+        worker.total_size_.assign(job.partition_count_, 0);
+        for (unsigned int p = 0; p < job.partition_count_; p++)
+            worker.tables_.push_back(new CountingTable(table_capacity));
+    }
+    for (uint32_t w = 0; w < num_threads; w++)
+        pthread_create(&job.workers_[w].thread_, NULL, distill_worker, &job.workers_[w]);
+    for (uint32_t w = 0; w < num_threads; w++)
+        pthread_join(job.workers_[w].thread_, NULL);
+    pthread_mutex_destroy(&job.lock_);
+
+    uint64_t all_raw_blocks = 0, all_raw_size = 0, all_total_blocks = 0, all_total_size = 0;
+    uint64_t all_dedup_blocks = 0, all_dedup_size = 0;
+    vector<string> runs;
+    for (unsigned int p = 0; p < job.partition_count_ && !job.failed_; p++) {
+        cout << "Starting Partition " << (p+1) << "/" << job.partition_count_ << endl;
+        raw_blocks = raw_size = total_blocks = total_size = 0;
+        for (size_t w = 0; w < job.workers_.size(); w++) {
+            raw_blocks += job.workers_[w].raw_blocks_[p];
+            raw_size += job.workers_[w].raw_size_[p];
+            total_blocks += job.workers_[w].total_blocks_[p];
+            total_size += job.workers_[w].total_size_[p];
+        }
+
+        // pass 1 aggregates the merged counts, pass 2 writes the selected blocks
+        partition_runs(job, p, runs);
+        CountRunMerger merger;
+        FingerprintCount entry;
+        map<uint32_t, CdsCount> cds_counter;
+        if (!merger.Open(runs)) {
+            job.failed_ = true;
+            break;
+        }
+        while (merger.Next(entry)) {
+            cds_counter[entry.count_].num_blocks += 1;
+            cds_counter[entry.count_].total_size += entry.size_;
+        }
+        uint64_t cds_freq_threshold[10];
+        uint64_t num_to_add[10];
+        select_cds(cds_counter, cds_freq_threshold, num_to_add);
 
+        ofstream cds_output[5];
+        open_cds_outputs(cds_output, cds_name);
+        Block blk;
+        merger.Open(runs);
+        while (merger.Next(entry)) {
+            entry.ToBlock(blk);
+            write_cds_block(cds_output, blk, entry.count_, cds_freq_threshold, num_to_add);
+        }
+        merger.Close();
         for (int i = 0; i < 4; ++i) {
             cds_output[i].close();
         }
+
+        cout << "End-of-Partition Analysis: " << endl;
+        cout << "raw:" << endl;
+        cout << "  blocks: " << raw_blocks << endl;
+        cout << "  size: " << raw_size / float(1024*1024*1024) << " GB" << endl;
+        cout << "after localized dedup: " << endl;
+        cout << "  blocks: " << total_blocks << endl;
+        cout << "  size: " << total_size / float(1024*1024*1024) << " GB" << endl;
+        cout << "after complete dedup:" << endl;
+        cout << "  blocks: " << dedup_blocks << endl;
+        cout << "  size: " << dedup_size / float(1024*1024*1024) << " GB" << endl;
+        all_raw_blocks += raw_blocks;
+        all_raw_size += raw_size;
+        all_total_blocks += total_blocks;
+        all_total_size += total_size;
+        all_dedup_blocks += dedup_blocks;
+        all_dedup_size += dedup_size;
+    }
+
+    for (unsigned int p = 0; p < job.partition_count_; p++) {
+        partition_runs(job, p, runs);
+        for (size_t i = 0; i < runs.size(); i++)
+            unlink(runs[i].c_str());
+    }
+    rmdir(tmpdir.c_str());
+    if (job.failed_) {
+        cout << "distilling failed" << endl;
+        return 1;
     }
+
+    cout << "Final Analysis: " << endl;
+    cout << "raw:" << endl;
+    cout << "  blocks: " << all_raw_blocks << endl;
+    cout << "  size: " << all_raw_size / float(1024*1024*1024) << " GB" << endl;
+    cout << "after localized dedup: " << endl;
+    cout << "  blocks: " << all_total_blocks << endl;
+    cout << "  size: " << all_total_size / float(1024*1024*1024) << " GB" << endl;
+    cout << "after complete dedup:" << endl;
+    cout << "  blocks: " << all_dedup_blocks << endl;
+    cout << "  size: " << all_dedup_size / float(1024*1024*1024) << " GB" << endl;
+    return 0;
 }
 
 int main(int argc, char** argv)
@@ -142,6 +469,11 @@ int main(int argc, char** argv)
     int argi = 1;
     int cds_start = -1;
     int cds_every = 5;
+    bool localized_dedup = true;
+    bool compact = false;
+    uint32_t num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t memory_mb = 1024;
+    string tmpdir = "";
     while (argi < argc && argv[argi][0] == '-') {
         if (strcmp(argv[argi],"--cdsname") == 0) {
             argi++;
@@ -161,6 +493,21 @@ int main(int argc, char** argv)
         } else if (strcmp(argv[argi],"--cdsevery") == 0) {
             argi++;
             cds_every = atoi(argv[argi++]);
+        } else if (strcmp(argv[argi],"--nolocal") == 0) {
+            argi++;
+            localized_dedup = false;
+        } else if (strcmp(argv[argi],"--compact") == 0) {
+            argi++;
+            compact = true;
+        } else if (strcmp(argv[argi],"--threads") == 0) {
+            argi++;
+            num_threads = atoi(argv[argi++]);
+        } else if (strcmp(argv[argi],"--memory") == 0) {
+            argi++;
+            memory_mb = strtoull(argv[argi++], NULL, 10);
+        } else if (strcmp(argv[argi],"--tmpdir") == 0) {
+            argi++;
+            tmpdir = argv[argi++];
         } else if (strcmp(argv[argi],"-?") == 0) {
             usage(argv[0]);
             exit(0);
@@ -178,7 +525,11 @@ int main(int argc, char** argv)
         usage(argv[0]);
         exit(1);
     }
-    bool localized_dedup = true;
+    if (compact && (cds_start >= 0 || num_threads == 0 || memory_mb == 0)) {
+        cout << "compact mode needs threads and memory, and does not support --cdsstart" << endl;
+        usage(argv[0]);
+        exit(1);
+    }
 
     //clear the cds files
     if (cds_start < 0) {
@@ -190,6 +541,10 @@ int main(int argc, char** argv)
             cds_output.close();
         }
     }
+    if (compact) {
+        return distill_compact(cds_name, list_fname, fprefix, fsuffix, localized_dedup,
+                               num_threads, memory_mb, tmpdir.empty() ? cds_name + ".runs" : tmpdir);
+    }
     unsigned int partition_count = 8;
     unsigned int partition_index;
     int vm_index = 0;
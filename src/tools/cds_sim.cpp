@@ -6,17 +6,12 @@
 #include <map>
 #include <algorithm>
 #include <math.h>
+#include <unistd.h>
 #include "../snapshot/trace_types.h"
+#include "../snapshot/dedup_sim.h"
 
 using namespace std;
 
-struct DedupCounter {
-    uint64_t num_bytes_;
-    uint64_t num_blocks_;
-
-    DedupCounter() {num_bytes_ = 0; num_blocks_ = 0;}
-};
-
 uint64_t raw_blocks = 0;
 uint64_t raw_size = 0;
 uint64_t after_l1_blocks = 0;
@@ -28,17 +23,18 @@ uint64_t after_l3_size = 0;
 
 void usage(char* progname)
 {
-    cout << "Usage: " << progname << " cds_file vm_list [prefix] [suffix] skip" << endl;
+    cout << "Usage: " << progname << " cds_file vm_list [prefix] [suffix] [skip] [threads]" << endl;
     cout << "vm_list is a list of vm description files." << endl;
     cout << "each vm description file is a list of vm snapshot traces." << endl;
     cout << "prefix is used to specify the path to vm snapshot trace files." << endl;
     cout << "suffix is used to specify the trace type, such like .bv4 or .v4" << endl;
     cout << "skip specifies that " << progname << " should skip <skip> vms from vm_list" << endl;
+    cout << "threads is the number of vms simulated in parallel, all cores by default" << endl;
 }
 
 int main(int argc, char** argv)
 {
-    if (argc < 3 || argc > 6) {
+    if (argc < 3 || argc > 7) {
         usage(argv[0]);
         return 1;
     }
@@ -47,6 +43,7 @@ int main(int argc, char** argv)
     string list_fname = argv[2];
     string fprefix, fsuffix;
     int skip = 0;
+    uint32_t num_threads = sysconf(_SC_NPROCESSORS_ONLN);
     if (argc > 3) {
         fprefix = argv[3];
     }
@@ -56,22 +53,25 @@ int main(int argc, char** argv)
     if (argc > 5) {
         skip = atoi(argv[5]);
     }
+    if (argc > 6) {
+        num_threads = atoi(argv[6]);
+    }
 
-    std::vector<Block> cds;
-    string vm_fname;
-    ifstream vm_ifs, cds_ifs;
-    vm_ifs.open(list_fname.c_str(), ios::in);
-    cds_ifs.open(cds_name.c_str(), ios::in | ios::binary);
-    Block blk;
-    while (blk.FromStream(cds_ifs)) {
-        cds.push_back(blk);
+    FingerprintSet cds;
+    if (!cds.Load(cds_name)) {
+        cout << "unable to open " << cds_name << endl;
+        return 1;
     }
-    cds_ifs.close();
-    sort(cds.begin(), cds.end());
     cout << "CDS file " << cds_name 
          << " is loaded and sorted, it has " 
-         << cds.size() << " objects" << endl;
+         << cds.GetNumRecords() << " objects" << endl;
 
+    // read all vm descriptions, the vms are simulated independently
+    string vm_fname;
+    ifstream vm_ifs;
+    vm_ifs.open(list_fname.c_str(), ios::in);
+    vector<string> vm_fnames;
+    vector< vector<string> > vms;
     while (vm_ifs.good()) {
         // open vm's snapshot list
         std::getline(vm_ifs, vm_fname);
@@ -84,95 +84,51 @@ int main(int argc, char** argv)
         }
         ifstream ss_ifs(vm_fname.c_str(), ios::in);
 
-        // open all the snapshots for that VM
+        // all the snapshots for that VM
         string ss_fname;
-        vector<ifstream*> trace_inputs;
+        vector<string> trace_fnames;
         while (ss_ifs.good()) {
             std::getline(ss_ifs, ss_fname);
             if (ss_fname.length() == 0) {
                 continue;
             }
-            string trace_fname = fprefix + ss_fname + fsuffix;
-            trace_inputs.push_back(new ifstream(trace_fname.c_str(), ios::in | ios::binary));
-        }
-        
-        // dedup each snapshot with its parent
-        int num_ss = trace_inputs.size();
-        Segment* segs = new Segment[num_ss];
-        cout << "processing " << num_ss << " snapshots in " << vm_fname << endl;
-        DedupCounter* new_data = new DedupCounter[num_ss];
-        DedupCounter* l1_data = new DedupCounter[num_ss];
-        DedupCounter* l2_data = new DedupCounter[num_ss];
-        DedupCounter* l3_data = new DedupCounter[num_ss];
-        bool finished = false;
-        while (!finished) {
-            for (int j = 0; j < num_ss; j++) {
-                segs[j].LoadFixSize(*trace_inputs[j]);
-                raw_blocks += segs[j].blocklist_.size();
-                raw_size += segs[j].size_;
-                // level 1
-                if (j > 0 && segs[j] == segs[j-1]) {
-                    // detected at level 1
-                    l1_data[j].num_blocks_ += segs[j].blocklist_.size();
-                    l1_data[j].num_bytes_ += segs[j].size_;
-                }
-                else {
-                    // level 2
-                    after_l1_blocks += segs[j].blocklist_.size();
-                    after_l1_size += segs[j].size_;;
-                    // sort previous segment
-                    if (j != 0) {
-                        sort(segs[j-1].blocklist_.begin(), segs[j-1].blocklist_.end());
-                    }
-                    for (vector<Block>::iterator it = segs[j].blocklist_.begin(); 
-                         it != segs[j].blocklist_.end(); ++it) {
-                        if (j != 0 
-                            && binary_search(segs[j-1].blocklist_.begin(), 
-                                             segs[j-1].blocklist_.end(), 
-                                             *it)) {
-                            // detected at level 2
-                            l2_data[j].num_blocks_ += 1;
-                            l2_data[j].num_bytes_ += it->size_;
-                        }
-                        else {
-                            // level 3
-                            after_l2_blocks += 1;
-                            after_l2_size += it->size_;
-                            if (binary_search(cds.begin(), cds.end(), *it)) {
-                                // detected at level 3
-                                l3_data[j].num_blocks_ += 1;
-                                l3_data[j].num_bytes_ += it->size_;
-                            }
-                            else {
-                                new_data[j].num_blocks_ += 1;
-                                new_data[j].num_bytes_ += it->size_;
-                                after_l3_blocks += 1;
-                                after_l3_size += it->size_;
-                            }
-                        }
-                    }
-                }
-            }
-            finished = true;
-            for (int j = 0; j < num_ss; j++) {
-                if (segs[j].blocklist_.size() != 0) {
-                    finished = false;
-                }
-            }
+            trace_fnames.push_back(fprefix + ss_fname + fsuffix);
         }
-        // we are done with this VM, print and clean up
-        delete[] segs;
-        for (size_t j = 0; j < trace_inputs.size(); ++j) {
-            trace_inputs[j]->close();
-            delete trace_inputs[j];
+        vm_fnames.push_back(vm_fname);
+        vms.push_back(trace_fnames);
+    }
+    vm_ifs.close();
+
+    AlignedSegmentL2 l2;
+    CdsL3 l3(cds);
+    DedupSimulator simulator(l2, l3);
+    vector< vector<SnapshotDedupStat> > stats;
+    vector<bool> ok;
+    simulator.Run(vms, num_threads, stats, ok);
+
+    for (size_t i = 0; i < vms.size(); i++) {
+        int num_ss = vms[i].size();
+        cout << "processing " << num_ss << " snapshots in " << vm_fnames[i] << endl;
+        if (!ok[i]) {
+            cout << "unable to open the snapshot traces of " << vm_fnames[i] << endl;
+            continue;
         }
 
         for (int j = 0; j < num_ss; j++) {
+            SnapshotDedupStat& stat = stats[i][j];
             cout << "snapshot" << j 
-                 << " l1: " << l1_data[j].num_blocks_ << " blocks, " << l1_data[j].num_bytes_ << " bytes,"
-                 << " l2: " << l2_data[j].num_blocks_ << " blocks, " << l2_data[j].num_bytes_ << " bytes,"
-                 << " l3: " << l3_data[j].num_blocks_ << " blocks, " << l3_data[j].num_bytes_ << " bytes,"
-                 << " new: " << new_data[j].num_blocks_ << " blocks, " << new_data[j].num_bytes_ << " bytes" << endl;
+                 << " l1: " << stat.l1_.num_blocks_ << " blocks, " << stat.l1_.num_bytes_ << " bytes,"
+                 << " l2: " << stat.l2_.num_blocks_ << " blocks, " << stat.l2_.num_bytes_ << " bytes,"
+                 << " l3: " << stat.l3_.num_blocks_ << " blocks, " << stat.l3_.num_bytes_ << " bytes,"
+                 << " new: " << stat.new_.num_blocks_ << " blocks, " << stat.new_.num_bytes_ << " bytes" << endl;
+            raw_blocks += stat.raw_.num_blocks_;
+            raw_size += stat.raw_.num_bytes_;
+            after_l1_blocks += stat.raw_.num_blocks_ - stat.l1_.num_blocks_;
+            after_l1_size += stat.raw_.num_bytes_ - stat.l1_.num_bytes_;
+            after_l2_blocks += stat.l3_.num_blocks_ + stat.new_.num_blocks_;
+            after_l2_size += stat.l3_.num_bytes_ + stat.new_.num_bytes_;
+            after_l3_blocks += stat.new_.num_blocks_;
+            after_l3_size += stat.new_.num_bytes_;
         }
 
         cout << "raw: " << " blocks: " << raw_blocks << " size: " << raw_size << endl;
@@ -180,25 +136,5 @@ int main(int argc, char** argv)
         cout << "after l2 dedup: " << " blocks: " << after_l2_blocks << " size: " << after_l2_size << endl;
         cout << "after l3 dedup: " << " blocks: " << after_l3_blocks << " size: " << after_l3_size << endl;
     }
-    vm_ifs.close();
     return 0;
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
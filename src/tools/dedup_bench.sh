@@ -0,0 +1,141 @@
+#!/bin/bash
+#
+# End-to-end dedup benchmark on local stand-ins, no QFS or memcached needed:
+#  1. synthesize a base trace and a CDS trace (trace_synth), derive a VM
+#     history of N generations from it (tracegen)
+#  2. load the CDS data into the local file system and build an embedded
+#     CDS index (cds_bulk_loader)
+#  3. back up and restore every generation (snapshot_write/snapshot_read)
+#     with the local file system backend
+#  4. write per-generation throughput, dedup per level and restore time as JSON,
+#     together with the metrics dumps of every run, for regression comparison
+#
+# Usage: dedup_bench.sh [options]
+#   -g N     generations (default 4)
+#   -s MB    snapshot size (default 512)
+#   -b R     fraction of blocks changed in a changed segment (default 0.1)
+#   -c R     fraction of segments changed per generation (default 0.2)
+#   -o R     fraction of unique blocks also in the CDS (default 0.3)
+#   -r SEED  random seed (default 1)
+#   -w DIR   work directory, removed first (default ./dedup_bench)
+#   -j FILE  results file (default <work dir>/results.json)
+
+BIN_DIR=$(cd "$(dirname "$0")" && pwd)
+SIM_DIR=$BIN_DIR/simulation
+
+GENERATIONS=4
+SIZE_MB=512
+BLOCK_CHANGE=0.1
+SEGMENT_CHANGE=0.2
+CDS_OVERLAP=0.3
+SEED=1
+WORK_DIR=./dedup_bench
+RESULTS=
+
+while getopts "g:s:b:c:o:r:w:j:h" opt; do
+    case $opt in
+        g) GENERATIONS=$OPTARG ;;
+        s) SIZE_MB=$OPTARG ;;
+        b) BLOCK_CHANGE=$OPTARG ;;
+        c) SEGMENT_CHANGE=$OPTARG ;;
+        o) CDS_OVERLAP=$OPTARG ;;
+        r) SEED=$OPTARG ;;
+        w) WORK_DIR=$OPTARG ;;
+        j) RESULTS=$OPTARG ;;
+        *) sed -n '2,/^$/s/^# \{0,1\}//p' "$0"; exit 1 ;;
+    esac
+done
+
+set -e
+rm -rf "$WORK_DIR"
+mkdir -p "$WORK_DIR"
+WORK_DIR=$(cd "$WORK_DIR" && pwd)
+RESULTS=${RESULTS:-$WORK_DIR/results.json}
+TRACE_DIR=$WORK_DIR/traces/bench/os
+mkdir -p "$TRACE_DIR" "$WORK_DIR/fs" "$WORK_DIR/metrics" "$WORK_DIR/logs"
+[ -f "$BIN_DIR/Log4cxxConfig.xml" ] && cp "$BIN_DIR/Log4cxxConfig.xml" "$WORK_DIR/"
+cd "$WORK_DIR"
+
+export LOCAL_FS_ROOT=$WORK_DIR/fs
+export CDS_INDEX_FILE=$WORK_DIR/cds.idx
+export CDS_DATA_OPTIONS=
+export METRICS_INTERVAL=60
+
+now() { date +%s.%N; }
+elapsed() { awk "BEGIN { printf \"%.3f\", $2 - $1 }"; }
+# value of a metric in a metrics JSON dump
+metric() { sed -n "s/^ *\"$2\": \([^,{]*\),\{0,1\}$/\1/p" "$1" | head -1; }
+ratio() { awk "BEGIN { printf \"%.3f\", ($2 > 0) ? ($1) / $2 : 0 }"; }
+
+echo "generating traces"
+# sample data blocks are cut from: 128MB sample region + 8MB reserved
+head -c $((136 * 1024 * 1024)) /dev/urandom > sample
+"$SIM_DIR/trace_synth" --size "$SIZE_MB" --rseed "$SEED" --cdsfile cds.bv4 --cdsoverlap "$CDS_OVERLAP" \
+    base.bv4 > logs/trace_synth.log
+echo "$WORK_DIR/base.bv4" > vm.list
+echo "$WORK_DIR/vm.list" > vmlist
+"$SIM_DIR/tracegen" --rseed "$SEED" --snapshots "$GENERATIONS" \
+    --segthresh "$SEGMENT_CHANGE" --blkthresh "$BLOCK_CHANGE" \
+    --tsegthresh "$SEGMENT_CHANGE" --tblkthresh "$BLOCK_CHANGE" \
+    --vmlistfile vmlist --outputdir "$TRACE_DIR" > logs/tracegen.log
+
+echo "loading CDS"
+start=$(now)
+"$BIN_DIR/cds_bulk_loader" --index "$CDS_INDEX_FILE" bench_cds cds.bv4 sample > logs/cds_bulk_loader.log 2>&1
+cds_seconds=$(elapsed "$start" "$(now)")
+
+{
+    echo "{"
+    echo "  \"config\": {\"generations\": $GENERATIONS, \"size_mb\": $SIZE_MB, \"block_change\": $BLOCK_CHANGE," \
+         "\"segment_change\": $SEGMENT_CHANGE, \"cds_overlap\": $CDS_OVERLAP, \"seed\": $SEED},"
+    echo "  \"cds_load_seconds\": $cds_seconds,"
+    echo "  \"generations\": ["
+} > "$RESULTS"
+
+gen=0
+parent=
+for trace in $(ls "$TRACE_DIR"/* | sort); do
+    echo "generation $gen: $(basename "$trace")"
+    start=$(now)
+    METRICS_FILE=metrics/write_$gen "$BIN_DIR/snapshot_write" sample "$trace" $parent > logs/write_$gen.log 2>&1
+    write_seconds=$(elapsed "$start" "$(now)")
+
+    start=$(now)
+    METRICS_FILE=metrics/read_$gen "$BIN_DIR/snapshot_read" bench_cds sample restore.img "$trace" > logs/read_$gen.log 2>&1
+    read_seconds=$(elapsed "$start" "$(now)")
+    restored_bytes=$(stat -c %s restore.img)
+    rm -f restore.img
+
+    w=metrics/write_$gen.json
+    total_bytes=$(metric $w bigarchive_snapshot_total_bytes)
+    [ $gen -gt 0 ] && echo "    ," >> "$RESULTS"
+    cat >> "$RESULTS" <<EOF
+    {
+      "generation": $gen,
+      "trace": "$(basename "$trace")",
+      "snapshot_bytes": $total_bytes,
+      "write_seconds": $write_seconds,
+      "write_mb_per_sec": $(ratio "$total_bytes / 1048576" "$write_seconds"),
+      "dedup_ratio": $(metric $w bigarchive_snapshot_dedup_ratio),
+      "level_bytes": {
+        "l1": $(metric $w bigarchive_snapshot_l1_bytes),
+        "l2": $(metric $w bigarchive_snapshot_l2_bytes),
+        "l2_similar": $(metric $w bigarchive_snapshot_l2_similar_bytes),
+        "l2_cache": $(metric $w bigarchive_snapshot_l2_cache_bytes),
+        "l3": $(metric $w bigarchive_snapshot_l3_bytes),
+        "new": $(metric $w bigarchive_snapshot_new_bytes)
+      },
+      "restore_seconds": $read_seconds,
+      "restore_mb_per_sec": $(ratio "$restored_bytes / 1048576" "$read_seconds"),
+      "restored_bytes": $restored_bytes,
+      "write_metrics": $(cat $w),
+      "read_metrics": $(cat metrics/read_$gen.json)
+    }
+EOF
+    parent=$trace
+    gen=$((gen + 1))
+done
+
+echo "  ]" >> "$RESULTS"
+echo "}" >> "$RESULTS"
+echo "results written to $RESULTS"
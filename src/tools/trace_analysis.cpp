@@ -1,7 +1,10 @@
 #include <iostream>
 #include <fstream>
 #include <string>
-#include "../snapshot/trace_types.h"
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
+#include "../snapshot/trace_reader.h"
 
 using namespace std;
 
@@ -10,6 +13,36 @@ void usage(char *progname)
 	cout << "Usage: " << progname << " logfile [-d]";
 }
 
+/*
+ * per-thread totals of one partition of the trace
+ */
+struct PartStats {
+	TraceSpan span_;
+	bool show_detail_;
+	uint64_t size_;
+	uint64_t nblocks_;
+	vector<Block> corrupted_;
+};
+
+void* analyze_part(void* arg)
+{
+	PartStats* part = (PartStats*)arg;
+	Block bl;
+	for (size_t i = 0; i < part->span_.Size(); i++) {
+		const TraceRecord& rec = part->span_[i];
+		part->size_ += rec.size_;
+		part->nblocks_++;
+		if (part->show_detail_ || rec.size_ == 0 || rec.size_ > 16384) {
+			rec.ToBlock(bl);
+			if (part->show_detail_)
+				cout << bl.ToString();
+			if (bl.size_ == 0 || bl.size_ > 16384)
+				part->corrupted_.push_back(bl);
+		}
+	}
+	return NULL;
+}
+
 int main(int argc, char **argv)
 {
 	if (argc < 2 || argc > 3) {
@@ -23,51 +56,32 @@ int main(int argc, char **argv)
 		show_detail = true;
 	}
 
-	ifstream is;
-	Block bl;
+	TraceReader reader;
 	uint64_t size = 0, nblocks = 0;
-	/*
-    uint64_t new_data = 0, l1_data = 0, l2_data = 0, l3_data = 0, l3_cache = 0;
-    uint64_t gb = 1024 * 1024 * 1024;
-    */
 
-	is.open(argv[1], std::ios_base::in | std::ios_base::binary);
-	if (!is.is_open()) {
+	if (!reader.Open(argv[1])) {
 		cout << "open failed: " << argv[1];
 		return 0;
 	}
 
-	while(bl.FromStream(is)) {
-		size += bl.size_;
-		nblocks++;
-        /*		
-        switch (bl.file_id_) {
-        case 0:
-            new_data += bl.size_;
-            break;
-        case IN_PARENT:
-            l1_data += bl.size_;
-            break;
-        case IN_CDS:
-            l3_data += bl.size_;
-            break;
-        case IN_DIRTY_SEG:
-            l2_data += bl.size_;
-            break;
-        case IN_CDS_CACHE:
-            l3_data += bl.size_;
-            l3_cache += bl.size_;
-            break;
-        default:
-            break;
-        }
-		*/
-		if (show_detail)
-			cout << bl.ToString();
-
-		if (bl.size_ == 0 || bl.size_ > 16384) {
-			cout << "corrupted block info: " << bl.ToString() << endl;
-		}
+	// detail output keeps the trace order, so it runs in a single part
+	uint32_t nthreads = show_detail ? 1 : sysconf(_SC_NPROCESSORS_ONLN);
+	vector<TraceSpan> spans;
+	reader.Partition(nthreads, SegmentPolicy::Fixed(), spans);
+	vector<PartStats> parts(spans.size());
+	vector<pthread_t> threads(spans.size());
+	for (size_t i = 0; i < spans.size(); i++) {
+		parts[i].span_ = spans[i];
+		parts[i].show_detail_ = show_detail;
+		parts[i].size_ = parts[i].nblocks_ = 0;
+		pthread_create(&threads[i], NULL, analyze_part, &parts[i]);
+	}
+	for (size_t i = 0; i < spans.size(); i++) {
+		pthread_join(threads[i], NULL);
+		size += parts[i].size_;
+		nblocks += parts[i].nblocks_;
+		for (size_t j = 0; j < parts[i].corrupted_.size(); j++)
+			cout << "corrupted block info: " << parts[i].corrupted_[j].ToString() << endl;
 	}
 	cout << argv[1] << ": " <<
         nblocks << " blocks, " << 
@@ -80,6 +94,6 @@ int main(int argc, char **argv)
         (float)l3_cache/gb << " l3_cache" <<
         */
         endl;
-	is.close();
+	reader.Close();
 	exit(0);
 }
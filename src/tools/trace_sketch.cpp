@@ -0,0 +1,368 @@
+/*
+ * One pass, bounded memory analytics over many scan traces, in place of the
+ * exact maps of hash_distribution and hash_hit_*:
+ *  - raw, unique and dedup size per bucket of the first hash bits (HyperLogLog)
+ *  - reference counts of the top-K blocks (count-min sketch, with exact
+ *    counting of the tracked candidates only)
+ *  - run lengths of segments hit and missed in the parent trace
+ * Traces are spread over threads, each with its own sketches, merged at the end.
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../snapshot/trace_reader.h"
+#include "../common/sketch.h"
+
+using namespace std;
+
+#define SIZE_UNIT 1024		// dedup size is estimated by counting distinct 1KB units
+
+void usage(char* progname)
+{
+    cout << "Usage: " << progname << " [options] trace[:parent] ..." << endl;
+    cout << "Possible options are:" << endl;
+    cout << "  --list <file>        more traces, one trace[:parent] per line" << endl;
+    cout << "  --threads <n>        worker threads (default all cores)" << endl;
+    cout << "  --bits <n>           report buckets by the first n bits of the hash, up to 12 (default 4)" << endl;
+    cout << "  --topk <k>           number of heavy hitters to track (default 20)" << endl;
+    cout << "  --precision <p>      HyperLogLog precision, 2^p registers (default 14)" << endl;
+    cout << "  --cm-width <w>       count-min sketch width (default 1048576)" << endl;
+    cout << "  --cm-depth <d>       count-min sketch depth (default 4)" << endl;
+}
+
+struct SketchOptions {
+    uint32_t threads_;
+    uint32_t bits_;
+    uint32_t topk_;
+    uint32_t precision_;
+    uint32_t cm_width_;
+    uint32_t cm_depth_;
+};
+
+struct TraceJob {
+    string trace_;
+    string parent_;
+    map<uint64_t, uint64_t> seg_hit_lens_;
+    map<uint64_t, uint64_t> seg_miss_lens_;
+    bool opened_;
+};
+
+/*
+ * a tracked heavy hitter, counted_ is exact from the time it was tracked on
+ */
+struct Candidate {
+    uint32_t size_;
+    uint32_t estimate_;
+    uint64_t counted_;
+};
+
+struct SketchState {
+    SketchState(const SketchOptions& opts);
+
+    void AddBlock(const TraceRecord& rec);
+
+    void Merge(const SketchState& other);
+
+    const SketchOptions& opts_;
+    uint64_t blocks_;
+    uint64_t bytes_;
+    uint64_t units_;
+    HyperLogLog unique_blocks_;
+    HyperLogLog unique_units_;
+    vector<uint64_t> bucket_blocks_;
+    vector<uint64_t> bucket_bytes_;
+    vector<uint64_t> bucket_units_;
+    vector<HyperLogLog> bucket_unique_blocks_;
+    vector<HyperLogLog> bucket_unique_units_;
+    CountMinSketch freq_;
+    map<Checksum, Candidate> candidates_;
+    set<pair<uint32_t, Checksum> > by_estimate_;	// candidates by estimate, lowest first
+};
+
+SketchState::SketchState(const SketchOptions& opts)
+    : opts_(opts), blocks_(0), bytes_(0), units_(0),
+      unique_blocks_(opts.precision_), unique_units_(opts.precision_),
+      bucket_blocks_(1 << opts.bits_, 0), bucket_bytes_(1 << opts.bits_, 0), bucket_units_(1 << opts.bits_, 0),
+      bucket_unique_blocks_(1 << opts.bits_, HyperLogLog(min(opts.precision_, 12u))),
+      bucket_unique_units_(1 << opts.bits_, HyperLogLog(min(opts.precision_, 12u))),
+      freq_(opts.cm_width_, opts.cm_depth_)
+{
+}
+
+void SketchState::AddBlock(const TraceRecord& rec)
+{
+    const Checksum& cksum = rec.GetChecksum();
+    uint64_t prefix;
+    memcpy(&prefix, rec.cksum_, sizeof(prefix));
+    uint64_t hash = MixHash(prefix);
+    uint32_t bucket = opts_.bits_ == 0 ? 0 : cksum.First4Bytes() >> (32 - opts_.bits_);
+    uint32_t units = (rec.size_ + SIZE_UNIT - 1) / SIZE_UNIT;
+
+    blocks_++;
+    bytes_ += rec.size_;
+    units_ += units;
+    bucket_blocks_[bucket]++;
+    bucket_bytes_[bucket] += rec.size_;
+    bucket_units_[bucket] += units;
+    unique_blocks_.Add(hash);
+    bucket_unique_blocks_[bucket].Add(hash);
+    for (uint32_t i = 0; i < units; i++) {
+        uint64_t unit_hash = MixHash(prefix ^ ((i + 1) * 0x9e3779b97f4a7c15ULL));
+        unique_units_.Add(unit_hash);
+        bucket_unique_units_[bucket].Add(unit_hash);
+    }
+
+    if (opts_.topk_ == 0)
+        return;
+    uint32_t estimate = freq_.Add(hash);
+    map<Checksum, Candidate>::iterator it = candidates_.find(cksum);
+    if (it != candidates_.end()) {
+        by_estimate_.erase(make_pair(it->second.estimate_, cksum));
+        it->second.estimate_ = estimate;
+        it->second.counted_++;
+        by_estimate_.insert(make_pair(estimate, cksum));
+        return;
+    }
+    if (candidates_.size() >= opts_.topk_) {
+        if (estimate <= by_estimate_.begin()->first)
+            return;
+        candidates_.erase(by_estimate_.begin()->second);
+        by_estimate_.erase(by_estimate_.begin());
+    }
+    Candidate& cand = candidates_[cksum];
+    cand.size_ = rec.size_;
+    cand.estimate_ = estimate;
+    cand.counted_ = 1;
+    by_estimate_.insert(make_pair(estimate, cksum));
+}
+
+void SketchState::Merge(const SketchState& other)
+{
+    blocks_ += other.blocks_;
+    bytes_ += other.bytes_;
+    units_ += other.units_;
+    unique_blocks_.Merge(other.unique_blocks_);
+    unique_units_.Merge(other.unique_units_);
+    for (size_t i = 0; i < bucket_blocks_.size(); i++) {
+        bucket_blocks_[i] += other.bucket_blocks_[i];
+        bucket_bytes_[i] += other.bucket_bytes_[i];
+        bucket_units_[i] += other.bucket_units_[i];
+        bucket_unique_blocks_[i].Merge(other.bucket_unique_blocks_[i]);
+        bucket_unique_units_[i].Merge(other.bucket_unique_units_[i]);
+    }
+    freq_.Merge(other.freq_);
+    // estimates are refreshed from the merged sketch when reporting
+    map<Checksum, Candidate>::const_iterator it;
+    for (it = other.candidates_.begin(); it != other.candidates_.end(); ++it) {
+        Candidate& cand = candidates_[it->first];
+        cand.size_ = it->second.size_;
+        cand.counted_ += it->second.counted_;
+    }
+}
+
+/*
+ * estimated distinct bytes: distinct units scaled back by the rounding of sizes to units
+ */
+double dedup_bytes(const HyperLogLog& unique_units, uint64_t bytes, uint64_t units)
+{
+    if (units == 0)
+        return 0;
+    return unique_units.Estimate() * bytes / units;
+}
+
+inline void save_counter(uint64_t& new_seq_counter, uint64_t& old_seq_counter, map<uint64_t, uint64_t>& old_counter_map)
+{
+    if (new_seq_counter == 0) {	// need to terminate old counter
+        if (old_seq_counter != 0)
+            old_counter_map[old_seq_counter] ++;
+        old_seq_counter = 0;
+    }
+    ++ new_seq_counter;
+}
+
+void process_trace(TraceJob& job, SketchState& state)
+{
+    TraceReader cur, par;
+    job.opened_ = cur.Open(job.trace_);
+    if (!job.opened_)
+        return;
+    const TraceSpan& records = cur.GetRecords();
+    for (size_t i = 0; i < records.Size(); i++)
+        if (records[i].size_ != 0)
+            state.AddBlock(records[i]);
+
+    if (job.parent_.empty() || !par.Open(job.parent_))
+        return;
+    // segments hit in the parent, as hash_hit_length
+    SegmentCursor cur_cursor(records, SegmentPolicy::Fixed());
+    SegmentCursor par_cursor(par.GetRecords(), SegmentPolicy::Fixed());
+    TraceSpan cur_seg, par_seg;
+    Checksum cur_cksum, par_cksum;
+    uint64_t n_seg_hits = 0, n_seg_misses = 0;
+    while (cur_cursor.Next(cur_seg)) {
+        cur_seg.GetChecksum(cur_cksum);
+        bool hit = false;
+        if (par_cursor.Next(par_seg)) {
+            par_seg.GetChecksum(par_cksum);
+            hit = cur_cksum == par_cksum;
+        }
+        if (hit)
+            save_counter(n_seg_hits, n_seg_misses, job.seg_miss_lens_);
+        else
+            save_counter(n_seg_misses, n_seg_hits, job.seg_hit_lens_);
+    }
+    if (n_seg_hits != 0)
+        job.seg_hit_lens_[n_seg_hits]++;
+    if (n_seg_misses != 0)
+        job.seg_miss_lens_[n_seg_misses]++;
+}
+
+struct SketchWorker {
+    pthread_t thread_;
+    SketchState* state_;
+    vector<TraceJob>* jobs_;
+    volatile uint32_t* next_job_;
+};
+
+void* sketch_worker(void* arg)
+{
+    SketchWorker* worker = (SketchWorker*)arg;
+    uint32_t i;
+    while ((i = __sync_fetch_and_add(worker->next_job_, 1)) < worker->jobs_->size())
+        process_trace((*worker->jobs_)[i], *worker->state_);
+    return NULL;
+}
+
+void add_job(vector<TraceJob>& jobs, const string& arg)
+{
+    TraceJob job;
+    size_t colon = arg.find(':');
+    job.trace_ = arg.substr(0, colon);
+    if (colon != string::npos)
+        job.parent_ = arg.substr(colon + 1);
+    job.opened_ = false;
+    jobs.push_back(job);
+}
+
+int main(int argc, char** argv)
+{
+    SketchOptions opts;
+    opts.threads_ = sysconf(_SC_NPROCESSORS_ONLN);
+    opts.bits_ = 4;
+    opts.topk_ = 20;
+    opts.precision_ = 14;
+    opts.cm_width_ = 1 << 20;
+    opts.cm_depth_ = 4;
+    vector<TraceJob> jobs;
+
+    int argi = 1;
+    for (; argi + 1 < argc && strncmp(argv[argi], "--", 2) == 0; argi += 2) {
+        if (strcmp(argv[argi], "--list") == 0) {
+            ifstream list(argv[argi + 1]);
+            string line;
+            while (getline(list, line))
+                if (line.length() != 0)
+                    add_job(jobs, line);
+        }
+        else if (strcmp(argv[argi], "--threads") == 0)
+            opts.threads_ = atoi(argv[argi + 1]);
+        else if (strcmp(argv[argi], "--bits") == 0)
+            opts.bits_ = atoi(argv[argi + 1]);
+        else if (strcmp(argv[argi], "--topk") == 0)
+            opts.topk_ = atoi(argv[argi + 1]);
+        else if (strcmp(argv[argi], "--precision") == 0)
+            opts.precision_ = atoi(argv[argi + 1]);
+        else if (strcmp(argv[argi], "--cm-width") == 0)
+            opts.cm_width_ = atoi(argv[argi + 1]);
+        else if (strcmp(argv[argi], "--cm-depth") == 0)
+            opts.cm_depth_ = atoi(argv[argi + 1]);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    for (; argi < argc; argi++)
+        add_job(jobs, argv[argi]);
+    if (jobs.empty() || opts.threads_ == 0 || opts.bits_ > 12 ||
+        opts.precision_ < 4 || opts.precision_ > 18 || opts.cm_depth_ == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    volatile uint32_t next_job = 0;
+    vector<SketchWorker> workers(min((size_t)opts.threads_, jobs.size()));
+    for (size_t w = 0; w < workers.size(); w++) {
+        workers[w].state_ = new SketchState(opts);
+        workers[w].jobs_ = &jobs;
+        workers[w].next_job_ = &next_job;
+        pthread_create(&workers[w].thread_, NULL, sketch_worker, &workers[w]);
+    }
+    for (size_t w = 0; w < workers.size(); w++)
+        pthread_join(workers[w].thread_, NULL);
+    SketchState& total = *workers[0].state_;
+    for (size_t w = 1; w < workers.size(); w++) {
+        total.Merge(*workers[w].state_);
+        delete workers[w].state_;
+    }
+
+    for (size_t i = 0; i < jobs.size(); i++)
+        if (!jobs[i].opened_)
+            cout << "open failed: " << jobs[i].trace_ << endl;
+
+    double unique = total.unique_blocks_.Estimate();
+    double dedup = dedup_bytes(total.unique_units_, total.bytes_, total.units_);
+    cout << "Traces: " << jobs.size() << ", blocks: " << total.blocks_ << ", bytes: " << total.bytes_
+         << ", unique blocks (est): " << (uint64_t)unique << ", dedup bytes (est): " << (uint64_t)dedup
+         << ", dedup ratio (est): " << (dedup > 0 ? total.bytes_ / dedup : 0) << endl;
+
+    cout << "Use the first " << opts.bits_ << " bits, " << total.bucket_blocks_.size() << " buckets" << endl;
+    for (size_t i = 0; i < total.bucket_blocks_.size(); ++i) {
+        cout << "Bucket " << i <<
+            ": raw " << total.bucket_bytes_[i] <<
+            ", dedup " << (uint64_t)dedup_bytes(total.bucket_unique_units_[i], total.bucket_bytes_[i], total.bucket_units_[i]) <<
+            ", unique " << (uint64_t)total.bucket_unique_blocks_[i].Estimate() <<
+            ", total " << total.bucket_blocks_[i] << endl;
+    }
+
+    if (opts.topk_ > 0) {
+        // rank the candidates of all threads by the merged sketch
+        vector<pair<uint32_t, Checksum> > top;
+        map<Checksum, Candidate>::iterator it;
+        for (it = total.candidates_.begin(); it != total.candidates_.end(); ++it) {
+            uint64_t prefix;
+            memcpy(&prefix, it->first.data_, sizeof(prefix));
+            top.push_back(make_pair(total.freq_.Estimate(MixHash(prefix)), it->first));
+        }
+        sort(top.rbegin(), top.rend());
+        if (top.size() > opts.topk_)
+            top.resize(opts.topk_);
+        cout << "Top " << top.size() << " blocks: checksum, size, references (est), references counted while tracked" << endl;
+        for (size_t i = 0; i < top.size(); i++) {
+            Candidate& cand = total.candidates_[top[i].second];
+            cout << top[i].second.ToString() << ", " << cand.size_ << ", " << top[i].first << ", " << cand.counted_ << endl;
+        }
+    }
+
+    map<uint64_t, uint64_t>::iterator cit;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (jobs[i].parent_.empty())
+            continue;
+        cout << "Segment runs of " << jobs[i].trace_ << " in parent " << jobs[i].parent_ << endl;
+        cout << "hit length, count" << endl;
+        for (cit = jobs[i].seg_hit_lens_.begin(); cit != jobs[i].seg_hit_lens_.end(); cit ++)
+            cout << cit->first << ", " << cit->second << endl;
+        cout << "miss length, count" << endl;
+        for (cit = jobs[i].seg_miss_lens_.begin(); cit != jobs[i].seg_miss_lens_.end(); cit ++)
+            cout << cit->first << ", " << cit->second << endl;
+    }
+    delete workers[0].state_;
+    return 0;
+}